@@ -0,0 +1,669 @@
+// src/astfile.c
+
+/**
+ * NOTE:
+ * Binary AST files (--emit-ast / --from-ast)
+ *
+ * `keccc --emit-ast` stops after parsing and writes the program in a
+ * flat form that `keccc --from-ast` generates code from, so parsing and
+ * code generation can run (and be cached) as separate steps:
+ * ----------------------------------------
+ *   header         magic, version and the counts below
+ *   nodes          nodeCount fixed-size records, children first
+ *   symbols        symbolCount symbol records, by symbol index
+ *   declarations   declarationCount symbol indices, in source order
+ *   strings        NUL-terminated names (the source file name first)
+ * ----------------------------------------
+ * Every field is a 32-bit integer in host byte order, and a node
+ * refers to its children by their distance from it (always negative,
+ * 0 for none), so the file can be mapped and its nodes read in place.
+ * The loader checks that the records make up one tree the parser could
+ * have built (see checkNodes()), then turns the distances into
+ * pointers (one pass, one allocation).
+ *
+ * AST_FILE_VERSION changes whenever the layout or the meaning of a
+ * node does; older files are refused rather than misread.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct astFileHeader {
+    char magic[8];             // AST_FILE_MAGIC
+    uint32_t version;          // AST_FILE_VERSION
+    uint32_t nodeCount;        // node records
+    uint32_t root;             // the program's node, or AST_FILE_NO_NODE
+    uint32_t symbolCount;      // global symbols
+    uint32_t declarationCount; // `int name;` and `int name[N];` statements
+    uint32_t stringsSize;      // bytes of names
+    uint32_t sourceName;       // string offset of the source file name
+    uint32_t reserved;         // 0
+};
+
+struct astFileNode {
+    int32_t op;     // A_* operator
+    int32_t line;   // source line
+    int32_t value;  // integer value or symbol index
+    int32_t left;   // distance to the children (negative), 0 for none
+    int32_t middle; //
+    int32_t right;  //
+};
+
+struct astFileSymbol {
+    uint32_t name;       // string offset
+    int32_t kind;        // S_VARIABLE, S_FUNCTION, S_PARAMETER or S_LOCAL
+    int32_t length;      // array length (0 for an int or anything else)
+    int32_t parameters;  // a function's parameter count, otherwise 0
+    int32_t position;    // a parameter's position, otherwise 0
+};
+
+// Globals declared while parsing for --emit-ast, in source order
+static _Thread_local int *declarations = NULL;
+static _Thread_local int declarationCount = 0;
+static _Thread_local int declarationCapacity = 0;
+
+// What astRead() loaded, released by astReset()
+static _Thread_local struct ASTnode *loadedNodes = NULL;
+static _Thread_local char *loadedSourceName = NULL;
+
+// Node records being collected by astWrite()
+struct astWriter {
+    struct astFileNode *nodes;
+    uint32_t count;
+    uint32_t capacity;
+    struct ASTnode **spine; // left spines being walked (see writeTree())
+    int spineCount;
+    int spineCapacity;
+};
+
+/**
+ * astRecordDeclaration - Remembers a global declaration for the AST
+ * file (called by codegenDeclareGlobalSymbol() with --emit-ast).
+ *
+ * @name: The declared name; it is already in the symbol table.
+ */
+void astRecordDeclaration(char *name) {
+    if (declarationCount == declarationCapacity) {
+        declarationCapacity = declarationCapacity ? declarationCapacity * 2
+                                                  : 64;
+        declarations = realloc(declarations,
+                               declarationCapacity * sizeof(*declarations));
+        if (declarations == NULL) {
+            logFatal("Out of memory while recording declarations");
+        }
+    }
+    declarations[declarationCount++] = findGlobalSymbol(name);
+}
+
+/**
+ * appendNode - Adds a node record; its children are already written.
+ *
+ * @w: The writer.
+ * @n: The node.
+ * @left: Index of its left child's record, or AST_FILE_NO_NODE.
+ * @middle: Index of its middle child's record, or AST_FILE_NO_NODE.
+ * @right: Index of its right child's record, or AST_FILE_NO_NODE.
+ *
+ * @return The index of the new record.
+ */
+static uint32_t appendNode(struct astWriter *w, struct ASTnode *n,
+                           uint32_t left, uint32_t middle, uint32_t right) {
+    struct astFileNode *r;
+    uint32_t i;
+
+    if (w->count == w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 1024;
+        w->nodes = realloc(w->nodes, w->capacity * sizeof(*w->nodes));
+        if (w->nodes == NULL) {
+            logFatal("Out of memory while writing the AST");
+        }
+    }
+    i = w->count++;
+    r = &w->nodes[i];
+    r->op = n->op;
+    r->line = n->line;
+    r->value = n->v.intvalue;
+    r->left = left == AST_FILE_NO_NODE ? 0 : (int32_t)(left - i);
+    r->middle = middle == AST_FILE_NO_NODE ? 0 : (int32_t)(middle - i);
+    r->right = right == AST_FILE_NO_NODE ? 0 : (int32_t)(right - i);
+    return i;
+}
+
+/**
+ * writeTree - Adds the records of a tree, children before parents.
+ *
+ * NOTE:
+ * Statement chains lean left (see walkStatements()), so the left
+ * spine is collected first and written from the bottom up; only the
+ * middle and right subtrees are written recursively.
+ *
+ * @w: The writer.
+ * @n: The tree (may be NULL).
+ *
+ * @return The index of its root's record, or AST_FILE_NO_NODE.
+ */
+static uint32_t writeTree(struct astWriter *w, struct ASTnode *n) {
+    uint32_t below = AST_FILE_NO_NODE, middle, right;
+    int base = w->spineCount;
+
+    for (; n != NULL; n = n->left) {
+        if (w->spineCount == w->spineCapacity) {
+            w->spineCapacity = w->spineCapacity ? w->spineCapacity * 2 : 256;
+            w->spine =
+                realloc(w->spine, w->spineCapacity * sizeof(*w->spine));
+            if (w->spine == NULL) {
+                logFatal("Out of memory while writing the AST");
+            }
+        }
+        w->spine[w->spineCount++] = n;
+    }
+
+    while (w->spineCount > base) {
+        n = w->spine[--w->spineCount];
+        middle = writeTree(w, n->middle);
+        right = writeTree(w, n->right);
+        below = appendNode(w, n, below, middle, right);
+    }
+    return below;
+}
+
+/**
+ * astWrite - Writes the parsed program to Outfile (--emit-ast).
+ *
+ * @tree: The program, as returned by parseParallel().
+ */
+void astWrite(struct ASTnode *tree) {
+    struct astWriter w = {0};
+    struct astFileHeader h = {0};
+    int symbolCount = countGlobalSymbols();
+    struct astFileSymbol *symbols;
+    uint32_t offset;
+    size_t length;
+
+    if ((symbols = malloc((symbolCount + 1) * sizeof(*symbols))) == NULL) {
+        logFatal("Out of memory while writing the AST");
+    }
+
+    memcpy(h.magic, AST_FILE_MAGIC, sizeof(h.magic));
+    h.version = AST_FILE_VERSION;
+    h.root = writeTree(&w, tree);
+    h.nodeCount = w.count;
+    h.symbolCount = symbolCount;
+    h.declarationCount = declarationCount;
+    h.sourceName = 0;
+
+    // The source name first, then one string per symbol
+    offset = strlen(Infilename) + 1;
+    for (int i = 0; i < symbolCount; i++) {
+        symbols[i].name = offset;
+        symbols[i].kind = GlobalSymbolTable[i].kind;
+        symbols[i].length = GlobalSymbolTable[i].length;
+        symbols[i].parameters = GlobalSymbolTable[i].parameters;
+        symbols[i].position = GlobalSymbolTable[i].position;
+        offset += strlen(GlobalSymbolTable[i].name) + 1;
+    }
+    h.stringsSize = offset;
+
+    fwrite(&h, sizeof(h), 1, Outfile);
+    fwrite(w.nodes, sizeof(*w.nodes), w.count, Outfile);
+    fwrite(symbols, sizeof(*symbols), symbolCount, Outfile);
+    fwrite(declarations, sizeof(*declarations), declarationCount, Outfile);
+    fwrite(Infilename, 1, strlen(Infilename) + 1, Outfile);
+    for (int i = 0; i < symbolCount; i++) {
+        length = strlen(GlobalSymbolTable[i].name) + 1;
+        fwrite(GlobalSymbolTable[i].name, 1, length, Outfile);
+    }
+
+    free(symbols);
+    free(w.nodes);
+    free(w.spine);
+}
+
+/**
+ * readStream - Reads the rest of Infile into memory, for inputs that
+ * cannot be mapped (standard input, in-memory sources).
+ *
+ * @size: Receives the number of bytes read.
+ *
+ * @return The bytes (to be freed by the caller).
+ */
+static char *readStream(size_t *size) {
+    size_t used = 0, capacity = 0, got;
+    char *buf = NULL;
+
+    do {
+        if (used == capacity) {
+            capacity = capacity ? capacity * 2 : 64 * 1024;
+            if ((buf = realloc(buf, capacity)) == NULL) {
+                logFatal("Out of memory while reading the AST");
+            }
+        }
+        got = fread(buf + used, 1, capacity - used, Infile);
+        used += got;
+    } while (got > 0);
+
+    *size = used;
+    return buf;
+}
+
+// What a node record is, and so which slots it may fill (see slotKinds())
+enum {
+    K_NONE = 1,       // no child
+    K_STATEMENT = 2,  // A_GLUE, A_IF, A_PRINT, ...
+    K_EXPRESSION = 4, // a value: A_ADD, A_IDENTIFIER, A_CALL, ...
+    K_TARGET = 8,     // what A_ASSIGN stores to
+    K_ARGUMENTS = 16, // a call's argument list
+};
+
+/**
+ * recordKind - Tells what a node record is.
+ *
+ * @op: Its operator, already checked to be one the parser makes.
+ *
+ * @return One of K_STATEMENT, K_EXPRESSION, K_TARGET and K_ARGUMENTS.
+ */
+static int recordKind(int op) {
+    switch (op) {
+    case A_ASSIGN:
+    case A_PRINT:
+    case A_GLUE:
+    case A_IF:
+    case A_SWITCH:
+    case A_CASE:
+    case A_DEFAULT:
+    case A_BREAK:
+    case A_WHILE:
+    case A_FUNCTION:
+    case A_RETURN:
+    case A_CALLSTATEMENT:
+    case A_INLINE:
+        return K_STATEMENT;
+    case A_LVALUEIDENTIFIER:
+    case A_LVALUEINDEX:
+        return K_TARGET;
+    case A_ARGUMENT:
+        return K_ARGUMENTS;
+    default:
+        return K_EXPRESSION;
+    }
+}
+
+/**
+ * slotKinds - Tells what the parser puts in a node's children.
+ *
+ * @op: The node's operator, already checked to be one the parser makes.
+ * @kinds: Receives, for left, middle and right, the K_* allowed there.
+ */
+static void slotKinds(int op, int kinds[3]) {
+    kinds[0] = kinds[1] = kinds[2] = K_NONE;
+    switch (op) {
+    case A_INTLIT:
+    case A_IDENTIFIER:
+    case A_LVALUEIDENTIFIER:
+    case A_CASE:
+    case A_DEFAULT:
+    case A_BREAK:
+        break;
+    case A_ASSIGN:
+        kinds[0] = K_EXPRESSION;
+        kinds[2] = K_TARGET;
+        break;
+    case A_PRINT:
+    case A_LOGNOT:
+    case A_INDEX:
+    case A_LVALUEINDEX:
+    case A_CALLSTATEMENT:
+        kinds[0] = K_EXPRESSION;
+        break;
+    case A_GLUE:
+        kinds[0] = kinds[2] = K_NONE | K_STATEMENT;
+        break;
+    case A_IF:
+    case A_WHILE:
+        kinds[0] = K_EXPRESSION;
+        kinds[1] = kinds[2] = K_NONE | K_STATEMENT;
+        break;
+    case A_SWITCH:
+        kinds[0] = K_EXPRESSION;
+        kinds[2] = K_NONE | K_STATEMENT;
+        break;
+    case A_FUNCTION:
+    case A_INLINE:
+        kinds[0] = K_NONE | K_STATEMENT;
+        break;
+    case A_RETURN:
+        kinds[0] = K_NONE | K_EXPRESSION;
+        break;
+    case A_CALL:
+        kinds[0] = K_NONE | K_ARGUMENTS;
+        break;
+    case A_ARGUMENT:
+        kinds[0] = K_EXPRESSION;
+        kinds[2] = K_NONE | K_ARGUMENTS;
+        break;
+    default:
+        // The binary operators
+        kinds[0] = kinds[2] = K_EXPRESSION;
+        break;
+    }
+}
+
+/**
+ * checkChild - Validates a child distance of node record i, and counts
+ * the child's parents.
+ *
+ * @records: The node records.
+ * @i: The record's index.
+ * @distance: The child's distance from it.
+ * @kinds: The K_* allowed in the slot.
+ * @parents: By record, the number of parents found so far.
+ *
+ * @return 1 if there is no child and that is allowed, or if the child
+ *         is an earlier record of an allowed kind with no other parent.
+ */
+static int checkChild(struct astFileNode *records, uint32_t i,
+                      int32_t distance, int kinds, unsigned char *parents) {
+    uint32_t child;
+
+    if (distance == 0) {
+        return (kinds & K_NONE) != 0;
+    }
+    if (distance > 0 || -(int64_t)distance > i) {
+        return 0;
+    }
+    child = i + distance;
+    return parents[child]++ == 0 && (kinds & recordKind(records[child].op));
+}
+
+/**
+ * checkSymbol - Validates a symbol record.
+ *
+ * @return 1 if it describes a symbol the parser could have made.
+ */
+static int checkSymbol(struct astFileSymbol *s) {
+    switch (s->kind) {
+    case S_VARIABLE:
+        return s->length >= 0 && s->length <= ARRAY_MAX_LENGTH &&
+               s->parameters == 0 && s->position == 0;
+    case S_FUNCTION:
+        return s->length == 0 && s->parameters >= 0 &&
+               s->parameters <= FUNCTION_MAX_PARAMETERS && s->position == 0;
+    case S_PARAMETER:
+        return s->length == 0 && s->parameters == 0 && s->position >= 0 &&
+               s->position < FUNCTION_MAX_PARAMETERS;
+    case S_LOCAL:
+        return s->length == 0 && s->parameters == 0 && s->position == 0;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * countRecordArguments - Counts the arguments of a call record, like
+ * countArguments() does for a node.
+ *
+ * @r: The A_CALL record; its argument records are already checked.
+ *
+ * @return The number of arguments.
+ */
+static int countRecordArguments(struct astFileNode *r) {
+    int count = 0;
+
+    for (int32_t next = r->left; next != 0; next = r->right) {
+        r += next;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * checkNode - Validates a node record against the rest of the file.
+ *
+ * @records: The node records; the ones before i are already checked.
+ * @i: The record's index.
+ * @symbols: The symbol records.
+ * @symbolCount: Number of symbols in the file.
+ * @parents: By record, the number of parents found so far.
+ *
+ * @return 1 if code can be generated from it.
+ */
+static int checkNode(struct astFileNode *records, uint32_t i,
+                     struct astFileSymbol *symbols, uint32_t symbolCount,
+                     unsigned char *parents) {
+    struct astFileNode *r = &records[i];
+    struct astFileSymbol *s = NULL;
+    int kinds[3];
+
+    // The operators after A_INLINE are only made by range.c, later
+    if (r->op < A_ADD || r->op > A_INLINE) {
+        return 0;
+    }
+    slotKinds(r->op, kinds);
+    if (!checkChild(records, i, r->left, kinds[0], parents) ||
+        !checkChild(records, i, r->middle, kinds[1], parents) ||
+        !checkChild(records, i, r->right, kinds[2], parents)) {
+        return 0;
+    }
+    if (r->op == A_IDENTIFIER || r->op == A_LVALUEIDENTIFIER ||
+        r->op == A_INDEX || r->op == A_LVALUEINDEX || r->op == A_CALL ||
+        r->op == A_FUNCTION) {
+        if (r->value < 0 || (uint32_t)r->value >= symbolCount) {
+            return 0;
+        }
+        s = &symbols[r->value];
+    }
+
+    switch (r->op) {
+    case A_IDENTIFIER:
+    case A_LVALUEIDENTIFIER:
+        return s->kind == S_PARAMETER || s->kind == S_LOCAL ||
+               (s->kind == S_VARIABLE && s->length == 0);
+    case A_INDEX:
+    case A_LVALUEINDEX:
+        return s->kind == S_VARIABLE && s->length > 0;
+    case A_CALL:
+        return s->kind == S_FUNCTION &&
+               countRecordArguments(r) == s->parameters;
+    case A_FUNCTION:
+        return s->kind == S_FUNCTION;
+    case A_CALLSTATEMENT:
+        return r[r->left].op == A_CALL;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * checkNodes - Validates the node records: they must make up one tree,
+ * each record but the root hanging from exactly one parent, in a slot
+ * the parser would have put it in.
+ *
+ * @records: The node records.
+ * @h: The file's header.
+ * @symbols: The symbol records.
+ *
+ * @return 1 if code can be generated from them.
+ */
+static int checkNodes(struct astFileNode *records, struct astFileHeader *h,
+                      struct astFileSymbol *symbols) {
+    unsigned char *parents;
+    int ok = 1;
+
+    if (h->root == AST_FILE_NO_NODE) {
+        return h->nodeCount == 0;
+    }
+    if ((parents = calloc(h->nodeCount, 1)) == NULL) {
+        logFatal("Out of memory while loading the AST");
+    }
+    for (uint32_t i = 0; ok && i < h->nodeCount; i++) {
+        ok = checkNode(records, i, symbols, h->symbolCount, parents);
+    }
+    for (uint32_t i = 0; ok && i < h->nodeCount; i++) {
+        ok = parents[i] == (i != h->root);
+    }
+    ok = ok && recordKind(records[h->root].op) == K_STATEMENT;
+    free(parents);
+    return ok;
+}
+
+/**
+ * loadTree - Validates the file and builds the program from it.
+ *
+ * @data: The file contents (4-byte aligned).
+ * @size: Their length.
+ * @tree: Receives the program (NULL if it is empty).
+ *
+ * @return NULL, or what is wrong with the file.
+ */
+static char *loadTree(char *data, size_t size, struct ASTnode **tree) {
+    struct astFileHeader *h = (struct astFileHeader *)data;
+    struct astFileNode *records;
+    struct ASTnode *n;
+    struct astFileSymbol *symbols;
+    uint32_t *declared;
+    char *strings;
+    int id;
+    uint64_t expected;
+
+    if (size < sizeof(*h) || memcmp(h->magic, AST_FILE_MAGIC, 8) != 0) {
+        return "Not a keccc AST file: ";
+    }
+    if (h->version != AST_FILE_VERSION) {
+        return "Unsupported AST file version: ";
+    }
+
+    expected = sizeof(*h) + (uint64_t)h->nodeCount * sizeof(*records) +
+               (uint64_t)h->symbolCount * sizeof(*symbols) +
+               (uint64_t)h->declarationCount * 4 +
+               h->stringsSize;
+    if (expected != size || h->symbolCount > INT_MAX ||
+        h->stringsSize == 0 || h->sourceName >= h->stringsSize ||
+        (h->root != AST_FILE_NO_NODE && h->root >= h->nodeCount)) {
+        return "Malformed AST file: ";
+    }
+
+    records = (struct astFileNode *)(h + 1);
+    symbols = (struct astFileSymbol *)(records + h->nodeCount);
+    declared = (uint32_t *)(symbols + h->symbolCount);
+    strings = (char *)(declared + h->declarationCount);
+    if (strings[h->stringsSize - 1] != '\0') {
+        return "Malformed AST file: ";
+    }
+
+    // The symbols keep their indices, so the nodes can use them as is
+    for (uint32_t i = 0; i < h->symbolCount; i++) {
+        if (symbols[i].name >= h->stringsSize || !checkSymbol(&symbols[i])) {
+            return "Malformed AST file: ";
+        }
+        if (symbols[i].kind == S_PARAMETER) {
+            id = addParameter(strings + symbols[i].name, symbols[i].position);
+        } else if (symbols[i].kind == S_LOCAL) {
+            id = addLocalSymbol(strings + symbols[i].name);
+        } else {
+            id = addGlobalSymbol(strings + symbols[i].name);
+        }
+        if (id != (int)i) {
+            return "Malformed AST file: ";
+        }
+        GlobalSymbolTable[i].kind = symbols[i].kind;
+        GlobalSymbolTable[i].length = symbols[i].length;
+        GlobalSymbolTable[i].parameters = symbols[i].parameters;
+    }
+    for (uint32_t i = 0; i < h->declarationCount; i++) {
+        if (declared[i] >= h->symbolCount ||
+            symbols[declared[i]].kind != S_VARIABLE) {
+            return "Malformed AST file: ";
+        }
+    }
+    if (!checkNodes(records, h, symbols)) {
+        return "Malformed AST file: ";
+    }
+
+    loadedNodes = malloc((h->nodeCount ? h->nodeCount : 1) * sizeof(*n));
+    loadedSourceName = strdup(strings + h->sourceName);
+    if (loadedNodes == NULL || loadedSourceName == NULL) {
+        logFatal("Out of memory while loading the AST");
+    }
+
+    // Distances become pointers; children come first, so one pass does
+    for (uint32_t i = 0; i < h->nodeCount; i++) {
+        n = &loadedNodes[i];
+        n->op = records[i].op;
+        n->line = records[i].line;
+        n->v.intvalue = records[i].value;
+        n->left = records[i].left ? n + records[i].left : NULL;
+        n->middle = records[i].middle ? n + records[i].middle : NULL;
+        n->right = records[i].right ? n + records[i].right : NULL;
+        n->liveLocals = 0;
+        n->refs = 0;
+    }
+
+    Infilename = loadedSourceName; // line annotations name the source
+    for (uint32_t i = 0; i < h->declarationCount; i++) {
+        codegenDeclareGlobalSymbol(GlobalSymbolTable[declared[i]].name,
+                                   symbols[declared[i]].length);
+    }
+
+    *tree = h->root == AST_FILE_NO_NODE ? NULL : &loadedNodes[h->root];
+    return NULL;
+}
+
+/**
+ * astRead - Loads a program written by --emit-ast from Infile
+ * (--from-ast) and declares its globals.
+ *
+ * NOTE:
+ * Must follow codegenPreamble(), like the declarations would when
+ * parsing. The nodes belong to this module and are released by
+ * astReset(), not freeAST().
+ *
+ * @return The program (NULL if it is empty).
+ */
+struct ASTnode *astRead(void) {
+    struct ASTnode *tree = NULL;
+    struct stat st;
+    char *data, *error;
+    size_t size;
+    int fd, mapped = 0;
+
+    if ((fd = fileno(Infile)) >= 0 && fstat(fd, &st) == 0 &&
+        S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = st.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        mapped = data != MAP_FAILED;
+    }
+    if (!mapped) {
+        data = readStream(&size);
+    }
+
+    error = loadTree(data, size, &tree);
+
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+    if (error != NULL) {
+        logFatals(error, Infilename);
+    }
+    return tree;
+}
+
+/**
+ * astReset - Releases what astRecordDeclaration() and astRead() kept.
+ */
+void astReset(void) {
+    free(declarations);
+    free(loadedNodes);
+    free(loadedSourceName);
+    declarations = NULL;
+    declarationCount = declarationCapacity = 0;
+    loadedNodes = NULL;
+    loadedSourceName = NULL;
+}
@@ -0,0 +1,448 @@
+// src/cache.c
+
+/**
+ * NOTE:
+ * Content-addressed compilation cache (--cache)
+ *
+ * The output of a compilation depends only on the source bytes,
+ * the compiler version and the code generation flags, so it is stored
+ * under a hash of those (see cacheKey()). A later compilation with
+ * the same key copies the stored output and skips every phase.
+ *
+ * Layout of the cache directory:
+ * ----------------------------------------
+ * <16 hex digit key>.out   cached output (mtime = last use)
+ * stats                    "hits N" and "misses N" lines
+ * ----------------------------------------
+ * Entries are written to a temporary name and renamed into place,
+ * so concurrent compilers never see a partial entry. When the
+ * directory grows beyond its size limit, the least recently used
+ * entries are deleted.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// A cache entry, as seen by the eviction scan
+struct cacheEntry {
+    char name[32]; // file name inside the cache directory
+    time_t used;   // last use (mtime)
+    off_t size;    // size in bytes
+};
+
+/**
+ * joinPath - Builds "directory/name".
+ *
+ * NOTE:
+ * A truncated path could name another file, which rename() or unlink()
+ * would then act on, so a path that does not fit is never used.
+ *
+ * @param path      Receives the path (PATH_MAX bytes).
+ * @param directory The directory.
+ * @param name      The name inside it.
+ *
+ * @return 0 on success, -1 if the path does not fit.
+ */
+static int joinPath(char *path, char *directory, char *name) {
+    int length = snprintf(path, PATH_MAX, "%s/%s", directory, name);
+
+    return length >= 0 && length < PATH_MAX ? 0 : -1;
+}
+
+/**
+ * cacheDirectory - Returns (and creates) the cache directory.
+ *
+ * NOTE:
+ * $KECCC_CACHE_DIR if set, otherwise $XDG_CACHE_HOME/keccc,
+ * otherwise ~/.cache/keccc.
+ *
+ * @return The directory path (static storage), or NULL if it is too
+ *         long, which makes every lookup a miss.
+ */
+static char *cacheDirectory(void) {
+    static char dir[PATH_MAX];
+    char *base;
+    int fits;
+
+    if (dir[0] != '\0') {
+        return dir;
+    }
+
+    if ((base = getenv("KECCC_CACHE_DIR")) != NULL) {
+        if ((fits = strlen(base) < sizeof(dir))) {
+            strcpy(dir, base);
+        }
+    } else if ((base = getenv("XDG_CACHE_HOME")) != NULL) {
+        fits = joinPath(dir, base, "keccc") == 0;
+    } else {
+        if ((base = getenv("HOME")) == NULL) {
+            base = "/tmp";
+        }
+        if ((fits = joinPath(dir, base, ".cache") == 0)) {
+            mkdir(dir, 0755);
+            fits = joinPath(dir, base, ".cache/keccc") == 0;
+        }
+    }
+    if (!fits) {
+        dir[0] = '\0';
+        return NULL;
+    }
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        logFatals("Cannot create cache directory ", dir);
+    }
+    return dir;
+}
+
+/**
+ * cachePath - Builds the path of a file in the cache directory.
+ *
+ * @param path Receives the path (PATH_MAX bytes).
+ * @param name The file name.
+ *
+ * @return 0 on success, -1 if the path does not fit.
+ */
+static int cachePath(char *path, char *name) {
+    char *dir = cacheDirectory();
+
+    return dir != NULL ? joinPath(path, dir, name) : -1;
+}
+
+/**
+ * entryName - Formats the file name of a cache entry.
+ *
+ * @param name   Receives the name.
+ * @param size   Size of the name buffer.
+ * @param key    The cache key.
+ * @param suffix "out", or the temporary suffix while it is written.
+ */
+static void entryName(char *name, size_t size, uint64_t key, char *suffix) {
+    snprintf(name, size, "%016llx.%s", (unsigned long long)key, suffix);
+}
+
+/**
+ * hashFile - Hashes the contents of an open file, then rewinds it.
+ *
+ * @param f    The file.
+ * @param seed Seed to chain from.
+ *
+ * @return The hash.
+ */
+static uint64_t hashFile(FILE *f, uint64_t seed) {
+    char *buf = NULL;
+    size_t used = 0, capacity = 0, got;
+    uint64_t h;
+
+    do {
+        if (used == capacity) {
+            capacity = capacity ? capacity * 2 : BUFSIZ;
+            if ((buf = realloc(buf, capacity)) == NULL) {
+                logFatal("Out of memory while hashing the input");
+            }
+        }
+        got = fread(buf + used, 1, capacity - used, f);
+        used += got;
+    } while (got > 0);
+
+    h = hash64(buf, used, seed);
+    free(buf);
+    rewind(f);
+    return h;
+}
+
+/**
+ * cacheKey - Computes the cache key of the current compilation.
+ *
+ * NOTE:
+ * Covers everything the output depends on: the source bytes, the
+ * compiler version, the code generation flags, the profile contents
+ * (--profile-use) and, with -g, the input file name that the line
+ * annotations refer to.
+ *
+ * @param profilePath Profile in use, or NULL.
+ *
+ * @return The 64-bit key.
+ */
+uint64_t cacheKey(char *profilePath) {
+    char flags[256];
+    uint64_t h;
+    FILE *f;
+
+    snprintf(flags, sizeof(flags),
+             "keccc %s backend=%d isel=%d cse=%d ifconv=%d jt=%d chains=%d "
+             "vec=%d inline=%d regs=%d ranges=%d reassoc=%d share=%d sopt=%d "
+             "os=%d inst=%d g=%d stream=%d ast=%d%d",
+             KECCC_VERSION, Backend, UseInstructionSelection, UseCSE,
+             IfConvert, JumpTables, BranchChains, VectorISA, InlineFunctions,
+             RegisterLocals, UseValueRanges, Reassociate, ShareSubtrees,
+             Superoptimize, OptimizeSize, InstrumentBranches, DebugLineInfo,
+             StreamStatements, EmitAST, FromAST);
+    h = hash64(flags, strlen(flags), 0);
+    if (DebugLineInfo) {
+        // Hashed whole: however long, it must not be cut short
+        h = hash64(Infilename, strlen(Infilename), h);
+    }
+
+    if (profilePath != NULL) {
+        if ((f = fopen(profilePath, "r")) == NULL) {
+            logFatals("Cannot open profile ", profilePath);
+        }
+        h = hashFile(f, h);
+        fclose(f);
+    }
+
+    return hashFile(Infile, h);
+}
+
+/**
+ * bumpStat - Adds one to a counter in the stats file.
+ *
+ * @param hit 1 to count a hit, 0 to count a miss.
+ */
+static void bumpStat(int hit) {
+    char path[PATH_MAX];
+    long hits = 0, misses = 0;
+    FILE *f;
+    int fd;
+
+    if (cachePath(path, "stats") < 0 ||
+        (fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        return; // statistics are best effort
+    }
+    flock(fd, LOCK_EX);
+    if ((f = fdopen(fd, "r+")) == NULL) {
+        close(fd);
+        return;
+    }
+
+    if (fscanf(f, "hits %ld\nmisses %ld\n", &hits, &misses) != 2) {
+        hits = misses = 0;
+    }
+    if (hit) {
+        hits++;
+    } else {
+        misses++;
+    }
+    rewind(f);
+    fprintf(f, "hits %ld\nmisses %ld\n", hits, misses);
+    fclose(f); // also drops the lock
+}
+
+/**
+ * copyFile - Copies a file, sharing its blocks when the filesystem can.
+ *
+ * NOTE:
+ * FICLONE makes a copy-on-write clone (btrfs, XFS); elsewhere the
+ * bytes are copied.
+ *
+ * @param from Source path.
+ * @param to   Destination path (created or truncated).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int copyFile(char *from, char *to) {
+    char buf[BUFSIZ * 8];
+    ssize_t n;
+    int in, out, status = 0;
+
+    if ((in = open(from, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        close(in);
+        return -1;
+    }
+
+    if (ioctl(out, FICLONE, in) < 0) {
+        while ((n = read(in, buf, sizeof(buf))) > 0) {
+            if (write(out, buf, n) != n) {
+                status = -1;
+                break;
+            }
+        }
+        if (n < 0) {
+            status = -1;
+        }
+    }
+
+    close(in);
+    if (close(out) < 0) {
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * cacheFetch - Produces the output from the cache, if it is there.
+ *
+ * @param key        The cache key (see cacheKey()).
+ * @param outputPath Where the output belongs.
+ *
+ * @return 1 on a hit (output written), 0 on a miss.
+ */
+int cacheFetch(uint64_t key, char *outputPath) {
+    char path[PATH_MAX], name[64];
+
+    entryName(name, sizeof(name), key, "out");
+    if (cachePath(path, name) < 0 || access(path, R_OK) < 0 ||
+        copyFile(path, outputPath) < 0) {
+        bumpStat(0);
+        return 0;
+    }
+
+    utime(path, NULL); // mark as recently used
+    bumpStat(1);
+    return 1;
+}
+
+/**
+ * compareEntryUse - qsort comparator, least recently used first.
+ */
+static int compareEntryUse(const void *a, const void *b) {
+    const struct cacheEntry *x = a, *y = b;
+
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/**
+ * cacheEvict - Deletes least recently used entries until the cache fits
+ * its size limit ($KECCC_CACHE_SIZE bytes, or CACHE_DEFAULT_MAX_SIZE).
+ */
+static void cacheEvict(void) {
+    char path[PATH_MAX];
+    char *dir = cacheDirectory();
+    char *limitText = getenv("KECCC_CACHE_SIZE");
+    long long limit = limitText ? atoll(limitText) : CACHE_DEFAULT_MAX_SIZE;
+    long long total = 0;
+    struct cacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    struct dirent *d;
+    struct stat st;
+    DIR *dp;
+
+    if (dir == NULL || (dp = opendir(dir)) == NULL) {
+        return;
+    }
+    while ((d = readdir(dp)) != NULL) {
+        size_t len = strlen(d->d_name);
+        if (len >= sizeof(entries->name) || len < 4 ||
+            strcmp(d->d_name + len - 4, ".out")) {
+            continue;
+        }
+        if (joinPath(path, dir, d->d_name) < 0 || stat(path, &st) < 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = realloc(entries, capacity * sizeof(*entries));
+            if (entries == NULL) {
+                closedir(dp);
+                return;
+            }
+        }
+        strcpy(entries[count].name, d->d_name);
+        entries[count].used = st.st_mtime;
+        entries[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dp);
+
+    if (total > limit) {
+        qsort(entries, count, sizeof(*entries), compareEntryUse);
+        for (int i = 0; i < count && total > limit; i++) {
+            if (joinPath(path, dir, entries[i].name) == 0 &&
+                unlink(path) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+    free(entries);
+}
+
+/**
+ * cacheStore - Adds a freshly written output to the cache.
+ *
+ * @param key        The cache key (see cacheKey()).
+ * @param outputPath The output just written.
+ */
+void cacheStore(uint64_t key, char *outputPath) {
+    char path[PATH_MAX], temp[PATH_MAX], name[64], suffix[32];
+
+    entryName(name, sizeof(name), key, "out");
+    if (cachePath(path, name) < 0) {
+        return; // a cache that cannot be written is just a cache miss
+    }
+    snprintf(suffix, sizeof(suffix), "%ld.tmp", (long)getpid());
+    entryName(name, sizeof(name), key, suffix);
+    if (cachePath(temp, name) < 0) {
+        return;
+    }
+    if (copyFile(outputPath, temp) < 0 || rename(temp, path) < 0) {
+        unlink(temp);
+        return;
+    }
+    cacheEvict();
+}
+
+/**
+ * cachePrintStats - Prints the hit/miss counters and the cache size.
+ */
+void cachePrintStats(void) {
+    char path[PATH_MAX];
+    char *dir = cacheDirectory();
+    long hits = 0, misses = 0;
+    long long total = 0;
+    int count = 0;
+    struct dirent *d;
+    struct stat st;
+    FILE *f;
+    DIR *dp;
+
+    if (dir == NULL) {
+        fprintf(stderr, "Cache directory path too long\n");
+        return;
+    }
+
+    if (joinPath(path, dir, "stats") == 0 && (f = fopen(path, "r")) != NULL) {
+        if (fscanf(f, "hits %ld\nmisses %ld\n", &hits, &misses) != 2) {
+            hits = misses = 0;
+        }
+        fclose(f);
+    }
+
+    if ((dp = opendir(dir)) != NULL) {
+        while ((d = readdir(dp)) != NULL) {
+            size_t len = strlen(d->d_name);
+            if (len < 4 || strcmp(d->d_name + len - 4, ".out")) {
+                continue;
+            }
+            if (joinPath(path, dir, d->d_name) == 0 && stat(path, &st) == 0) {
+                total += st.st_size;
+                count++;
+            }
+        }
+        closedir(dp);
+    }
+
+    printf("cache directory: %s\n", dir);
+    printf("hits:            %ld\n", hits);
+    printf("misses:          %ld\n", misses);
+    if (hits + misses > 0) {
+        printf("hit rate:        %.1f%%\n", 100.0 * hits / (hits + misses));
+    }
+    printf("entries:         %d\n", count);
+    printf("size:            %lld bytes\n", total);
+}
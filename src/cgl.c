@@ -0,0 +1,752 @@
+// src/cgl.c
+
+/**
+ * NOTE:
+ * Code generation in textual LLVM IR
+ * (Target-specific layer)
+ *
+ * NOTE: Use the following command to earn executable from generated IR
+ * $ clang -O2 (output IR path) -o out
+ * $ ./out
+ *
+ * NOTE:
+ * "Registers" handed back to gen.c are SSA value numbers (%t<N>),
+ * not physical registers, so there is no pool to allocate from or free.
+ * Globals live at module scope as @name, and each gen.c label becomes
+ * a basic block named L<N>.
+ */
+
+#include "data.h"
+#include "decl.h"
+
+// Next free SSA value number (%t1, %t2, ...)
+static _Thread_local int nextValue = 1;
+
+// Whether the current basic block already ends with a terminator
+// (br/ret). LLVM does not allow instructions after a terminator,
+// nor a block that falls through into the next label.
+static _Thread_local int blockTerminated = 0;
+
+// SSA values held by the CSE cache slots (see cse.c)
+static _Thread_local int cacheValues[NCSESLOTS];
+
+// Globals declared so far; emitted at module scope by llvmPostamble()
+static _Thread_local char **globalSymbols = NULL;
+static _Thread_local int *globalLengths = NULL; // see struct symbolTable
+static _Thread_local int globalSymbolCount = 0;
+static _Thread_local int globalSymbolCapacity = 0;
+
+// Arguments of the calls being generated, innermost last
+// (see llvmPushArgument())
+static _Thread_local int *argumentValues = NULL;
+static _Thread_local int argumentCount = 0;
+static _Thread_local int argumentCapacity = 0;
+
+// blockTerminated of main while a function is being generated
+static _Thread_local int mainBlockTerminated = 0;
+
+/**
+ * newValue - Returns a fresh SSA value number.
+ *
+ * Returns: The new value number.
+ */
+static int newValue(void) { return nextValue++; }
+
+/**
+ * ensureBlock - Opens an anonymous basic block if the current one is already
+ * terminated, so the next instruction has a block to live in.
+ */
+static void ensureBlock(void) {
+    if (blockTerminated) {
+        fprintf(Outfile, "b%d:\n", newValue());
+        blockTerminated = 0;
+    }
+}
+
+/**
+ * comparePredicate - Maps a comparison AST operation to an icmp predicate.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @caller: The calling routine, used in the error message.
+ *
+ * Returns: The icmp predicate string.
+ */
+static char *comparePredicate(int ASTop, char *caller) {
+    switch (ASTop) {
+    case A_EQ:
+        return "eq";
+    case A_NE:
+        return "ne";
+    case A_LT:
+        return "slt";
+    case A_LE:
+        return "sle";
+    case A_GT:
+        return "sgt";
+    case A_GE:
+        return "sge";
+    default:
+        fprintf(Errfile, "Error: Invalid AST operation %d in %s\n", ASTop,
+                caller);
+        fatalExit();
+    }
+}
+
+/**
+ * llvmPreamble - Outputs the module header, the printint helper and
+ *              the opening of main.
+ */
+void llvmPreamble(void) {
+    nextValue = 1;
+    blockTerminated = 0;
+    globalSymbolCount = 0;
+    argumentCount = 0;
+
+    fputs("@LC0 = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\"\n"
+          "\n"
+          "declare i32 @printf(i8*, ...)\n"
+          "\n"
+          "define internal void @printint(i64 %x) {\n"
+          "entry:\n"
+          "\t%v = trunc i64 %x to i32\n"
+          "\t%fmt = getelementptr inbounds [4 x i8], [4 x i8]* @LC0, "
+          "i64 0, i64 0\n"
+          "\tcall i32 (i8*, ...) @printf(i8* %fmt, i32 %v)\n"
+          "\tret void\n"
+          "}\n"
+          "\n"
+          "define i32 @main() {\n"
+          "entry:\n",
+          Outfile);
+}
+
+/**
+ * llvmPostamble - Closes main and emits the module-scope globals.
+ */
+void llvmPostamble(void) {
+    ensureBlock();
+    fputs("\tret i32 0\n"
+          "}\n",
+          Outfile);
+    blockTerminated = 1;
+
+    free(argumentValues);
+    argumentValues = NULL;
+    argumentCapacity = 0;
+
+    if (globalSymbolCount) {
+        fputs("\n", Outfile);
+    }
+    for (int i = 0; i < globalSymbolCount; i++) {
+        if (globalLengths[i] == 0) {
+            fprintf(Outfile, "@%s = global i64 0, align 8\n",
+                    globalSymbols[i]);
+        } else {
+            fprintf(Outfile,
+                    "@%s = global [%d x i64] zeroinitializer, align %d\n",
+                    globalSymbols[i], globalLengths[i], ARRAY_ALIGNMENT);
+        }
+    }
+    free(globalSymbols);
+    free(globalLengths);
+    globalSymbols = NULL;
+    globalLengths = NULL;
+    globalSymbolCapacity = 0;
+}
+
+/**
+ * llvmLoadImmediateInt - Materializes an integer constant as an SSA value.
+ *
+ * @value: The integer constant to load.
+ *
+ * Returns: The SSA value holding the constant.
+ */
+int llvmLoadImmediateInt(int value) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = add i64 0, %d\n", v, value);
+    return v;
+}
+
+/**
+ * llvmLoadGlobalSymbol - Loads a global's value into an SSA value.
+ *
+ * @identifier: The name of the global symbol.
+ *
+ * Returns: The SSA value holding the loaded value.
+ */
+int llvmLoadGlobalSymbol(char *identifier) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = load i64, i64* @%s, align 8\n", v,
+            identifier);
+    return v;
+}
+
+/**
+ * llvmStoreGlobalSymbol - Stores an SSA value into a global.
+ *
+ * @valueIndex: The SSA value to store.
+ * @identifier: The name of the global symbol.
+ *
+ * Returns: The SSA value that was stored.
+ */
+int llvmStoreGlobalSymbol(int valueIndex, char *identifier) {
+    ensureBlock();
+    fprintf(Outfile, "\tstore i64 %%t%d, i64* @%s, align 8\n", valueIndex,
+            identifier);
+    return valueIndex;
+}
+
+/**
+ * llvmLoadParameter - Loads a parameter of the function being generated.
+ *
+ * @position: The position of the parameter (0 for the first).
+ *
+ * Returns: The SSA value holding the loaded value.
+ */
+int llvmLoadParameter(int position) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = load i64, i64* %%a%d, align 8\n", v,
+            position);
+    return v;
+}
+
+/**
+ * llvmStoreParameter - Stores an SSA value into a parameter of the
+ * function being generated.
+ *
+ * @valueIndex: The SSA value to store.
+ * @position: The position of the parameter (0 for the first).
+ *
+ * Returns: The SSA value that was stored.
+ */
+int llvmStoreParameter(int valueIndex, int position) {
+    ensureBlock();
+    fprintf(Outfile, "\tstore i64 %%t%d, i64* %%a%d, align 8\n", valueIndex,
+            position);
+    return valueIndex;
+}
+
+/**
+ * llvmDeclareLocal - Gives a local its stack slot %l<N>.
+ *
+ * NOTE:
+ * Emitted before the code of the statements the local is used in
+ * (see codegenAllocateLocals()), never inside a loop; mem2reg turns
+ * the slot into SSA values.
+ *
+ * @identifierIndex: The symbol table index of the local.
+ */
+void llvmDeclareLocal(int identifierIndex) {
+    ensureBlock();
+    fprintf(Outfile, "\t%%l%d = alloca i64, align 8\n", identifierIndex);
+}
+
+/**
+ * llvmLoadLocal - Loads a local's value into an SSA value.
+ *
+ * @identifierIndex: The symbol table index of the local.
+ *
+ * Returns: The SSA value holding the loaded value.
+ */
+int llvmLoadLocal(int identifierIndex) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = load i64, i64* %%l%d, align 8\n", v,
+            identifierIndex);
+    return v;
+}
+
+/**
+ * llvmStoreLocal - Stores an SSA value into a local.
+ *
+ * @valueIndex: The SSA value to store.
+ * @identifierIndex: The symbol table index of the local.
+ *
+ * Returns: The SSA value that was stored.
+ */
+int llvmStoreLocal(int valueIndex, int identifierIndex) {
+    ensureBlock();
+    fprintf(Outfile, "\tstore i64 %%t%d, i64* %%l%d, align 8\n", valueIndex,
+            identifierIndex);
+    return valueIndex;
+}
+
+/**
+ * llvmDeclareGlobalSymbol - Records a global for emission at module scope.
+ *
+ * NOTE:
+ * Declarations arrive while main's body is being written,
+ * so they are held back until llvmPostamble().
+ *
+ * @symbol: The name of the global symbol.
+ * @length: Number of elements of an array, 0 for an int.
+ */
+void llvmDeclareGlobalSymbol(char *symbol, int length) {
+    for (int i = 0; i < globalSymbolCount; i++) {
+        if (!strcmp(globalSymbols[i], symbol)) {
+            return;
+        }
+    }
+    if (globalSymbolCount == globalSymbolCapacity) {
+        globalSymbolCapacity =
+            globalSymbolCapacity ? globalSymbolCapacity * 2 : 64;
+        globalSymbols =
+            realloc(globalSymbols, globalSymbolCapacity * sizeof(char *));
+        globalLengths =
+            realloc(globalLengths, globalSymbolCapacity * sizeof(int));
+        if (globalSymbols == NULL || globalLengths == NULL) {
+            logFatal("Out of memory while declaring a global");
+        }
+    }
+    globalLengths[globalSymbolCount] = length;
+    globalSymbols[globalSymbolCount++] = symbol;
+}
+
+/**
+ * llvmElementPointer - Emits the address of an array element.
+ *
+ * @vIndex: The SSA value holding the element index.
+ * @array: The name of the array.
+ * @length: Its number of elements.
+ *
+ * Returns: The SSA value holding the element's address.
+ */
+static int llvmElementPointer(int vIndex, char *array, int length) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile,
+            "\t%%t%d = getelementptr inbounds [%d x i64], [%d x i64]* @%s, "
+            "i64 0, i64 %%t%d\n",
+            v, length, length, array, vIndex);
+    return v;
+}
+
+/**
+ * llvmLoadElement - Loads an array element into an SSA value.
+ *
+ * @vIndex: The SSA value holding the element index.
+ * @array: The name of the array.
+ * @length: Its number of elements.
+ *
+ * Returns: The SSA value holding the loaded value.
+ */
+int llvmLoadElement(int vIndex, char *array, int length) {
+    int p = llvmElementPointer(vIndex, array, length);
+    int v = newValue();
+
+    fprintf(Outfile, "\t%%t%d = load i64, i64* %%t%d, align 8\n", v, p);
+    return v;
+}
+
+/**
+ * llvmStoreElement - Stores an SSA value into an array element.
+ *
+ * @valueIndex: The SSA value to store.
+ * @vIndex: The SSA value holding the element index.
+ * @array: The name of the array.
+ * @length: Its number of elements.
+ *
+ * Returns: The SSA value that was stored.
+ */
+int llvmStoreElement(int valueIndex, int vIndex, char *array, int length) {
+    int p = llvmElementPointer(vIndex, array, length);
+
+    fprintf(Outfile, "\tstore i64 %%t%d, i64* %%t%d, align 8\n", valueIndex,
+            p);
+    return valueIndex;
+}
+
+/**
+ * llvmBinaryOp - Emits a two-operand integer instruction.
+ *
+ * @opcode: The LLVM instruction name (add, sub, ...).
+ * @v1: The first operand.
+ * @v2: The second operand.
+ *
+ * Returns: The SSA value holding the result.
+ */
+static int llvmBinaryOp(char *opcode, int v1, int v2) {
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = %s i64 %%t%d, %%t%d\n", v, opcode, v1, v2);
+    return v;
+}
+
+/**
+ * llvmAddRegs - Emits an addition.
+ *
+ * @v1: The first operand.
+ * @v2: The second operand.
+ *
+ * Returns: The SSA value holding the result.
+ */
+int llvmAddRegs(int v1, int v2) { return llvmBinaryOp("add", v1, v2); }
+
+/**
+ * llvmSubRegs - Emits a subtraction.
+ *
+ * @v1: The first operand.
+ * @v2: The second operand.
+ *
+ * Returns: The SSA value holding the result.
+ */
+int llvmSubRegs(int v1, int v2) { return llvmBinaryOp("sub", v1, v2); }
+
+/**
+ * llvmMulRegs - Emits a multiplication.
+ *
+ * @v1: The first operand.
+ * @v2: The second operand.
+ *
+ * Returns: The SSA value holding the result.
+ */
+int llvmMulRegs(int v1, int v2) { return llvmBinaryOp("mul", v1, v2); }
+
+/**
+ * llvmDivRegsSigned - Emits a signed division.
+ *
+ * @v1: The dividend.
+ * @v2: The divisor.
+ *
+ * Returns: The SSA value holding the quotient.
+ */
+int llvmDivRegsSigned(int v1, int v2) { return llvmBinaryOp("sdiv", v1, v2); }
+
+/**
+ * llvmModRegsSigned - Emits a signed remainder.
+ *
+ * @v1: The dividend.
+ * @v2: The divisor.
+ *
+ * Returns: The SSA value holding the remainder.
+ */
+int llvmModRegsSigned(int v1, int v2) { return llvmBinaryOp("srem", v1, v2); }
+
+/**
+ * llvmImmediateOp - Emits a two-operand integer instruction whose
+ * second operand is a constant.
+ *
+ * @opcode: The LLVM instruction name (ashr, and).
+ * @v: The first operand.
+ * @value: The constant.
+ *
+ * Returns: The SSA value holding the result.
+ */
+static int llvmImmediateOp(char *opcode, int v, int value) {
+    int result = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = %s i64 %%t%d, %d\n", result, opcode, v,
+            value);
+    return result;
+}
+
+/**
+ * llvmShiftRight - Emits an arithmetic shift right.
+ *
+ * @v: The value to shift.
+ * @bits: Number of bits to shift by.
+ *
+ * Returns: The SSA value holding the result.
+ */
+int llvmShiftRight(int v, int bits) { return llvmImmediateOp("ashr", v, bits); }
+
+/**
+ * llvmAndImmediate - Emits a bitwise and with a constant.
+ *
+ * @v: The value to mask.
+ * @mask: The mask.
+ *
+ * Returns: The SSA value holding the result.
+ */
+int llvmAndImmediate(int v, int mask) {
+    return llvmImmediateOp("and", v, mask);
+}
+
+/**
+ * llvmPrintIntFromReg - Emits a call to the printint runtime helper.
+ *
+ * @v: The SSA value to print.
+ */
+void llvmPrintIntFromReg(int v) {
+    ensureBlock();
+    fprintf(Outfile, "\tcall void @printint(i64 %%t%d)\n", v);
+}
+
+/**
+ * llvmCompareAndSet - Emits a comparison producing 0 or 1.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @v1: The first operand.
+ * @v2: The second operand.
+ *
+ * Returns: The SSA value holding the comparison result (0 or 1).
+ */
+int llvmCompareAndSet(int ASTop, int v1, int v2) {
+    char *predicate = comparePredicate(ASTop, "llvmCompareAndSet");
+    int flag = newValue();
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = icmp %s i64 %%t%d, %%t%d\n", flag, predicate,
+            v1, v2);
+    fprintf(Outfile, "\t%%t%d = zext i1 %%t%d to i64\n", v, flag);
+    return v;
+}
+
+/**
+ * llvmLabel - Starts the basic block for a label.
+ *
+ * NOTE:
+ * If the previous block is still open, it falls through,
+ * which LLVM requires to be spelled out as an explicit branch.
+ *
+ * @label: The label number to output.
+ */
+void llvmLabel(int label) {
+    if (!blockTerminated) {
+        fprintf(Outfile, "\tbr label %%L%d\n", label);
+    }
+    fprintf(Outfile, "L%d:\n", label);
+    blockTerminated = 0;
+}
+
+/**
+ * llvmJump - Emits an unconditional branch to a label.
+ *
+ * @label: The label number to jump to.
+ */
+void llvmJump(int label) {
+    ensureBlock();
+    fprintf(Outfile, "\tbr label %%L%d\n", label);
+    blockTerminated = 1;
+}
+
+/**
+ * llvmCompareAndJump - Emits a comparison and a conditional branch to
+ * a label taken when the comparison is FALSE.
+ *
+ * NOTE:
+ * The TRUE edge goes to a fresh block that immediately follows,
+ * mirroring the fall-through of the NASM backend.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @v1: The first operand.
+ * @v2: The second operand.
+ * @label: The label number to jump to if the comparison is false.
+ *
+ * Returns: NOREG (indicating no value is returned).
+ */
+int llvmCompareAndJump(int ASTop, int v1, int v2, int label) {
+    char *predicate = comparePredicate(ASTop, "llvmCompareAndJump");
+    int flag = newValue();
+    int fallthrough = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = icmp %s i64 %%t%d, %%t%d\n", flag, predicate,
+            v1, v2);
+    fprintf(Outfile, "\tbr i1 %%t%d, label %%b%d, label %%L%d\n", flag,
+            fallthrough, label);
+    fprintf(Outfile, "b%d:\n", fallthrough);
+
+    return NOREG;
+}
+
+/**
+ * llvmCacheStore - Remembers an SSA value in a CSE cache slot.
+ *
+ * NOTE:
+ * SSA values can be used any number of times, so no copy is needed.
+ * gen.c flushes the cache at every label, which keeps each reuse
+ * dominated by its definition.
+ *
+ * @v: The SSA value.
+ * @slot: The cache slot to fill.
+ *
+ * Returns: The SSA value.
+ */
+int llvmCacheStore(int v, int slot) {
+    cacheValues[slot] = v;
+    return v;
+}
+
+/**
+ * llvmCacheLoad - Returns the SSA value remembered in a CSE cache slot.
+ *
+ * @slot: The cache slot to read.
+ *
+ * Returns: The SSA value.
+ */
+int llvmCacheLoad(int slot) { return cacheValues[slot]; }
+
+/**
+ * llvmSelect - Emits a comparison feeding a select.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @v1: The first compared value.
+ * @v2: The second compared value.
+ * @vTrue: The value if the comparison holds.
+ * @vFalse: The value otherwise.
+ *
+ * Returns: The SSA value holding the selected value.
+ */
+int llvmSelect(int ASTop, int v1, int v2, int vTrue, int vFalse) {
+    char *predicate = comparePredicate(ASTop, "llvmSelect");
+    int flag = newValue();
+    int v = newValue();
+
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = icmp %s i64 %%t%d, %%t%d\n", flag, predicate,
+            v1, v2);
+    fprintf(Outfile, "\t%%t%d = select i1 %%t%d, i64 %%t%d, i64 %%t%d\n", v,
+            flag, vTrue, vFalse);
+    return v;
+}
+
+/**
+ * llvmBooleanPhi - Merges the 1 and 0 of a logical operator whose
+ * value is needed (see codegenBooleanValue() in gen.c).
+ *
+ * NOTE:
+ * The blocks of both labels hold nothing but a branch to the current
+ * one, so they are its only predecessors.
+ *
+ * @labelTrue: The label of the block the value is 1 from.
+ * @labelFalse: The label of the block the value is 0 from.
+ *
+ * Returns: The SSA value holding 0 or 1.
+ */
+int llvmBooleanPhi(int labelTrue, int labelFalse) {
+    int v = newValue();
+
+    fprintf(Outfile, "	%%t%d = phi i64 [ 1, %%L%d ], [ 0, %%L%d ]\n", v,
+            labelTrue, labelFalse);
+    return v;
+}
+
+/**
+ * llvmSwitch - Emits a switch statement's dispatch as an LLVM switch,
+ * which LLVM lowers to a jump table or a compare tree itself.
+ *
+ * @v: The SSA value of the selector.
+ * @cases: The cases, in any order.
+ * @count: Number of cases.
+ * @labelDefault: The label for every other value.
+ */
+void llvmSwitch(int v, struct switchCase *cases, int count, int labelDefault) {
+    ensureBlock();
+    fprintf(Outfile, "\tswitch i64 %%t%d, label %%L%d [\n", v, labelDefault);
+    for (int i = 0; i < count; i++) {
+        fprintf(Outfile, "\t\ti64 %d, label %%L%d\n", cases[i].value,
+                cases[i].label);
+    }
+    fputs("\t]\n", Outfile);
+    blockTerminated = 1;
+}
+
+/**
+ * llvmFunctionPreamble - Opens the definition of a function.
+ *
+ * NOTE:
+ * Each parameter %p<N> gets a stack slot %a<N> that the body loads
+ * and stores; mem2reg turns the slots back into SSA values.
+ * gen.c writes the definition apart from main's body.
+ *
+ * @name: The name of the function.
+ * @parameters: Number of parameters.
+ */
+void llvmFunctionPreamble(char *name, int parameters) {
+    mainBlockTerminated = blockTerminated;
+    blockTerminated = 0;
+
+    fprintf(Outfile, "\ndefine internal i64 @%s(", name);
+    for (int i = 0; i < parameters; i++) {
+        fprintf(Outfile, "%si64 %%p%d", i ? ", " : "", i);
+    }
+    fputs(") {\n"
+          "entry:\n",
+          Outfile);
+    for (int i = 0; i < parameters; i++) {
+        fprintf(Outfile, "\t%%a%d = alloca i64, align 8\n", i);
+        fprintf(Outfile, "\tstore i64 %%p%d, i64* %%a%d, align 8\n", i, i);
+    }
+}
+
+/**
+ * llvmFunctionPostamble - Closes the definition of a function.
+ *
+ * NOTE:
+ * A body that ends without a return statement returns 0, and so does
+ * returnLabel, which only a malformed AST file could jump to.
+ *
+ * @returnLabel: The label number of the function's exit.
+ */
+void llvmFunctionPostamble(int returnLabel) {
+    if (!blockTerminated) {
+        fputs("\tret i64 0\n", Outfile);
+    }
+    fprintf(Outfile, "L%d:\n", returnLabel);
+    fputs("\tret i64 0\n"
+          "}\n",
+          Outfile);
+    blockTerminated = mainBlockTerminated;
+}
+
+/**
+ * llvmReturn - Emits a return statement.
+ *
+ * @v: The SSA value to return.
+ */
+void llvmReturn(int v) {
+    ensureBlock();
+    fprintf(Outfile, "\tret i64 %%t%d\n", v);
+    blockTerminated = 1;
+}
+
+/**
+ * llvmPushArgument - Records an argument of the call being generated.
+ *
+ * @v: The SSA value of the argument.
+ */
+void llvmPushArgument(int v) {
+    if (argumentCount == argumentCapacity) {
+        argumentCapacity = argumentCapacity ? argumentCapacity * 2 : 16;
+        argumentValues =
+            realloc(argumentValues, argumentCapacity * sizeof(int));
+        if (argumentValues == NULL) {
+            logFatal("Out of memory while generating a call");
+        }
+    }
+    argumentValues[argumentCount++] = v;
+}
+
+/**
+ * llvmCall - Emits a call to a function.
+ *
+ * @name: The name of the function.
+ * @arguments: Number of arguments recorded by llvmPushArgument().
+ *
+ * Returns: The SSA value holding the returned value.
+ */
+int llvmCall(char *name, int arguments) {
+    int v = newValue();
+
+    argumentCount -= arguments;
+    ensureBlock();
+    fprintf(Outfile, "\t%%t%d = call i64 @%s(", v, name);
+    for (int i = 0; i < arguments; i++) {
+        fprintf(Outfile, "%si64 %%t%d", i ? ", " : "",
+                argumentValues[argumentCount + i]);
+    }
+    fputs(")\n", Outfile);
+    return v;
+}
@@ -13,21 +13,58 @@
 
 #include "data.h"
 #include "decl.h"
+#include "superopt.h"
 
-static int freeRegisters[4];
-static char *qwordRegisterList[4] = {
+static _Thread_local int freeRegisters[4];
+// The pool's registers, r8-r11 unless -Os picks others
+// (see nasmChoosePool())
+static _Thread_local char *qwordRegisterList[4] = {
     "r8",  // x64 general-purpose register #1
     "r9",  // x64 general-purpose register #2
     "r10", // x64 general-purpose register #3
     "r11"  // x64 general-purpose register #4
 };
-static char *byteRegisterList[4] = {
+static _Thread_local char *dwordRegisterList[4] = {
+    "r8d",  // lower 32 bits of r8
+    "r9d",  // lower 32 bits of r9
+    "r10d", // lower 32 bits of r10
+    "r11d"  // lower 32 bits of r11
+};
+static _Thread_local char *byteRegisterList[4] = {
     "r8b",  // lower 8 bits of r8
     "r9b",  // lower 8 bits of r9
     "r10b", // lower 8 bits of r10
     "r11b"  //  lower 8 bits of r11
 };
 
+// Registers backing the CSE cache slots (see cse.c).
+// They are callee-saved, so cached values survive calls to printint.
+static char *cacheRegisterList[NCSESLOTS] = {"r12", "r13", "r14", "r15"};
+
+// Registers holding locals (see regalloc.c); rbx is callee-saved,
+// the others are saved around the calls they must survive
+static char *localRegisterList[LOCAL_REGISTERS] = {"rbx", "rcx", "rsi",
+                                                   "rdi"};
+static char *localDwordRegisterList[LOCAL_REGISTERS] = {"ebx", "ecx", "esi",
+                                                        "edi"};
+static char *localByteRegisterList[LOCAL_REGISTERS] = {"bl", "cl", "sil",
+                                                       "dil"};
+
+// Registers the System V ABI passes the first six arguments in
+static char *argumentRegisterList[FUNCTION_MAX_PARAMETERS] = {
+    "rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+
+// Words pushed since the prologue, which aligned the stack to 16 bytes
+// (see nasmCall())
+static _Thread_local int pushedWords = 0;
+
+// Parameters of the function being generated (0 in main); the stack
+// slots of its locals follow theirs (see nasmFunctionPreamble())
+static _Thread_local int frameParameters = 0;
+
+// Operand built by nasmVariableOperand()
+static _Thread_local char variableOperand[TEXTLEN + 9];
+
 /**
  * nasmResetRegisterPool - Marks all registers as free for allocation.
  */
@@ -39,6 +76,39 @@ void nasmResetRegisterPool(void) {
     }
 }
 
+/**
+ * nasmChoosePool - Picks the registers of the pool for a frame.
+ *
+ * NOTE:
+ * r8-r11 need a REX prefix, which the 32-bit forms of -Os (see
+ * immediateText()) could otherwise do without. So under -Os, the local
+ * registers no local of the frame was given take the pool's places
+ * from the first on. They are saved around calls like r8-r11 are, and
+ * rbx by the prologues.
+ *
+ * @avoid: Mask of the local registers the frame's locals hold (see
+ *         regalloc.c); every register of the pool must be free.
+ */
+void nasmChoosePool(int avoid) {
+    static char *qword[4] = {"r8", "r9", "r10", "r11"};
+    static char *dword[4] = {"r8d", "r9d", "r10d", "r11d"};
+    static char *byte[4] = {"r8b", "r9b", "r10b", "r11b"};
+    int k = 0;
+
+    for (int i = 0; OptimizeSize && i < LOCAL_REGISTERS; i++) {
+        if (!(avoid & (1 << i))) {
+            qwordRegisterList[k] = localRegisterList[i];
+            dwordRegisterList[k] = localDwordRegisterList[i];
+            byteRegisterList[k++] = localByteRegisterList[i];
+        }
+    }
+    for (; k < 4; k++) {
+        qwordRegisterList[k] = qword[k];
+        dwordRegisterList[k] = dword[k];
+        byteRegisterList[k] = byte[k];
+    }
+}
+
 /**
  * allocateRegister - Allocates a free register and returns its index.
  * Dies with an error if no registers are available.
@@ -54,8 +124,8 @@ static int allocateRegister(void) {
         }
     }
 
-    fprintf(stderr, "Error: No free registers available\n");
-    exit(1);
+    fprintf(Errfile, "Error: No free registers available\n");
+    fatalExit();
 }
 
 /**
@@ -66,19 +136,54 @@ static int allocateRegister(void) {
  */
 static void freeRegister(int r) {
     if (freeRegisters[r] == 1) {
-        fprintf(stderr, "Error: Register %s is already free\n",
+        fprintf(Errfile, "Error: Register %s is already free\n",
                 qwordRegisterList[r]);
-        exit(1);
+        fatalExit();
     }
     freeRegisters[r] = 1; // Mark as free
 }
 
+/**
+ * nasmAllocateRegister - Allocates a free register for the instruction
+ * selector (see isel.c).
+ *
+ * Returns: Index of the allocated register.
+ */
+int nasmAllocateRegister(void) { return allocateRegister(); }
+
+/**
+ * nasmFreeRegister - Frees a register allocated by the instruction selector.
+ *
+ * @r: Index of the register to free.
+ */
+void nasmFreeRegister(int r) { freeRegister(r); }
+
+/**
+ * nasmRegisterName - Returns the 64-bit name of a register.
+ *
+ * @r: Index of the register.
+ *
+ * Returns: The register name.
+ */
+char *nasmRegisterName(int r) { return qwordRegisterList[r]; }
+
+/**
+ * nasmByteRegisterName - Returns the name of a register's low 8 bits.
+ *
+ * @r: Index of the register.
+ *
+ * Returns: The register name.
+ */
+char *nasmByteRegisterName(int r) { return byteRegisterList[r]; }
+
 /**
  * nasmPreamble - Outputs the assembly code preamble, including
  *              function prologues for main and printint.
  */
 void nasmPreamble() {
     nasmResetRegisterPool();
+    pushedWords = 0;
+    frameParameters = 0;
     fputs("\tglobal\tmain\n"
 
           "\textern\tprintf\n"
@@ -103,19 +208,95 @@ void nasmPreamble() {
 
           "main:\n"
           "\tpush\trbp\n"
-          "\tmov	rbp, rsp\n",
+          "\tmov	rbp, rsp\n"
+          "\tpush\tr12\n"
+          "\tpush\tr13\n"
+          "\tpush\tr14\n"
+          "\tpush\tr15\n"
+          "\tpush\trbx\n"
+          "\tsub\trsp, main.frame\n", // see nasmPostamble()
           Outfile);
 }
 
+/**
+ * frameSize - Returns the bytes a prologue reserves below the saved
+ * registers for the given number of 8-byte slots.
+ *
+ * NOTE:
+ * Five registers are pushed after rbp, so an odd number of slots
+ * leaves the stack 16-byte aligned for the calls made from the body.
+ */
+static int frameSize(int slots) { return 8 * (slots | 1); }
+
 /**
  * nasmPostamble - Outputs the assembly code postamble,
  *               including function epilogue for main.
+ *
+ * NOTE:
+ * main's prologue was written before any local was allocated, so it
+ * reserves main.frame bytes, defined here once the stack slots are
+ * known.
+ *
+ * @spillSlots: Stack slots main's locals need (see allocateLocals()).
  */
-void nasmPostamble() {
+void nasmPostamble(int spillSlots) {
+    if (InstrumentBranches) {
+        // Write the branch counters out before leaving main
+        fputs("\tcall\tkeccc_prof_dump\n", Outfile);
+    }
     fputs("\tmov	eax, 0\n"
+          "\tlea\trsp, [rbp-40]\n"
+          "\tpop\trbx\n"
+          "\tpop\tr15\n"
+          "\tpop\tr14\n"
+          "\tpop\tr13\n"
+          "\tpop\tr12\n"
           "\tpop	rbp\n"
           "\tret\n",
           Outfile);
+    fprintf(Outfile, "main.frame\tequ\t%d\n", frameSize(spillSlots));
+}
+
+/**
+ * immediateText - Writes an instruction that sets a register or
+ * variable to an integer constant, without the tab before it or the
+ * newline after it.
+ *
+ * NOTE:
+ * That is `mov operand, value`, or under -Os the shortest of (with rbx,
+ * against 7 bytes for `mov rbx, value`):
+ * ----------------------------------------
+ *   xor   ebx, ebx          2 bytes    0
+ *   push  value             3 bytes    -128 to 127
+ *   pop   rbx
+ *   mov   ebx, value        5 bytes    up to 2^31 - 1 (zero extended)
+ *   and   qword [x], 0      9 bytes    0 in memory (12 for a mov)
+ *   or    qword [x], -1     9 bytes    -1 in memory
+ * ----------------------------------------
+ * xor, and and or write the flags, which no code reads across the
+ * loading of an operand.
+ *
+ * @operand: The register (64-bit name) or memory operand.
+ * @dword: The register's 32-bit name, or NULL for memory.
+ * @value: The integer constant.
+ */
+static void immediateText(char *operand, char *dword, int value) {
+    if (!OptimizeSize) {
+        fprintf(Outfile, "mov\t%s, %d", operand, value);
+    } else if (dword == NULL && (value == 0 || value == -1)) {
+        fprintf(Outfile, "%s\t%s, %d", value == 0 ? "and" : "or", operand,
+                value);
+    } else if (dword == NULL) {
+        fprintf(Outfile, "mov\t%s, %d", operand, value);
+    } else if (value == 0) {
+        fprintf(Outfile, "xor\t%s, %s", dword, dword);
+    } else if (value >= -128 && value <= 127) {
+        fprintf(Outfile, "push\t%d\n\tpop\t%s", value, operand);
+    } else if (value > 0) {
+        fprintf(Outfile, "mov\t%s, %d", dword, value);
+    } else {
+        fprintf(Outfile, "mov\t%s, %d", operand, value);
+    }
 }
 
 /**
@@ -129,49 +310,187 @@ void nasmPostamble() {
 int nasmLoadImmediateInt(int value) {
     int registerIndex = allocateRegister();
 
-    fprintf(Outfile, "\tmov\t%s, %d\n", qwordRegisterList[registerIndex],
-            value);
+    fputc('\t', Outfile);
+    immediateText(qwordRegisterList[registerIndex],
+                  dwordRegisterList[registerIndex], value);
+    fputc('\n', Outfile);
     return registerIndex;
 }
 
 /**
- * nasmLoadGlobalSymbol - Generates code to load a global symbol's value into a
+ * nasmMoveImmediate - Generates code to overwrite a register with an
+ * integer constant.
+ *
+ * NOTE:
+ * Used where control flow merges: each path puts its value into
+ * the same register (see codegenBooleanValue() in gen.c).
+ *
+ * @r: Index of the register, or NOREG to allocate one.
+ * @value: The integer constant to load.
+ *
+ * Returns: Index of the register containing the integer.
+ */
+int nasmMoveImmediate(int r, int value) {
+    if (r == NOREG) {
+        r = allocateRegister();
+    }
+    fputc('\t', Outfile);
+    immediateText(qwordRegisterList[r], dwordRegisterList[r], value);
+    fputc('\n', Outfile);
+    return r;
+}
+
+/**
+ * nasmImmediateText - Writes the instruction of an instruction selector
+ * template that sets a register or variable to an integer constant
+ * (see immediateText()).
+ *
+ * @r: Index of the register, or NOREG for the variable.
+ * @identifierIndex: The symbol table index of the variable.
+ * @value: The integer constant.
+ */
+void nasmImmediateText(int r, int identifierIndex, int value) {
+    int location;
+
+    if (r != NOREG) {
+        immediateText(qwordRegisterList[r], dwordRegisterList[r], value);
+    } else if (nasmVariableInRegister(identifierIndex)) {
+        location = GlobalSymbolTable[identifierIndex].location;
+        immediateText(localRegisterList[location],
+                      localDwordRegisterList[location], value);
+    } else {
+        immediateText(nasmVariableOperand(identifierIndex), NULL, value);
+    }
+}
+
+/**
+ * nasmVariableInRegister - Checks whether an int variable is a local
+ * kept in a register.
+ *
+ * @identifierIndex: The symbol table index of the variable.
+ *
+ * Returns: 1 if it is, 0 if it is in memory.
+ */
+int nasmVariableInRegister(int identifierIndex) {
+    struct symbolTable *s = &GlobalSymbolTable[identifierIndex];
+
+    return s->kind == S_LOCAL && s->location >= 0;
+}
+
+/**
+ * nasmVariableOperand - Returns the operand of an int variable.
+ *
+ * NOTE:
+ * A global is addressed by name, a parameter or a spilled local by its
+ * slot in the frame of the function being generated (see
+ * nasmFunctionPreamble()), and any other local is its register.
+ * Memory operands carry their size, so they may stand alone, as in
+ * `inc qword [count]`. The operand stays valid until the next call.
+ *
+ * @identifierIndex: The symbol table index of the variable.
+ *
+ * Returns: The operand, e.g. "qword [count]", "qword [rbp-48]" or "rbx".
+ */
+char *nasmVariableOperand(int identifierIndex) {
+    struct symbolTable *s = &GlobalSymbolTable[identifierIndex];
+    int slot;
+
+    if (s->kind == S_LOCAL && s->location >= 0) {
+        return localRegisterList[s->location];
+    }
+    if (s->kind == S_PARAMETER || s->kind == S_LOCAL) {
+        slot = s->kind == S_PARAMETER ? s->position
+                                      : frameParameters - 1 - s->location;
+        snprintf(variableOperand, sizeof(variableOperand),
+                 "qword [rbp-%d]", 48 + 8 * slot);
+    } else {
+        snprintf(variableOperand, sizeof(variableOperand), "qword [%s]",
+                 s->name);
+    }
+    return variableOperand;
+}
+
+/**
+ * nasmLoadVariable - Generates code to load a variable's value into a
  * register.
  *
- * @identifier: The name of the global symbol.
+ * @identifierIndex: The symbol table index of the variable.
  *
  * Returns: Index of the register containing the loaded value.
  */
-int nasmLoadGlobalSymbol(char *identifier) {
+int nasmLoadVariable(int identifierIndex) {
     int registerIndex = allocateRegister();
 
-    fprintf(Outfile, "\tmov\t%s, [%s]\n", qwordRegisterList[registerIndex],
-            identifier);
+    fprintf(Outfile, "\tmov\t%s, %s\n", qwordRegisterList[registerIndex],
+            nasmVariableOperand(identifierIndex));
+    return registerIndex;
+}
+
+/**
+ * nasmStoreVariable - Generates code to store a register's value into a
+ * variable.
+ *
+ * @registerIndex: Index of the register containing the value to store.
+ * @identifierIndex: The symbol table index of the variable.
+ *
+ * Returns: Index of the register that was stored.
+ */
+int nasmStoreVariable(int registerIndex, int identifierIndex) {
+    fprintf(Outfile, "\tmov\t%s, %s\n", nasmVariableOperand(identifierIndex),
+            qwordRegisterList[registerIndex]);
     return registerIndex;
 }
 
 /**
- * nasmStoreGlobalSymbol - Generates code to store a register's value into a
- * global symbol.
+ * nasmLoadElement - Generates code to load an array element into the
+ * register holding its index.
+ *
+ * @r: Index of the register containing the element index.
+ * @array: The name of the array.
+ *
+ * Returns: Index of the register containing the loaded value.
+ */
+int nasmLoadElement(int r, char *array) {
+    fprintf(Outfile, "\tmov\t%s, [%s+%s*8]\n", qwordRegisterList[r], array,
+            qwordRegisterList[r]);
+    return r;
+}
+
+/**
+ * nasmStoreElement - Generates code to store a register's value into an
+ * array element.
  *
  * @registerIndex: Index of the register containing the value to store.
- * @identifier: The name of the global symbol.
+ * @indexRegister: Index of the register containing the element index.
+ * @array: The name of the array.
  *
  * Returns: Index of the register that was stored.
  */
-int nasmStoreGlobalSymbol(int registerIndex, char *identifier) {
-    fprintf(Outfile, "\tmov\t[%s], %s\n", identifier,
+int nasmStoreElement(int registerIndex, int indexRegister, char *array) {
+    fprintf(Outfile, "\tmov\t[%s+%s*8], %s\n", array,
+            qwordRegisterList[indexRegister],
             qwordRegisterList[registerIndex]);
+    freeRegister(indexRegister);
     return registerIndex;
 }
 
 /**
  * nasmDeclareCommonGlobal - Generates code to declare a global symbol.
  *
+ * NOTE:
+ * Common symbols end up in .bss. Arrays are aligned for the
+ * vector loads and stores of vectorized loops (see vectorize.c).
+ *
  * @symbol: The name of the global symbol.
+ * @length: Number of elements of an array, 0 for an int.
  */
-void nasmDeclareGlobalSymbol(char *symbol) {
-    fprintf(Outfile, "\tcommon\t%s 8:8\n", symbol);
+void nasmDeclareGlobalSymbol(char *symbol, int length) {
+    if (length == 0) {
+        fprintf(Outfile, "\tcommon\t%s 8:8\n", symbol);
+    } else {
+        fprintf(Outfile, "\tcommon\t%s %d:%d\n", symbol, length * 8,
+                ARRAY_ALIGNMENT);
+    }
 }
 
 /**
@@ -222,6 +541,75 @@ int nasmMulRegs(int r1, int r2) {
     return r1;
 }
 
+/**
+ * compareMultipliers - Orders superopt.h rules by multiplier, for
+ * bsearch().
+ */
+static int compareMultipliers(const void *key, const void *rule) {
+    int multiplier = *(const int *)key;
+    int other = ((const struct superoptRule *)rule)->multiplier;
+
+    return (multiplier > other) - (multiplier < other);
+}
+
+/**
+ * nasmMulSequence - Finds the instructions superopt.c found for
+ * multiplying by a constant faster than imul.
+ *
+ * @multiplier: The constant.
+ *
+ * Returns: The sequence, as a template where %1 is the register and rax
+ *          is scratch, or NULL if there is none (under -Os, none of more
+ *          than one instruction; with --no-superopt, none at all).
+ */
+char *nasmMulSequence(int multiplier) {
+    const struct superoptRule *rule;
+
+    if (!Superoptimize) {
+        return NULL;
+    }
+    rule = bsearch(&multiplier, superoptRules,
+                   sizeof(superoptRules) / sizeof(superoptRules[0]),
+                   sizeof(superoptRules[0]), compareMultipliers);
+    if (rule == NULL ||
+        (OptimizeSize && strchr(rule->sequence, '\n') != NULL)) {
+        return NULL; // no smaller than imul
+    }
+    return rule->sequence;
+}
+
+/**
+ * nasmMulConstant - Generates code to multiply a register by a constant,
+ * with the sequence from superopt.h if there is one.
+ *
+ * @r: Index of the register.
+ * @multiplier: The constant.
+ *
+ * Returns: Index of the register containing the result.
+ */
+int nasmMulConstant(int r, int multiplier) {
+    char *t = nasmMulSequence(multiplier);
+
+    if (t == NULL) {
+        fprintf(Outfile, "\timul\t%s, %s, %d\n", qwordRegisterList[r],
+                qwordRegisterList[r], multiplier);
+        return r;
+    }
+    fputc('\t', Outfile);
+    for (; *t; t++) {
+        if (*t == '\n') {
+            fputs("\n\t", Outfile);
+        } else if (*t == '%' && t[1] == '1') {
+            fputs(qwordRegisterList[r], Outfile);
+            t++;
+        } else {
+            fputc(*t, Outfile);
+        }
+    }
+    fputc('\n', Outfile);
+    return r;
+}
+
 /**
  * nasmDivRegsSigned - Generates code to divide values in two registers.
  *
@@ -240,15 +628,143 @@ int nasmDivRegsSigned(int r1, int r2) {
     return r1;
 }
 
+/**
+ * nasmModRegsSigned - Generates code for the remainder of dividing
+ * values in two registers.
+ *
+ * @r1: Index of the dividend register.
+ * @r2: Index of the divisor register.
+ *
+ * Returns: Index of the register containing the result (remainder).
+ */
+int nasmModRegsSigned(int r1, int r2) {
+    fprintf(Outfile, "\tmov\trax, %s\n", qwordRegisterList[r1]);
+    fprintf(Outfile, "\tcqo\n");
+    fprintf(Outfile, "\tidiv\t%s\n", qwordRegisterList[r2]);
+    fprintf(Outfile, "\tmov\t%s, rdx\n", qwordRegisterList[r1]);
+    freeRegister(r2);
+
+    return r1;
+}
+
+/**
+ * nasmDivPowerOfTwo - Generates code to divide a register by a power of
+ * two, or to take the remainder, without idiv.
+ *
+ * NOTE:
+ * A shift rounds towards minus infinity and idiv towards zero, so a
+ * negative dividend is corrected by 2^k - 1 first (after cqo, rdx is
+ * all ones if rax is negative and zero otherwise):
+ * ----------------------------------------
+ *        mov     rax, x
+ *        cqo
+ *        and     rdx, 2^k - 1
+ *        add     x, rdx
+ *        sar     x, k            ; x / 2^k
+ *   or:  and     x, 2^k - 1
+ *        sub     x, rdx          ; x % 2^k
+ * ----------------------------------------
+ * Where x cannot be negative, range.c leaves a plain shift or mask
+ * instead (see nasmShiftRight() and nasmAndImmediate()).
+ *
+ * @r: Index of the dividend register.
+ * @divisor: The divisor, a power of two from 2 on.
+ * @remainder: Whether to compute the remainder instead.
+ *
+ * Returns: Index of the register containing the result.
+ */
+int nasmDivPowerOfTwo(int r, int divisor, int remainder) {
+    fprintf(Outfile, "\tmov\trax, %s\n", qwordRegisterList[r]);
+    fprintf(Outfile, "\tcqo\n");
+    fprintf(Outfile, "\tand\trdx, %d\n", divisor - 1);
+    fprintf(Outfile, "\tadd\t%s, rdx\n", qwordRegisterList[r]);
+    if (remainder) {
+        fprintf(Outfile, "\tand\t%s, %d\n", qwordRegisterList[r],
+                divisor - 1);
+        fprintf(Outfile, "\tsub\t%s, rdx\n", qwordRegisterList[r]);
+    } else {
+        fprintf(Outfile, "\tsar\t%s, %d\n", qwordRegisterList[r],
+                __builtin_ctz(divisor));
+    }
+    return r;
+}
+
+/**
+ * nasmShiftRight - Generates code to shift a register right, keeping
+ * its sign.
+ *
+ * @r: Index of the register.
+ * @bits: Number of bits to shift by.
+ *
+ * Returns: Index of the register containing the result.
+ */
+int nasmShiftRight(int r, int bits) {
+    fprintf(Outfile, "\tsar\t%s, %d\n", qwordRegisterList[r], bits);
+    return r;
+}
+
+/**
+ * nasmAndImmediate - Generates code to mask a register.
+ *
+ * @r: Index of the register.
+ * @mask: The mask (sign-extended from 32 bits).
+ *
+ * Returns: Index of the register containing the result.
+ */
+int nasmAndImmediate(int r, int mask) {
+    fprintf(Outfile, "\tand\t%s, %d\n", qwordRegisterList[r], mask);
+    return r;
+}
+
+/**
+ * pushLocals - Saves the registers of locals a call must not clobber.
+ *
+ * @live: Mask of local registers (see regalloc.c).
+ */
+static void pushLocals(int live) {
+    for (int i = 0; i < LOCAL_REGISTERS; i++) {
+        if (live & (1 << i)) {
+            fprintf(Outfile, "\tpush\t%s\n", localRegisterList[i]);
+            pushedWords++;
+        }
+    }
+}
+
+/**
+ * popLocals - Restores what pushLocals() saved.
+ *
+ * @live: The same mask.
+ */
+static void popLocals(int live) {
+    for (int i = LOCAL_REGISTERS - 1; i >= 0; i--) {
+        if (live & (1 << i)) {
+            fprintf(Outfile, "\tpop\t%s\n", localRegisterList[i]);
+            pushedWords--;
+        }
+    }
+}
+
 /**
  * nasmPrintIntFromReg - Generates code to print an integer value from a
  * register.
  *
  * @r: Index of the register containing the integer to print.
+ * @live: Registers of locals live across the call (see regalloc.c).
  */
-void nasmPrintIntFromReg(int r) {
+void nasmPrintIntFromReg(int r, int live) {
+    int pad;
+
+    pushLocals(live);
+    pad = pushedWords % 2;
     fprintf(Outfile, "\tmov\trdi, %s\n", qwordRegisterList[r]);
+    if (pad) {
+        fputs("\tsub\trsp, 8\n", Outfile);
+    }
     fprintf(Outfile, "\tcall\tprintint\n");
+    if (pad) {
+        fputs("\tadd\trsp, 8\n", Outfile);
+    }
+    popLocals(live);
     freeRegister(r);
 }
 
@@ -265,10 +781,10 @@ void nasmPrintIntFromReg(int r) {
 int nasmCompareAndSet(int ASTop, int r1, int r2) {
     if (!((ASTop == A_EQ) || (ASTop == A_NE) || (ASTop == A_LT) ||
           (ASTop == A_LE) || (ASTop == A_GT) || (ASTop == A_GE))) {
-        fprintf(stderr,
+        fprintf(Errfile,
                 "Error: Invalid AST operation %d in nasmCompareAndSet\n",
                 ASTop);
-        exit(1);
+        fatalExit();
     }
 
     fprintf(Outfile, "\tcmp\t%s, %s\n", qwordRegisterList[r1],
@@ -296,10 +812,10 @@ int nasmCompareAndSet(int ASTop, int r1, int r2) {
         fprintf(Outfile, "\tsetge\t%s\n", byteRegister);
         break;
     default:
-        fprintf(stderr,
+        fprintf(Errfile,
                 "Error: Unknown AST operation %d in nasmCompareAndSet\n",
                 ASTop);
-        exit(1);
+        fatalExit();
     }
 
     // Zero-extend the result to the full register
@@ -331,17 +847,22 @@ void nasmJump(int label) { fprintf(Outfile, "\tjmp\tL%d\n", label); }
  * @ASTop: The AST operation code representing the comparison.
  * @r1: Index of the first register.
  * @r2: Index of the second register.
- * @label: The label number to jump to if the comparison is true.
+ * @label: The label number to jump to if the comparison is false.
+ *
+ * NOTE:
+ * Only the two compared registers are freed, so a chain of these
+ * (see codegenBranch() in gen.c) may sit inside a larger expression
+ * whose other registers stay live.
  *
  * Returns: NOREG (indicating no register is returned).
  */
 int nasmCompareAndJump(int ASTop, int r1, int r2, int label) {
     if (!((ASTop == A_EQ) || (ASTop == A_NE) || (ASTop == A_LT) ||
           (ASTop == A_LE) || (ASTop == A_GT) || (ASTop == A_GE))) {
-        fprintf(stderr,
+        fprintf(Errfile,
                 "Error: Invalid AST operation %d in nasmCompareAndJump\n",
                 ASTop);
-        exit(1);
+        fatalExit();
     }
 
     fprintf(Outfile, "\tcmp\t%s, %s\n", qwordRegisterList[r1],
@@ -375,13 +896,432 @@ int nasmCompareAndJump(int ASTop, int r1, int r2, int label) {
         fprintf(Outfile, "\tjl\tL%d\n", label);
         break;
     default:
-        fprintf(stderr,
+        fprintf(Errfile,
                 "Error: Unknown AST operation %d in nasmCompareAndJump\n",
                 ASTop);
-        exit(1);
+        fatalExit();
     }
 
-    nasmResetRegisterPool();
+    freeRegister(r1);
+    freeRegister(r2);
 
     return NOREG;
 }
+
+/**
+ * nasmBranchCounter - Generates code to bump one branch profiling counter.
+ *
+ * @branchId: The id of the IF statement.
+ * @slot: Which of the statement's counters to bump (PROFILE_SLOT_*).
+ */
+void nasmBranchCounter(int branchId, int slot) {
+    fprintf(Outfile, "\tinc\tqword [keccc_prof+%d]\n",
+            (branchId * 2 + slot) * 8);
+}
+
+/**
+ * nasmProfileRuntime - Outputs the branch counter array and the routine
+ * that dumps it to PROFILE_DEFAULT_PATH.
+ *
+ * NOTE:
+ * The file format is the one read back by profileLoad():
+ * one "<id> <taken> <not taken>" line per if statement.
+ *
+ * @branchCount: Number of if statements that own counters.
+ */
+void nasmProfileRuntime(int branchCount) {
+    fputs("\textern\tfopen\n"
+          "\textern\tfprintf\n"
+          "\textern\tfclose\n"
+          "keccc_prof_path:\tdb\t\"" PROFILE_DEFAULT_PATH "\",0\n"
+          "keccc_prof_mode:\tdb\t\"w\",0\n"
+          "keccc_prof_header:\tdb\t\"# keccc branch profile v1\",10,0\n"
+          "keccc_prof_line:\tdb\t\"%ld %ld %ld\",10,0\n"
+          "\n"
+
+          "keccc_prof_dump:\n"
+          "\tpush\trbp\n"
+          "\tmov\trbp, rsp\n"
+          "\tpush\trbx\n"
+          "\tpush\tr12\n"
+          "\tlea\trdi, [rel keccc_prof_path]\n"
+          "\tlea\trsi, [rel keccc_prof_mode]\n"
+          "\tcall\tfopen\n"
+          "\ttest\trax, rax\n"
+          "\tjz\t.done\n"
+          "\tmov\trbx, rax\n"
+          "\tmov\trdi, rbx\n"
+          "\tlea\trsi, [rel keccc_prof_header]\n"
+          "\tmov\teax, 0\n"
+          "\tcall\tfprintf\n"
+          "\tmov\tr12, 0\n"
+          ".loop:\n",
+          Outfile);
+    fprintf(Outfile, "\tcmp\tr12, %d\n", branchCount);
+    fputs("\tjge\t.close\n"
+          "\tmov\trax, r12\n"
+          "\tshl\trax, 4\n"
+          "\tmov\trdx, r12\n"
+          "\tmov\trcx, [keccc_prof+rax+8]\n" // taken
+          "\tmov\tr8, [keccc_prof+rax]\n"    // executed
+          "\tsub\tr8, rcx\n"                 // not taken
+          "\tmov\trdi, rbx\n"
+          "\tlea\trsi, [rel keccc_prof_line]\n"
+          "\tmov\teax, 0\n"
+          "\tcall\tfprintf\n"
+          "\tinc\tr12\n"
+          "\tjmp\t.loop\n"
+          ".close:\n"
+          "\tmov\trdi, rbx\n"
+          "\tcall\tfclose\n"
+          ".done:\n"
+          "\tpop\tr12\n"
+          "\tpop\trbx\n"
+          "\tpop\trbp\n"
+          "\tret\n"
+          "\n"
+
+          "\tsection\t.bss\n"
+          "\talignb\t8\n",
+          Outfile);
+    // Keep at least one counter pair so the symbol always exists
+    fprintf(Outfile, "keccc_prof:\tresq\t%d\n",
+            2 * (branchCount > 0 ? branchCount : 1));
+}
+
+/**
+ * nasmSourceLine - Attributes the following instructions to a source line.
+ *
+ * NOTE:
+ * "%line N+0 file" makes NASM report every following line as line N
+ * of file until the next %line. Assembled with `nasm -g -F dwarf`,
+ * this becomes the .debug_line table used by addr2line/perf annotate.
+ *
+ * @line: The source line number.
+ * @filename: The source file name.
+ */
+void nasmSourceLine(int line, char *filename) {
+    fprintf(Outfile, "%%line %d+0 %s\n", line, filename);
+}
+
+/**
+ * nasmCacheStore - Generates code to keep a copy of a register in a
+ * CSE cache slot.
+ *
+ * @r: Index of the register holding the value.
+ * @slot: The cache slot to fill.
+ *
+ * Returns: Index of the register (still holding the value).
+ */
+int nasmCacheStore(int r, int slot) {
+    fprintf(Outfile, "\tmov\t%s, %s\n", cacheRegisterList[slot],
+            qwordRegisterList[r]);
+    return r;
+}
+
+/**
+ * nasmCacheLoad - Generates code to copy a CSE cache slot into a fresh
+ * register.
+ *
+ * @slot: The cache slot to read.
+ *
+ * Returns: Index of the register containing the copy.
+ */
+int nasmCacheLoad(int slot) {
+    int registerIndex = allocateRegister();
+
+    fprintf(Outfile, "\tmov\t%s, %s\n", qwordRegisterList[registerIndex],
+            cacheRegisterList[slot]);
+    return registerIndex;
+}
+
+/**
+ * nasmSelect - Generates code to pick one of two registers based on a
+ * comparison, without branching.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @r1: Index of the first compared register.
+ * @r2: Index of the second compared register.
+ * @rTrue: Index of the register holding the value if the comparison holds.
+ * @rFalse: Index of the register holding the value otherwise.
+ *
+ * Returns: Index of the register containing the selected value (rTrue).
+ */
+int nasmSelect(int ASTop, int r1, int r2, int rTrue, int rFalse) {
+    char *cmov;
+
+    // Move the 'false' value in when the comparison FAILS
+    switch (ASTop) {
+    case A_EQ:
+        cmov = "cmovne";
+        break;
+    case A_NE:
+        cmov = "cmove";
+        break;
+    case A_LT:
+        cmov = "cmovge";
+        break;
+    case A_LE:
+        cmov = "cmovg";
+        break;
+    case A_GT:
+        cmov = "cmovle";
+        break;
+    case A_GE:
+        cmov = "cmovl";
+        break;
+    default:
+        fprintf(Errfile, "Error: Invalid AST operation %d in nasmSelect\n",
+                ASTop);
+        fatalExit();
+    }
+
+    fprintf(Outfile, "\tcmp\t%s, %s\n", qwordRegisterList[r1],
+            qwordRegisterList[r2]);
+    fprintf(Outfile, "\t%s\t%s, %s\n", cmov, qwordRegisterList[rTrue],
+            qwordRegisterList[rFalse]);
+    freeRegister(r1);
+    freeRegister(r2);
+    freeRegister(rFalse);
+
+    return rTrue;
+}
+
+/**
+ * nasmCaseJump - Generates one step of a switch statement's compare
+ * tree: jumps to a case when the selector equals its value.
+ *
+ * @r: Index of the register holding the selector.
+ * @value: The case value.
+ * @labelEqual: The case's label.
+ * @labelGreater: Label to jump to when the selector is greater,
+ *                or NOREG to fall through.
+ */
+void nasmCaseJump(int r, int value, int labelEqual, int labelGreater) {
+    fprintf(Outfile, "\tcmp\t%s, %d\n", qwordRegisterList[r], value);
+    fprintf(Outfile, "\tje\tL%d\n", labelEqual);
+    if (labelGreater != NOREG) {
+        fprintf(Outfile, "\tjg\tL%d\n", labelGreater);
+    }
+}
+
+/**
+ * nasmJumpTable - Generates a switch statement's dispatch through a
+ * table of case addresses.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        sub   r, low          ; selector - lowest case value
+ *        cmp   r, count - 1
+ *        ja    Ldefault        ; unsigned: also catches r < low
+ *        jmp   qword [Ltable + r*8]
+ *        section .rodata
+ * Ltable:
+ *        dq    Lcase, Ldefault, Lcase, ...
+ *        section .text
+ * ----------------------------------------
+ * The register is clobbered.
+ *
+ * @r: Index of the register holding the selector.
+ * @low: The lowest case value.
+ * @labels: The label of each value from low on (holes jump to default).
+ * @count: Number of table entries.
+ * @labelDefault: The label for values outside the table.
+ * @labelTable: The label to give the table.
+ */
+void nasmJumpTable(int r, int low, int *labels, int count, int labelDefault,
+                   int labelTable) {
+    char *reg = qwordRegisterList[r];
+
+    if (low != 0) {
+        fprintf(Outfile, "\tsub\t%s, %d\n", reg, low);
+    }
+    fprintf(Outfile, "\tcmp\t%s, %d\n", reg, count - 1);
+    fprintf(Outfile, "\tja\tL%d\n", labelDefault);
+    fprintf(Outfile, "\tjmp\tqword [L%d+%s*8]\n", labelTable, reg);
+
+    fputs("\tsection\t.rodata\n"
+          "\talign\t8\n",
+          Outfile);
+    fprintf(Outfile, "L%d:\n", labelTable);
+    for (int i = 0; i < count; i++) {
+        fprintf(Outfile, "\tdq\tL%d\n", labels[i]);
+    }
+    fputs("\tsection\t.text\n", Outfile);
+}
+
+/**
+ * nasmFunctionPreamble - Outputs the prologue of a function.
+ *
+ * NOTE:
+ * The frame keeps the CSE registers and rbx of the caller and gives
+ * every parameter an 8-byte slot below them, then every stack slot of
+ * the locals (see allocateLocals()):
+ * ----------------------------------------
+ *   [rbp+8]              return address
+ *   [rbp]                caller's rbp
+ *   [rbp-8] .. [rbp-32]  r12 .. r15
+ *   [rbp-40]             rbx
+ *   [rbp-48]             first parameter (from rdi)
+ *   [rbp-56]             second parameter (from rsi), and so on
+ *   ...                  the locals' slots
+ * ----------------------------------------
+ * main has the same frame without parameters. The slots are rounded
+ * up, so calls made from the body find the stack 16-byte aligned.
+ *
+ * @name: The name of the function.
+ * @parameters: Number of parameters.
+ * @spillSlots: Stack slots of its locals.
+ */
+void nasmFunctionPreamble(char *name, int parameters, int spillSlots) {
+    nasmResetRegisterPool();
+    pushedWords = 0;
+    frameParameters = parameters;
+
+    fprintf(Outfile, "\n%s:\n", name);
+    fputs("\tpush\trbp\n"
+          "\tmov\trbp, rsp\n"
+          "\tpush\tr12\n"
+          "\tpush\tr13\n"
+          "\tpush\tr14\n"
+          "\tpush\tr15\n"
+          "\tpush\trbx\n",
+          Outfile);
+    fprintf(Outfile, "\tsub\trsp, %d\n", frameSize(parameters + spillSlots));
+    for (int i = 0; i < parameters; i++) {
+        fprintf(Outfile, "\tmov\t[rbp-%d], %s\n", 48 + 8 * i,
+                argumentRegisterList[i]);
+    }
+}
+
+/**
+ * nasmFunctionPostamble - Outputs the epilogue of a function.
+ *
+ * NOTE:
+ * A body that ends without a return statement returns 0;
+ * the return statements jump to returnLabel with their value in rax.
+ *
+ * @returnLabel: The label number of the epilogue.
+ */
+void nasmFunctionPostamble(int returnLabel) {
+    fputs("\tmov\teax, 0\n", Outfile);
+    fprintf(Outfile, "L%d:\n", returnLabel);
+    fputs("\tlea\trsp, [rbp-40]\n"
+          "\tpop\trbx\n"
+          "\tpop\tr15\n"
+          "\tpop\tr14\n"
+          "\tpop\tr13\n"
+          "\tpop\tr12\n"
+          "\tpop\trbp\n"
+          "\tret\n",
+          Outfile);
+    frameParameters = 0; // back in main
+}
+
+/**
+ * nasmReturn - Generates a return statement.
+ *
+ * @r: Index of the register containing the value to return.
+ * @returnLabel: The label number of the function's epilogue.
+ */
+void nasmReturn(int r, int returnLabel) {
+    fprintf(Outfile, "\tmov\trax, %s\n", qwordRegisterList[r]);
+    fprintf(Outfile, "\tjmp\tL%d\n", returnLabel);
+    freeRegister(r);
+}
+
+/**
+ * nasmSaveRegisters - Pushes the registers in use before a call, which
+ * may clobber them, and frees them for computing the arguments.
+ *
+ * NOTE:
+ * The registers of locals live across the call are pushed first;
+ * the arguments may still read them, since nasmCall() only overwrites
+ * the argument registers once every argument is computed.
+ *
+ * @live: Registers of locals live across the call (see regalloc.c).
+ *
+ * Returns: A mask of the saved registers, for nasmCall().
+ */
+int nasmSaveRegisters(int live) {
+    int registerCount = sizeof(freeRegisters) / sizeof(freeRegisters[0]);
+    int saved = live << registerCount;
+
+    pushLocals(live);
+    for (int i = 0; i < registerCount; i++) {
+        if (!freeRegisters[i]) {
+            fprintf(Outfile, "\tpush\t%s\n", qwordRegisterList[i]);
+            pushedWords++;
+            freeRegisters[i] = 1;
+            saved |= 1 << i;
+        }
+    }
+    return saved;
+}
+
+/**
+ * nasmPushArgument - Generates code to pass an argument of a call.
+ *
+ * NOTE:
+ * Arguments are pushed as they are computed, since computing a later
+ * one may call another function; nasmCall() pops them into the
+ * argument registers.
+ *
+ * @r: Index of the register containing the argument.
+ */
+void nasmPushArgument(int r) {
+    fprintf(Outfile, "\tpush\t%s\n", qwordRegisterList[r]);
+    pushedWords++;
+    freeRegister(r);
+}
+
+/**
+ * nasmCall - Generates a call to a function.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        pop   r9 ... rdi      ; the pushed arguments, last first
+ *        sub   rsp, 8          ; if an odd number of words is pushed
+ *        call  name
+ *        add   rsp, 8
+ *        pop   ...             ; the saved registers, then locals
+ *        mov   r, rax
+ * ----------------------------------------
+ *
+ * @name: The name of the function.
+ * @arguments: Number of arguments pushed by nasmPushArgument().
+ * @saved: The registers saved by nasmSaveRegisters().
+ *
+ * Returns: Index of the register containing the returned value.
+ */
+int nasmCall(char *name, int arguments, int saved) {
+    int registerCount = sizeof(freeRegisters) / sizeof(freeRegisters[0]);
+    int pad, r;
+
+    for (int i = arguments - 1; i >= 0; i--) {
+        fprintf(Outfile, "\tpop\t%s\n", argumentRegisterList[i]);
+        pushedWords--;
+    }
+
+    // The ABI wants rsp 16-byte aligned at the call
+    pad = pushedWords % 2;
+    if (pad) {
+        fputs("\tsub\trsp, 8\n", Outfile);
+    }
+    fprintf(Outfile, "\tcall\t%s\n", name);
+    if (pad) {
+        fputs("\tadd\trsp, 8\n", Outfile);
+    }
+
+    for (int i = registerCount - 1; i >= 0; i--) {
+        if (saved & (1 << i)) {
+            fprintf(Outfile, "\tpop\t%s\n", qwordRegisterList[i]);
+            pushedWords--;
+            freeRegisters[i] = 0;
+        }
+    }
+    popLocals(saved >> registerCount);
+    r = allocateRegister();
+    fprintf(Outfile, "\tmov\t%s, rax\n", qwordRegisterList[r]);
+    return r;
+}
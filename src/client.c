@@ -0,0 +1,166 @@
+// src/client.c
+
+/**
+ * NOTE:
+ * keccc-client: drop-in replacement for the keccc command line
+ *
+ * Takes the same arguments as keccc, but hands the job to a running
+ * `keccc --server` (protocol in ipc.c) and writes the returned code
+ * where keccc would (out.s/out.ll/out.ast, the -o file, or standard
+ * output), worked out from its own arguments rather than the server's.
+ * An input file of "-" sends standard input as inline source.
+ */
+
+#include "decl.h"
+#include "defs.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * readStdin - Reads all of standard input.
+ *
+ * @param size Receives the number of bytes read.
+ *
+ * @return The bytes (malloc'd).
+ */
+static char *readStdin(long *size) {
+    char *buf = NULL;
+    long used = 0, capacity = 0;
+    size_t got;
+
+    do {
+        if (used == capacity) {
+            capacity = capacity ? capacity * 2 : BUFSIZ;
+            if ((buf = realloc(buf, capacity)) == NULL) {
+                fprintf(stderr, "Out of memory reading standard input\n");
+                exit(1);
+            }
+        }
+        got = fread(buf + used, 1, capacity - used, stdin);
+        used += got;
+    } while (got > 0);
+
+    *size = used;
+    return buf;
+}
+
+/**
+ * connectServer - Connects to the compile server.
+ *
+ * @return The connected socket (exits on failure).
+ */
+static int connectServer(void) {
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    ipcSocketPath(addr.sun_path, sizeof(addr.sun_path));
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr,
+                "Cannot reach keccc server at %s: %s "
+                "(start one with keccc --server)\n",
+                addr.sun_path, strerror(errno));
+        exit(1);
+    }
+    // The source goes to it, so it must be this user's own server
+    if (!ipcPeerIsUser(fd)) {
+        fprintf(stderr, "keccc server at %s runs as another user\n",
+                addr.sun_path);
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    char line[IPC_LINE_MAX];
+    char cwd[IPC_LINE_MAX];
+    char *name = NULL, *source = NULL, *output, *diagnostics;
+    long sourceBytes = -1, outputBytes, diagnosticBytes;
+    int fd, status, emitLLVM = 0, emitAST = 0;
+    FILE *f;
+
+    if (argc < 2 || argc - 1 > IPC_MAX_ARGS) {
+        fprintf(stderr, "Usage: %s [keccc options] infile\n", argv[0]);
+        exit(1);
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "Cannot get working directory: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    // The output goes where keccc would put it (see outputName())
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            name = argv[++i];
+        } else if (!strcmp(argv[i], "--profile-use") ||
+                   !strcmp(argv[i], "-j")) {
+            i++; // skip the option's argument
+        } else if (!strcmp(argv[i], "--emit-llvm")) {
+            emitLLVM = 1;
+        } else if (!strcmp(argv[i], "--emit-ast")) {
+            emitAST = 1;
+        } else if (!strcmp(argv[i], "-")) {
+            source = readStdin(&sourceBytes);
+        }
+    }
+    if (name == NULL) {
+        name = emitAST ? "out.ast" : emitLLVM ? "out.ll" : "out.s";
+    }
+
+    // Send the job
+    fd = connectServer();
+    snprintf(line, sizeof(line), IPC_MAGIC " %d %ld\n", argc - 1,
+             sourceBytes);
+    if (ipcWriteFull(fd, line, strlen(line)) < 0 ||
+        ipcWriteFull(fd, cwd, strlen(cwd)) < 0 ||
+        ipcWriteFull(fd, "\n", 1) < 0) {
+        goto lost;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (ipcWriteFull(fd, argv[i], strlen(argv[i])) < 0 ||
+            ipcWriteFull(fd, "\n", 1) < 0) {
+            goto lost;
+        }
+    }
+    if (source != NULL && ipcWriteFull(fd, source, sourceBytes) < 0) {
+        goto lost;
+    }
+
+    // Collect the reply
+    if (ipcReadLine(fd, line, sizeof(line)) < 0 ||
+        sscanf(line, IPC_MAGIC " %d %ld %ld", &status, &outputBytes,
+               &diagnosticBytes) != 3 ||
+        outputBytes < 0 || diagnosticBytes < 0) {
+        goto lost;
+    }
+    output = malloc(outputBytes + 1);
+    diagnostics = malloc(diagnosticBytes + 1);
+    if (output == NULL || diagnostics == NULL ||
+        ipcReadFull(fd, output, outputBytes) < 0 ||
+        ipcReadFull(fd, diagnostics, diagnosticBytes) < 0) {
+        goto lost;
+    }
+    close(fd);
+
+    fwrite(diagnostics, 1, diagnosticBytes, stderr);
+    if (status == 0) {
+        f = !strcmp(name, "-") ? stdout : fopen(name, "w");
+        if (f == NULL ||
+            fwrite(output, 1, outputBytes, f) != (size_t)outputBytes ||
+            fclose(f) != 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", name, strerror(errno));
+            exit(1);
+        }
+    }
+    exit(status);
+
+lost:
+    fprintf(stderr, "Lost connection to keccc server\n");
+    exit(1);
+}
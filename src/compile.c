@@ -0,0 +1,299 @@
+// src/compile.c
+
+/**
+ * NOTE:
+ * Compilation driver
+ * (shared by the command line, the compile server and libkeccc)
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// The program (or, with --stream, the statement) being compiled, which
+// resetCompilation() frees even when a fatal error cut it short
+static _Thread_local struct ASTnode *program = NULL;
+
+static void init() {
+    Line = 1;
+    Putback = '\n';
+}
+
+/**
+ * parseOptions - Sets the option globals from a command line.
+ *
+ * @argc: Number of arguments.
+ * @argv: The arguments; argv[0] is the program name.
+ * @profilePath: Receives the --profile-use path (NULL if not given).
+ *
+ * @return int Index of the input file argument, or -1 on a usage error.
+ */
+int parseOptions(int argc, char **argv, char **profilePath) {
+    int i, input = -1;
+
+    Backend = BACKEND_NASM;
+    UseInstructionSelection = 1;
+    UseCSE = 1;
+    IfConvert = 1;
+    JumpTables = 1;
+    BranchChains = 1;
+    InstrumentBranches = 0;
+    DebugLineInfo = 0;
+    UseCache = 0;
+    PrintStatistics = 0;
+    StreamStatements = 0;
+    VectorISA = VECTOR_SSE2;
+    InlineFunctions = 1;
+    RegisterLocals = 1;
+    UseValueRanges = 1;
+    Reassociate = 1;
+    ShareSubtrees = 1;
+    Superoptimize = 1;
+    OptimizeSize = 0;
+    ScanThread = 0;
+    CodegenJobs = 1;
+    EmitAST = 0;
+    FromAST = 0;
+    OutputPath = NULL;
+    *profilePath = NULL;
+    for (i = 1; i < argc; i++) {
+        // Exactly one input file ("-" is standard input)
+        if (argv[i][0] != '-' || argv[i][1] == '\0') {
+            if (input != -1) {
+                return -1;
+            }
+            input = i;
+        } else if (!strcmp(argv[i], "-g")) {
+            DebugLineInfo = 1;
+        } else if (!strcmp(argv[i], "--emit-llvm")) {
+            Backend = BACKEND_LLVM;
+        } else if (!strcmp(argv[i], "--no-isel")) {
+            UseInstructionSelection = 0;
+        } else if (!strcmp(argv[i], "--no-cse")) {
+            UseCSE = 0;
+        } else if (!strcmp(argv[i], "--no-if-convert")) {
+            IfConvert = 0;
+        } else if (!strcmp(argv[i], "--no-jump-tables")) {
+            JumpTables = 0;
+        } else if (!strcmp(argv[i], "--no-branch-chains")) {
+            BranchChains = 0;
+        } else if (!strcmp(argv[i], "--no-vectorize")) {
+            VectorISA = VECTOR_NONE;
+        } else if (!strcmp(argv[i], "--no-inline")) {
+            InlineFunctions = 0;
+        } else if (!strcmp(argv[i], "--no-regalloc")) {
+            RegisterLocals = 0;
+        } else if (!strcmp(argv[i], "--no-ranges")) {
+            UseValueRanges = 0;
+        } else if (!strcmp(argv[i], "--no-reassociate")) {
+            Reassociate = 0;
+        } else if (!strcmp(argv[i], "--no-share")) {
+            ShareSubtrees = 0;
+        } else if (!strcmp(argv[i], "--no-superopt")) {
+            Superoptimize = 0;
+        } else if (!strcmp(argv[i], "-Os")) {
+            OptimizeSize = 1;
+        } else if (!strcmp(argv[i], "-mavx2")) {
+            VectorISA = VECTOR_AVX2;
+        } else if (!strcmp(argv[i], "--instrument")) {
+            InstrumentBranches = 1;
+        } else if (!strcmp(argv[i], "--profile-use") && i + 1 < argc) {
+            *profilePath = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            OutputPath = argv[++i];
+        } else if (!strcmp(argv[i], "--stream")) {
+            StreamStatements = 1;
+        } else if (!strcmp(argv[i], "--scan-thread")) {
+            ScanThread = 1;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            CodegenJobs = atoi(argv[++i]);
+            if (CodegenJobs < 1 || CodegenJobs > CODEGEN_MAX_JOBS) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--emit-ast")) {
+            EmitAST = 1;
+        } else if (!strcmp(argv[i], "--from-ast")) {
+            FromAST = 1;
+        } else if (!strcmp(argv[i], "--cache")) {
+            UseCache = 1;
+        } else if (!strcmp(argv[i], "--stats")) {
+            PrintStatistics = 1;
+        } else {
+            return -1;
+        }
+    }
+
+    if (input == -1) {
+        return -1;
+    }
+
+    if (Backend == BACKEND_LLVM && (InstrumentBranches || *profilePath)) {
+        fprintf(Errfile, "--instrument and --profile-use are only supported "
+                         "by the NASM backend\n");
+        return -1;
+    }
+    if ((EmitAST && FromAST) || ((EmitAST || FromAST) && StreamStatements)) {
+        fprintf(Errfile, "--emit-ast and --from-ast exclude each other "
+                         "and --stream\n");
+        return -1;
+    }
+    return input;
+}
+
+/**
+ * outputName - Returns the file the output is written to:
+ * the -o path, out.ast with --emit-ast, or out.s/out.ll depending
+ * on the backend.
+ *
+ * @return char* The output file name ("-" for standard output).
+ */
+char *outputName(void) {
+    if (OutputPath != NULL) {
+        return OutputPath;
+    }
+    if (EmitAST) {
+        return "out.ast";
+    }
+    return (Backend == BACKEND_LLVM) ? "out.ll" : "out.s";
+}
+
+/**
+ * streamStatements - Compiles the program one top-level statement at
+ * a time (--stream).
+ *
+ * NOTE:
+ * Each statement is parsed, generated and freed before the next one is
+ * read, so memory stays constant however long the program is.
+ * Repeated subexpressions are only shared within a statement, and
+ * codegenPostamble() emits the global declarations at the end.
+ */
+static void streamStatements(void) {
+    leftBrace();
+    while (Token.token != T_RBRACE) {
+        trackNodes(1);
+        program = singleStatement();
+        trackNodes(0);
+        if (program == NULL) {
+            continue; // a declaration
+        }
+        program = inlineStatement(program);
+        if ((program = rangeStatement(program)) == NULL) {
+            continue; // an if or loop that never runs
+        }
+        reassociateChains(program);
+        program = mergeTails(program);
+        hashconsTree(program);
+        codegenAllocateLocals(program);
+        cseCountCandidates(program);
+        codegenAST(program, NOREG, 0);
+        codegenResetRegisters();
+        cseReset();
+        freeAST(program);
+        program = NULL;
+    }
+    rightBrace();
+}
+
+/**
+ * parseProgram - Parses the whole input into an AST.
+ *
+ * NOTE:
+ * The nodes are tracked while the parser runs (see trackNodes()), so
+ * a fatal error in the middle of it leaks none of them.
+ *
+ * @return struct ASTnode* The program.
+ */
+static struct ASTnode *parseProgram(void) {
+    struct ASTnode *tree;
+
+    trackNodes(1);
+    tree = parseParallel();
+    trackNodes(0);
+    return tree;
+}
+
+/**
+ * compileProgram - Compiles Infile into Outfile.
+ *
+ * NOTE:
+ * The program's AST stays until resetCompilation(), which frees it
+ * whether or not the compilation got to the end.
+ *
+ * @profilePath: Branch profile to lay out branches with (or NULL).
+ */
+void compileProgram(char *profilePath) {
+    init();
+
+    if (profilePath != NULL) {
+        profileLoad(profilePath);
+    }
+
+    if (FromAST) {
+        codegenPreamble();               // Emit preamble
+        program = copyAST(astRead());    // What --emit-ast parsed, to rewrite
+        program = rangeProgram(program); // Fold what value ranges decide
+        reassociateChains(program);      // Balance + and * chains
+        program = mergeTails(program);   // Share if/else tails (-Os)
+        hashconsTree(program);           // Share identical pure subtrees
+        codegenAllocateLocals(program);  // Place the locals
+        cseCountCandidates(program);     // Find repeated subexpressions
+        codegenParallel(program);        // Generate code (on -j threads)
+        codegenPostamble();              // Output the postamble
+        if (PrintStatistics) {
+            hashconsPrintStats();
+        }
+        return;
+    }
+
+    if (ScanThread) {
+        scanThreadStart(); // Scan ahead on another thread
+    }
+    scan(&Token); // First token
+    if (EmitAST) {
+        program = parseProgram();         // Parse the whole input into an AST
+        program = inlineProgram(program); // Inline function calls
+        astWrite(program);                // and write it out instead of code
+        scanThreadStop();
+        return;
+    }
+
+    codegenPreamble(); // Emit preamble(global, printint, main prologue)
+    if (StreamStatements) {
+        streamStatements(); // Parse and generate statement by statement
+    } else {
+        program = parseProgram();         // Parse the whole input into an AST
+        program = inlineProgram(program); // Inline function calls
+        program = rangeProgram(program);  // Fold what value ranges decide
+        reassociateChains(program);       // Balance + and * chains
+        program = mergeTails(program);    // Share if/else tails (-Os)
+        hashconsTree(program);            // Share identical pure subtrees
+        codegenAllocateLocals(program);   // Place the locals
+        cseCountCandidates(program);      // Find repeated subexpressions
+        codegenParallel(program);         // Generate code (on -j threads)
+    }
+    codegenPostamble(); // Output the postamble
+    scanThreadStop();
+    if (PrintStatistics) {
+        hashconsPrintStats();
+    }
+}
+
+/**
+ * resetCompilation - Returns every module to its startup state,
+ * so another program can be compiled in the same process.
+ */
+void resetCompilation(void) {
+    scanThreadStop();
+    codegenReset();
+    profileReset();
+    astReset();
+    inlineReset();
+    rangeReset();
+    hashconsReset();
+    parseReset();
+    treeReset(); // the nodes of an unfinished parse
+    freeAST(program);
+    program = NULL;
+    clearGlobalSymbols();
+    init();
+}
@@ -0,0 +1,422 @@
+// src/cse.c
+
+/**
+ * NOTE:
+ * Local common-subexpression elimination (hash-based value numbering)
+ *
+ * Two expression trees get the same value number when they have the same
+ * operator, the same leaf values and value-numbered-equal children.
+ * Code generation keeps the result of a repeated expression in one of
+ * NCSESLOTS cache slots (callee-saved registers in the NASM backend),
+ * and later occurrences copy it from there instead of recomputing it.
+ *
+ * A cached value stays valid until
+ * - an assignment writes to one of the identifiers it reads, or to an
+ *   element of an array it reads (cseKill), or
+ * - control flow merges at a label (cseFlush).
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// Buckets of the occurrence counting table
+#define CSEBUCKETS 1024
+
+// An entry of the occurrence counting table
+struct cseCount {
+    struct ASTnode *expr;   // representative tree
+    unsigned hash;          // its value-number hash
+    int count;              // occurrences seen in the program
+    struct cseCount *next;  // next entry in the bucket
+    struct cseCount *older; // previously created entry (see cseReset)
+};
+
+// A cached value available for reuse
+struct cseSlot {
+    struct ASTnode *expr; // tree whose value the slot holds (NULL if free)
+    unsigned hash;        // its value-number hash
+};
+
+static _Thread_local struct cseCount *countTable[CSEBUCKETS];
+// Most recently created entry; the entries are chained through 'older'
+static _Thread_local struct cseCount *newestCount = NULL;
+static _Thread_local struct cseSlot slots[NCSESLOTS];
+// Counting table of another thread, used instead of countTable by
+// parallel code generation workers (see cseBorrowCounts())
+static _Thread_local struct cseCount **borrowedCounts = NULL;
+
+/**
+ * isPureOperator - Checks whether an operator computes a value from its
+ * operands alone, without side effects.
+ *
+ * @param op The AST operator.
+ *
+ * @return 1 if the operator is pure, 0 otherwise.
+ */
+static int isPureOperator(int op) {
+    switch (op) {
+    case A_ADD:
+    case A_SUBTRACT:
+    case A_MULTIPLY:
+    case A_DIVIDE:
+    case A_MODULO:
+    case A_SHIFTRIGHT:
+    case A_BITAND:
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+    case A_LOGNOT:
+    case A_INTLIT:
+    case A_IDENTIFIER:
+    case A_INDEX:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * isPureExpression - Checks whether a whole tree is side-effect free.
+ *
+ * @param n The expression tree.
+ *
+ * @return 1 if every node is pure, 0 otherwise.
+ */
+static int isPureExpression(struct ASTnode *n) {
+    if (n == NULL) {
+        return 1;
+    }
+    return isPureOperator(n->op) && isPureExpression(n->left) &&
+           isPureExpression(n->right);
+}
+
+/**
+ * isWorthCaching - Checks whether a tree is an operator worth keeping.
+ *
+ * NOTE:
+ * Leaves are a single instruction to rematerialize, so only
+ * interior pure nodes take a cache slot.
+ *
+ * @param n The expression tree.
+ *
+ * @return 1 if the tree may be cached, 0 otherwise.
+ */
+static int isWorthCaching(struct ASTnode *n) {
+    return n->op != A_INTLIT && n->op != A_IDENTIFIER && isPureExpression(n);
+}
+
+/**
+ * valueHash - Computes the value-number hash of an expression tree.
+ *
+ * @param n The expression tree.
+ *
+ * @return The hash (equal trees hash equally).
+ */
+static unsigned valueHash(struct ASTnode *n) {
+    unsigned h;
+
+    if (n == NULL) {
+        return 0;
+    }
+
+    h = (unsigned)n->op * 31u;
+    if (n->op == A_INTLIT || n->op == A_IDENTIFIER || n->op == A_INDEX) {
+        h ^= (unsigned)n->v.intvalue * 2654435761u;
+    }
+    h = h * 16777619u ^ valueHash(n->left);
+    h = h * 16777619u ^ valueHash(n->right);
+    return h;
+}
+
+/**
+ * sameValue - Checks whether two trees compute the same value.
+ *
+ * @param a The first expression tree.
+ * @param b The second expression tree.
+ *
+ * @return 1 if they are structurally equal, 0 otherwise.
+ */
+static int sameValue(struct ASTnode *a, struct ASTnode *b) {
+    if (a == b) {
+        return 1;
+    }
+    if (a == NULL || b == NULL || a->op != b->op) {
+        return 0;
+    }
+    if ((a->op == A_INTLIT || a->op == A_IDENTIFIER || a->op == A_INDEX) &&
+        a->v.intvalue != b->v.intvalue) {
+        return 0;
+    }
+    return sameValue(a->left, b->left) && sameValue(a->right, b->right);
+}
+
+/**
+ * readsIdentifier - Checks whether a tree reads a given identifier
+ * (or an element of a given array).
+ *
+ * @param n The expression tree.
+ * @param identifierIndex The symbol table index of the identifier.
+ *
+ * @return 1 if the identifier occurs in the tree, 0 otherwise.
+ */
+static int readsIdentifier(struct ASTnode *n, int identifierIndex) {
+    if (n == NULL) {
+        return 0;
+    }
+    if ((n->op == A_IDENTIFIER || n->op == A_INDEX) &&
+        n->v.identifierIndex == identifierIndex) {
+        return 1;
+    }
+    return readsIdentifier(n->left, identifierIndex) ||
+           readsIdentifier(n->right, identifierIndex);
+}
+
+/**
+ * countOccurrence - Bumps the occurrence count of one expression tree.
+ *
+ * @param n The expression tree.
+ */
+static void countOccurrence(struct ASTnode *n) {
+    unsigned h = valueHash(n);
+    struct cseCount *e;
+
+    for (e = countTable[h % CSEBUCKETS]; e != NULL; e = e->next) {
+        if (e->hash == h && sameValue(e->expr, n)) {
+            e->count++;
+            return;
+        }
+    }
+
+    e = (struct cseCount *)malloc(sizeof(struct cseCount));
+    if (e == NULL) {
+        logFatal("Out of memory in countOccurrence()");
+    }
+    e->expr = n;
+    e->hash = h;
+    e->count = 1;
+    e->next = countTable[h % CSEBUCKETS];
+    countTable[h % CSEBUCKETS] = e;
+    e->older = newestCount;
+    newestCount = e;
+}
+
+/**
+ * countCondition - Counts the values computed by a condition.
+ *
+ * NOTE:
+ * Comparisons, && and || and ! become jumps (see codegenBranch()
+ * in gen.c), so only their operands and any other expression
+ * tested against zero are values.
+ *
+ * @param n The condition.
+ */
+static void countCondition(struct ASTnode *n) {
+    switch (n->op) {
+    case A_LOGAND:
+    case A_LOGOR:
+        countCondition(n->left);
+        countCondition(n->right);
+        return;
+    case A_LOGNOT:
+        countCondition(n->left);
+        return;
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+        cseCountCandidates(n->left);
+        cseCountCandidates(n->right);
+        return;
+    }
+    cseCountCandidates(n);
+}
+
+/**
+ * countStatement - Counts the candidates of one statement of a chain.
+ *
+ * @param link Where the statement hangs (see walkStatements()).
+ * @param arg Unused.
+ */
+static void countStatement(struct ASTnode **link, void *arg) {
+    (void)arg;
+    cseCountCandidates(*link);
+}
+
+/**
+ * cseCountCandidates - Counts how often each pure expression occurs,
+ * so codegen only spends cache slots on repeated ones.
+ *
+ * @param n The AST to scan (usually the whole program).
+ */
+void cseCountCandidates(struct ASTnode *n) {
+    // With nothing counted, no expression is a candidate (--no-cse)
+    if (n == NULL || !UseCSE) {
+        return;
+    }
+    if (n->op == A_GLUE) {
+        walkStatements(&n, countStatement, NULL);
+        return;
+    }
+
+    // An if or loop condition is turned into a jump, not a value
+    if (n->op == A_IF || n->op == A_WHILE) {
+        countCondition(n->left);
+        cseCountCandidates(n->middle);
+        cseCountCandidates(n->right);
+        return;
+    }
+
+    if (isWorthCaching(n)) {
+        countOccurrence(n);
+    }
+    cseCountCandidates(n->left);
+    cseCountCandidates(n->middle);
+    cseCountCandidates(n->right);
+}
+
+/**
+ * cseIsCandidate - Checks whether an expression occurs more than once.
+ *
+ * @param n The expression tree.
+ *
+ * @return 1 if its value is worth caching, 0 otherwise.
+ */
+int cseIsCandidate(struct ASTnode *n) {
+    struct cseCount **table = borrowedCounts ? borrowedCounts : countTable;
+    unsigned h;
+    struct cseCount *e;
+
+    if (!isWorthCaching(n)) {
+        return 0;
+    }
+
+    h = valueHash(n);
+    for (e = table[h % CSEBUCKETS]; e != NULL; e = e->next) {
+        if (e->hash == h && sameValue(e->expr, n)) {
+            return e->count > 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * cseHasCandidates - Checks whether generating a tree may leave a value
+ * in the cache.
+ *
+ * @param n The tree.
+ *
+ * @return 1 if some subtree is a candidate, 0 otherwise.
+ */
+int cseHasCandidates(struct ASTnode *n) {
+    if (n == NULL) {
+        return 0;
+    }
+    return cseIsCandidate(n) || cseHasCandidates(n->left) ||
+           cseHasCandidates(n->middle) || cseHasCandidates(n->right);
+}
+
+/**
+ * cseShareCounts - Returns this thread's occurrence counts,
+ * for code generation workers to borrow.
+ *
+ * @return The counting table.
+ */
+struct cseCount **cseShareCounts(void) {
+    return borrowedCounts ? borrowedCounts : countTable;
+}
+
+/**
+ * cseBorrowCounts - Makes cseIsCandidate() read another thread's
+ * occurrence counts, which must stay unchanged while borrowed.
+ *
+ * @param table A table from cseShareCounts(), or NULL to stop borrowing.
+ */
+void cseBorrowCounts(struct cseCount **table) { borrowedCounts = table; }
+
+/**
+ * cseLookup - Finds a cache slot holding the value of an expression.
+ *
+ * @param n The expression tree.
+ *
+ * @return The slot index, or NOREG if the value is not available.
+ */
+int cseLookup(struct ASTnode *n) {
+    unsigned h = valueHash(n);
+
+    for (int i = 0; i < NCSESLOTS; i++) {
+        if (slots[i].expr != NULL && slots[i].hash == h &&
+            sameValue(slots[i].expr, n)) {
+            return i;
+        }
+    }
+    return NOREG;
+}
+
+/**
+ * cseRecord - Reserves a cache slot for the value of an expression.
+ *
+ * @param n The expression tree just computed.
+ *
+ * @return The slot index, or NOREG if every slot is in use.
+ */
+int cseRecord(struct ASTnode *n) {
+    for (int i = 0; i < NCSESLOTS; i++) {
+        if (slots[i].expr == NULL) {
+            slots[i].expr = n;
+            slots[i].hash = valueHash(n);
+            return i;
+        }
+    }
+    return NOREG;
+}
+
+/**
+ * cseKill - Drops every cached value that reads an identifier.
+ * Called after the identifier has been assigned.
+ *
+ * @param identifierIndex The symbol table index of the identifier.
+ */
+void cseKill(int identifierIndex) {
+    for (int i = 0; i < NCSESLOTS; i++) {
+        if (slots[i].expr != NULL &&
+            readsIdentifier(slots[i].expr, identifierIndex)) {
+            slots[i].expr = NULL;
+        }
+    }
+}
+
+/**
+ * cseReset - Forgets the occurrence counts and every cached value.
+ *
+ * NOTE:
+ * Walks the entries rather than the buckets, as --stream resets
+ * after every statement.
+ */
+void cseReset(void) {
+    struct cseCount *e, *older;
+
+    for (e = newestCount; e != NULL; e = older) {
+        older = e->older;
+        countTable[e->hash % CSEBUCKETS] = NULL;
+        free(e);
+    }
+    newestCount = NULL;
+    cseFlush();
+}
+
+/**
+ * cseFlush - Drops every cached value.
+ * Called where control flow merges, since the value may not have been
+ * computed on every incoming path.
+ */
+void cseFlush(void) {
+    for (int i = 0; i < NCSESLOTS; i++) {
+        slots[i].expr = NULL;
+    }
+}
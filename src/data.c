@@ -0,0 +1,7 @@
+// src/data.c
+
+// Definitions of the globals declared in data.h
+
+#define extern_
+#include "data.h"
+#undef extern_
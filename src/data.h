@@ -7,18 +7,75 @@
 #include "defs.h"
 #include <stdio.h> // Just for FILE
 
+// NOTE:
+// Every global is thread-local, so each thread compiles with its own
+// state and libkeccc (libkeccc.c) can be used from several threads.
+
 // Current Line number
-extern_ int Line;
+extern_ _Thread_local int Line;
 // Character put back by scanner for re-reading
-extern_ int Putback;
+extern_ _Thread_local int Putback;
 // Input file (source code)
-extern_ FILE *Infile;
+extern_ _Thread_local FILE *Infile;
+// Input file name, as given on the command line
+extern_ _Thread_local char *Infilename;
 // Output file (generated code, currently Assembly)
-extern_ FILE *Outfile;
+extern_ _Thread_local FILE *Outfile;
+// Output file name given with -o (NULL for out.s/out.ll)
+extern_ _Thread_local char *OutputPath;
+// Diagnostics file (stderr, or a buffer when compiling in memory)
+extern_ _Thread_local FILE *Errfile;
+// Selected code generator (BACKEND_NASM or BACKEND_LLVM)
+extern_ _Thread_local int Backend;
+// Whether to count how often each if statement's branches run
+extern_ _Thread_local int InstrumentBranches;
+// Whether to emit source line information for debuggers/profilers
+extern_ _Thread_local int DebugLineInfo;
+// Whether the NASM backend uses the tree-pattern instruction selector
+extern_ _Thread_local int UseInstructionSelection;
+// Whether small if statements may become branchless selects (cmov)
+extern_ _Thread_local int IfConvert;
+// Whether a switch with dense cases may use a jump table, see gen.c
+extern_ _Thread_local int JumpTables;
+// Whether conditions jump on each comparison rather than test a 0 or 1
+extern_ _Thread_local int BranchChains;
+// Whether locals may live in registers, see regalloc.c
+extern_ _Thread_local int RegisterLocals;
+// Whether to reuse the values of repeated expressions, see cse.c
+extern_ _Thread_local int UseCSE;
+// Whether to generate code statement by statement as they are parsed
+extern_ _Thread_local int StreamStatements;
+// Vector instructions for vectorized loops (VECTOR_*), see vectorize.c
+extern_ _Thread_local int VectorISA;
+// Whether to inline small and single-call functions, see inline.c
+extern_ _Thread_local int InlineFunctions;
+// Whether to fold what value ranges decide, see range.c
+extern_ _Thread_local int UseValueRanges;
+// Whether to rebalance + and * chains, see reassociate.c
+extern_ _Thread_local int Reassociate;
+// Whether identical pure subtrees share their nodes, see hashcons.c
+extern_ _Thread_local int ShareSubtrees;
+// Whether to multiply by constants with superopt.h's sequences
+extern_ _Thread_local int Superoptimize;
+// Whether to generate smaller code (-Os), see cgn.c and tailmerge.c
+extern_ _Thread_local int OptimizeSize;
+// Whether to run the scanner on its own thread
+extern_ _Thread_local int ScanThread;
+// Number of threads generating code (-j), see parallel.c
+extern_ _Thread_local int CodegenJobs;
+// Whether to write the parsed program instead of code (--emit-ast)
+extern_ _Thread_local int EmitAST;
+// Whether the input is a program written by --emit-ast (--from-ast)
+extern_ _Thread_local int FromAST;
+// Whether to reuse outputs from the compilation cache
+extern_ _Thread_local int UseCache;
+// Whether to print compile statistics (--stats), see hashcons.c
+extern_ _Thread_local int PrintStatistics;
 // Latest token scanned
-extern_ struct token Token;
+extern_ _Thread_local struct token Token;
 
 // Last identifier scanned (e.g. "print")
-extern_ char Text[TEXTLEN + 1];
+extern_ _Thread_local char Text[TEXTLEN + 1];
 // Global symbol table
-extern_ struct symbolTable GlobalSymbolTable[NSYMBOLS];
+// (grown as needed, see getNewGlobalSymbolIndex() in symbol.c)
+extern_ _Thread_local struct symbolTable *GlobalSymbolTable;
@@ -5,17 +5,152 @@
 #include "defs.h"
 
 /**
- * variableDeclaration - Parses a variable declaration.
+ * variableDeclaration - Parses the rest of a variable declaration.
  *
  * NOTE:
- * Currently, we only support integer variable declarations.
- * Thus, we ensure that the type is 'int', followed by an identifier
- * and a semicolon(;).
+ * Currently, we only support integer variables and fixed-size
+ * integer arrays. Thus, we ensure that the type is 'int', followed
+ * by an identifier, an optional '[' length ']' and a semicolon(;).
+ *
+ * @name: The variable's name ('int' and the name are already parsed).
+ */
+static void variableDeclaration(char *name) {
+    int length = 0;
+
+    if (Token.token == T_LBRACKET) {
+        leftBracket();
+        if (Token.token != T_INTLIT) {
+            logFatal("Array length must be an integer literal");
+        }
+        if (Token.intvalue <= 0 || Token.intvalue > ARRAY_MAX_LENGTH) {
+            logFatald("Bad array length ", Token.intvalue);
+        }
+        length = Token.intvalue;
+        scan(&Token);
+        rightBracket();
+    }
+
+    declareGlobalSymbol(name, length);
+    semicolon();
+}
+
+/**
+ * functionDeclaration - Parses the rest of a function definition.
+ *
+ * NOTE:
+ * ----------------------------------------
+ * int name(int a, int b) { ... }
+ * ----------------------------------------
+ * becomes an A_FUNCTION node whose left child is the body. The
+ * parameters are symbols of their own (see addParameter()), visible
+ * in a scope around the body.
+ *
+ * @name: The function's name ('int' and the name are already parsed).
+ *
+ * @return AST node representing the function.
+ */
+static struct ASTnode *functionDeclaration(char *name) {
+    char names[FUNCTION_MAX_PARAMETERS][TEXTLEN + 1];
+    struct ASTnode *body, *n;
+    int count = 0, id, line = Line;
+
+    if (!strcmp(name, "main") || !strcmp(name, "printint") ||
+        !strcmp(name, "printf")) {
+        logFatals("Reserved function name: ", name);
+    }
+
+    leftParenthesis();
+    while (Token.token != T_RPAREN) {
+        if (count > 0) {
+            match(T_COMMA, ",");
+        }
+        if (count == FUNCTION_MAX_PARAMETERS) {
+            logFatals("Too many parameters: ", name);
+        }
+        match(T_INT, "int");
+        identifier();
+        for (int i = 0; i < count; i++) {
+            if (!strcmp(names[i], Text)) {
+                logFatals("Duplicate parameter: ", Text);
+            }
+        }
+        strcpy(names[count++], Text);
+    }
+    rightParenthesis();
+
+    // The parameters follow each other in the symbol table
+    id = declareFunction(name, count);
+    openScope();
+    for (int i = 0; i < count; i++) {
+        addToScope(addParameter(names[i], i));
+    }
+
+    body = functionBody();
+    closeScope();
+
+    n = makeASTUnary(A_FUNCTION, body, id);
+    n->line = line; // where the definition starts, for -g
+    return n;
+}
+
+/**
+ * localDeclaration - Parses the rest of a local variable declaration.
+ *
+ * NOTE:
+ * ----------------------------------------
+ * { int x; ... }    ->    { x = 0; ... }
+ * ----------------------------------------
+ * A local is visible until the end of its block and starts out as 0,
+ * so the assignment is where its value (and its live range, see
+ * regalloc.c) begins.
+ *
+ * @name: The variable's name ('int' and the name are already parsed).
+ *
+ * @return AST node assigning the local its initial value.
  */
-void variableDeclaration(void) {
+static struct ASTnode *localDeclaration(char *name) {
+    struct ASTnode *n;
+    int id;
+
+    if (Token.token == T_LBRACKET) {
+        logFatals("Arrays must be declared at the top level: ", name);
+    }
+
+    id = addLocalSymbol(name);
+    addToScope(id);
+    n = makeASTNode(A_ASSIGN, makeASTLeaf(A_INTLIT, 0), NULL,
+                    makeASTLeaf(A_LVALUEIDENTIFIER, id), 0);
+    semicolon();
+    return n;
+}
+
+/**
+ * declaration - Parses a variable declaration or a function definition.
+ *
+ * @topLevel: Whether this is a statement of the program's block,
+ *            the only place functions and globals are declared.
+ *
+ * @return AST node representing a function or initializing a local,
+ *         NULL for a global.
+ */
+struct ASTnode *declaration(int topLevel) {
+    char name[TEXTLEN + 1];
+
     match(T_INT, "int");
     identifier(); // Text now has the identifier's name
-    addGlobalSymbol(Text);
-    codegenDeclareGlobalSymbol(Text);
-    semicolon();
+    strcpy(name, Text);
+
+    if (Token.token == T_LPAREN) {
+        if (!topLevel) {
+            logFatal("Functions can only be defined at the top level of "
+                     "the program");
+        }
+        return functionDeclaration(name);
+    }
+
+    if (!topLevel) {
+        return localDeclaration(name);
+    }
+    variableDeclaration(name);
+    return NULL;
 }
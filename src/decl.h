@@ -3,10 +3,26 @@
 // Declarations for scanner, parser, AST, interpreter, and code generator
 // Used in various source files
 
+#include <setjmp.h> // Just for jmp_buf
+#include <stddef.h> // Just for size_t
+#include <stdint.h> // Just for uint64_t
+#include <stdio.h>  // Just for FILE
+
 struct token;
+struct cseCount;
+struct codegenPosition;
+struct symbolEvent;
+struct symbolTable;
+struct switchCase;
 
 // NOTE: scan.c
 int scan(struct token *t);
+int scanInput(struct token *t);
+
+// NOTE: scanthread.c
+void scanThreadStart(void);
+int scanThreadNext(struct token *t);
+void scanThreadStop(void);
 
 // NOTE: tree.c
 struct ASTnode *makeASTNode(int op, struct ASTnode *left,
@@ -14,33 +30,112 @@ struct ASTnode *makeASTNode(int op, struct ASTnode *left,
                             int intvalue);
 struct ASTnode *makeASTLeaf(int op, int intvalue);
 struct ASTnode *makeASTUnary(int op, struct ASTnode *left, int intvalue);
+void walkStatements(struct ASTnode **link,
+                    void (*visit)(struct ASTnode **link, void *arg),
+                    void *arg);
+void freeAST(struct ASTnode *n);
+void treeReset(void);
+void trackNodes(int on);
+void freeTrackedNodes(void);
+struct ASTnode *copyAST(struct ASTnode *n);
+int isComparison(int op);
+int hasCall(struct ASTnode *n);
+int countArguments(struct ASTnode *call);
 
 // NOTE: gen.c (target-agnostic code generation)
 int codegenAST(struct ASTnode *n, int reg, int parentASTop);
 void codegenPreamble();
 void codegenPostamble();
+void codegenAllocateLocals(struct ASTnode *tree);
+void codegenReset(void);
+void codegenMoveColdCode(FILE *to);
+void codegenAddColdCode(char *code, size_t size);
+void codegenGetPosition(struct codegenPosition *pos);
+void codegenSetPosition(struct codegenPosition *pos);
+int codegenSkipStatement(struct ASTnode *n, struct codegenPosition *pos);
 void codegenResetRegisters();
-void codegenPrintInt(int reg);
-void codegenDeclareGlobalSymbol(char *s);
+void codegenPrintInt(int reg, int live);
+void codegenDeclareGlobalSymbol(char *s, int length);
+int codegenLoadImmediateInt(int value);
+int codegenLoadVariable(int identifierIndex);
+int codegenStoreVariable(int reg, int identifierIndex);
+int codegenLoadElement(int reg, int identifierIndex);
+int codegenStoreElement(int reg, int indexReg, int identifierIndex);
+int codegenAddRegs(int r1, int r2);
+int codegenSubRegs(int r1, int r2);
+int codegenMulRegs(int r1, int r2);
+int codegenDivRegsSigned(int r1, int r2);
+int codegenModRegsSigned(int r1, int r2);
+int codegenShiftRight(int r, int bits);
+int codegenAndImmediate(int r, int mask);
+int codegenCompareAndSet(int ASTop, int r1, int r2);
+int codegenCompareAndJump(int ASTop, int r1, int r2, int label);
+void codegenLabel(int label);
+int codegenSelect(int ASTop, int r1, int r2, int rTrue, int rFalse);
+int codegenSetBoolean(int reg, int value);
+int codegenMergeBoolean(int reg, int labelTrue, int labelFalse);
+void codegenJump(int label);
+void codegenFunctionPreamble(char *name, int parameters, int spillSlots);
+void codegenFunctionPostamble(int returnLabel);
+void codegenReturn(int reg, int returnLabel);
+int codegenSaveRegisters(int live);
+void codegenPushArgument(int reg);
+int codegenCall(int identifierIndex, int arguments, int saved);
+void codegenBranchCounter(int branchId, int slot);
+void codegenSourceLine(int line);
+int codegenCacheStore(int reg, int slot);
+int codegenCacheLoad(int slot);
 
 // NOTE: cgn.c
 // Code generation utilities (NASM x86-64)
 void nasmResetRegisterPool(void);
+int nasmAllocateRegister(void);
+void nasmFreeRegister(int r);
+char *nasmRegisterName(int r);
+char *nasmByteRegisterName(int r);
 void nasmPreamble();
-void nasmPostamble();
+void nasmPostamble(int spillSlots);
 int nasmLoadImmediateInt(int value);
-int nasmLoadGlobalSymbol(char *identifier);
-int nasmStoreGlobalSymbol(int registerIndex, char *identifier);
-void nasmDeclareGlobalSymbol(char *symbol);
+int nasmVariableInRegister(int identifierIndex);
+char *nasmVariableOperand(int identifierIndex);
+int nasmLoadVariable(int identifierIndex);
+int nasmStoreVariable(int registerIndex, int identifierIndex);
+int nasmLoadElement(int r, char *array);
+int nasmStoreElement(int registerIndex, int indexRegister, char *array);
+void nasmDeclareGlobalSymbol(char *symbol, int length);
 int nasmAddRegs(int dstReg, int srcReg);
 int nasmSubRegs(int dstReg, int srcReg);
 int nasmMulRegs(int dstReg, int srcReg);
+char *nasmMulSequence(int multiplier);
+int nasmMulConstant(int r, int multiplier);
 int nasmDivRegsSigned(int dividendReg, int divisorReg);
-void nasmPrintIntFromReg(int reg);
+int nasmModRegsSigned(int dividendReg, int divisorReg);
+int nasmDivPowerOfTwo(int r, int divisor, int remainder);
+int nasmShiftRight(int r, int bits);
+int nasmAndImmediate(int r, int mask);
+void nasmPrintIntFromReg(int reg, int live);
 int nasmCompareAndSet(int ASTop, int r1, int r2);
 int nasmCompareAndJump(int ASTop, int r1, int r2, int label);
+int nasmSelect(int ASTop, int r1, int r2, int rTrue, int rFalse);
+int nasmMoveImmediate(int r, int value);
+void nasmImmediateText(int r, int identifierIndex, int value);
+void nasmChoosePool(int avoid);
 void nasmLabel(int label);
 void nasmJump(int label);
+void nasmBranchCounter(int branchId, int slot);
+void nasmSourceLine(int line, char *filename);
+int nasmCacheStore(int r, int slot);
+int nasmCacheLoad(int slot);
+void nasmProfileRuntime(int branchCount);
+void nasmFunctionPreamble(char *name, int parameters, int spillSlots);
+void nasmFunctionPostamble(int returnLabel);
+void nasmReturn(int r, int returnLabel);
+int nasmSaveRegisters(int live);
+void nasmPushArgument(int r);
+int nasmCall(char *name, int arguments, int saved);
+void nasmCaseJump(int r, int value, int labelEqual, int labelGreater);
+void nasmJumpTable(int r, int low, int *labels, int count, int labelDefault,
+                   int labelTable);
 // int nasmCompareEqual(int r1, int r2);
 // int nasmCompareNotEqual(int r1, int r2);
 // int nasmCompareLessThan(int r1, int r2);
@@ -48,32 +143,191 @@ void nasmJump(int label);
 // int nasmCompareGreaterThan(int r1, int r2);
 // int nasmCompareGreaterThanOrEqual(int r1, int r2);
 
+// NOTE: isel.c
+// Tree-pattern instruction selection (NASM x86-64)
+int iselStatement(struct ASTnode *n);
+int iselCondition(struct ASTnode *cond, int jumpOp, int labelNumber);
+
+// NOTE: regalloc.c
+// Linear-scan allocation of locals (NASM x86-64)
+int allocateLocals(struct ASTnode *n, int *registers);
+void regallocReset(void);
+
+// NOTE: vectorize.c
+// Loop vectorization (NASM x86-64, SSE2/AVX2)
+int vectorWidth(struct ASTnode *loop);
+void vectorLoop(struct ASTnode *loop, int labelLoop, int labelDone);
+
+// NOTE: cgl.c
+// Code generation utilities (textual LLVM IR)
+void llvmPreamble(void);
+void llvmPostamble(void);
+int llvmLoadImmediateInt(int value);
+int llvmLoadGlobalSymbol(char *identifier);
+int llvmStoreGlobalSymbol(int valueIndex, char *identifier);
+int llvmLoadParameter(int position);
+int llvmStoreParameter(int valueIndex, int position);
+void llvmDeclareLocal(int identifierIndex);
+int llvmLoadLocal(int identifierIndex);
+int llvmStoreLocal(int valueIndex, int identifierIndex);
+int llvmLoadElement(int vIndex, char *array, int length);
+int llvmStoreElement(int valueIndex, int vIndex, char *array, int length);
+void llvmDeclareGlobalSymbol(char *symbol, int length);
+int llvmAddRegs(int v1, int v2);
+int llvmSubRegs(int v1, int v2);
+int llvmMulRegs(int v1, int v2);
+int llvmDivRegsSigned(int v1, int v2);
+int llvmModRegsSigned(int v1, int v2);
+int llvmShiftRight(int v, int bits);
+int llvmAndImmediate(int v, int mask);
+void llvmPrintIntFromReg(int v);
+int llvmCompareAndSet(int ASTop, int v1, int v2);
+int llvmCompareAndJump(int ASTop, int v1, int v2, int label);
+int llvmSelect(int ASTop, int v1, int v2, int vTrue, int vFalse);
+int llvmBooleanPhi(int labelTrue, int labelFalse);
+void llvmLabel(int label);
+void llvmJump(int label);
+int llvmCacheStore(int v, int slot);
+int llvmCacheLoad(int slot);
+void llvmSwitch(int v, struct switchCase *cases, int count, int labelDefault);
+void llvmFunctionPreamble(char *name, int parameters);
+void llvmFunctionPostamble(int returnLabel);
+void llvmReturn(int v);
+void llvmPushArgument(int v);
+int llvmCall(char *name, int arguments);
+
 // NOTE: expr.c
 struct ASTnode *binexpr(int rbp);
+struct ASTnode *functionCall(int id);
 
 // NOTE: stmt.c
 // void statements(void);
 struct ASTnode *compoundStatement(void);
+struct ASTnode *singleStatement(void);
+struct ASTnode *functionBody(void);
+void parseReset(void);
 
 // NOTE: misc.c
 void match(int t, char *what);
 void semicolon(void);
+void colon(void);
 void leftBrace(void);        // {
 void rightBrace(void);       // }
 void leftParenthesis(void);  // (
 void rightParenthesis(void); // )
+void leftBracket(void);      // [
+void rightBracket(void);     // ]
 void identifier(void);
 void logFatal(char *s);
 void logFatals(char *s1, char *s2);
 void logFatald(char *s, int d);
 void logFatalc(char *s, int c);
+void setFatalRecovery(jmp_buf *env);
+int hasFatalRecovery(void);
+_Noreturn void fatalExit(void);
 
 // NOTE: symbol.c
 int findGlobalSymbol(char *s);
 int addGlobalSymbol(char *name);
+void clearGlobalSymbols(void);
+void borrowGlobalSymbols(struct symbolTable *table, int count);
+void releaseGlobalSymbols(void);
+int countGlobalSymbols(void);
+int declareGlobalSymbol(char *name, int length);
+int useGlobalSymbol(char *name);
+int declareFunction(char *name, int parameters);
+int addParameter(char *name, int position);
+int addLocalSymbol(char *name);
+void openScope(void);
+void closeScope(void);
+void addToScope(int id);
+void resetScopes(void);
+void deferGlobalSymbols(void);
+struct symbolEvent *takeSymbolEvents(int *count);
+
+// NOTE: cse.c
+void cseCountCandidates(struct ASTnode *n);
+int cseIsCandidate(struct ASTnode *n);
+int cseLookup(struct ASTnode *n);
+int cseRecord(struct ASTnode *n);
+void cseKill(int identifierIndex);
+void cseFlush(void);
+void cseReset(void);
+int cseHasCandidates(struct ASTnode *n);
+struct cseCount **cseShareCounts(void);
+void cseBorrowCounts(struct cseCount **table);
+
+// NOTE: profile.c
+void profileLoad(char *path);
+int profileLookup(int id, long *taken, long *notTaken);
+void profileCheck(int branchCount);
+void profileReset(void);
+void profileShare(long **taken, long **notTaken, int *count);
+void profileBorrow(long *taken, long *notTaken, int count);
+
+// NOTE: astfile.c
+void astRecordDeclaration(char *name);
+void astWrite(struct ASTnode *tree);
+struct ASTnode *astRead(void);
+void astReset(void);
+
+// NOTE: parallelparse.c
+struct ASTnode *parseParallel(void);
+
+// NOTE: parallel.c
+void codegenParallel(struct ASTnode *tree);
+
+// NOTE: compile.c
+int parseOptions(int argc, char **argv, char **profilePath);
+char *outputName(void);
+void compileProgram(char *profilePath);
+void resetCompilation(void);
+
+// NOTE: server.c
+int serverRun(char *socketPath);
+
+// NOTE: ipc.c
+char *ipcSocketPath(char *buf, size_t size);
+int ipcPeerIsUser(int fd);
+int ipcReadFull(int fd, void *buf, size_t n);
+int ipcWriteFull(int fd, const void *buf, size_t n);
+int ipcReadLine(int fd, char *buf, size_t size);
+
+// NOTE: hash.c
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+// NOTE: cache.c
+uint64_t cacheKey(char *profilePath);
+int cacheFetch(uint64_t key, char *outputPath);
+void cacheStore(uint64_t key, char *outputPath);
+void cachePrintStats(void);
+
+// NOTE: superopt.c
+int superoptRun(void);
 
 // NOTE: interpret.c
 int interpretAST(struct ASTnode *n);
 
 // NOTE: decl.c
-void variableDeclaration(void);
+struct ASTnode *declaration(int topLevel);
+
+// NOTE: inline.c
+struct ASTnode *inlineProgram(struct ASTnode *tree);
+struct ASTnode *inlineStatement(struct ASTnode *n);
+void inlineReset(void);
+
+// NOTE: range.c
+struct ASTnode *rangeProgram(struct ASTnode *tree);
+struct ASTnode *rangeStatement(struct ASTnode *n);
+void rangeReset(void);
+
+// NOTE: reassociate.c
+void reassociateChains(struct ASTnode *tree);
+
+// NOTE: tailmerge.c
+struct ASTnode *mergeTails(struct ASTnode *tree);
+
+// NOTE: hashcons.c
+void hashconsTree(struct ASTnode *tree);
+void hashconsPrintStats(void);
+void hashconsReset(void);
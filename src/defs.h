@@ -10,8 +10,8 @@
 // Length of symbols in input
 #define TEXTLEN 512
 
-// Number of symbol table entries
-// = maximum number of unique symbols in input
+// Number of symbol table entries allocated at first;
+// the table doubles whenever it is full
 #define NSYMBOLS 1024
 
 // Token types
@@ -22,6 +22,7 @@ enum {
     T_MINUS,      // -
     T_STAR,       // *
     T_SLASH,      // /
+    T_PERCENT,    // %
     T_EQ,         // ==
     T_NE,         // !=
     T_LT,         // <
@@ -37,12 +38,26 @@ enum {
     T_RBRACE,     // }
     T_LPAREN,     // (
     T_RPAREN,     // )
+    T_COLON,      // :
+    T_LOGAND,     // &&
+    T_LOGOR,      // ||
+    T_LOGNOT,     // !
+    T_LBRACKET,   // [
+    T_RBRACKET,   // ]
+    T_COMMA,      // ,
 
     // Keywords
-    T_PRINT, // "print"
-    T_INT,   // "int"
-    T_IF,    // "if"
-    T_ELSE,  // "else"
+    T_PRINT,   // "print"
+    T_INT,     // "int"
+    T_IF,      // "if"
+    T_ELSE,    // "else"
+    T_SWITCH,  // "switch"
+    T_CASE,    // "case"
+    T_DEFAULT, // "default"
+    T_BREAK,   // "break"
+    T_WHILE,   // "while"
+    T_FOR,     // "for"
+    T_RETURN,  // "return"
 };
 
 // Token structure
@@ -57,6 +72,7 @@ enum {
     A_SUBTRACT,         // Subtraction
     A_MULTIPLY,         // Multiplication
     A_DIVIDE,           // Division
+    A_MODULO,           // Remainder (%)
     A_EQ,               // Equality comparison (==)
     A_NE,               // Inequality comparison (!=)
     A_LT,               // Less than comparison (<)
@@ -70,6 +86,34 @@ enum {
     A_PRINT,            // Print statement
     A_GLUE,             // Statement glue (for sequencing statements)
     A_IF,               // If statement
+    A_SWITCH,           // Switch statement
+    A_CASE,             // Case label (in a switch body)
+    A_DEFAULT,          // Default label (in a switch body)
+    A_BREAK,            // Break statement (leaves the switch)
+    A_LOGAND,           // Logical and (&&), short-circuit
+    A_LOGOR,            // Logical or (||), short-circuit
+    A_LOGNOT,           // Logical not (!)
+    A_INDEX,            // Array element (array[left])
+    A_LVALUEINDEX,      // L-value array element
+    A_WHILE,            // Loop (condition, body, for-loop step)
+    A_FUNCTION,         // Function definition (body)
+    A_RETURN,           // Return statement (value)
+    A_CALL,             // Function call (arguments)
+    A_ARGUMENT,         // Call argument (value, next argument)
+    A_CALLSTATEMENT,    // Call whose value is unused (the call)
+    A_INLINE,           // Inlined function body (see inline.c)
+    A_SHIFTRIGHT,       // Arithmetic shift right by a literal (range.c)
+    A_BITAND,           // Bitwise and with a literal (range.c)
+};
+
+// Nonterminals of the instruction selector (see isel.c)
+enum {
+    NT_STMT, // a statement, no value
+    NT_REG,  // a value in a register
+    NT_IMM,  // an immediate operand
+    NT_MEM,  // a variable operand (global, parameter or local)
+    NT_COND, // flags set up for a conditional jump
+    NT_COUNT,
 };
 
 // AST node structure
@@ -78,9 +122,15 @@ struct ASTnode {
     struct ASTnode *left;    // left subtree
     struct ASTnode *middle;  // middle subtree (for if-else statements)
     struct ASTnode *right;   // right subtree
+    int line;                // source line the node was parsed on
+    int iselCost[NT_COUNT];  // cheapest cost per nonterminal (isel.c)
+    int iselRule[NT_COUNT];  // rule achieving it (isel.c)
+    int liveLocals;          // A_PRINT, A_CALL: registers of locals the
+                             // call must save (see regalloc.c)
+    int refs;                // parents sharing it, less one (hashcons.c)
     union {                  //
         int intvalue;        // integer value if op == A_INTLIT
-        int identifierIndex; // symbol name if op == A_IDENTIFIER
+        int identifierIndex; // symbol name if op == A_IDENTIFIER/A_INDEX
     } v;
 };
 
@@ -89,9 +139,151 @@ struct ASTnode {
 // functions have no register to return
 #define NOREG -1
 
+// Code generation backends
+enum {
+    BACKEND_NASM, // NASM x86-64 assembly (cgn.c)
+    BACKEND_LLVM, // Textual LLVM IR (cgl.c)
+};
+
+// Number of cache slots for common subexpressions
+// (one callee-saved register each in the NASM backend)
+#define NCSESLOTS 4
+
+// If-conversion (branchless selects for small if statements)
+#define IFCONV_MAX_ASSIGNS 4 // most assignments per branch
+#define IFCONV_MISPREDICT_COST 16 // cost of a mispredicted jump
+#define IFCONV_DEFAULT_MISPREDICT_PERCENT 25 // when there is no profile
+
+// Switch statement dispatch (see codegenSwitchStatementAST())
+#define SWITCH_TABLE_MIN_CASES 4    // fewer cases are always compared
+#define SWITCH_TABLE_MIN_DENSITY 40 // percent of table entries with a case
+#define SWITCH_LINEAR_CASES 3       // binary search compares this few in a row
+
+// Functions (`int name(int a, int b) { ... }`)
+// Arguments are passed in rdi, rsi, rdx, rcx, r8 and r9 only
+#define FUNCTION_MAX_PARAMETERS 6
+
+// Locals (see regalloc.c): the NASM backend keeps them in rbx, rcx,
+// rsi and rdi, the first LOCAL_CALLEE_SAVED of which survive calls
+#define LOCAL_REGISTERS 4
+#define LOCAL_CALLEE_SAVED 1
+
+// Inlining (see inline.c); sizes are counted in AST nodes
+#define INLINE_CALL_COST 12     // size of a call, before its arguments
+#define INLINE_ARGUMENT_COST 2  // size added by each argument
+#define INLINE_LOOP_WEIGHT 4    // a call in a loop counts this many times
+#define INLINE_MAX_LOOP_DEPTH 3 // deeper loops weigh no more
+#define INLINE_MAX_SIZE 400     // largest body inlined at its only call
+
+// Array declarations (`int name[length];`)
+#define ARRAY_MAX_LENGTH (1 << 24) // elements
+#define ARRAY_ALIGNMENT 32         // bytes, one AVX2 vector
+
+// Loop vectorization (see vectorize.c)
+enum {
+    VECTOR_NONE, // scalar loops only (--no-vectorize)
+    VECTOR_SSE2, // 2 elements per xmm register (default)
+    VECTOR_AVX2, // 4 elements per ymm register (-mavx2)
+};
+#define VECTOR_REGISTERS 16      // xmm0-15 / ymm0-15
+#define VECTOR_MAX_STATEMENTS 16 // most statements in a vectorized body
+
+// Version, mixed into compilation cache keys (meson passes the real one)
+#ifndef KECCC_VERSION
+#define KECCC_VERSION "unknown"
+#endif
+
+// The compile options, for the usage messages of keccc and its server
+#define KECCC_USAGE_OPTIONS                                                    \
+    "[-g] [--emit-llvm] [--no-isel] [--no-cse] [--no-if-convert] "            \
+    "[--no-jump-tables] [--no-branch-chains] [--no-vectorize] [-mavx2] "      \
+    "[--no-inline] [--no-regalloc] [--no-ranges] [--no-reassociate] "         \
+    "[--no-share] [--no-superopt] [-Os] [--instrument] [--profile-use file] " \
+    "[--stream] [--scan-thread] [-j jobs] [--emit-ast | --from-ast] "         \
+    "[--cache] [--stats] [-o outfile] infile"
+
+// stdio buffer size for the input and output files, so pipes
+// (`keccc - -o - | nasm`) move data in large blocks
+#define IO_BUFFER_SIZE (1 << 20)
+
+// Scanner thread (--scan-thread), see scanthread.c
+#define SCAN_RING_SIZE 4096      // tokens in flight (a power of two)
+#define SCAN_INTERN_CHUNK 4096   // interned names per chunk
+#define SCAN_INTERN_CHUNKS 4096  // at most this many chunks
+
+// Parallel code generation (-j), see parallel.c
+#define CODEGEN_MAX_JOBS 256
+// Smallest part of the input parsed on its own thread (parallelparse.c)
+#define PARSE_MIN_SEGMENT (64 * 1024)
+
+// Binary AST files (--emit-ast / --from-ast), see astfile.c
+#define AST_FILE_MAGIC "KECCAST" // 8 bytes with the NUL
+#define AST_FILE_VERSION 5
+#define AST_FILE_NO_NODE 0xffffffffu // no node (an empty program)
+
+// Compilation cache (--cache), see cache.c
+#define CACHE_DEFAULT_MAX_SIZE (64LL << 20) // bytes, see $KECCC_CACHE_SIZE
+
+// Compile server (--server) protocol, see ipc.c
+#define IPC_MAGIC "KECCC2"
+#define IPC_SOCKET_NAME "keccc.sock"
+#define IPC_LINE_MAX 4096 // longest header, path or argument line
+#define IPC_MAX_ARGS 64   // most arguments of one job
+#define IPC_MAX_CONNECTIONS 64 // most jobs served at once, one thread each
+
+// Branch profiling (--instrument / --profile-use)
+// Each if statement owns two 8-byte counters in the keccc_prof array
+#define PROFILE_SLOT_EXECUTED 0 // times the condition was evaluated
+#define PROFILE_SLOT_TAKEN 1    // times the 'then' branch ran
+// File written by instrumented programs when main returns
+#define PROFILE_DEFAULT_PATH "keccc.prof"
+// A block running less than 1/PROFILE_COLD_RATIO of the time is cold
+#define PROFILE_COLD_RATIO 16
+
+// Code generation counters at a statement boundary (see gen.c)
+struct codegenPosition {
+    int label;          // next label number
+    int branch;         // next branch id
+    int sourceLine;     // source line of the last line annotation
+    int localRegisters; // registers main's locals hold so far
+};
+
+// A case of a switch statement and the label of its code (see gen.c)
+struct switchCase {
+    int value; // case value
+    int label; // label number
+};
+
+// A declaration or first use of a global, logged while part of the
+// program is parsed on its own thread (see parallelparse.c)
+struct symbolEvent {
+    int declaration; // 1 for `int name;`, 0 for a use before any
+    int id;          // symbol index on the parsing thread
+    int kind;        // declarations: see struct symbolTable
+    int length;      //
+    int parameters;  //
+    int position;    //
+};
+
+// Kinds of symbols
+enum {
+    S_VARIABLE,  // global int or array
+    S_FUNCTION,  // function
+    S_PARAMETER, // parameter of a function (see addParameter())
+    S_LOCAL,     // int declared inside a block (see addLocalSymbol())
+};
+
 // Symbol table structure
 struct symbolTable {
-    char *name; // Name of a symbol
+    char *name;     // Name of a symbol
+    int kind;       // S_*
+    int length;     // elements of an array, 0 for an int, a function,
+                    // a parameter or a local, -1 while not declared yet
+                    // (see useGlobalSymbol())
+    int parameters; // number of parameters of a function
+    int position;   // position of a parameter (0 for the first)
+    int location;   // register (>= 0) or stack slot (-1 - slot) of
+                    // a local, set by allocateLocals()
 };
 
 #endif
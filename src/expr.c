@@ -4,9 +4,62 @@
 #include "decl.h"
 #include "defs.h"
 
+/**
+ * functionCall - Parse the arguments of a call; the function's name
+ * is already parsed.
+ *
+ * NOTE:
+ * The arguments hang off the call as a list, in order:
+ * ----------------------------------------
+ *    [A_CALL f] -> [A_ARGUMENT] -> [A_ARGUMENT] -> NULL
+ *                       |              |
+ *                     first          second
+ * ----------------------------------------
+ * (left is the call's first argument, an argument's left is its
+ * value and its right the next argument).
+ *
+ * @param id The symbol index of the function.
+ *
+ * @return ASTnode* The AST node representing the call.
+ */
+struct ASTnode *functionCall(int id) {
+    struct ASTnode *first = NULL, *last = NULL, *argument;
+    int count = 0;
+
+    if (GlobalSymbolTable[id].length != -1 &&
+        GlobalSymbolTable[id].kind != S_FUNCTION) {
+        logFatals("Not a function: ", GlobalSymbolTable[id].name);
+    }
+
+    leftParenthesis();
+    while (Token.token != T_RPAREN) {
+        if (count > 0) {
+            match(T_COMMA, ",");
+        }
+        argument = makeASTUnary(A_ARGUMENT, binexpr(0), 0);
+        if (last == NULL) {
+            first = argument;
+        } else {
+            last->right = argument;
+        }
+        last = argument;
+        count++;
+    }
+    rightParenthesis();
+
+    // A function not declared yet (see useGlobalSymbol()) is checked
+    // once it is
+    if (GlobalSymbolTable[id].kind == S_FUNCTION &&
+        GlobalSymbolTable[id].parameters != count) {
+        logFatals("Wrong number of arguments to ", GlobalSymbolTable[id].name);
+    }
+    return makeASTUnary(A_CALL, first, id);
+}
+
 /**
  * primary - Parse a primary expression.
- * e.g., integer literals.
+ * e.g., integer literals, identifiers, array elements (`name[expression]`),
+ * function calls, `!primary` and `(expression)`.
  *
  * @return ASTnode* The AST node representing the primary expression.
  */
@@ -26,13 +79,45 @@ static struct ASTnode *primary(void) {
 
     case T_IDENTIFIER:
         // Check that if this identifier exists
-        id = findGlobalSymbol(Text);
+        id = useGlobalSymbol(Text);
         if (id == -1) {
             logFatals("Undeclared identifier: ", Text);
         }
 
-        n = makeASTLeaf(A_IDENTIFIER, id);
-        break;
+        scan(&Token);
+        if (Token.token == T_LPAREN) {
+            return functionCall(id);
+        }
+        if (GlobalSymbolTable[id].kind == S_FUNCTION) {
+            logFatals("Not a variable: ", GlobalSymbolTable[id].name);
+        }
+        if (Token.token == T_LBRACKET) {
+            // An array element; the ']' ends the index's binexpr()
+            if (GlobalSymbolTable[id].length == 0) {
+                logFatals("Not an array: ", GlobalSymbolTable[id].name);
+            }
+            scan(&Token);
+            n = makeASTUnary(A_INDEX, binexpr(0), id);
+            rightBracket();
+            return n;
+        }
+        if (GlobalSymbolTable[id].length > 0) {
+            logFatals("Array used without an index: ",
+                      GlobalSymbolTable[id].name);
+        }
+        return makeASTLeaf(A_IDENTIFIER, id);
+
+    case T_LPAREN:
+        // A parenthesized expression; its ')' ends the inner binexpr()
+        scan(&Token);
+        n = binexpr(0);
+        rightParenthesis();
+        return n;
+
+    case T_LOGNOT:
+        // Logical not binds tighter than any binary operator
+        scan(&Token);
+        return makeASTUnary(A_LOGNOT, primary(), 0);
 
     default:
         logFatald("Syntax error: unexpected token ", Token.token);
@@ -61,6 +146,8 @@ int tokenToASTOperator(int token) {
         return A_MULTIPLY;
     case T_SLASH:
         return A_DIVIDE;
+    case T_PERCENT:
+        return A_MODULO;
 
     // Comparison operators
     case T_EQ:
@@ -76,10 +163,16 @@ int tokenToASTOperator(int token) {
     case T_GE:
         return A_GE;
 
+    // Logical operators
+    case T_LOGAND:
+        return A_LOGAND;
+    case T_LOGOR:
+        return A_LOGOR;
+
     default:
-        fprintf(stderr, "Unknown arithmetic operator: %d, line: %d\n", token,
-                Line);
-        exit(1);
+        fprintf(Errfile, "Unknown arithmetic operator: %d, line: %d\n",
+                token, Line);
+        fatalExit();
     }
 }
 
@@ -92,18 +185,21 @@ int tokenToASTOperator(int token) {
 // Based on the C language operator precedence:
 // https://en.cppreference.com/w/c/language/operator_precedence.html
 static int OpPrecedence[] = {
-    [T_EOF] = 0,    // End of file
-    [T_PLUS] = 10,  // Composes additive expressions
-    [T_MINUS] = 10, // Composes additive expressions
-    [T_STAR] = 20,  // Composes multiplicative expressions
-    [T_SLASH] = 20, // Composes multiplicative expressions
-    [T_EQ] = 30,    // Equality operator
-    [T_NE] = 30,    // Inequality operator
-    [T_LT] = 40,    // Relational operators
-    [T_GT] = 40,    // Relational operators
-    [T_LE] = 40,    // Relational operators
-    [T_GE] = 40,    // Relational operators
-    [T_INTLIT] = 0, // Integer literals
+    [T_EOF] = 0,      // End of file
+    [T_PLUS] = 10,    // Composes additive expressions
+    [T_MINUS] = 10,   // Composes additive expressions
+    [T_STAR] = 20,    // Composes multiplicative expressions
+    [T_SLASH] = 20,   // Composes multiplicative expressions
+    [T_PERCENT] = 20, // Composes multiplicative expressions
+    [T_EQ] = 30,      // Equality operator
+    [T_NE] = 30,      // Inequality operator
+    [T_LT] = 40,      // Relational operators
+    [T_GT] = 40,      // Relational operators
+    [T_LE] = 40,      // Relational operators
+    [T_GE] = 40,      // Relational operators
+    [T_INTLIT] = 0,   // Integer literals
+    [T_LOGAND] = 5,   // Logical and
+    [T_LOGOR] = 4,    // Logical or
 };
 
 /**
@@ -113,10 +209,11 @@ static int OpPrecedence[] = {
  * @return int The precedence of the operator.
  */
 static int operatorPrecedence(int tokentype) {
-    int precedence = OpPrecedence[tokentype];
+    int count = sizeof(OpPrecedence) / sizeof(OpPrecedence[0]);
+    int precedence = tokentype < count ? OpPrecedence[tokentype] : 0;
     if (precedence == 0) {
-        fprintf(stderr, "Unknown operator: %d, line: %d\n", tokentype, Line);
-        exit(1);
+        fprintf(Errfile, "Unknown operator: %d, line: %d\n", tokentype, Line);
+        fatalExit();
     }
     return precedence;
 }
@@ -135,11 +232,12 @@ struct ASTnode *binexpr(int ptp) {
     // and fetch the next token at the same time.
     left = primary();
 
-    // If we hit a semicolon(";") or right parenthesis(")"),
-    // it means it's end of the expression,
-    // so we return just the left node. OvO
+    // If we hit a semicolon(";"), right parenthesis(")"),
+    // right bracket("]") or comma(","), it means it's end of the
+    // expression, so we return just the left node. OvO
     tokentype = Token.token;
-    if (tokentype == T_SEMICOLON || tokentype == T_RPAREN) {
+    if (tokentype == T_SEMICOLON || tokentype == T_RPAREN ||
+        tokentype == T_RBRACKET || tokentype == T_COMMA) {
         return left;
     }
 
@@ -155,10 +253,12 @@ struct ASTnode *binexpr(int ptp) {
         left = makeASTNode(tokenToASTOperator(tokentype), left, NULL, right, 0);
 
         // Update the details of the current token.
-        // If we hit a semicolon, it means it's end of the sentence,
-        // so we return just the left node. OvO
+        // If we hit a semicolon(";"), right parenthesis(")"),
+        // right bracket("]") or comma(","), it means it's end of the
+        // expression, so we return just the left node. OvO
         tokentype = Token.token;
-        if (tokentype == T_SEMICOLON) {
+        if (tokentype == T_SEMICOLON || tokentype == T_RPAREN ||
+            tokentype == T_RBRACKET || tokentype == T_COMMA) {
             return left;
         }
     }
@@ -10,14 +10,612 @@
 #include "decl.h"
 #include "defs.h"
 
+// Cold code (rarely executed blocks chosen by the profile) is written
+// here and appended after main by codegenPostamble()
+static _Thread_local FILE *Coldfile = NULL;
+// Whether Outfile currently points at Coldfile
+static _Thread_local int emittingColdCode = 0;
+// Number of branch ids handed out so far
+static _Thread_local int branchCount = 0;
+// Next free label number
+static _Thread_local int labelCount = 1;
+// Source line of the last line annotation (see codegenSourceLine())
+static _Thread_local int lastSourceLine = 0;
+
+// A switch statement whose body is being generated
+struct switchContext {
+    int *labels;                 // label of each case/default, in body order
+    int labelCount;              // number of labels
+    int next;                    // the next label the body reaches
+    struct switchContext *outer; // enclosing switch, or NULL
+};
+// The innermost switch being generated (see codegenSwitchStatementAST())
+static _Thread_local struct switchContext *currentSwitch = NULL;
+// Where a break jumps: the end of the innermost switch or loop
+// (0 outside of both)
+static _Thread_local int breakLabel = 0;
+// The epilogue of the function being generated (0 in main)
+static _Thread_local int returnLabel = 0;
+// The end of the innermost inlined function body (0 outside of one),
+// see codegenInlineAST()
+static _Thread_local int inlineExitLabel = 0;
+// Stack slots main's locals need so far (see codegenAllocateLocals())
+static _Thread_local int mainSpillSlots = 0;
+// Registers main's locals were given so far, which the register pool
+// keeps off (see nasmChoosePool())
+static _Thread_local int mainLocalRegisters = 0;
+
+static int codegenOperatorAST(struct ASTnode *n, int reg, int parentASTop);
+
+// Layouts an if statement can be emitted in
+enum {
+    IF_LAYOUT_DEFAULT,   // cond, then, else (fall through into then)
+    IF_LAYOUT_ELSE_FIRST, // inverted cond, else, then
+    IF_LAYOUT_COLD_THEN, // inverted cond, else; then moved out of line
+    IF_LAYOUT_COLD_ELSE, // cond, then; else moved out of line
+    IF_LAYOUT_CONVERTED, // no branches at all (codegenIfConverted())
+};
+
 /**
  * getLabelNumber - Generates a unique label number for code generation.
  *
  * @return int A unique label number.
  */
-static int getLabelNumber(void) {
-    static int id = 1;
-    return (id++);
+static int getLabelNumber(void) { return (labelCount++); }
+
+/**
+ * getBranchNumber - Generates a unique id for an if statement.
+ *
+ * NOTE:
+ * Ids are handed out in code generation order. They index the
+ * instrumentation counters and the records of a loaded profile.
+ *
+ * @return int A unique branch id.
+ */
+static int getBranchNumber(void) { return (branchCount++); }
+
+/**
+ * invertComparison - Returns the comparison that is true exactly when
+ * the given one is false.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ *
+ * @return int The inverted comparison operation.
+ */
+static int invertComparison(int ASTop) {
+    switch (ASTop) {
+    case A_EQ:
+        return A_NE;
+    case A_NE:
+        return A_EQ;
+    case A_LT:
+        return A_GE;
+    case A_LE:
+        return A_GT;
+    case A_GT:
+        return A_LE;
+    case A_GE:
+        return A_LT;
+    default:
+        logFatald("Cannot invert AST operator: ", ASTop);
+        return -1;
+    }
+}
+
+/**
+ * isSelectable - Checks whether the instruction selector can cover a tree.
+ *
+ * NOTE:
+ * The value of && and || takes branches, and a call saves registers
+ * around it (see codegenCallAST()); the selector's tree patterns can
+ * express neither. Its memory operands would also read a global
+ * only after a call that may have changed it.
+ *
+ * @n: The tree.
+ *
+ * @return int 1 if it can, 0 if the tree has && or || or a call.
+ */
+static int isSelectable(struct ASTnode *n) {
+    if (n == NULL) {
+        return 1;
+    }
+    if (n->op == A_LOGAND || n->op == A_LOGOR || n->op == A_CALL) {
+        return 0;
+    }
+    return isSelectable(n->left) && isSelectable(n->right);
+}
+
+/**
+ * codegenCompareBranch - Generates a comparison that jumps to a label.
+ *
+ * @cond: The comparison AST node.
+ * @label: The label to jump to.
+ * @jumpIfTrue: Jump when the comparison holds (1) or fails (0).
+ */
+static void codegenCompareBranch(struct ASTnode *cond, int label,
+                                 int jumpIfTrue) {
+    int leftRegister, rightRegister;
+    int op = jumpIfTrue ? invertComparison(cond->op) : cond->op;
+
+    if (Backend == BACKEND_NASM && UseInstructionSelection &&
+        isSelectable(cond)) {
+        iselCondition(cond, op, label);
+        return;
+    }
+
+    leftRegister = codegenAST(cond->left, NOREG, cond->op);
+    rightRegister = codegenAST(cond->right, leftRegister, cond->op);
+
+    // codegenCompareAndJump() jumps when the comparison is FALSE
+    codegenCompareAndJump(op, leftRegister, rightRegister, label);
+}
+
+/**
+ * codegenTestBranch - Generates a jump on whether a value is not zero.
+ *
+ * @cond: The value.
+ * @label: The label to jump to.
+ * @jumpIfTrue: Jump when the value is not zero (1) or is zero (0).
+ */
+static void codegenTestBranch(struct ASTnode *cond, int label,
+                              int jumpIfTrue) {
+    // Compared with zero (a `test` for the selector)
+    struct ASTnode zero = {.op = A_INTLIT, .line = cond->line};
+    struct ASTnode test = {
+        .op = A_NE, .left = cond, .right = &zero, .line = cond->line};
+
+    codegenCompareBranch(&test, label, jumpIfTrue);
+}
+
+/**
+ * codegenBranch - Generates a condition as a chain of compare-and-jumps.
+ *
+ * NOTE:
+ * The condition is never turned into a 0 or 1 first. Every comparison
+ * jumps straight to where its outcome leads, e.g. for
+ * `if (a < b && (c == d || e))`, jumping to L1 when it is false:
+ * ----------------------------------------
+ *        compare a, b; jump to L1 if a >= b
+ *        compare c, d; jump to L2 if c == d
+ *        test e;       jump to L1 if e == 0
+ * L2:
+ * ----------------------------------------
+ * Any other integer expression is true when it is not zero.
+ * The registers used are freed again, so a chain may be part of an
+ * expression (see codegenBooleanValue()). With --no-branch-chains only
+ * && and || jump; every other condition is computed to 0 or 1 first
+ * and that value tested.
+ *
+ * @cond: The condition.
+ * @label: The label to jump to.
+ * @jumpIfTrue: Jump when the condition holds (1) or fails (0);
+ *              otherwise fall through.
+ */
+static void codegenBranch(struct ASTnode *cond, int label, int jumpIfTrue) {
+    int labelSkip;
+
+    if (!BranchChains && cond->op != A_LOGAND && cond->op != A_LOGOR) {
+        codegenTestBranch(cond, label, jumpIfTrue);
+        return;
+    }
+
+    switch (cond->op) {
+    case A_LOGNOT:
+        codegenBranch(cond->left, label, !jumpIfTrue);
+        return;
+
+    case A_LOGAND:
+    case A_LOGOR:
+        // A false operand of && (a true one of ||) decides the outcome
+        if (jumpIfTrue == (cond->op == A_LOGOR)) {
+            codegenBranch(cond->left, label, jumpIfTrue);
+            codegenBranch(cond->right, label, jumpIfTrue);
+            return;
+        }
+
+        // Otherwise the left operand may decide against jumping
+        labelSkip = getLabelNumber();
+        codegenBranch(cond->left, labelSkip, !jumpIfTrue);
+        codegenBranch(cond->right, label, jumpIfTrue);
+        codegenLabel(labelSkip);
+        return;
+    }
+
+    if (isComparison(cond->op)) {
+        codegenCompareBranch(cond, label, jumpIfTrue);
+        return;
+    }
+
+    codegenTestBranch(cond, label, jumpIfTrue);
+}
+
+/**
+ * codegenCondition - Generates an if statement's condition,
+ * see codegenBranch().
+ *
+ * @cond: The condition AST node.
+ * @label: The label to jump to.
+ * @jumpIfTrue: Jump when the condition holds (1) or fails (0).
+ *
+ * @return int NOREG
+ */
+static int codegenCondition(struct ASTnode *cond, int label, int jumpIfTrue) {
+    codegenSourceLine(cond->line);
+    codegenBranch(cond, label, jumpIfTrue);
+    return NOREG;
+}
+
+/**
+ * codegenBooleanValue - Generates the 0 or 1 value of && or ||.
+ *
+ * NOTE:
+ * The operator is generated as a condition (see codegenBranch()),
+ * so the right operand is only evaluated when it is needed:
+ * ----------------------------------------
+ *        condition chain, jump to L2 if false
+ * L1:
+ *        result = 1
+ *        jump to L3
+ * L2:
+ *        result = 0
+ * L3:
+ * ----------------------------------------
+ * The LLVM backend merges the two results with a phi instead.
+ *
+ * @n: The A_LOGAND or A_LOGOR node.
+ *
+ * @return int The register index containing 0 or 1.
+ */
+static int codegenBooleanValue(struct ASTnode *n) {
+    int labelTrue = getLabelNumber();
+    int labelFalse = getLabelNumber();
+    int labelEnd = getLabelNumber();
+    int reg;
+
+    codegenBranch(n, labelFalse, 0);
+    codegenLabel(labelTrue);
+    reg = codegenSetBoolean(NOREG, 1);
+    codegenJump(labelEnd);
+    codegenLabel(labelFalse);
+    codegenSetBoolean(reg, 0);
+    codegenLabel(labelEnd);
+    return codegenMergeBoolean(reg, labelTrue, labelFalse);
+}
+
+/**
+ * isColdBranch - Decides whether a block ran too rarely to stay inline.
+ *
+ * @count: How often the block ran.
+ * @executed: How often the enclosing if statement ran.
+ *
+ * @return int 1 if the block is cold, 0 otherwise.
+ */
+static int isColdBranch(long count, long executed) {
+    return count * PROFILE_COLD_RATIO < executed;
+}
+
+/**
+ * chooseIfLayout - Picks the block order of an if statement from the
+ * loaded profile, so the hot path falls through.
+ *
+ * @n: The AST node representing the IF statement.
+ * @branchId: The id of the IF statement.
+ * @cold: Whether the statement itself is in out-of-line code.
+ *
+ * @return int One of IF_LAYOUT_*.
+ */
+static int chooseIfLayout(struct ASTnode *n, int branchId, int cold) {
+    long taken, notTaken;
+
+    if (!profileLookup(branchId, &taken, &notTaken)) {
+        return IF_LAYOUT_DEFAULT;
+    }
+
+    // A block nested in cold code is already out of line
+    if (!cold) {
+        if (isColdBranch(taken, taken + notTaken)) {
+            return IF_LAYOUT_COLD_THEN;
+        }
+        if (n->right && isColdBranch(notTaken, taken + notTaken)) {
+            return IF_LAYOUT_COLD_ELSE;
+        }
+    }
+    if (n->right && notTaken > taken) {
+        return IF_LAYOUT_ELSE_FIRST;
+    }
+    return IF_LAYOUT_DEFAULT;
+}
+
+/**
+ * codegenIfBlock - Generates one branch of an if statement.
+ *
+ * @block: The compound statement of the branch (may be NULL).
+ * @branchId: The id of the IF statement.
+ * @isThen: Whether this is the 'then' branch (counted as "taken").
+ */
+static void codegenIfBlock(struct ASTnode *block, int branchId, int isThen) {
+    if (isThen && InstrumentBranches) {
+        codegenBranchCounter(branchId, PROFILE_SLOT_TAKEN);
+    }
+    codegenAST(block, NOREG, A_IF);
+    codegenResetRegisters();
+}
+
+/**
+ * codegenColdBlock - Generates one branch of an if statement out of line.
+ *
+ * NOTE:
+ * The block is written to Coldfile as
+ * ----------------------------------------
+ * Lentry:
+ *        perform the block
+ *        jump to Lreturn
+ * ----------------------------------------
+ * and ends up after main's epilogue, away from the hot path.
+ *
+ * @block: The compound statement of the branch (may be NULL).
+ * @branchId: The id of the IF statement.
+ * @isThen: Whether this is the 'then' branch.
+ * @labelEntry: The label the hot path jumps to.
+ * @labelReturn: The label to jump back to.
+ */
+static void codegenColdBlock(struct ASTnode *block, int branchId, int isThen,
+                             int labelEntry, int labelReturn) {
+    FILE *hotfile = Outfile;
+    int hotLine = lastSourceLine;
+
+    if (Coldfile == NULL && (Coldfile = tmpfile()) == NULL) {
+        logFatal("Cannot create temporary file for cold code");
+    }
+
+    // Cold code is moved after main, so it starts with a line of its own
+    Outfile = Coldfile;
+    lastSourceLine = 0;
+    emittingColdCode = 1;
+
+    codegenLabel(labelEntry);
+    codegenIfBlock(block, branchId, isThen);
+    codegenJump(labelReturn);
+
+    emittingColdCode = 0;
+    Outfile = hotfile;
+    lastSourceLine = hotLine;
+
+    // Values computed in the cold block do not exist on the hot path
+    cseFlush();
+}
+
+// An assignment of a branch considered for if-conversion
+struct ifConvAssign {
+    int identifierIndex;   // global being assigned
+    struct ASTnode *value; // its new value (a leaf)
+};
+
+/**
+ * collectIfConvAssigns - Flattens a branch made only of simple
+ * assignments into a list.
+ *
+ * @n: The compound statement of the branch (may be NULL).
+ * @list: Receives the assignments, in order.
+ * @count: In: entries used so far. Out: entries used in total.
+ *
+ * @return int 1 if the branch qualifies, 0 otherwise.
+ */
+static int collectIfConvAssigns(struct ASTnode *n, struct ifConvAssign *list,
+                                int *count) {
+    if (n == NULL) {
+        return 1;
+    }
+    if (n->op == A_GLUE) {
+        return collectIfConvAssigns(n->left, list, count) &&
+               collectIfConvAssigns(n->right, list, count);
+    }
+
+    // Only `global = literal;` and `global = global;` are cheap and
+    // side-effect free enough to execute unconditionally
+    if (n->op != A_ASSIGN || *count == IFCONV_MAX_ASSIGNS ||
+        n->right->op != A_LVALUEIDENTIFIER ||
+        (n->left->op != A_INTLIT && n->left->op != A_IDENTIFIER)) {
+        return 0;
+    }
+    list[*count].identifierIndex = n->right->v.identifierIndex;
+    list[*count].value = n->left;
+    (*count)++;
+    return 1;
+}
+
+/**
+ * findIfConvAssign - Looks up the assignment of a global in a branch.
+ *
+ * @list: The branch's assignments.
+ * @count: Number of entries.
+ * @identifierIndex: The global to look for.
+ *
+ * @return The assignment, or NULL if the branch leaves the global alone.
+ */
+static struct ifConvAssign *findIfConvAssign(struct ifConvAssign *list,
+                                             int count, int identifierIndex) {
+    for (int i = 0; i < count; i++) {
+        if (list[i].identifierIndex == identifierIndex) {
+            return &list[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * readsAssignedGlobal - Checks whether a leaf reads a global written by
+ * either branch.
+ *
+ * @leaf: The leaf (A_INTLIT or A_IDENTIFIER).
+ * @list: All assignments of both branches.
+ * @count: Number of entries.
+ *
+ * @return int 1 if it does, 0 otherwise.
+ */
+static int readsAssignedGlobal(struct ASTnode *leaf, struct ifConvAssign *list,
+                               int count) {
+    return leaf->op == A_IDENTIFIER &&
+           findIfConvAssign(list, count, leaf->v.identifierIndex) != NULL;
+}
+
+/**
+ * shouldIfConvert - Decides whether an if statement is better emitted as
+ * a branchless select.
+ *
+ * NOTE:
+ * The statement qualifies when
+ * - the condition compares two leaves,
+ * - each branch only assigns literals or globals to globals,
+ *   at most once per global, and
+ * - nothing read by the condition or the assigned values is written
+ *   by either branch (so evaluation order does not matter).
+ * It is then converted when the selects cost no more than the branches,
+ * counting IFCONV_MISPREDICT_COST for a mispredicted jump. The
+ * misprediction rate comes from the profile when one is loaded.
+ *
+ * @n: The AST node representing the IF statement.
+ * @branchId: The id of the IF statement.
+ *
+ * @return int 1 to if-convert, 0 to keep the branches.
+ */
+static int shouldIfConvert(struct ASTnode *n, int branchId) {
+    struct ifConvAssign list[2 * IFCONV_MAX_ASSIGNS];
+    int thenCount = 0, count;
+    int targets = 0;
+    long taken, notTaken;
+    int mispredictPercent = IFCONV_DEFAULT_MISPREDICT_PERCENT;
+    int convertedCost, branchCost;
+
+    if (!isComparison(n->left->op)) {
+        return 0;
+    }
+    if (n->left->left->op != A_INTLIT && n->left->left->op != A_IDENTIFIER) {
+        return 0;
+    }
+    if (n->left->right->op != A_INTLIT && n->left->right->op != A_IDENTIFIER) {
+        return 0;
+    }
+
+    if (!collectIfConvAssigns(n->middle, list, &thenCount)) {
+        return 0;
+    }
+    count = thenCount;
+    if (!collectIfConvAssigns(n->right, list, &count) || count == 0) {
+        return 0;
+    }
+
+    // Each global at most once per branch; count the distinct ones
+    for (int i = 0; i < count; i++) {
+        int first = i < thenCount ? 0 : thenCount;
+        if (findIfConvAssign(list + first, i - first,
+                             list[i].identifierIndex) != NULL) {
+            return 0;
+        }
+        if (i < thenCount ||
+            !findIfConvAssign(list, thenCount, list[i].identifierIndex)) {
+            targets++;
+        }
+    }
+
+    // No read may observe a write of the other assignments
+    if (readsAssignedGlobal(n->left->left, list, count) ||
+        readsAssignedGlobal(n->left->right, list, count)) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (readsAssignedGlobal(list[i].value, list, count)) {
+            return 0;
+        }
+    }
+
+    if (profileLookup(branchId, &taken, &notTaken)) {
+        mispredictPercent =
+            (int)(100 * (taken < notTaken ? taken : notTaken) /
+                  (taken + notTaken));
+    }
+
+    // Per global: two values, compare, cmov, store.
+    // Branches: compare, jcc, the average branch's stores, the jump
+    // over the else branch and the expected misprediction penalty.
+    convertedCost = targets * 5;
+    branchCost = 2 + (count + 1) / 2 + (n->right ? 1 : 0) +
+                 IFCONV_MISPREDICT_COST * mispredictPercent / 100;
+    return convertedCost <= branchCost;
+}
+
+/**
+ * ifLayout - Decides how an if statement is generated.
+ *
+ * @n: The AST node representing the IF statement.
+ * @branchId: The id of the IF statement.
+ * @cold: Whether the statement itself is in out-of-line code.
+ *
+ * @return int One of IF_LAYOUT_*.
+ */
+static int ifLayout(struct ASTnode *n, int branchId, int cold) {
+    // Counting needs real branches, so no if-conversion either
+    if (IfConvert && !InstrumentBranches && shouldIfConvert(n, branchId)) {
+        return IF_LAYOUT_CONVERTED;
+    }
+    return chooseIfLayout(n, branchId, cold);
+}
+
+/**
+ * codegenIfConverted - Generates an if statement as branchless selects.
+ *
+ * NOTE:
+ * For every global assigned by either branch:
+ * ----------------------------------------
+ *        load the 'then' value (or the global itself)
+ *        load the 'else' value (or the global itself)
+ *        compare, then conditionally move the 'else' value
+ *        store the selected value
+ * ----------------------------------------
+ *
+ * @n: The AST node representing the IF statement.
+ *
+ * @return int NOREG
+ */
+static int codegenIfConverted(struct ASTnode *n) {
+    struct ifConvAssign list[2 * IFCONV_MAX_ASSIGNS];
+    struct ifConvAssign *thenAssign, *elseAssign;
+    struct ASTnode *cond = n->left;
+    int thenCount = 0, count;
+    int id, thenRegister, elseRegister, leftRegister, rightRegister;
+
+    collectIfConvAssigns(n->middle, list, &thenCount);
+    count = thenCount;
+    collectIfConvAssigns(n->right, list, &count);
+
+    codegenSourceLine(cond->line);
+    for (int i = 0; i < count; i++) {
+        id = list[i].identifierIndex;
+
+        // An else assignment also in 'then' was handled with it
+        if (i >= thenCount && findIfConvAssign(list, thenCount, id) != NULL) {
+            continue;
+        }
+        thenAssign = findIfConvAssign(list, thenCount, id);
+        elseAssign = findIfConvAssign(list + thenCount, count - thenCount, id);
+
+        thenRegister = thenAssign
+                           ? codegenAST(thenAssign->value, NOREG, A_ASSIGN)
+                           : codegenLoadVariable(id);
+        elseRegister = elseAssign
+                           ? codegenAST(elseAssign->value, NOREG, A_ASSIGN)
+                           : codegenLoadVariable(id);
+        leftRegister = codegenAST(cond->left, NOREG, cond->op);
+        rightRegister = codegenAST(cond->right, leftRegister, cond->op);
+
+        thenRegister = codegenSelect(cond->op, leftRegister, rightRegister,
+                                     thenRegister, elseRegister);
+        codegenStoreVariable(thenRegister, id);
+        cseKill(id);
+        codegenResetRegisters();
+    }
+
+    return NOREG;
 }
 
 /**
@@ -43,6 +641,9 @@ static int getLabelNumber(void) {
  *        perform the other block of code
  * L2:
  * ----------------------------------------
+ * With a profile loaded (--profile-use), chooseIfLayout() may instead
+ * put the hotter block first, or move a cold block out of line.
+ * Small enough statements are not branched at all (shouldIfConvert()).
  *
  * @n: The AST node representing the IF statement.
  *
@@ -51,6 +652,54 @@ static int getLabelNumber(void) {
 static int codegenIFStatementAST(struct ASTnode *n) {
     int labelFalseStatement;
     int labelEndStatement;
+    int branchId = getBranchNumber();
+
+    if (InstrumentBranches) {
+        codegenBranchCounter(branchId, PROFILE_SLOT_EXECUTED);
+    }
+
+    switch (ifLayout(n, branchId, emittingColdCode)) {
+    case IF_LAYOUT_CONVERTED:
+        return codegenIfConverted(n);
+
+    case IF_LAYOUT_COLD_THEN:
+        // Jump out of line when the condition is TRUE,
+        // the (optional) else branch falls through
+        labelFalseStatement = getLabelNumber(); // out-of-line 'then'
+        labelEndStatement = getLabelNumber();
+        codegenCondition(n->left, labelFalseStatement, 1);
+        codegenResetRegisters();
+        codegenIfBlock(n->right, branchId, 0);
+        codegenLabel(labelEndStatement);
+        codegenColdBlock(n->middle, branchId, 1, labelFalseStatement,
+                         labelEndStatement);
+        return NOREG;
+
+    case IF_LAYOUT_COLD_ELSE:
+        // Jump out of line when the condition is FALSE
+        labelFalseStatement = getLabelNumber(); // out-of-line 'else'
+        labelEndStatement = getLabelNumber();
+        codegenCondition(n->left, labelFalseStatement, 0);
+        codegenResetRegisters();
+        codegenIfBlock(n->middle, branchId, 1);
+        codegenLabel(labelEndStatement);
+        codegenColdBlock(n->right, branchId, 0, labelFalseStatement,
+                         labelEndStatement);
+        return NOREG;
+
+    case IF_LAYOUT_ELSE_FIRST:
+        // Same shape as the default layout with the roles swapped
+        labelFalseStatement = getLabelNumber(); // 'then' block
+        labelEndStatement = getLabelNumber();
+        codegenCondition(n->left, labelFalseStatement, 1);
+        codegenResetRegisters();
+        codegenIfBlock(n->right, branchId, 0);
+        codegenJump(labelEndStatement);
+        codegenLabel(labelFalseStatement);
+        codegenIfBlock(n->middle, branchId, 1);
+        codegenLabel(labelEndStatement);
+        return NOREG;
+    }
 
     // Generate two labels:
     // - one for the false branch
@@ -63,73 +712,680 @@ static int codegenIFStatementAST(struct ASTnode *n) {
 
     // WARNING:
     // Jump to false label when condition is FALSE
-    codegenAST(n->left, labelFalseStatement, n->op);
+    codegenCondition(n->left, labelFalseStatement, 0);
     codegenResetRegisters();
 
     // Generate the true branch's compound statement
-    codegenAST(n->middle, NOREG, n->op);
-    codegenResetRegisters();
+    codegenIfBlock(n->middle, branchId, 1);
 
     if (n->right) {
-        nasmJump(labelEndStatement);
+        codegenJump(labelEndStatement);
     }
 
-    nasmLabel(labelFalseStatement);
+    codegenLabel(labelFalseStatement);
 
     // Optional ELSE clause exists
     // Generate the false compount statement and the end label
     if (n->right) {
-        codegenAST(n->right, NOREG, n->op);
-        codegenResetRegisters();
-        nasmLabel(labelEndStatement);
+        codegenIfBlock(n->right, branchId, 0);
+        codegenLabel(labelEndStatement);
     }
 
     return NOREG;
 }
 
 /**
- * codegenAST - Generates code for the given AST node and its subtrees.
+ * codegenStatement - Generates one statement of a chain (see
+ * walkStatements()), then frees the registers it used.
  *
- * @n: The AST node to generate code for.
- * @param reg: The register index to use for code generation.
- * @param parentASTop: The operator of the parent AST node.
+ * @link: Where the statement hangs.
+ * @arg: Unused.
+ */
+static void codegenStatement(struct ASTnode **link, void *arg) {
+    (void)arg;
+    codegenAST(*link, NOREG, A_GLUE);
+    codegenResetRegisters();
+}
+
+/**
+ * switchLabels - Lists the case and default labels of a switch body.
  *
  * NOTE:
- * If parentASTop is A_IF, comparison operations will generate
- * a jump instruction instead of setting a register value.
- * (e.g., if (b < c) { ... } )
- * Otherwise, comparison operations will set a register to 1 or 0
- * (e.g., int a = (b < c); )
+ * The body is glued like a compound statement (see switchStatement()),
+ * so its spine is walked without recursion.
  *
- * @return int The register index where the result is stored.
+ * @body: The switch body (may be NULL).
+ * @count: Receives the number of labels.
+ *
+ * @return The A_CASE and A_DEFAULT nodes in body order
+ *         (to be freed by the caller).
  */
-int codegenAST(struct ASTnode *n, int reg, int parentASTop) {
-    int leftRegister, rightRegister;
+static struct ASTnode **switchLabels(struct ASTnode *body, int *count) {
+    struct ASTnode **labels;
+    struct ASTnode *n, *statement;
+    int i = 0;
 
-    if (n == NULL) {
-        return NOREG;
+    for (int pass = 0; pass < 2; pass++) {
+        for (n = body; n != NULL; n = n->op == A_GLUE ? n->left : NULL) {
+            statement = n->op == A_GLUE ? n->right : n;
+            if (statement != NULL &&
+                (statement->op == A_CASE || statement->op == A_DEFAULT)) {
+                if (pass == 0) {
+                    i++;
+                } else {
+                    labels[--i] = statement;
+                }
+            }
+        }
+        if (pass == 0) {
+            *count = i;
+            if ((labels = malloc((i ? i : 1) * sizeof(*labels))) == NULL) {
+                logFatal("Out of memory in switchLabels()");
+            }
+        }
+    }
+    return labels;
+}
+
+/**
+ * compareSwitchCases - qsort() comparator ordering cases by value.
+ */
+static int compareSwitchCases(const void *a, const void *b) {
+    const struct switchCase *x = a, *y = b;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/**
+ * useJumpTable - Decides whether a switch dispatches through a table.
+ *
+ * @count: Number of cases.
+ * @low: The lowest case value.
+ * @high: The highest case value.
+ *
+ * @return int 1 for a jump table, 0 for a compare tree.
+ */
+static int useJumpTable(int count, int low, int high) {
+    long long span = (long long)high - low + 1;
+
+    return JumpTables && count >= SWITCH_TABLE_MIN_CASES &&
+           count * 100LL >= span * SWITCH_TABLE_MIN_DENSITY;
+}
+
+/**
+ * searchLabelCount - Number of labels codegenCaseSearch() hands out.
+ *
+ * @count: Number of cases searched.
+ */
+static int searchLabelCount(int count) {
+    if (count <= SWITCH_LINEAR_CASES) {
+        return 0;
+    }
+    return 1 + searchLabelCount(count / 2) +
+           searchLabelCount(count - count / 2 - 1);
+}
+
+/**
+ * dispatchLabelCount - Number of labels the dispatch of a switch
+ * hands out, besides the labels of its cases (see codegenSwitchDispatch()).
+ *
+ * @count: Number of cases.
+ * @low: The lowest case value.
+ * @high: The highest case value.
+ */
+static int dispatchLabelCount(int count, int low, int high) {
+    if (Backend == BACKEND_LLVM) {
+        return 0;
+    }
+    if (useJumpTable(count, low, high)) {
+        return 1;
+    }
+    return searchLabelCount(count);
+}
+
+/**
+ * codegenCaseSearch - Generates a balanced compare tree over sorted cases.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        cmp selector, middle value
+ *        je  Lmiddle case
+ *        jg  Lupper
+ *        (search the lower half)
+ * Lupper:
+ *        (search the upper half)
+ * ----------------------------------------
+ * Runs of SWITCH_LINEAR_CASES or fewer are compared one by one and
+ * end with a jump to the default label, so a lookup takes
+ * O(log n) compares.
+ *
+ * @reg: The register holding the selector.
+ * @cases: The cases, sorted by value.
+ * @count: Number of cases.
+ * @labelDefault: The label for every other value.
+ */
+static void codegenCaseSearch(int reg, struct switchCase *cases, int count,
+                              int labelDefault) {
+    int middle, labelUpper;
+
+    if (count <= SWITCH_LINEAR_CASES) {
+        for (int i = 0; i < count; i++) {
+            nasmCaseJump(reg, cases[i].value, cases[i].label, NOREG);
+        }
+        codegenJump(labelDefault);
+        return;
+    }
+
+    middle = count / 2;
+    labelUpper = getLabelNumber();
+    nasmCaseJump(reg, cases[middle].value, cases[middle].label, labelUpper);
+    codegenCaseSearch(reg, cases, middle, labelDefault);
+    codegenLabel(labelUpper);
+    codegenCaseSearch(reg, cases + middle + 1, count - middle - 1,
+                      labelDefault);
+}
+
+/**
+ * codegenSwitchDispatch - Generates the jump from a switch selector
+ * to the matching case.
+ *
+ * NOTE:
+ * LLVM gets a `switch` instruction and picks the lowering itself.
+ * The NASM backend uses a jump table when the case values are dense
+ * enough (useJumpTable()) and --no-jump-tables is not given, and a
+ * binary search over them otherwise.
+ *
+ * @reg: The register holding the selector (clobbered).
+ * @cases: The cases, sorted by value.
+ * @count: Number of cases.
+ * @labelDefault: The label for every other value.
+ */
+static void codegenSwitchDispatch(int reg, struct switchCase *cases,
+                                  int count, int labelDefault) {
+    int low, span, labelTable;
+    int *table;
+
+    if (Backend == BACKEND_LLVM) {
+        llvmSwitch(reg, cases, count, labelDefault);
+        return;
+    }
+    if (count == 0 ||
+        !useJumpTable(count, cases[0].value, cases[count - 1].value)) {
+        codegenCaseSearch(reg, cases, count, labelDefault);
+        return;
+    }
+
+    low = cases[0].value;
+    span = cases[count - 1].value - low + 1;
+    if ((table = malloc(span * sizeof(*table))) == NULL) {
+        logFatal("Out of memory in codegenSwitchDispatch()");
+    }
+    for (int i = 0; i < span; i++) {
+        table[i] = labelDefault;
+    }
+    for (int i = 0; i < count; i++) {
+        table[cases[i].value - low] = cases[i].label;
+    }
+
+    labelTable = getLabelNumber();
+    nasmJumpTable(reg, low, table, span, labelDefault, labelTable);
+    free(table);
+}
+
+/**
+ * codegenSwitchStatementAST - Generates code for a SWITCH statement.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        evaluate the selector
+ *        dispatch to the matching case label, or to Ldefault
+ *        (codegenSwitchDispatch())
+ * Lcase1:
+ *        statements ...     (falling through into the next case)
+ * Lcase2:
+ *        statements ...
+ *        jump to Lbreak     (break)
+ * Ldefault:
+ *        statements ...
+ * Lbreak:
+ * ----------------------------------------
+ * Without a default label, Ldefault is Lbreak.
+ *
+ * @n: The AST node representing the SWITCH statement.
+ *
+ * @return int NOREG
+ */
+static int codegenSwitchStatementAST(struct ASTnode *n) {
+    struct switchContext context;
+    struct switchCase *cases;
+    struct ASTnode **labels;
+    int count, caseCount = 0;
+    int labelDefault, labelBreak, reg;
+    int outerBreak = breakLabel;
+
+    labels = switchLabels(n->right, &count);
+    context.labels = malloc((count ? count : 1) * sizeof(*context.labels));
+    cases = malloc((count ? count : 1) * sizeof(*cases));
+    if (context.labels == NULL || cases == NULL) {
+        logFatal("Out of memory in codegenSwitchStatementAST()");
+    }
+
+    codegenSourceLine(n->left->line);
+    reg = codegenAST(n->left, NOREG, A_SWITCH);
+
+    labelBreak = labelDefault = getLabelNumber();
+    for (int i = 0; i < count; i++) {
+        context.labels[i] = getLabelNumber();
+        if (labels[i]->op == A_DEFAULT) {
+            labelDefault = context.labels[i];
+        } else {
+            cases[caseCount].value = labels[i]->v.intvalue;
+            cases[caseCount].label = context.labels[i];
+            caseCount++;
+        }
+    }
+    qsort(cases, caseCount, sizeof(*cases), compareSwitchCases);
+
+    codegenSwitchDispatch(reg, cases, caseCount, labelDefault);
+    codegenResetRegisters();
+    free(cases);
+    free(labels);
+
+    // The body reaches the labels in order (see codegenSwitchLabel())
+    context.labelCount = count;
+    context.next = 0;
+    context.outer = currentSwitch;
+    currentSwitch = &context;
+    breakLabel = labelBreak;
+    codegenAST(n->right, NOREG, A_SWITCH);
+    codegenResetRegisters();
+    currentSwitch = context.outer;
+    breakLabel = outerBreak;
+
+    codegenLabel(labelBreak);
+    free(context.labels);
+    return NOREG;
+}
+
+/**
+ * codegenSwitchLabel - Generates a case or default label of the
+ * switch being generated.
+ *
+ * @return int NOREG
+ */
+static int codegenSwitchLabel(void) {
+    if (currentSwitch == NULL ||
+        currentSwitch->next == currentSwitch->labelCount) {
+        logFatal("Case label outside of a switch body");
+    }
+    codegenLabel(currentSwitch->labels[currentSwitch->next++]);
+    return NOREG;
+}
+
+/**
+ * codegenWhileStatementAST - Generates code for a loop.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        (vectorized loop, see vectorLoop())
+ * Lstart:
+ *        jump to Lend if the condition is FALSE
+ *        body
+ *        step (for loops)
+ *        jump to Lstart
+ * Lend:
+ * ----------------------------------------
+ * A break jumps to Lend. When the NASM backend can vectorize the loop
+ * (vectorWidth()), the vector loop runs first and the scalar loop
+ * only does the iterations left over.
+ *
+ * @n: The AST node representing the WHILE statement.
+ *
+ * @return int NOREG
+ */
+static int codegenWhileStatementAST(struct ASTnode *n) {
+    int labelStart, labelEnd, labelVector, labelVectorDone;
+    int outerBreak = breakLabel;
+
+    if (Backend == BACKEND_NASM && vectorWidth(n)) {
+        labelVector = getLabelNumber();
+        labelVectorDone = getLabelNumber();
+        codegenSourceLine(n->left->line);
+        vectorLoop(n, labelVector, labelVectorDone);
+        codegenResetRegisters();
+    }
+
+    labelStart = getLabelNumber();
+    labelEnd = getLabelNumber();
+
+    codegenLabel(labelStart);
+    codegenCondition(n->left, labelEnd, 0);
+    codegenResetRegisters();
+
+    breakLabel = labelEnd;
+    codegenAST(n->middle, NOREG, A_WHILE);
+    codegenResetRegisters();
+    codegenAST(n->right, NOREG, A_WHILE);
+    codegenResetRegisters();
+    breakLabel = outerBreak;
+
+    codegenJump(labelStart);
+    codegenLabel(labelEnd);
+    return NOREG;
+}
+
+/**
+ * declareLocals - Gives every local of a frame its LLVM stack slot.
+ *
+ * NOTE:
+ * A local is assigned before it is read (its declaration assigns it
+ * 0), so the assignments find them all. Each local belongs to one
+ * frame; its location marks it as done.
+ *
+ * @n: The frame's statements; functions defined in them are skipped.
+ */
+static void declareLocals(struct ASTnode *n) {
+    struct symbolTable *s;
+
+    // Down the left spine in a loop, see walkStatements()
+    for (; n != NULL && n->op != A_FUNCTION; n = n->left) {
+        if (n->op == A_LVALUEIDENTIFIER) {
+            s = &GlobalSymbolTable[n->v.identifierIndex];
+            if (s->kind == S_LOCAL && s->location == 0) {
+                llvmDeclareLocal(n->v.identifierIndex);
+                s->location = 1;
+            }
+        }
+        declareLocals(n->middle);
+        declareLocals(n->right);
+    }
+}
+
+/**
+ * codegenFunctionAST - Generates a function definition.
+ *
+ * NOTE:
+ * The function is written to Coldfile, so it ends up after main
+ * like the cold blocks do:
+ * ----------------------------------------
+ * name:
+ *        prologue, parameters into their slots
+ *        perform the body
+ *        result = 0
+ * Lreturn:
+ *        epilogue
+ * ----------------------------------------
+ * A return statement jumps to Lreturn with its value (see
+ * codegenReturnAST()). No cached value crosses the function's edges.
+ * The body's locals are placed before the prologue, which reserves
+ * their stack slots.
+ *
+ * @n: The AST node representing the FUNCTION.
+ *
+ * @return int NOREG
+ */
+static int codegenFunctionAST(struct ASTnode *n) {
+    struct symbolTable *f = &GlobalSymbolTable[n->v.identifierIndex];
+    FILE *mainfile = Outfile;
+    int mainLine = lastSourceLine;
+    int outerBreak = breakLabel, outerExit = inlineExitLabel;
+    int spillSlots = 0, registers;
+
+    if (emittingColdCode) {
+        logFatal("Functions can only be defined at the top level of the "
+                 "program");
+    }
+    if (Coldfile == NULL && (Coldfile = tmpfile()) == NULL) {
+        logFatal("Cannot create temporary file for cold code");
+    }
+
+    Outfile = Coldfile;
+    lastSourceLine = 0;
+    emittingColdCode = 1;
+    breakLabel = inlineExitLabel = 0;
+    returnLabel = getLabelNumber();
+    cseFlush();
+
+    codegenSourceLine(n->line);
+    if (Backend == BACKEND_NASM) {
+        spillSlots = allocateLocals(n->left, &registers);
+        nasmChoosePool(registers);
+    }
+    codegenFunctionPreamble(f->name, f->parameters, spillSlots);
+    if (Backend == BACKEND_LLVM) {
+        declareLocals(n->left);
+    }
+    codegenAST(n->left, NOREG, A_FUNCTION);
+    codegenResetRegisters();
+    codegenFunctionPostamble(returnLabel);
+    if (Backend == BACKEND_NASM) {
+        nasmChoosePool(mainLocalRegisters); // back in main
+    }
+
+    cseFlush();
+    returnLabel = 0;
+    breakLabel = outerBreak;
+    inlineExitLabel = outerExit;
+    emittingColdCode = 0;
+    Outfile = mainfile;
+    lastSourceLine = mainLine;
+    return NOREG;
+}
+
+/**
+ * codegenReturnAST - Generates a return statement.
+ *
+ * NOTE:
+ * A return without a value only occurs in an inlined function body
+ * (see inline.c), where it jumps past the rest of the body.
+ *
+ * @n: The AST node representing the RETURN statement.
+ *
+ * @return int NOREG
+ */
+static int codegenReturnAST(struct ASTnode *n) {
+    if (n->left == NULL) {
+        if (inlineExitLabel == 0) {
+            logFatal("return outside of a function");
+        }
+        codegenJump(inlineExitLabel);
+        return NOREG;
+    }
+    if (returnLabel == 0) {
+        logFatal("return outside of a function");
+    }
+    codegenReturn(codegenAST(n->left, NOREG, A_RETURN), returnLabel);
+    return NOREG;
+}
+
+/**
+ * codegenCallAST - Generates a function call.
+ *
+ * NOTE:
+ * The arguments are computed left to right, each one saved before
+ * the next (which may be a call itself) is computed. The callee may
+ * assign any global, so no cached value survives the call.
+ *
+ * @n: The AST node representing the CALL.
+ *
+ * @return int The register index containing the returned value.
+ */
+static int codegenCallAST(struct ASTnode *n) {
+    int saved = codegenSaveRegisters(n->liveLocals);
+    int count = 0, reg;
+
+    for (struct ASTnode *a = n->left; a != NULL; a = a->right) {
+        codegenPushArgument(codegenAST(a->left, NOREG, A_CALL));
+        count++;
+    }
+    reg = codegenCall(n->v.identifierIndex, count, saved);
+    cseFlush();
+    return reg;
+}
+
+/**
+ * codegenInlineAST - Generates a function body inlined by inline.c.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        perform the body
+ * Lexit:
+ * ----------------------------------------
+ * Its return statements assign the result and jump to Lexit.
+ *
+ * @n: The AST node representing the INLINE body.
+ *
+ * @return int NOREG
+ */
+static int codegenInlineAST(struct ASTnode *n) {
+    int outerExit = inlineExitLabel;
+
+    inlineExitLabel = getLabelNumber();
+    codegenAST(n->left, NOREG, A_INLINE);
+    codegenResetRegisters();
+    codegenLabel(inlineExitLabel);
+    inlineExitLabel = outerExit;
+    return NOREG;
+}
+
+/**
+ * codegenAST - Generates code for the given AST node and its subtrees.
+ *
+ * @n: The AST node to generate code for.
+ * @param reg: The register index to use for code generation.
+ * @param parentASTop: The operator of the parent AST node.
+ *
+ * NOTE:
+ * If parentASTop is A_IF, comparison operations will generate
+ * a jump instruction instead of setting a register value.
+ * (e.g., if (b < c) { ... } )
+ * Otherwise, comparison operations will set a register to 1 or 0
+ * (e.g., int a = (b < c); )
+ *
+ * @return int The register index where the result is stored.
+ */
+int codegenAST(struct ASTnode *n, int reg, int parentASTop) {
+    int resultRegister;
+    int slot;
+
+    if (n == NULL) {
+        return NOREG;
     }
 
     switch (n->op) {
     case A_IF:
         // If statement
         return codegenIFStatementAST(n);
+    case A_SWITCH:
+        return codegenSwitchStatementAST(n);
+    case A_WHILE:
+        return codegenWhileStatementAST(n);
+    case A_CASE:
+    case A_DEFAULT:
+        return codegenSwitchLabel();
+    case A_BREAK:
+        if (breakLabel == 0) {
+            logFatal("break outside of a switch or loop");
+        }
+        codegenJump(breakLabel);
+        return NOREG;
+    case A_FUNCTION:
+        return codegenFunctionAST(n);
+    case A_INLINE:
+        return codegenInlineAST(n);
+    case A_CALL:
+        return codegenCallAST(n);
+    case A_RETURN:
+        codegenSourceLine(n->line);
+        return codegenReturnAST(n);
+    case A_CALLSTATEMENT:
+        codegenSourceLine(n->line);
+        codegenCallAST(n->left);
+        codegenResetRegisters();
+        return NOREG;
     case A_GLUE:
-        // Do each sub-tree separately,
-        // and return NOREG since GLUE does not produce a value
-        // Then free registers used in each sub-tree
-        codegenAST(n->left, NOREG, n->op);
-        nasmResetRegisterPool();
-        if (n->right) {
-            codegenAST(n->right, NOREG, n->op);
-            nasmResetRegisterPool();
+        // Do each statement separately, and return NOREG since GLUE
+        // does not produce a value
+        walkStatements(&n, codegenStatement, NULL);
+        return NOREG;
+
+    case A_ASSIGN:
+    case A_PRINT:
+        // Statements start a new source line
+        codegenSourceLine(n->line);
+
+        // The NASM backend covers whole statements with tree patterns,
+        // unless a && or || or a call is in the middle of one, or a
+        // print must save locals around its call
+        if (Backend == BACKEND_NASM && UseInstructionSelection &&
+            isSelectable(n) &&
+            (n->op != A_PRINT || n->liveLocals == 0)) {
+            iselStatement(n);
+            if (n->op == A_ASSIGN) {
+                cseKill(n->right->v.identifierIndex);
+            }
+            return NOREG;
         }
+        break;
+    }
 
-        return NOREG;
+    // Repeated pure expressions are computed once and then copied
+    // out of a cache slot (see cse.c). A comparison under A_IF
+    // is a jump, not a value, so it is never cached.
+    if (parentASTop != A_IF && cseIsCandidate(n)) {
+        if ((slot = cseLookup(n)) != NOREG) {
+            return codegenCacheLoad(slot);
+        }
+        resultRegister = codegenOperatorAST(n, reg, parentASTop);
+        if ((slot = cseRecord(n)) != NOREG) {
+            codegenCacheStore(resultRegister, slot);
+        }
+        return resultRegister;
+    }
+
+    return codegenOperatorAST(n, reg, parentASTop);
+}
+
+/**
+ * codegenOperatorAST - Generates code for an expression or simple
+ * statement node (everything but A_IF and A_GLUE).
+ *
+ * @n: The AST node to generate code for.
+ * @param reg: The register index to use for code generation.
+ * @param parentASTop: The operator of the parent AST node.
+ *
+ * @return int The register index where the result is stored.
+ */
+static int codegenOperatorAST(struct ASTnode *n, int reg, int parentASTop) {
+    int leftRegister, rightRegister;
+
+    // && and || only evaluate their right operand when needed
+    if (n->op == A_LOGAND || n->op == A_LOGOR) {
+        return codegenBooleanValue(n);
     }
 
-    // NOTE:
-    // General AST node handling below
+    // A literal shift or mask (see range.c) is an immediate operand,
+    // and so is a power of two divisor on NASM
+    if (n->op == A_SHIFTRIGHT || n->op == A_BITAND) {
+        leftRegister = codegenAST(n->left, NOREG, n->op);
+        return n->op == A_SHIFTRIGHT
+                   ? codegenShiftRight(leftRegister, n->right->v.intvalue)
+                   : codegenAndImmediate(leftRegister, n->right->v.intvalue);
+    }
+    if (Backend == BACKEND_NASM &&
+        (n->op == A_DIVIDE || n->op == A_MODULO) &&
+        n->right->op == A_INTLIT && n->right->v.intvalue > 1 &&
+        (n->right->v.intvalue & (n->right->v.intvalue - 1)) == 0) {
+        leftRegister = codegenAST(n->left, NOREG, n->op);
+        return nasmDivPowerOfTwo(leftRegister, n->right->v.intvalue,
+                                 n->op == A_MODULO);
+    }
+    // On NASM, a multiplier with a sequence faster than imul (superopt.c)
+    if (Backend == BACKEND_NASM && n->op == A_MULTIPLY &&
+        n->right->op == A_INTLIT &&
+        nasmMulSequence(n->right->v.intvalue) != NULL) {
+        leftRegister = codegenAST(n->left, NOREG, n->op);
+        return nasmMulConstant(leftRegister, n->right->v.intvalue);
+    }
 
     // Get the left and right sub-tree value
     if (n->left) {
@@ -143,13 +1399,15 @@ int codegenAST(struct ASTnode *n, int reg, int parentASTop) {
     switch (n->op) {
     // Arithmetic operations
     case A_ADD:
-        return nasmAddRegs(leftRegister, rightRegister);
+        return codegenAddRegs(leftRegister, rightRegister);
     case A_SUBTRACT:
-        return nasmSubRegs(leftRegister, rightRegister);
+        return codegenSubRegs(leftRegister, rightRegister);
     case A_MULTIPLY:
-        return nasmMulRegs(leftRegister, rightRegister);
+        return codegenMulRegs(leftRegister, rightRegister);
     case A_DIVIDE:
-        return nasmDivRegsSigned(leftRegister, rightRegister);
+        return codegenDivRegsSigned(leftRegister, rightRegister);
+    case A_MODULO:
+        return codegenModRegsSigned(leftRegister, rightRegister);
 
     // Comparison operations
     case A_EQ:
@@ -163,25 +1421,39 @@ int codegenAST(struct ASTnode *n, int reg, int parentASTop) {
         // Otherwise, compare registers and set one to 1 or 0 based on the
         // comparison.
         if (parentASTop == A_IF) {
-            return nasmCompareAndJump(n->op, leftRegister, rightRegister, reg);
+            return codegenCompareAndJump(n->op, leftRegister, rightRegister, reg);
         } else {
-            return nasmCompareAndSet(n->op, leftRegister, rightRegister);
+            return codegenCompareAndSet(n->op, leftRegister, rightRegister);
         }
 
+    // Logical not as a value (a condition just flips, see codegenBranch())
+    case A_LOGNOT:
+        // !x is x == 0
+        return codegenCompareAndSet(A_EQ, leftRegister,
+                                    codegenLoadImmediateInt(0));
+
     // Leaf nodes
     case A_INTLIT:
-        return nasmLoadImmediateInt(n->v.intvalue);
+        return codegenLoadImmediateInt(n->v.intvalue);
     case A_IDENTIFIER:
-        return nasmLoadGlobalSymbol(
-            GlobalSymbolTable[n->v.identifierIndex].name);
+        return codegenLoadVariable(n->v.identifierIndex);
     case A_LVALUEIDENTIFIER:
-        return nasmStoreGlobalSymbol(
-            reg, GlobalSymbolTable[n->v.identifierIndex].name);
+        codegenStoreVariable(reg, n->v.identifierIndex);
+        // Cached values that read the old value are stale now
+        cseKill(n->v.identifierIndex);
+        return reg;
+    case A_INDEX:
+        return codegenLoadElement(leftRegister, n->v.identifierIndex);
+    case A_LVALUEINDEX:
+        codegenStoreElement(reg, leftRegister, n->v.identifierIndex);
+        // Cached values that read any element of the array are stale now
+        cseKill(n->v.identifierIndex);
+        return reg;
     case A_ASSIGN:
         // The work has already been done, return the result
         return rightRegister;
     case A_PRINT:
-        codegenPrintInt(leftRegister);
+        codegenPrintInt(leftRegister, n->liveLocals);
         codegenResetRegisters();
         return NOREG;
 
@@ -192,31 +1464,955 @@ int codegenAST(struct ASTnode *n, int reg, int parentASTop) {
     }
 }
 
+/**
+ * NOTE:
+ * The wrappers below forward to the backend selected by `Backend`.
+ * Every target-specific call made by codegenAST() goes through them,
+ * so a new backend only has to provide the matching set of routines.
+ */
+
 /**
  * codegenPreamble - Wraps CPU-specific preamble generation.
  */
-void codegenPreamble() { nasmPreamble(); }
+void codegenPreamble() {
+    if (Backend == BACKEND_LLVM) {
+        llvmPreamble();
+        return;
+    }
+    nasmPreamble();
+}
 
 /**
  * codegenPostamble - Wraps CPU-specific postamble generation.
+ *
+ * NOTE:
+ * Functions, out-of-line cold blocks and the instrumentation runtime
+ * are placed after main's epilogue. With --stream, the globals
+ * are declared here, once the whole program has been seen.
  */
-void codegenPostamble() { nasmPostamble(); }
+void codegenPostamble() {
+    if (Backend == BACKEND_LLVM) {
+        llvmPostamble();
+        codegenMoveColdCode(Outfile); // the functions
+        return;
+    }
+    nasmPostamble(mainSpillSlots);
+
+    codegenMoveColdCode(Outfile);
+    profileCheck(branchCount); // every if statement has its id now
+
+    if (InstrumentBranches) {
+        nasmProfileRuntime(branchCount);
+    }
+
+    if (StreamStatements) {
+        for (int i = 0; i < countGlobalSymbols(); i++) {
+            if (GlobalSymbolTable[i].kind == S_VARIABLE) {
+                nasmDeclareGlobalSymbol(GlobalSymbolTable[i].name,
+                                        GlobalSymbolTable[i].length);
+            }
+        }
+    }
+}
 
 /**
- * codegenResetRegisters - Frees all registers used during code generation.
+ * codegenAllocateLocals - Places the locals of main's statements,
+ * before their code is generated.
+ *
+ * NOTE:
+ * The NASM backend puts them in registers or stack slots (see
+ * regalloc.c); main's frame has room for the most slots any of the
+ * calls needed.
+ * The LLVM backend gives each its stack slot, which mem2reg turns
+ * into SSA values. The locals of functions are placed with them
+ * (see codegenFunctionAST()).
+ *
+ * @tree: The statements (all of them, or one with --stream).
  */
-void codegenResetRegisters() { nasmResetRegisterPool(); }
+void codegenAllocateLocals(struct ASTnode *tree) {
+    int slots, registers;
+
+    if (Backend == BACKEND_LLVM) {
+        declareLocals(tree);
+        return;
+    }
+    if ((slots = allocateLocals(tree, &registers)) > mainSpillSlots) {
+        mainSpillSlots = slots;
+    }
+    mainLocalRegisters |= registers;
+    nasmChoosePool(mainLocalRegisters);
+}
 
 /**
- * codegenPrintInt - Wraps CPU-specific integer printing.
+ * codegenReset - Forgets everything generated so far, so the next
+ * compilation in the same process starts from a clean state.
  *
- * @reg: The register index containing the integer to print.
+ * NOTE:
+ * Also used after a fatal error, which may leave a cold block open.
  */
-void codegenPrintInt(int reg) { nasmPrintIntFromReg(reg); }
+void codegenReset(void) {
+    if (Coldfile != NULL) {
+        fclose(Coldfile);
+        Coldfile = NULL;
+    }
+    emittingColdCode = 0;
+    branchCount = 0;
+    labelCount = 1;
+    lastSourceLine = 0;
+    currentSwitch = NULL;
+    breakLabel = 0;
+    returnLabel = 0;
+    inlineExitLabel = 0;
+    mainSpillSlots = 0;
+    mainLocalRegisters = 0;
+    cseReset();
+    regallocReset();
+}
 
 /**
- * codegenDeclareGlobalSymbol - Wraps CPU-specific global symbol generation.
+ * codegenMoveColdCode - Writes out the cold code generated so far
+ * and forgets it.
+ *
+ * @to: Where the cold code goes.
+ */
+void codegenMoveColdCode(FILE *to) {
+    char buf[BUFSIZ];
+    size_t n;
+
+    if (Coldfile == NULL) {
+        return;
+    }
+    rewind(Coldfile);
+    while ((n = fread(buf, 1, sizeof(buf), Coldfile)) > 0) {
+        fwrite(buf, 1, n, to);
+    }
+    fclose(Coldfile);
+    Coldfile = NULL;
+}
+
+/**
+ * codegenAddColdCode - Appends cold code generated elsewhere
+ * (by a parallel.c worker) to this thread's cold code.
+ *
+ * @code: The cold code.
+ * @size: Its size in bytes.
+ */
+void codegenAddColdCode(char *code, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (Coldfile == NULL && (Coldfile = tmpfile()) == NULL) {
+        logFatal("Cannot create temporary file for cold code");
+    }
+    fwrite(code, 1, size, Coldfile);
+}
+
+/**
+ * codegenGetPosition - Reads the counters that code generation
+ * has advanced so far.
+ *
+ * @pos: Receives the counters.
+ */
+void codegenGetPosition(struct codegenPosition *pos) {
+    pos->label = labelCount;
+    pos->branch = branchCount;
+    pos->sourceLine = lastSourceLine;
+    pos->localRegisters = mainLocalRegisters;
+}
+
+/**
+ * codegenSetPosition - Continues code generation from the given
+ * counters, as if everything before them had been generated here.
+ *
+ * @pos: The counters.
+ */
+void codegenSetPosition(struct codegenPosition *pos) {
+    labelCount = pos->label;
+    branchCount = pos->branch;
+    lastSourceLine = pos->sourceLine;
+    mainLocalRegisters = pos->localRegisters;
+    if (Backend == BACKEND_NASM) {
+        nasmChoosePool(mainLocalRegisters);
+    }
+}
+
+static void skipAST(struct ASTnode *n, struct codegenPosition *pos,
+                    int cold);
+static int skipIfStatement(struct ASTnode *n, struct codegenPosition *pos,
+                           int cold);
+static void skipSwitchStatement(struct ASTnode *n,
+                                struct codegenPosition *pos, int cold);
+static void skipWhileStatement(struct ASTnode *n, struct codegenPosition *pos,
+                               int cold);
+static int branchLabelCount(struct ASTnode *cond, int jumpIfTrue);
+
+/**
+ * valueLabelCount - Returns how many labels computing an expression
+ * takes, see codegenBooleanValue().
+ *
+ * NOTE:
+ * An expression holding && or || is never cached (see cse.c),
+ * so its labels are always taken.
+ *
+ * @n: The expression.
+ *
+ * @return int The number of labels.
+ */
+static int valueLabelCount(struct ASTnode *n) {
+    if (n == NULL) {
+        return 0;
+    }
+    if (n->op == A_LOGAND || n->op == A_LOGOR) {
+        return 3 + branchLabelCount(n, 0);
+    }
+    return valueLabelCount(n->left) + valueLabelCount(n->right);
+}
+
+/**
+ * branchLabelCount - Returns how many labels codegenBranch() takes
+ * for a condition.
+ *
+ * @cond: The condition.
+ * @jumpIfTrue: As passed to codegenBranch().
+ *
+ * @return int The number of labels.
+ */
+static int branchLabelCount(struct ASTnode *cond, int jumpIfTrue) {
+    if (!BranchChains && cond->op != A_LOGAND && cond->op != A_LOGOR) {
+        return valueLabelCount(cond);
+    }
+    switch (cond->op) {
+    case A_LOGNOT:
+        return branchLabelCount(cond->left, !jumpIfTrue);
+    case A_LOGAND:
+    case A_LOGOR:
+        if (jumpIfTrue == (cond->op == A_LOGOR)) {
+            return branchLabelCount(cond->left, jumpIfTrue) +
+                   branchLabelCount(cond->right, jumpIfTrue);
+        }
+        return 1 + branchLabelCount(cond->left, !jumpIfTrue) +
+               branchLabelCount(cond->right, jumpIfTrue);
+    }
+    if (isComparison(cond->op)) {
+        return valueLabelCount(cond->left) + valueLabelCount(cond->right);
+    }
+    return valueLabelCount(cond);
+}
+
+// The counters a chain of statements advances, see skipStatement()
+struct skipWalk {
+    struct codegenPosition *pos;
+    int cold;
+};
+
+/**
+ * skipStatement - Advances the counters past one statement of a chain
+ * (see walkStatements()).
+ *
+ * @link: Where the statement hangs.
+ * @arg: The struct skipWalk.
+ */
+static void skipStatement(struct ASTnode **link, void *arg) {
+    struct skipWalk *walk = arg;
+
+    skipAST(*link, walk->pos, walk->cold);
+}
+
+/**
+ * skipColdAST - Advances the counters past a tree generated out of line.
+ *
+ * NOTE:
+ * Cold code keeps its line annotations to itself, so the source line
+ * is the one before the tree (see codegenColdBlock()).
+ *
+ * @n: The AST node.
+ * @pos: The counters to advance.
+ */
+static void skipColdAST(struct ASTnode *n, struct codegenPosition *pos) {
+    int hotLine = pos->sourceLine;
+
+    skipAST(n, pos, 1);
+    pos->sourceLine = hotLine;
+}
+
+/**
+ * skipAST - Advances the counters past a tree, see codegenSkipStatement().
+ *
+ * @n: The AST node.
+ * @pos: The counters to advance.
+ * @cold: Whether the tree would be generated out of line.
+ */
+static void skipAST(struct ASTnode *n, struct codegenPosition *pos,
+                    int cold) {
+    if (n == NULL) {
+        return;
+    }
+
+    switch (n->op) {
+    case A_GLUE:
+        walkStatements(&n, skipStatement, &(struct skipWalk){pos, cold});
+        return;
+    case A_IF:
+        skipIfStatement(n, pos, cold);
+        return;
+    case A_SWITCH:
+        skipSwitchStatement(n, pos, cold);
+        return;
+    case A_WHILE:
+        skipWhileStatement(n, pos, cold);
+        return;
+    case A_ASSIGN:
+    case A_PRINT:
+        pos->sourceLine = n->line;
+        pos->label += valueLabelCount(n);
+        return;
+    case A_RETURN:
+    case A_CALLSTATEMENT:
+        pos->sourceLine = n->line;
+        pos->label += valueLabelCount(n->left);
+        return;
+    case A_FUNCTION:
+        // Generated out of line, see codegenFunctionAST()
+        pos->label++;
+        skipColdAST(n->left, pos);
+        return;
+    case A_INLINE:
+        pos->label++;
+        skipAST(n->left, pos, cold);
+        return;
+    }
+}
+
+/**
+ * skipIfStatement - Advances the counters past an if statement, in the
+ * order codegenIFStatementAST() generates its blocks.
+ *
+ * @n: The AST node representing the IF statement.
+ * @pos: The counters to advance.
+ * @cold: Whether the statement would be generated out of line.
+ *
+ * @return int 1 if the statement ends with a label, 0 if it has none.
+ */
+static int skipIfStatement(struct ASTnode *n, struct codegenPosition *pos,
+                           int cold) {
+    int branchId = pos->branch++;
+
+    pos->sourceLine = n->left->line;
+    switch (ifLayout(n, branchId, cold)) {
+    case IF_LAYOUT_CONVERTED:
+        return 0;
+    case IF_LAYOUT_COLD_THEN:
+        pos->label += 2 + branchLabelCount(n->left, 1);
+        skipAST(n->right, pos, cold);
+        skipColdAST(n->middle, pos);
+        return 1;
+    case IF_LAYOUT_COLD_ELSE:
+        pos->label += 2 + branchLabelCount(n->left, 0);
+        skipAST(n->middle, pos, cold);
+        skipColdAST(n->right, pos);
+        return 1;
+    case IF_LAYOUT_ELSE_FIRST:
+        pos->label += 2 + branchLabelCount(n->left, 1);
+        skipAST(n->right, pos, cold);
+        skipAST(n->middle, pos, cold);
+        return 1;
+    }
+
+    pos->label += (n->right ? 2 : 1) + branchLabelCount(n->left, 0);
+    skipAST(n->middle, pos, cold);
+    skipAST(n->right, pos, cold);
+    return 1;
+}
+
+/**
+ * skipSwitchStatement - Advances the counters past a switch statement,
+ * see codegenSwitchStatementAST().
+ *
+ * @n: The AST node representing the SWITCH statement.
+ * @pos: The counters to advance.
+ * @cold: Whether the statement would be generated out of line.
+ */
+static void skipSwitchStatement(struct ASTnode *n,
+                                struct codegenPosition *pos, int cold) {
+    struct ASTnode **labels;
+    int count, caseCount = 0, low = 0, high = 0;
+
+    labels = switchLabels(n->right, &count);
+    for (int i = 0; i < count; i++) {
+        if (labels[i]->op == A_CASE) {
+            if (caseCount == 0 || labels[i]->v.intvalue < low) {
+                low = labels[i]->v.intvalue;
+            }
+            if (caseCount == 0 || labels[i]->v.intvalue > high) {
+                high = labels[i]->v.intvalue;
+            }
+            caseCount++;
+        }
+    }
+    free(labels);
+
+    pos->sourceLine = n->left->line;
+    pos->label += 1 + count + dispatchLabelCount(caseCount, low, high) +
+                  valueLabelCount(n->left);
+    skipAST(n->right, pos, cold);
+}
+
+/**
+ * skipWhileStatement - Advances the counters past a loop,
+ * see codegenWhileStatementAST().
+ *
+ * @n: The AST node representing the WHILE statement.
+ * @pos: The counters to advance.
+ * @cold: Whether the statement would be generated out of line.
+ */
+static void skipWhileStatement(struct ASTnode *n, struct codegenPosition *pos,
+                               int cold) {
+    if (Backend == BACKEND_NASM && vectorWidth(n)) {
+        pos->label += 2;
+    }
+    pos->sourceLine = n->left->line;
+    pos->label += 2 + branchLabelCount(n->left, 0);
+    skipAST(n->middle, pos, cold);
+    skipAST(n->right, pos, cold);
+}
+
+/**
+ * codegenSkipStatement - Advances the counters past a top-level
+ * statement without generating it.
+ *
+ * NOTE:
+ * Makes the same layout decisions as codegenIFStatementAST(),
+ * so the counters end up exactly where generating the statement
+ * would leave them. parallel.c uses this to start each chunk of
+ * statements from the right label, branch id and source line.
+ *
+ * @n: The statement.
+ * @pos: The counters to advance.
+ *
+ * @return int 1 if the statement ends with a label, which empties
+ *         the CSE cache; 0 otherwise.
+ */
+int codegenSkipStatement(struct ASTnode *n, struct codegenPosition *pos) {
+    if (n != NULL && n->op == A_IF) {
+        return skipIfStatement(n, pos, 0);
+    }
+    if (n != NULL && n->op == A_SWITCH) {
+        skipSwitchStatement(n, pos, 0);
+        return 1;
+    }
+    skipAST(n, pos, 0);
+
+    // A loop, or a for loop (its first assignment glued to the loop);
+    // codegenFunctionAST() flushes the cache itself
+    return n != NULL && (n->op == A_WHILE || n->op == A_FUNCTION ||
+                         n->op == A_INLINE ||
+                         (n->op == A_GLUE && n->right != NULL &&
+                          n->right->op == A_WHILE));
+}
+
+/**
+ * codegenResetRegisters - Frees all registers used during code generation.
+ *
+ * NOTE:
+ * The LLVM backend hands out SSA values instead of physical registers,
+ * so there is nothing to free there.
+ */
+void codegenResetRegisters() {
+    if (Backend == BACKEND_LLVM) {
+        return;
+    }
+    nasmResetRegisterPool();
+}
+
+/**
+ * codegenPrintInt - Wraps CPU-specific integer printing.
+ *
+ * @reg: The register index containing the integer to print.
+ * @live: Registers of locals the call must save (see regalloc.c).
+ */
+void codegenPrintInt(int reg, int live) {
+    if (Backend == BACKEND_LLVM) {
+        llvmPrintIntFromReg(reg);
+        return;
+    }
+    nasmPrintIntFromReg(reg, live);
+}
+
+/**
+ * codegenDeclareGlobalSymbol - Wraps CPU-specific global symbol generation.
  *
  * @name: The name of the global symbol.
+ * @length: Number of elements of an array, 0 for an int.
+ */
+void codegenDeclareGlobalSymbol(char *name, int length) {
+    if (EmitAST) {
+        astRecordDeclaration(name); // written with the AST
+        return;
+    }
+    if (Backend == BACKEND_LLVM) {
+        llvmDeclareGlobalSymbol(name, length);
+        return;
+    }
+    if (StreamStatements) {
+        return; // declared by codegenPostamble()
+    }
+    nasmDeclareGlobalSymbol(name, length);
+}
+
+/**
+ * codegenLoadImmediateInt - Wraps CPU-specific integer constant loading.
+ *
+ * @value: The integer constant to load.
+ *
+ * @return int The register index containing the constant.
+ */
+int codegenLoadImmediateInt(int value) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmLoadImmediateInt(value);
+    }
+    return nasmLoadImmediateInt(value);
+}
+
+/**
+ * codegenLoadVariable - Wraps CPU-specific loading of a global int,
+ * a parameter or a local.
+ *
+ * @identifierIndex: The symbol table index of the variable.
+ *
+ * @return int The register index containing the loaded value.
+ */
+int codegenLoadVariable(int identifierIndex) {
+    struct symbolTable *s = &GlobalSymbolTable[identifierIndex];
+
+    if (Backend == BACKEND_LLVM) {
+        if (s->kind == S_LOCAL) {
+            return llvmLoadLocal(identifierIndex);
+        }
+        return s->kind == S_PARAMETER ? llvmLoadParameter(s->position)
+                                      : llvmLoadGlobalSymbol(s->name);
+    }
+    return nasmLoadVariable(identifierIndex);
+}
+
+/**
+ * codegenStoreVariable - Wraps CPU-specific storing into a global int,
+ * a parameter or a local.
+ *
+ * @reg: The register index containing the value to store.
+ * @identifierIndex: The symbol table index of the variable.
+ *
+ * @return int The register index that was stored.
+ */
+int codegenStoreVariable(int reg, int identifierIndex) {
+    struct symbolTable *s = &GlobalSymbolTable[identifierIndex];
+
+    if (Backend == BACKEND_LLVM) {
+        if (s->kind == S_LOCAL) {
+            return llvmStoreLocal(reg, identifierIndex);
+        }
+        return s->kind == S_PARAMETER ? llvmStoreParameter(reg, s->position)
+                                      : llvmStoreGlobalSymbol(reg, s->name);
+    }
+    return nasmStoreVariable(reg, identifierIndex);
+}
+
+/**
+ * codegenLoadElement - Wraps CPU-specific array element loading.
+ *
+ * @reg: The register index containing the element index.
+ * @identifierIndex: The symbol table index of the array.
+ *
+ * @return int The register index containing the loaded value.
+ */
+int codegenLoadElement(int reg, int identifierIndex) {
+    struct symbolTable *array = &GlobalSymbolTable[identifierIndex];
+
+    if (Backend == BACKEND_LLVM) {
+        return llvmLoadElement(reg, array->name, array->length);
+    }
+    return nasmLoadElement(reg, array->name);
+}
+
+/**
+ * codegenStoreElement - Wraps CPU-specific array element storing.
+ *
+ * @reg: The register index containing the value to store.
+ * @indexReg: The register index containing the element index.
+ * @identifierIndex: The symbol table index of the array.
+ *
+ * @return int The register index that was stored.
+ */
+int codegenStoreElement(int reg, int indexReg, int identifierIndex) {
+    struct symbolTable *array = &GlobalSymbolTable[identifierIndex];
+
+    if (Backend == BACKEND_LLVM) {
+        return llvmStoreElement(reg, indexReg, array->name, array->length);
+    }
+    return nasmStoreElement(reg, indexReg, array->name);
+}
+
+/**
+ * codegenAddRegs - Wraps CPU-specific addition.
+ *
+ * @r1: The register index of the first operand.
+ * @r2: The register index of the second operand.
+ *
+ * @return int The register index containing the result.
+ */
+int codegenAddRegs(int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmAddRegs(r1, r2);
+    }
+    return nasmAddRegs(r1, r2);
+}
+
+/**
+ * codegenSubRegs - Wraps CPU-specific subtraction.
+ *
+ * @r1: The register index of the first operand.
+ * @r2: The register index of the second operand.
+ *
+ * @return int The register index containing the result.
+ */
+int codegenSubRegs(int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmSubRegs(r1, r2);
+    }
+    return nasmSubRegs(r1, r2);
+}
+
+/**
+ * codegenMulRegs - Wraps CPU-specific multiplication.
+ *
+ * @r1: The register index of the first operand.
+ * @r2: The register index of the second operand.
+ *
+ * @return int The register index containing the result.
+ */
+int codegenMulRegs(int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmMulRegs(r1, r2);
+    }
+    return nasmMulRegs(r1, r2);
+}
+
+/**
+ * codegenDivRegsSigned - Wraps CPU-specific signed division.
+ *
+ * @r1: The register index of the dividend.
+ * @r2: The register index of the divisor.
+ *
+ * @return int The register index containing the quotient.
+ */
+int codegenDivRegsSigned(int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmDivRegsSigned(r1, r2);
+    }
+    return nasmDivRegsSigned(r1, r2);
+}
+
+/**
+ * codegenModRegsSigned - Wraps CPU-specific signed remainder.
+ *
+ * @r1: The register index of the dividend.
+ * @r2: The register index of the divisor.
+ *
+ * @return int The register index containing the remainder.
+ */
+int codegenModRegsSigned(int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmModRegsSigned(r1, r2);
+    }
+    return nasmModRegsSigned(r1, r2);
+}
+
+/**
+ * codegenShiftRight - Wraps CPU-specific arithmetic shift right.
+ *
+ * @r: The register index of the value.
+ * @bits: Number of bits to shift by.
+ *
+ * @return int The register index containing the result.
+ */
+int codegenShiftRight(int r, int bits) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmShiftRight(r, bits);
+    }
+    return nasmShiftRight(r, bits);
+}
+
+/**
+ * codegenAndImmediate - Wraps CPU-specific bitwise and with a constant.
+ *
+ * @r: The register index of the value.
+ * @mask: The constant.
+ *
+ * @return int The register index containing the result.
+ */
+int codegenAndImmediate(int r, int mask) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmAndImmediate(r, mask);
+    }
+    return nasmAndImmediate(r, mask);
+}
+
+/**
+ * codegenCompareAndSet - Wraps CPU-specific compare-and-set.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @r1: The register index of the first operand.
+ * @r2: The register index of the second operand.
+ *
+ * @return int The register index containing 0 or 1.
+ */
+int codegenCompareAndSet(int ASTop, int r1, int r2) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmCompareAndSet(ASTop, r1, r2);
+    }
+    return nasmCompareAndSet(ASTop, r1, r2);
+}
+
+/**
+ * codegenCompareAndJump - Wraps CPU-specific compare-and-branch.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @r1: The register index of the first operand.
+ * @r2: The register index of the second operand.
+ * @label: The label to jump to when the comparison is FALSE.
+ *
+ * @return int NOREG
+ */
+int codegenCompareAndJump(int ASTop, int r1, int r2, int label) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmCompareAndJump(ASTop, r1, r2, label);
+    }
+    return nasmCompareAndJump(ASTop, r1, r2, label);
+}
+
+/**
+ * codegenSelect - Wraps CPU-specific compare-and-select.
+ *
+ * @ASTop: The AST operation code representing the comparison.
+ * @r1: The register index of the first compared operand.
+ * @r2: The register index of the second compared operand.
+ * @rTrue: The register index of the value when the comparison holds.
+ * @rFalse: The register index of the value when it does not.
+ *
+ * @return int The register index containing the selected value.
+ */
+int codegenSelect(int ASTop, int r1, int r2, int rTrue, int rFalse) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmSelect(ASTop, r1, r2, rTrue, rFalse);
+    }
+    return nasmSelect(ASTop, r1, r2, rTrue, rFalse);
+}
+
+/**
+ * codegenSetBoolean - Wraps CPU-specific setting of one path's 0 or 1,
+ * see codegenBooleanValue().
+ *
+ * @reg: The register index holding the result, or NOREG on the first path.
+ * @value: 0 or 1.
+ *
+ * @return int The register index holding the result.
+ */
+int codegenSetBoolean(int reg, int value) {
+    if (Backend == BACKEND_LLVM) {
+        return NOREG; // llvmBooleanPhi() supplies the values
+    }
+    return nasmMoveImmediate(reg, value);
+}
+
+/**
+ * codegenMergeBoolean - Wraps CPU-specific merging of the paths of
+ * codegenBooleanValue().
+ *
+ * @reg: The register index set on both paths.
+ * @labelTrue: The label of the path with value 1.
+ * @labelFalse: The label of the path with value 0.
+ *
+ * @return int The register index containing 0 or 1.
+ */
+int codegenMergeBoolean(int reg, int labelTrue, int labelFalse) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmBooleanPhi(labelTrue, labelFalse);
+    }
+    return reg;
+}
+
+/**
+ * codegenLabel - Wraps CPU-specific label output.
+ *
+ * NOTE:
+ * Control flow merges at a label, so no cached value survives it.
+ *
+ * @label: The label number to output.
+ */
+void codegenLabel(int label) {
+    cseFlush();
+    if (Backend == BACKEND_LLVM) {
+        llvmLabel(label);
+        return;
+    }
+    nasmLabel(label);
+}
+
+/**
+ * codegenBranchCounter - Wraps CPU-specific branch counter increments.
+ *
+ * @branchId: The id of the IF statement.
+ * @slot: Which counter to bump (PROFILE_SLOT_*).
  */
-void codegenDeclareGlobalSymbol(char *name) { nasmDeclareGlobalSymbol(name); }
+void codegenBranchCounter(int branchId, int slot) {
+    if (Backend == BACKEND_LLVM) {
+        logFatal("Branch instrumentation is not supported by the LLVM backend");
+    }
+    nasmBranchCounter(branchId, slot);
+}
+
+/**
+ * codegenCacheStore - Wraps CPU-specific copies into a CSE cache slot.
+ *
+ * @reg: The register index holding the value.
+ * @slot: The cache slot to fill.
+ *
+ * @return int The register index (still holding the value).
+ */
+int codegenCacheStore(int reg, int slot) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmCacheStore(reg, slot);
+    }
+    return nasmCacheStore(reg, slot);
+}
+
+/**
+ * codegenCacheLoad - Wraps CPU-specific copies out of a CSE cache slot.
+ *
+ * @slot: The cache slot to read.
+ *
+ * @return int The register index holding a copy of the value.
+ */
+int codegenCacheLoad(int slot) {
+    if (Backend == BACKEND_LLVM) {
+        return llvmCacheLoad(slot);
+    }
+    return nasmCacheLoad(slot);
+}
+
+/**
+ * codegenSourceLine - Wraps CPU-specific source line annotations.
+ *
+ * NOTE:
+ * Only emitted with -g, and only when the line changes.
+ * The LLVM backend does not produce debug info (yet).
+ *
+ * @line: The source line of the statement about to be generated.
+ */
+void codegenSourceLine(int line) {
+    if (!DebugLineInfo || Backend == BACKEND_LLVM || line == lastSourceLine) {
+        return;
+    }
+    lastSourceLine = line;
+    nasmSourceLine(line, Infilename);
+}
+
+/**
+ * codegenJump - Wraps CPU-specific unconditional jump.
+ *
+ * @label: The label number to jump to.
+ */
+void codegenJump(int label) {
+    if (Backend == BACKEND_LLVM) {
+        llvmJump(label);
+        return;
+    }
+    nasmJump(label);
+}
+
+/**
+ * codegenFunctionPreamble - Wraps CPU-specific function prologue.
+ *
+ * @name: The function's name.
+ * @parameters: The number of parameters it takes.
+ * @spillSlots: Stack slots of its locals (see allocateLocals()).
+ */
+void codegenFunctionPreamble(char *name, int parameters, int spillSlots) {
+    if (Backend == BACKEND_LLVM) {
+        llvmFunctionPreamble(name, parameters);
+        return;
+    }
+    nasmFunctionPreamble(name, parameters, spillSlots);
+}
+
+/**
+ * codegenFunctionPostamble - Wraps CPU-specific function epilogue.
+ *
+ * @returnLabel: The label return statements jump to.
+ */
+void codegenFunctionPostamble(int returnLabel) {
+    if (Backend == BACKEND_LLVM) {
+        llvmFunctionPostamble(returnLabel);
+        return;
+    }
+    nasmFunctionPostamble(returnLabel);
+}
+
+/**
+ * codegenReturn - Wraps CPU-specific return from a function.
+ *
+ * @reg: The register index containing the returned value.
+ * @returnLabel: The label of the function's epilogue.
+ */
+void codegenReturn(int reg, int returnLabel) {
+    if (Backend == BACKEND_LLVM) {
+        llvmReturn(reg);
+        return;
+    }
+    nasmReturn(reg, returnLabel);
+}
+
+/**
+ * codegenSaveRegisters - Wraps CPU-specific saving of the registers
+ * in use before a call.
+ *
+ * @live: Registers of locals the call must save (see regalloc.c).
+ *
+ * @return int What codegenCall() needs to restore them.
+ */
+int codegenSaveRegisters(int live) {
+    if (Backend == BACKEND_LLVM) {
+        return 0; // SSA values survive calls
+    }
+    return nasmSaveRegisters(live);
+}
+
+/**
+ * codegenPushArgument - Wraps CPU-specific passing of an argument.
+ *
+ * @reg: The register index containing the argument.
+ */
+void codegenPushArgument(int reg) {
+    if (Backend == BACKEND_LLVM) {
+        llvmPushArgument(reg);
+        return;
+    }
+    nasmPushArgument(reg);
+}
+
+/**
+ * codegenCall - Wraps CPU-specific function call.
+ *
+ * @identifierIndex: The symbol table index of the function.
+ * @arguments: The number of arguments pushed for it.
+ * @saved: What codegenSaveRegisters() returned.
+ *
+ * @return int The register index containing the returned value.
+ */
+int codegenCall(int identifierIndex, int arguments, int saved) {
+    char *name = GlobalSymbolTable[identifierIndex].name;
+
+    if (Backend == BACKEND_LLVM) {
+        return llvmCall(name, arguments);
+    }
+    return nasmCall(name, arguments, saved);
+}
@@ -0,0 +1,127 @@
+// src/hash.c
+
+/**
+ * NOTE:
+ * 64-bit xxHash (XXH64)
+ *
+ * A fast non-cryptographic hash, used to name compilation cache
+ * entries (see cache.c). Follows the reference algorithm, so results
+ * match other XXH64 implementations.
+ */
+
+#include "decl.h"
+#include "defs.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/**
+ * rotl64 - Rotates a 64-bit value left.
+ *
+ * @param x The value.
+ * @param r The number of bits (1..63).
+ *
+ * @return The rotated value.
+ */
+static uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+/**
+ * read64 - Reads a little-endian 64-bit value from unaligned memory.
+ */
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * read32 - Reads a little-endian 32-bit value from unaligned memory.
+ */
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * round64 - Mixes one 8-byte lane into an accumulator.
+ */
+static uint64_t round64(uint64_t acc, uint64_t lane) {
+    acc += lane * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+/**
+ * mergeRound64 - Folds an accumulator into the final hash.
+ */
+static uint64_t mergeRound64(uint64_t h, uint64_t acc) {
+    h ^= round64(0, acc);
+    return h * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * hash64 - Computes the XXH64 hash of a buffer.
+ *
+ * @param data The bytes to hash.
+ * @param len  Number of bytes.
+ * @param seed The seed (chaining one hash into the next combines them).
+ *
+ * @return The 64-bit hash.
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = mergeRound64(h, v1);
+        h = mergeRound64(h, v2);
+        h = mergeRound64(h, v3);
+        h = mergeRound64(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)len;
+
+    while (end - p >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
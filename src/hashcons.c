@@ -0,0 +1,253 @@
+// src/hashcons.c
+
+/**
+ * NOTE:
+ * Hash-consing of pure expressions (on the AST, before code generation)
+ *
+ * Generated programs repeat the same expressions over and over, and
+ * each occurrence is parsed into nodes of its own. Once the passes
+ * that rewrite the tree in place (inline.c, range.c, reassociate.c)
+ * are done, the nodes of pure expressions are interned bottom-up: a
+ * node with the operator, value and (already interned) children of
+ * one seen before is freed, and its parent points to that one instead.
+ * The tree becomes a DAG:
+ * ----------------------------------------
+ *   x = a[i] * 2;             [=]              [=]
+ *   y = a[i] * 2 - b;        /   \            /   \
+ *                           /     x         [-]    y
+ *                          /                / \
+ *                        [*] <-------------+   b
+ *                        / \
+ *                     a[i]  2
+ * ----------------------------------------
+ * Nothing rewrites the tree after this, and code generation walks it
+ * the same way as before, generating a shared node at every use; only
+ * the memory is saved. (Whether a value is computed once is cse.c's
+ * business.)
+ *
+ * A node's refs counts its parents beyond the first, and freeAST()
+ * frees it with its last one. isel.c labels the nodes it covers in
+ * place, so with -j, where threads generate different top-level
+ * statements, the nodes are shared within a top-level statement only.
+ * With -g a node also keeps its line, which codegen annotates the code
+ * with (see codegenSourceLine()), so only nodes of one line are shared.
+ * --no-share leaves the tree as it is.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// The nodes interned so far (open addressing, NULL if free)
+static _Thread_local struct ASTnode **table = NULL;
+static _Thread_local int tableSize = 0, tableCount = 0;
+// Statistics, for --stats
+static _Thread_local long nodesSeen = 0, nodesShared = 0;
+
+/**
+ * isShareable - Checks whether nodes with an operator may be shared:
+ * those that compute a value from their operands alone.
+ */
+static int isShareable(int op) {
+    switch (op) {
+    case A_ADD:
+    case A_SUBTRACT:
+    case A_MULTIPLY:
+    case A_DIVIDE:
+    case A_MODULO:
+    case A_SHIFTRIGHT:
+    case A_BITAND:
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+    case A_LOGAND:
+    case A_LOGOR:
+    case A_LOGNOT:
+    case A_INTLIT:
+    case A_IDENTIFIER:
+    case A_INDEX:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * hashNode - Hashes a node's operator, value and children (and line,
+ * with -g).
+ */
+static unsigned hashNode(struct ASTnode *n) {
+    uintptr_t h = (unsigned)n->op * 0x9e3779b1u ^ (unsigned)n->v.intvalue;
+
+    h = h * 31 + (uintptr_t)n->left;
+    h = h * 31 + (uintptr_t)n->right;
+    if (DebugLineInfo) {
+        h = h * 31 + (unsigned)n->line;
+    }
+    // Spread runs of neighbouring values (lines) over the table
+    h = (h ^ h >> 17) * 0x9e3779b1u;
+    return (unsigned)(h ^ h >> 15);
+}
+
+/**
+ * sameNode - Checks whether two nodes are the same expression, given
+ * that their children are interned.
+ */
+static int sameNode(struct ASTnode *a, struct ASTnode *b) {
+    return a->op == b->op && a->v.intvalue == b->v.intvalue &&
+           a->left == b->left && a->right == b->right &&
+           (!DebugLineInfo || a->line == b->line);
+}
+
+/**
+ * growTable - Doubles the table.
+ */
+static void growTable(void) {
+    struct ASTnode **old = table;
+    int oldSize = tableSize;
+
+    tableSize = tableSize ? tableSize * 2 : 1024;
+    if ((table = calloc(tableSize, sizeof(*table))) == NULL) {
+        logFatal("Out of memory while sharing subtrees");
+    }
+    for (int i = 0; i < oldSize; i++) {
+        if (old[i] != NULL) {
+            unsigned k = hashNode(old[i]) & (tableSize - 1);
+            while (table[k] != NULL) {
+                k = (k + 1) & (tableSize - 1);
+            }
+            table[k] = old[i];
+        }
+    }
+    free(old);
+}
+
+/**
+ * intern - Returns the node that stands for a pure expression.
+ *
+ * @n: The expression's root; its children are interned.
+ *
+ * @return n, or the same expression seen before (n is freed then).
+ */
+static struct ASTnode *intern(struct ASTnode *n) {
+    struct ASTnode *m;
+    unsigned k;
+
+    // At most half full
+    if (2 * (tableCount + 1) > tableSize) {
+        growTable();
+    }
+    k = hashNode(n) & (tableSize - 1);
+    for (; (m = table[k]) != NULL; k = (k + 1) & (tableSize - 1)) {
+        if (sameNode(m, n)) {
+            // m has the same children, so they lose a parent
+            if (n->left != NULL) {
+                n->left->refs--;
+            }
+            if (n->right != NULL) {
+                n->right->refs--;
+            }
+            free(n);
+            m->refs++;
+            nodesShared++;
+            return m;
+        }
+    }
+    table[k] = n;
+    tableCount++;
+    return n;
+}
+
+/**
+ * share - Interns the pure expressions of a tree.
+ *
+ * @link: Where the tree hangs (it may be NULL).
+ *
+ * @return 1 if the tree is a pure expression (interned), 0 otherwise.
+ */
+static int share(struct ASTnode **link) {
+    struct ASTnode *n = *link;
+    int pure;
+
+    if (n == NULL) {
+        return 1;
+    }
+    if (n->op == A_GLUE) {
+        // Down the left spine in a loop, see walkStatements()
+        for (; *link != NULL && (*link)->op == A_GLUE;
+             link = &(*link)->left) {
+            nodesSeen++;
+            share(&(*link)->right);
+        }
+        share(link);
+        return 0;
+    }
+
+    nodesSeen++;
+    pure = share(&n->left);
+    pure &= share(&n->middle);
+    pure &= share(&n->right);
+    if (!pure || n->middle != NULL || !isShareable(n->op)) {
+        return 0;
+    }
+    *link = intern(n);
+    return 1;
+}
+
+/**
+ * clearTable - Forgets the nodes interned so far.
+ */
+static void clearTable(void) {
+    free(table);
+    table = NULL;
+    tableSize = tableCount = 0;
+}
+
+/**
+ * hashconsTree - Shares the identical pure subtrees of a program, or
+ * of one of its statements, see the note at the top of this file.
+ *
+ * @tree: The program or statement (may be NULL).
+ */
+void hashconsTree(struct ASTnode *tree) {
+    struct ASTnode **link = &tree;
+
+    if (!ShareSubtrees) {
+        return;
+    }
+    if (CodegenJobs > 1) {
+        // One table per top-level statement
+        for (; *link != NULL && (*link)->op == A_GLUE;
+             link = &(*link)->left) {
+            nodesSeen++;
+            share(&(*link)->right);
+            clearTable();
+        }
+    }
+    share(link);
+    clearTable();
+}
+
+/**
+ * hashconsPrintStats - Prints how many nodes sharing saved (--stats).
+ */
+void hashconsPrintStats(void) {
+    fprintf(Errfile, "AST nodes:       %ld\n", nodesSeen);
+    fprintf(Errfile, "shared:          %ld", nodesShared);
+    if (nodesSeen > 0) {
+        fprintf(Errfile, " (%.1f%%)", 100.0 * nodesShared / nodesSeen);
+    }
+    fprintf(Errfile, "\nmemory saved:    %ld bytes\n",
+            nodesShared * (long)sizeof(struct ASTnode));
+}
+
+/**
+ * hashconsReset - Clears the statistics of the program compiled last.
+ */
+void hashconsReset(void) {
+    clearTable();
+    nodesSeen = nodesShared = 0;
+}
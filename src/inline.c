@@ -0,0 +1,690 @@
+// src/inline.c
+
+/**
+ * NOTE:
+ * Function inlining (on the AST, before code generation)
+ *
+ * The top-level statements are visited in order. A function's body has
+ * its own calls inlined first and is then kept (as a copy) for the
+ * calls that follow; there are no forward declarations, so a body can
+ * only call functions defined before it, or itself.
+ *
+ * A call is inlined when its function is not recursive and
+ * ----------------------------------------
+ *   size <= (INLINE_CALL_COST + INLINE_ARGUMENT_COST * arguments)
+ *           * INLINE_LOOP_WEIGHT ^ min(loop depth, INLINE_MAX_LOOP_DEPTH)
+ * ----------------------------------------
+ * where size counts the nodes of the body, or when it is the only call
+ * of the function and size <= INLINE_MAX_SIZE. A call takes
+ * a call/ret, a frame and argument moves, and one in a loop takes them
+ * on every iteration, hence the weight.
+ *
+ * Two forms are produced:
+ * - A body that is just `return E;` is substituted into any expression,
+ *   E's parameters replaced by copies of the arguments:
+ *       x = sq(a + 1) * 2;    ->    x = ((a + 1) * (a + 1)) * 2;
+ *   (only if E makes no calls and a parameter used twice gets a leaf).
+ * - Otherwise a call that is a statement's whole value
+ *   (`f(...);`, `x = f(...);`, `a[i] = f(...);`, `print f(...);`)
+ *   is replaced by the body. The arguments are stored in new locals
+ *   named after the function (`f.a` for parameter a), the body's own
+ *   locals are copied too, and a return assigns the result and leaves
+ *   the body:
+ *       x = f(y);    ->    f.a = y; {body, return v: x = v}
+ *   The result goes to x itself, or to a local `f.return`, which the
+ *   rest of the statement then reads.
+ *
+ * Only calls with no calls among their arguments (nor elsewhere in
+ * the statement) are inlined, so the order of evaluation is kept.
+ * Functions left without calls are removed from the program.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// What is known about each symbol that is a function
+struct inlineFunction {
+    int defined;           // whether it was defined and may be inlined
+    struct ASTnode *body;  // copy of its processed body (owned here)
+    struct ASTnode **link; // where the definition is in the program
+    int size;              // nodes in the body
+    int recursive;         // whether the body calls the function
+    int calls;             // calls in the program (see countCalls())
+};
+
+// How the parameters and returns of a body being inlined are replaced
+struct expansion {
+    struct ASTnode *arguments[FUNCTION_MAX_PARAMETERS]; // substituted,
+                                                        // or NULL
+    int temporaries[FUNCTION_MAX_PARAMETERS]; // otherwise the locals
+    int *locals; // by symbol index, the copy of a local of the body + 1
+                 // (an entry per symbol before the body was copied,
+                 // or NULL if it has none)
+    int target;  // variable a return assigns, or -1 to drop the value
+    int returns; // returns left that must leave the body
+};
+
+// By symbol index, functionCount entries (see prepareFunctions())
+static _Thread_local struct inlineFunction *functions = NULL;
+static _Thread_local int functionCount = 0;
+// Whether the calls were counted (not with --stream)
+static _Thread_local int callsCounted = 0;
+
+static void inlineStatements(struct ASTnode **link, int loopDepth);
+
+/**
+ * countNodes - Returns the number of nodes in a tree.
+ */
+static int countNodes(struct ASTnode *n) {
+    int count = 0;
+
+    for (; n != NULL; n = n->left) {
+        count += 1 + countNodes(n->middle) + countNodes(n->right);
+    }
+    return count;
+}
+
+/**
+ * callsFunction - Checks whether a tree calls the given function.
+ */
+static int callsFunction(struct ASTnode *n, int id) {
+    for (; n != NULL; n = n->left) {
+        if ((n->op == A_CALL && n->v.identifierIndex == id) ||
+            callsFunction(n->middle, id) || callsFunction(n->right, id)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * isParameter - Checks whether a node names the parameter at a
+ * position (any position if it is -1).
+ */
+static int isParameter(struct ASTnode *n, int op, int position) {
+    struct symbolTable *s;
+
+    if (n->op != op) {
+        return 0;
+    }
+    s = &GlobalSymbolTable[n->v.identifierIndex];
+    return s->kind == S_PARAMETER &&
+           (position == -1 || s->position == position);
+}
+
+/**
+ * countUses - Counts the nodes of a tree that are the given operator
+ * on the parameter at a position.
+ */
+static int countUses(struct ASTnode *n, int op, int position) {
+    int count = 0;
+
+    for (; n != NULL; n = n->left) {
+        count += isParameter(n, op, position);
+        count += countUses(n->middle, op, position);
+        count += countUses(n->right, op, position);
+    }
+    return count;
+}
+
+/**
+ * countCalls - Adds delta to the call count of each function a tree
+ * calls, except for calls of the function they are in.
+ *
+ * @n: The tree (its left spine is walked iteratively).
+ * @enclosing: The function being walked, or -1.
+ * @delta: 1 or -1.
+ */
+static void countCalls(struct ASTnode *n, int enclosing, int delta) {
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_FUNCTION) {
+            enclosing = n->v.identifierIndex; // its body is n->left
+        }
+        if (n->op == A_CALL && n->v.identifierIndex != enclosing) {
+            functions[n->v.identifierIndex].calls += delta;
+        }
+        countCalls(n->middle, enclosing, delta);
+        countCalls(n->right, enclosing, delta);
+    }
+}
+
+/**
+ * worthInlining - Applies the heuristic at the top of this file.
+ *
+ * @id: The symbol index of the function.
+ * @arguments: Number of arguments of the call.
+ * @loopDepth: Loops around the call.
+ *
+ * @return 1 if the call should be inlined.
+ */
+static int worthInlining(int id, int arguments, int loopDepth) {
+    struct inlineFunction *f = &functions[id];
+    int benefit = INLINE_CALL_COST + INLINE_ARGUMENT_COST * arguments;
+
+    if (!f->defined || f->recursive) {
+        return 0;
+    }
+    for (int i = 0; i < loopDepth && i < INLINE_MAX_LOOP_DEPTH; i++) {
+        benefit *= INLINE_LOOP_WEIGHT;
+    }
+    return f->size <= benefit ||
+           (callsCounted && f->calls == 1 && f->size <= INLINE_MAX_SIZE);
+}
+
+/**
+ * replaceParameters - Replaces the parameters of a copied body as an
+ * expansion says, and gives its locals new symbols.
+ *
+ * NOTE:
+ * Every copy of a body has locals of its own, so their live ranges
+ * stay where the copy is (see regalloc.c).
+ *
+ * @link: Where the tree hangs.
+ * @e: The expansion.
+ */
+static void replaceParameters(struct ASTnode **link, struct expansion *e) {
+    struct ASTnode *n = *link, *c;
+    struct symbolTable *s;
+    int position;
+
+    if (n == NULL) {
+        return;
+    }
+    if (e->locals != NULL &&
+        (n->op == A_IDENTIFIER || n->op == A_LVALUEIDENTIFIER)) {
+        s = &GlobalSymbolTable[n->v.identifierIndex];
+        if (s->kind == S_LOCAL) {
+            if (e->locals[n->v.identifierIndex] == 0) {
+                e->locals[n->v.identifierIndex] = addLocalSymbol(s->name) + 1;
+            }
+            n->v.identifierIndex = e->locals[n->v.identifierIndex] - 1;
+            return;
+        }
+    }
+    if (isParameter(n, A_IDENTIFIER, -1) ||
+        isParameter(n, A_LVALUEIDENTIFIER, -1)) {
+        position = GlobalSymbolTable[n->v.identifierIndex].position;
+        if (e->arguments[position] == NULL) {
+            n->v.identifierIndex = e->temporaries[position];
+            return;
+        }
+        // Only read, see expandCall(); the copy is the caller's
+        c = copyAST(e->arguments[position]);
+        *link = c;
+        free(n);
+        return;
+    }
+    replaceParameters(&n->left, e);
+    replaceParameters(&n->middle, e);
+    replaceParameters(&n->right, e);
+}
+
+/**
+ * assignResult - Builds the statement storing a result.
+ *
+ * @value: The result.
+ * @target: The symbol index of the variable.
+ * @line: Source line to give the nodes.
+ */
+static struct ASTnode *assignResult(struct ASTnode *value, int target,
+                                    int line) {
+    struct ASTnode *n;
+
+    n = makeASTNode(A_ASSIGN, value, NULL,
+                    makeASTLeaf(A_LVALUEIDENTIFIER, target), 0);
+    n->line = n->right->line = line;
+    return n;
+}
+
+/**
+ * replaceReturns - Turns the returns of a copied body into assignments
+ * of the result followed by a jump out of the body.
+ *
+ * @link: Where the tree hangs.
+ * @e: The expansion; counts the returns.
+ */
+static void replaceReturns(struct ASTnode **link, struct expansion *e) {
+    struct ASTnode *n = *link;
+
+    if (n == NULL) {
+        return;
+    }
+    replaceReturns(&n->left, e);
+    replaceReturns(&n->middle, e);
+    replaceReturns(&n->right, e);
+
+    if (n->op != A_RETURN || n->left == NULL) {
+        return;
+    }
+    if (e->target == -1) {
+        freeAST(n->left);
+    } else {
+        *link = makeASTNode(A_GLUE, assignResult(n->left, e->target, n->line),
+                            NULL, n, 0);
+        (*link)->line = n->line;
+    }
+    n->left = NULL; // see codegenReturnAST()
+    e->returns++;
+}
+
+/**
+ * appendStatement - Glues a statement to the end of a chain.
+ *
+ * @chain: The chain (may be NULL).
+ * @n: The statement (may be NULL).
+ *
+ * @return The new chain.
+ */
+static struct ASTnode *appendStatement(struct ASTnode *chain,
+                                       struct ASTnode *n) {
+    if (n == NULL) {
+        return chain;
+    }
+    if (chain == NULL) {
+        return n;
+    }
+    return makeASTNode(A_GLUE, chain, NULL, n, 0);
+}
+
+/**
+ * temporary - Adds a local `function.suffix`, which the source cannot
+ * name.
+ *
+ * @return The symbol index, or -1 if the name is longer than the
+ *         TEXTLEN the backends allow for.
+ */
+static int temporary(char *function, char *suffix) {
+    size_t length = strlen(function) + 1 + strlen(suffix);
+    char *name;
+    int id;
+
+    if (length > TEXTLEN) {
+        return -1;
+    }
+    if ((name = malloc(length + 1)) == NULL) {
+        logFatal("Out of memory while inlining");
+    }
+    snprintf(name, length + 1, "%s.%s", function, suffix);
+    id = addLocalSymbol(name);
+    free(name);
+    return id;
+}
+
+/**
+ * substituteCall - Replaces a call of a `return E;` function by E.
+ *
+ * @link: Where the call hangs.
+ * @loopDepth: Loops around the call.
+ */
+static void substituteCall(struct ASTnode **link, int loopDepth) {
+    struct ASTnode *call = *link, *body, *a;
+    struct expansion e = {0};
+    int id = call->v.identifierIndex, p = 0;
+
+    body = functions[id].body;
+    if (!worthInlining(id, countArguments(call), loopDepth) ||
+        body == NULL || body->op != A_RETURN || hasCall(body->left) ||
+        hasCall(call->left)) {
+        return;
+    }
+    for (a = call->left; a != NULL; a = a->right, p++) {
+        // Copying a tree would compute it again
+        if (a->left->op != A_INTLIT && a->left->op != A_IDENTIFIER &&
+            countUses(body->left, A_IDENTIFIER, p) > 1) {
+            return;
+        }
+        e.arguments[p] = a->left;
+    }
+
+    body = copyAST(body->left);
+    replaceParameters(&body, &e);
+    *link = body;
+    freeAST(call);
+}
+
+/**
+ * inlineExpression - Inlines the calls of an expression whose function
+ * is just `return E;`, innermost first.
+ *
+ * @link: Where the expression hangs.
+ * @loopDepth: Loops around it.
+ */
+static void inlineExpression(struct ASTnode **link, int loopDepth) {
+    struct ASTnode *n = *link;
+
+    if (n == NULL) {
+        return;
+    }
+    inlineExpression(&n->left, loopDepth);
+    inlineExpression(&n->middle, loopDepth);
+    inlineExpression(&n->right, loopDepth);
+    if (n->op == A_CALL) {
+        substituteCall(link, loopDepth);
+    }
+}
+
+/**
+ * findParameter - Finds a node of a tree naming the parameter at a
+ * position.
+ *
+ * @return Its symbol index, or -1 if the tree does not use it.
+ */
+static int findParameter(struct ASTnode *n, int position) {
+    int id;
+
+    for (; n != NULL; n = n->left) {
+        if (isParameter(n, A_IDENTIFIER, position) ||
+            isParameter(n, A_LVALUEIDENTIFIER, position)) {
+            return n->v.identifierIndex;
+        }
+        if ((id = findParameter(n->middle, position)) != -1 ||
+            (id = findParameter(n->right, position)) != -1) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * expandCall - Replaces a statement whose whole value is a call by the
+ * function's body, see the note at the top of this file.
+ *
+ * @link: Where the statement hangs.
+ * @loopDepth: Loops around it.
+ */
+static void expandCall(struct ASTnode **link, int loopDepth) {
+    struct ASTnode *n = *link, *call = n->left, *body, *chain = NULL, *a;
+    struct ASTnode **last;
+    struct expansion e = {0};
+    char *name; // the function's (not a pointer into the symbol table,
+                // which grows as the temporaries are added)
+    int id, p, parameter, result = -1;
+
+    if (call == NULL || call->op != A_CALL) {
+        return;
+    }
+    id = call->v.identifierIndex;
+    name = GlobalSymbolTable[id].name;
+    body = functions[id].body;
+    if (!worthInlining(id, GlobalSymbolTable[id].parameters, loopDepth) ||
+        hasCall(call->left) || (n->op == A_ASSIGN && hasCall(n->right))) {
+        return;
+    }
+
+    // Where a return puts the result; a discarded one is only
+    // computed for the calls it makes
+    if (n->op == A_ASSIGN && n->right->op == A_LVALUEIDENTIFIER) {
+        e.target = n->right->v.identifierIndex;
+    } else if (n->op != A_CALLSTATEMENT || hasCall(body)) {
+        if ((result = e.target = temporary(name, "return")) == -1) {
+            return;
+        }
+    } else {
+        e.target = -1;
+    }
+
+    // Bind the arguments; a literal is used as is if never assigned
+    for (a = call->left, p = 0; a != NULL; a = a->right, p++) {
+        if ((parameter = findParameter(body, p)) == -1) {
+            continue; // unused, and computing it has no effect
+        }
+        if (a->left->op == A_INTLIT &&
+            countUses(body, A_LVALUEIDENTIFIER, p) == 0) {
+            e.arguments[p] = a->left;
+            continue;
+        }
+        e.temporaries[p] =
+            temporary(name, GlobalSymbolTable[parameter].name);
+        if (e.temporaries[p] == -1) {
+            freeAST(chain);
+            return;
+        }
+        chain = appendStatement(
+            chain, assignResult(a->left, e.temporaries[p], n->line));
+        a->left = NULL;
+    }
+
+    body = copyAST(body);
+    if ((e.locals = calloc(countGlobalSymbols(), sizeof(int))) == NULL) {
+        logFatal("Out of memory while inlining");
+    }
+    replaceParameters(&body, &e);
+    free(e.locals);
+
+    // A return ending the body needs no jump, and without one the
+    // result is 0
+    last = body != NULL && body->op == A_GLUE ? &body->right : &body;
+    if (*last != NULL && (*last)->op == A_RETURN) {
+        a = *last;
+        if (e.target == -1) {
+            *last = NULL;
+            freeAST(a->left);
+        } else {
+            *last = assignResult(a->left, e.target, a->line);
+        }
+        free(a);
+    } else if (e.target != -1) {
+        body = appendStatement(body,
+                               assignResult(makeASTLeaf(A_INTLIT, 0),
+                                            e.target, n->line));
+    }
+    replaceReturns(&body, &e);
+    if (e.returns > 0) {
+        body = makeASTUnary(A_INLINE, body, 0);
+    }
+    chain = appendStatement(chain, body);
+
+    // The statement itself remains if it uses the result
+    if (result != -1 && n->op != A_CALLSTATEMENT) {
+        freeAST(call);
+        n->left = makeASTLeaf(A_IDENTIFIER, result);
+        n->left->line = n->line;
+        chain = appendStatement(chain, n);
+    } else {
+        freeAST(n);
+    }
+    // An empty statement if nothing is left
+    *link = chain != NULL ? chain : makeASTNode(A_GLUE, NULL, NULL, NULL, 0);
+}
+
+/**
+ * defineFunction - Keeps a function's body for the calls that follow.
+ *
+ * @n: The A_FUNCTION node; its calls are already inlined.
+ * @link: Where it is in the program.
+ */
+static void defineFunction(struct ASTnode *n, struct ASTnode **link) {
+    struct inlineFunction *f = &functions[n->v.identifierIndex];
+
+    f->link = link;
+    f->size = countNodes(n->left);
+    f->recursive = callsFunction(n->left, n->v.identifierIndex);
+    // Larger bodies are never inlined, so they need no copy
+    f->body = f->size <= INLINE_MAX_SIZE ? copyAST(n->left) : NULL;
+    f->defined = f->size <= INLINE_MAX_SIZE;
+}
+
+/**
+ * inlineStatement - Inlines the calls of one statement.
+ *
+ * @link: Where the statement hangs.
+ * @loopDepth: Loops around it.
+ */
+static void inlineOne(struct ASTnode **link, int loopDepth) {
+    struct ASTnode *n = *link;
+
+    switch (n->op) {
+    case A_GLUE:
+        inlineStatements(link, loopDepth);
+        return;
+    case A_IF:
+        inlineExpression(&n->left, loopDepth);
+        inlineStatements(&n->middle, loopDepth);
+        inlineStatements(&n->right, loopDepth);
+        return;
+    case A_WHILE:
+        inlineExpression(&n->left, loopDepth + 1);
+        inlineStatements(&n->middle, loopDepth + 1);
+        inlineStatements(&n->right, loopDepth + 1);
+        return;
+    case A_SWITCH:
+        inlineExpression(&n->left, loopDepth);
+        inlineStatements(&n->right, loopDepth);
+        return;
+    case A_FUNCTION:
+        inlineStatements(&n->left, 0);
+        defineFunction(n, link);
+        return;
+    case A_RETURN:
+        inlineExpression(&n->left, loopDepth);
+        return;
+    case A_ASSIGN:
+        inlineExpression(&n->right, loopDepth); // an element's index
+        // fall through
+    case A_PRINT:
+        inlineExpression(&n->left, loopDepth);
+        expandCall(link, loopDepth);
+        return;
+    case A_CALLSTATEMENT:
+        inlineExpression(&n->left->left, loopDepth); // the arguments
+        expandCall(link, loopDepth);
+        return;
+    }
+}
+
+/**
+ * inlineStatements - Inlines the calls of a statement chain, in
+ * program order.
+ *
+ * @link: Where the chain hangs.
+ * @loopDepth: Loops around it.
+ */
+static void inlineStatements(struct ASTnode **link, int loopDepth) {
+    struct ASTnode ***spine, *n;
+    int count = 0;
+
+    // Collect the chain's left spine (see flattenStatements())
+    for (n = *link; n != NULL && n->op == A_GLUE; n = n->left) {
+        count++;
+    }
+    if ((spine = malloc((count + 1) * sizeof(*spine))) == NULL) {
+        logFatal("Out of memory while inlining");
+    }
+    spine[count] = link;
+    for (int i = count - 1; i >= 0; i--) {
+        spine[i] = &(*spine[i + 1])->left;
+    }
+
+    // The first statement is at the bottom
+    if (*spine[0] != NULL) {
+        inlineOne(spine[0], loopDepth);
+    }
+    for (int i = 1; i <= count; i++) {
+        if ((*spine[i])->right != NULL) {
+            inlineOne(&(*spine[i])->right, loopDepth);
+        }
+    }
+    free(spine);
+}
+
+/**
+ * prepareFunctions - Grows the function table to an entry per symbol.
+ *
+ * NOTE:
+ * Functions are only declared by the parser, so the symbols the
+ * inliner adds itself never need one.
+ */
+static void prepareFunctions(void) {
+    int count = countGlobalSymbols();
+
+    if (functionCount >= count) {
+        return;
+    }
+    functions = realloc(functions, count * sizeof(*functions));
+    if (functions == NULL) {
+        logFatal("Out of memory while inlining");
+    }
+    memset(functions + functionCount, 0,
+           (count - functionCount) * sizeof(*functions));
+    functionCount = count;
+}
+
+/**
+ * inlineProgram - Inlines the calls of a parsed program and removes
+ * the functions no call is left to.
+ *
+ * @tree: The program, as returned by parseParallel().
+ *
+ * @return The program.
+ */
+struct ASTnode *inlineProgram(struct ASTnode *tree) {
+    struct inlineFunction *f;
+    int removed;
+
+    if (!InlineFunctions || tree == NULL) {
+        return tree;
+    }
+    prepareFunctions();
+    countCalls(tree, -1, 1);
+    callsCounted = 1;
+    inlineStatements(&tree, 0);
+
+    // Count again, and remove unused functions (and so on)
+    for (int i = 0; i < functionCount; i++) {
+        functions[i].calls = 0;
+    }
+    countCalls(tree, -1, 1);
+    do {
+        removed = 0;
+        for (int i = 0; i < functionCount; i++) {
+            f = &functions[i];
+            if (f->link != NULL && *f->link != NULL && f->calls == 0) {
+                countCalls(*f->link, -1, -1);
+                freeAST(*f->link);
+                *f->link = NULL;
+                removed = 1;
+            }
+        }
+    } while (removed);
+    return tree;
+}
+
+/**
+ * inlineStatement - Inlines the calls of a top-level statement
+ * (--stream), which may define a function for the statements after it.
+ *
+ * NOTE:
+ * The calls of the program are not known in advance, so only the
+ * size limit applies, and functions are never removed.
+ *
+ * @n: The statement.
+ *
+ * @return The statement.
+ */
+struct ASTnode *inlineStatement(struct ASTnode *n) {
+    if (!InlineFunctions || n == NULL) {
+        return n;
+    }
+    prepareFunctions();
+    inlineOne(&n, 0);
+    if (n->op == A_FUNCTION) {
+        functions[n->v.identifierIndex].link = NULL; // n is not kept
+    }
+    return n;
+}
+
+/**
+ * inlineReset - Forgets the functions of the program compiled last.
+ */
+void inlineReset(void) {
+    if (functions != NULL) {
+        for (int i = 0; i < functionCount; i++) {
+            freeAST(functions[i].body);
+        }
+        free(functions);
+        functions = NULL;
+        functionCount = 0;
+    }
+    callsCounted = 0;
+}
@@ -0,0 +1,162 @@
+// src/ipc.c
+
+#define _GNU_SOURCE // struct ucred, see ipcPeerIsUser()
+
+/**
+ * NOTE:
+ * Socket plumbing shared by the compile server (server.c)
+ * and its client shim (client.c)
+ *
+ * Jobs travel over a Unix domain stream socket, one job per connection.
+ * Request:
+ * ----------------------------------------
+ * KECCC2 <argument count> <inline source bytes, or -1>\n
+ * <client working directory>\n
+ * <argument>\n                  (argument count times, options first,
+ * ...                            the input file last)
+ * <inline source bytes>         (only if not -1)
+ * ----------------------------------------
+ * Reply:
+ * ----------------------------------------
+ * KECCC2 <exit status> <output bytes> <diagnostic bytes>\n
+ * <output bytes><diagnostic bytes>
+ * ----------------------------------------
+ * With -1 the server reads the input file itself, otherwise the
+ * inline bytes are compiled and the input file name only labels them.
+ * The client works out where the output goes from its own arguments.
+ *
+ * Both ends only talk to a peer of their own user (ipcPeerIsUser()),
+ * and the server's socket is only open to that user.
+ */
+
+#include "decl.h"
+#include "defs.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * ipcSocketPath - Works out where the compile server listens.
+ *
+ * NOTE:
+ * $KECCC_SOCKET if set, otherwise IPC_SOCKET_NAME in $XDG_RUNTIME_DIR,
+ * otherwise a per-user name in /tmp.
+ *
+ * @param buf  Receives the path.
+ * @param size Size of buf.
+ *
+ * @return buf
+ */
+char *ipcSocketPath(char *buf, size_t size) {
+    char *dir;
+
+    if ((dir = getenv("KECCC_SOCKET")) != NULL) {
+        snprintf(buf, size, "%s", dir);
+    } else if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL) {
+        snprintf(buf, size, "%s/" IPC_SOCKET_NAME, dir);
+    } else {
+        snprintf(buf, size, "/tmp/keccc-%u.sock", (unsigned)getuid());
+    }
+    return buf;
+}
+
+/**
+ * ipcPeerIsUser - Checks that the other end of a connection runs as the
+ * same user as this process.
+ *
+ * @param fd The connected socket.
+ *
+ * @return 1 if it does, 0 if not or if the socket cannot tell.
+ */
+int ipcPeerIsUser(int fd) {
+    struct ucred peer;
+    socklen_t size = sizeof(peer);
+
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 &&
+           peer.uid == geteuid();
+}
+
+/**
+ * ipcReadFull - Reads exactly n bytes from a socket.
+ *
+ * @param fd  The socket.
+ * @param buf Receives the bytes.
+ * @param n   Number of bytes to read.
+ *
+ * @return 0 on success, -1 on error or early end of stream.
+ */
+int ipcReadFull(int fd, void *buf, size_t n) {
+    char *p = buf;
+    ssize_t got;
+
+    while (n > 0) {
+        if ((got = read(fd, p, n)) <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += got;
+        n -= got;
+    }
+    return 0;
+}
+
+/**
+ * ipcWriteFull - Writes exactly n bytes to a socket.
+ *
+ * @param fd  The socket.
+ * @param buf The bytes to write.
+ * @param n   Number of bytes to write.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int ipcWriteFull(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    ssize_t put;
+
+    while (n > 0) {
+        if ((put = write(fd, p, n)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += put;
+        n -= put;
+    }
+    return 0;
+}
+
+/**
+ * ipcReadLine - Reads one newline-terminated line from a socket.
+ *
+ * NOTE:
+ * Reads a byte at a time so nothing after the newline is consumed;
+ * the lines of the protocol are short.
+ *
+ * @param fd   The socket.
+ * @param buf  Receives the line, without the newline.
+ * @param size Size of buf.
+ *
+ * @return 0 on success, -1 on error, end of stream or an overlong line.
+ */
+int ipcReadLine(int fd, char *buf, size_t size) {
+    size_t i = 0;
+    char c;
+
+    for (;;) {
+        if (ipcReadFull(fd, &c, 1) < 0) {
+            return -1;
+        }
+        if (c == '\n') {
+            buf[i] = '\0';
+            return 0;
+        }
+        if (i == size - 1) {
+            return -1;
+        }
+        buf[i++] = c;
+    }
+}
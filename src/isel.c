@@ -0,0 +1,654 @@
+// src/isel.c
+
+/**
+ * NOTE:
+ * Tree-pattern instruction selection for NASM x86-64
+ * (Target-specific layer)
+ *
+ * This is a small BURS-style selector. Each rule of the table below
+ * rewrites a tree pattern into a nonterminal (a value in a register,
+ * an immediate, a variable, a statement or a condition)
+ * at a given cost. Selection runs in two passes over a statement:
+ *
+ * 1. label(): bottom-up, record for every node and nonterminal
+ *    the cheapest rule and its total cost (dynamic programming).
+ * 2. reduce(): top-down from the root, follow the chosen rules,
+ *    reduce the subtrees each rule needs, then emit its template.
+ *
+ * So the whole cover of a tree is chosen before anything is emitted,
+ * and e.g. `x = x + 5` becomes a single `add qword [x], 5`.
+ *
+ * Template placeholders:
+ *   %0   result register          %1..%9  operands (kids of the pattern)
+ *   %bN  8-bit name of register N %mN     immediate N minus one
+ *   %lN  log2 of immediate N      %c      condition code of the root node
+ *   %a   array of the root node (of its destination for A_ASSIGN)
+ *   %sN  superopt.h sequence multiplying %1 by immediate N
+ *   %iDN set operand D (a register or variable) to immediate N, with a
+ *        mov or the shorter forms of -Os (see immediateText() in cgn.c)
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// Cost that marks a nonterminal as not derivable
+#define ISEL_INFINITY 0x3fffffff
+
+// Most nonterminal leaves a pattern may have
+#define ISEL_MAXKIDS 8
+
+// Pseudo operator matching any comparison in a pattern
+#define OP_ANYCMP -1
+
+// Where a rule leaves its value
+#define RES_NONE -1 // statements and conditions produce no value
+#define RES_NEW 0   // a freshly allocated register
+
+// A tree pattern. An interior node matches an AST operator;
+// a leaf (op == 0) matches any subtree derivable to nonterminal nt.
+struct pattern {
+    int op;
+    int nt;
+    struct pattern *left;
+    struct pattern *right;
+};
+
+// An instruction selection rule
+struct rule {
+    int lhs;                                // nonterminal produced
+    struct pattern *pattern;                // tree pattern to match
+    int cost;                               // cost of the instructions
+    int (*predicate)(struct ASTnode **kid); // extra check, or NULL
+    char *template;                         // instructions, '\n' separated
+    int result;                             // RES_NONE, RES_NEW or kid 1..9
+};
+
+// Pattern constructors; compound literals give the table static storage
+#define NT(x) (&(struct pattern){0, (x), NULL, NULL})
+#define OP0(o) (&(struct pattern){(o), 0, NULL, NULL})
+#define OP1(o, l) (&(struct pattern){(o), 0, (l), NULL})
+#define OP2(o, l, r) (&(struct pattern){(o), 0, (l), (r)})
+
+#define REG NT(NT_REG)
+#define IMM NT(NT_IMM)
+#define MEM NT(NT_MEM)
+
+/**
+ * NOTE:
+ * Predicates. They see the subtrees bound to the pattern leaves,
+ * in left-to-right order (kid[0] is %1 in the template).
+ */
+
+static int kid2IsOne(struct ASTnode **kid) {
+    return kid[1]->v.intvalue == 1;
+}
+
+static int kid2IsZero(struct ASTnode **kid) {
+    return kid[1]->v.intvalue == 0;
+}
+
+static int isScale(int value) {
+    return value == 2 || value == 4 || value == 8;
+}
+
+static int kid2IsScale(struct ASTnode **kid) {
+    return isScale(kid[1]->v.intvalue);
+}
+
+static int kid3IsScale(struct ASTnode **kid) {
+    return isScale(kid[2]->v.intvalue);
+}
+
+// Multipliers with a sequence faster than imul, see superopt.c
+static int kid2IsSuperoptimized(struct ASTnode **kid) {
+    return nasmMulSequence(kid[1]->v.intvalue) != NULL;
+}
+
+// x / 2^k and x % 2^k, see nasmDivPowerOfTwo()
+static int kid2IsPowerOfTwo(struct ASTnode **kid) {
+    int value = kid[1]->v.intvalue;
+    return value > 1 && (value & (value - 1)) == 0;
+}
+
+// x = x op y: the first operand and the destination are the same global
+static int kid1IsKid3(struct ASTnode **kid) {
+    return kid[0]->v.identifierIndex == kid[2]->v.identifierIndex;
+}
+
+static int kid1IsKid3AndKid2IsOne(struct ASTnode **kid) {
+    return kid1IsKid3(kid) && kid2IsOne(kid);
+}
+
+// x = y op x: the second operand and the destination are the same global
+static int kid2IsKid3(struct ASTnode **kid) {
+    return kid[1]->v.identifierIndex == kid[2]->v.identifierIndex;
+}
+
+/**
+ * NOTE:
+ * The rule table. Costs are roughly ten per instruction,
+ * minus one for a shorter encoding of the same work.
+ */
+static struct rule rules[] = {
+    // Leaves
+    {NT_IMM, OP0(A_INTLIT), 0, NULL, NULL, RES_NONE},
+    {NT_MEM, OP0(A_IDENTIFIER), 0, NULL, NULL, RES_NONE},
+    {NT_MEM, OP0(A_LVALUEIDENTIFIER), 0, NULL, NULL, RES_NONE},
+
+    // Chain rules: load an operand into a register
+    {NT_REG, IMM, 10, NULL, "%i01", RES_NEW},
+    {NT_REG, MEM, 10, NULL, "mov\t%0, %1", RES_NEW},
+
+    // Array elements (8 bytes each)
+    {NT_REG, OP1(A_INDEX, REG), 10, NULL, "mov\t%1, [%a+%1*8]", 1},
+    {NT_REG, OP1(A_INDEX, IMM), 10, NULL, "mov\t%0, [%a+%1*8]", RES_NEW},
+
+    // Addition
+    {NT_REG, OP2(A_ADD, REG, REG), 10, NULL, "add\t%1, %2", 1},
+    {NT_REG, OP2(A_ADD, REG, IMM), 10, NULL, "add\t%1, %2", 1},
+    {NT_REG, OP2(A_ADD, REG, MEM), 10, NULL, "add\t%1, %2", 1},
+    {NT_REG, OP2(A_ADD, IMM, REG), 10, NULL, "add\t%2, %1", 2},
+    {NT_REG, OP2(A_ADD, MEM, REG), 10, NULL, "add\t%2, %1", 2},
+    {NT_REG, OP2(A_ADD, REG, IMM), 9, kid2IsOne, "inc\t%1", 1},
+    {NT_REG, OP2(A_ADD, REG, OP2(A_MULTIPLY, REG, IMM)), 10, kid3IsScale,
+     "lea\t%1, [%1+%2*%3]", 1},
+    {NT_REG, OP2(A_ADD, OP2(A_MULTIPLY, REG, IMM), REG), 10, kid2IsScale,
+     "lea\t%3, [%3+%1*%2]", 3},
+    {NT_REG, OP2(A_ADD, OP2(A_ADD, REG, OP2(A_MULTIPLY, REG, IMM)), IMM), 10,
+     kid3IsScale, "lea\t%1, [%1+%2*%3+%4]", 1},
+    {NT_REG, OP2(A_ADD, OP2(A_ADD, REG, REG), IMM), 10, NULL,
+     "lea\t%1, [%1+%2+%3]", 1},
+
+    // Subtraction
+    {NT_REG, OP2(A_SUBTRACT, REG, REG), 10, NULL, "sub\t%1, %2", 1},
+    {NT_REG, OP2(A_SUBTRACT, REG, IMM), 10, NULL, "sub\t%1, %2", 1},
+    {NT_REG, OP2(A_SUBTRACT, REG, MEM), 10, NULL, "sub\t%1, %2", 1},
+    {NT_REG, OP2(A_SUBTRACT, REG, IMM), 9, kid2IsOne, "dec\t%1", 1},
+
+    // Multiplication
+    {NT_REG, OP2(A_MULTIPLY, REG, REG), 10, NULL, "imul\t%1, %2", 1},
+    {NT_REG, OP2(A_MULTIPLY, REG, MEM), 10, NULL, "imul\t%1, %2", 1},
+    {NT_REG, OP2(A_MULTIPLY, REG, IMM), 10, NULL, "imul\t%1, %1, %2", 1},
+    {NT_REG, OP2(A_MULTIPLY, IMM, REG), 10, NULL, "imul\t%2, %2, %1", 2},
+    // (superopt.h only has sequences faster than imul)
+    {NT_REG, OP2(A_MULTIPLY, REG, IMM), 9, kid2IsSuperoptimized, "%s2", 1},
+
+    // Signed division (idiv works on rdx:rax)
+    {NT_REG, OP2(A_DIVIDE, REG, REG), 40, NULL,
+     "mov\trax, %1\ncqo\nidiv\t%2\nmov\t%1, rax", 1},
+    {NT_REG, OP2(A_DIVIDE, REG, MEM), 40, NULL,
+     "mov\trax, %1\ncqo\nidiv\t%2\nmov\t%1, rax", 1},
+    {NT_REG, OP2(A_MODULO, REG, REG), 40, NULL,
+     "mov\trax, %1\ncqo\nidiv\t%2\nmov\t%1, rdx", 1},
+    {NT_REG, OP2(A_MODULO, REG, MEM), 40, NULL,
+     "mov\trax, %1\ncqo\nidiv\t%2\nmov\t%1, rdx", 1},
+
+    // By a power of two: shifts and masks with a sign correction, longer
+    // than idiv but many times faster (see nasmDivPowerOfTwo())
+    {NT_REG, OP2(A_DIVIDE, REG, IMM), 30, kid2IsPowerOfTwo,
+     "mov\trax, %1\ncqo\nand\trdx, %m2\nadd\t%1, rdx\nsar\t%1, %l2", 1},
+    {NT_REG, OP2(A_MODULO, REG, IMM), 30, kid2IsPowerOfTwo,
+     "mov\trax, %1\ncqo\nand\trdx, %m2\nadd\t%1, rdx\nand\t%1, %m2\n"
+     "sub\t%1, rdx",
+     1},
+
+    // Without one, where range.c proved the dividend is not negative
+    {NT_REG, OP2(A_SHIFTRIGHT, REG, IMM), 10, NULL, "sar\t%1, %2", 1},
+    {NT_REG, OP2(A_BITAND, REG, IMM), 10, NULL, "and\t%1, %2", 1},
+
+    // Comparisons whose 0/1 result is used as a value
+    {NT_REG, OP2(OP_ANYCMP, REG, REG), 30, NULL,
+     "cmp\t%1, %2\nset%c\t%b1\nmovzx\t%1, %b1", 1},
+    {NT_REG, OP2(OP_ANYCMP, REG, IMM), 30, NULL,
+     "cmp\t%1, %2\nset%c\t%b1\nmovzx\t%1, %b1", 1},
+    {NT_REG, OP2(OP_ANYCMP, REG, MEM), 30, NULL,
+     "cmp\t%1, %2\nset%c\t%b1\nmovzx\t%1, %b1", 1},
+    {NT_REG, OP2(OP_ANYCMP, REG, IMM), 29, kid2IsZero,
+     "test\t%1, %1\nset%c\t%b1\nmovzx\t%1, %b1", 1},
+    {NT_REG, OP2(OP_ANYCMP, MEM, IMM), 30, NULL,
+     "cmp\t%1, %2\nset%c\t%b0\nmovzx\t%0, %b0", RES_NEW},
+    {NT_REG, OP1(A_LOGNOT, REG), 29, NULL,
+     "test\t%1, %1\nsete\t%b1\nmovzx\t%1, %b1", 1},
+
+    // Comparisons feeding a conditional jump (set up the flags only)
+    {NT_COND, OP2(OP_ANYCMP, REG, REG), 10, NULL, "cmp\t%1, %2", RES_NONE},
+    {NT_COND, OP2(OP_ANYCMP, REG, IMM), 10, NULL, "cmp\t%1, %2", RES_NONE},
+    {NT_COND, OP2(OP_ANYCMP, REG, MEM), 10, NULL, "cmp\t%1, %2", RES_NONE},
+    {NT_COND, OP2(OP_ANYCMP, MEM, REG), 10, NULL, "cmp\t%1, %2", RES_NONE},
+    {NT_COND, OP2(OP_ANYCMP, MEM, IMM), 10, NULL, "cmp\t%1, %2",
+     RES_NONE},
+    {NT_COND, OP2(OP_ANYCMP, REG, IMM), 9, kid2IsZero, "test\t%1, %1",
+     RES_NONE},
+
+    // Assignments
+    {NT_STMT, OP2(A_ASSIGN, REG, MEM), 10, NULL, "mov\t%2, %1", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, IMM, MEM), 10, NULL, "%i21", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_ADD, MEM, IMM), MEM), 10, kid1IsKid3,
+     "add\t%3, %2", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_ADD, MEM, IMM), MEM), 9,
+     kid1IsKid3AndKid2IsOne, "inc\t%3", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_SUBTRACT, MEM, IMM), MEM), 10, kid1IsKid3,
+     "sub\t%3, %2", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_SUBTRACT, MEM, IMM), MEM), 9,
+     kid1IsKid3AndKid2IsOne, "dec\t%3", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_ADD, MEM, REG), MEM), 10, kid1IsKid3,
+     "add\t%3, %2", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_ADD, REG, MEM), MEM), 10, kid2IsKid3,
+     "add\t%3, %1", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, OP2(A_SUBTRACT, MEM, REG), MEM), 10, kid1IsKid3,
+     "sub\t%3, %2", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, REG, OP1(A_LVALUEINDEX, REG)), 10, NULL,
+     "mov\t[%a+%2*8], %1", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, REG, OP1(A_LVALUEINDEX, IMM)), 10, NULL,
+     "mov\t[%a+%2*8], %1", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, IMM, OP1(A_LVALUEINDEX, REG)), 10, NULL,
+     "mov\tqword [%a+%2*8], %1", RES_NONE},
+    {NT_STMT, OP2(A_ASSIGN, IMM, OP1(A_LVALUEINDEX, IMM)), 10, NULL,
+     "mov\tqword [%a+%2*8], %1", RES_NONE},
+
+    // Print
+    {NT_STMT, OP1(A_PRINT, REG), 20, NULL, "mov\trdi, %1\ncall\tprintint",
+     RES_NONE},
+    {NT_STMT, OP1(A_PRINT, IMM), 20, NULL, "mov\trdi, %1\ncall\tprintint",
+     RES_NONE},
+    {NT_STMT, OP1(A_PRINT, MEM), 20, NULL, "mov\trdi, %1\ncall\tprintint",
+     RES_NONE},
+};
+
+#define NRULES ((int)(sizeof(rules) / sizeof(rules[0])))
+
+/**
+ * conditionCode - Returns the x86 condition code suffix of a comparison.
+ *
+ * @param op The comparison AST operator.
+ *
+ * @return The suffix for setcc/jcc (e.g. "l" for A_LT).
+ */
+static char *conditionCode(int op) {
+    switch (op) {
+    case A_EQ:
+        return "e";
+    case A_NE:
+        return "ne";
+    case A_LT:
+        return "l";
+    case A_LE:
+        return "le";
+    case A_GT:
+        return "g";
+    case A_GE:
+        return "ge";
+    default:
+        logFatald("No condition code for AST operator: ", op);
+        return NULL;
+    }
+}
+
+/**
+ * invertedConditionCode - Returns the condition code that holds exactly
+ * when the comparison fails.
+ *
+ * @param op The comparison AST operator.
+ *
+ * @return The suffix for jcc (e.g. "ge" for A_LT).
+ */
+static char *invertedConditionCode(int op) {
+    switch (op) {
+    case A_EQ:
+        return "ne";
+    case A_NE:
+        return "e";
+    case A_LT:
+        return "ge";
+    case A_LE:
+        return "g";
+    case A_GT:
+        return "le";
+    case A_GE:
+        return "l";
+    default:
+        logFatald("No condition code for AST operator: ", op);
+        return NULL;
+    }
+}
+
+/**
+ * matchPattern - Matches a pattern against a subtree.
+ *
+ * @param p The pattern.
+ * @param n The subtree.
+ * @param kid Receives the subtrees bound to the pattern leaves.
+ * @param kidNT Receives the nonterminals of the pattern leaves.
+ * @param nkids In: leaves bound so far. Out: leaves bound in total.
+ *
+ * @return Sum of the leaves' costs, or ISEL_INFINITY if no match.
+ */
+static int matchPattern(struct pattern *p, struct ASTnode *n,
+                        struct ASTnode **kid, int *kidNT, int *nkids) {
+    int cost, c;
+
+    if (n == NULL) {
+        return ISEL_INFINITY;
+    }
+
+    // A leaf matches whatever is derivable to its nonterminal
+    if (p->op == 0) {
+        if (*nkids == ISEL_MAXKIDS) {
+            logFatal("Instruction selection pattern has too many leaves");
+        }
+        kid[*nkids] = n;
+        kidNT[*nkids] = p->nt;
+        (*nkids)++;
+        return n->iselCost[p->nt];
+    }
+
+    if (p->op == OP_ANYCMP ? !isComparison(n->op) : p->op != n->op) {
+        return ISEL_INFINITY;
+    }
+
+    cost = 0;
+    if (p->left) {
+        if ((c = matchPattern(p->left, n->left, kid, kidNT, nkids)) >=
+            ISEL_INFINITY) {
+            return ISEL_INFINITY;
+        }
+        cost += c;
+    }
+    if (p->right) {
+        if ((c = matchPattern(p->right, n->right, kid, kidNT, nkids)) >=
+            ISEL_INFINITY) {
+            return ISEL_INFINITY;
+        }
+        cost += c;
+    }
+    return cost;
+}
+
+/**
+ * label - Finds the cheapest rule for every nonterminal of every node.
+ *
+ * @param n The root of the subtree to label.
+ */
+static void label(struct ASTnode *n) {
+    struct ASTnode *kid[ISEL_MAXKIDS];
+    int kidNT[ISEL_MAXKIDS];
+    int nkids, cost, changed;
+
+    if (n == NULL) {
+        return;
+    }
+    label(n->left);
+    label(n->right);
+
+    for (int nt = 0; nt < NT_COUNT; nt++) {
+        n->iselCost[nt] = ISEL_INFINITY;
+        n->iselRule[nt] = -1;
+    }
+
+    // Base rules; chain rules (bare leaf patterns) come after
+    for (int r = 0; r < NRULES; r++) {
+        if (rules[r].pattern->op == 0) {
+            continue;
+        }
+        nkids = 0;
+        cost = matchPattern(rules[r].pattern, n, kid, kidNT, &nkids);
+        if (cost >= ISEL_INFINITY ||
+            (rules[r].predicate && !rules[r].predicate(kid))) {
+            continue;
+        }
+        cost += rules[r].cost;
+        if (cost < n->iselCost[rules[r].lhs]) {
+            n->iselCost[rules[r].lhs] = cost;
+            n->iselRule[rules[r].lhs] = r;
+        }
+    }
+
+    // Close over the chain rules until nothing gets cheaper
+    do {
+        changed = 0;
+        for (int r = 0; r < NRULES; r++) {
+            if (rules[r].pattern->op != 0) {
+                continue;
+            }
+            cost = n->iselCost[rules[r].pattern->nt];
+            if (cost >= ISEL_INFINITY) {
+                continue;
+            }
+            cost += rules[r].cost;
+            if (cost < n->iselCost[rules[r].lhs]) {
+                n->iselCost[rules[r].lhs] = cost;
+                n->iselRule[rules[r].lhs] = r;
+                changed = 1;
+            }
+        }
+    } while (changed);
+}
+
+/**
+ * formatOperand - Writes the text of a pattern leaf.
+ *
+ * @param n The subtree bound to the leaf.
+ * @param nt The nonterminal it was reduced to.
+ * @param reg The register holding it (NT_REG only).
+ */
+static void formatOperand(struct ASTnode *n, int nt, int reg) {
+    switch (nt) {
+    case NT_REG:
+        fputs(nasmRegisterName(reg), Outfile);
+        break;
+    case NT_IMM:
+        fprintf(Outfile, "%d", n->v.intvalue);
+        break;
+    case NT_MEM:
+        fputs(nasmVariableOperand(n->v.identifierIndex), Outfile);
+        break;
+    }
+}
+
+/**
+ * emitText - Writes a template's text with placeholders filled in; the
+ * caller writes the tab before and the newline after it.
+ *
+ * @param t The template.
+ * @param n The node the rule was matched at.
+ * @param kid The subtrees bound to the pattern leaves.
+ * @param kidNT Their nonterminals.
+ * @param kidReg Their registers (NT_REG leaves only).
+ * @param result The result register, or NOREG.
+ */
+static void emitText(char *t, struct ASTnode *n, struct ASTnode **kid,
+                     int *kidNT, int *kidReg, int result) {
+    int k, value;
+
+    for (; *t; t++) {
+        if (*t == '\n') {
+            fputs("\n\t", Outfile);
+            continue;
+        }
+        if (*t != '%') {
+            fputc(*t, Outfile);
+            continue;
+        }
+
+        switch (*++t) {
+        case 'c':
+            fputs(conditionCode(n->op), Outfile);
+            break;
+        case 'a':
+            k = (n->op == A_ASSIGN ? n->right : n)->v.identifierIndex;
+            fputs(GlobalSymbolTable[k].name, Outfile);
+            break;
+        case 'b':
+            k = *++t - '0';
+            fputs(nasmByteRegisterName(k ? kidReg[k - 1] : result), Outfile);
+            break;
+        case 'm':
+        case 'l':
+            k = *(t + 1) - '0';
+            value = kid[k - 1]->v.intvalue;
+            if (*t == 'm') {
+                fprintf(Outfile, "%d", value - 1);
+            } else {
+                fprintf(Outfile, "%d", __builtin_ctz(value));
+            }
+            t++;
+            break;
+        case 'i':
+            k = *++t - '0';
+            value = kid[*++t - '1']->v.intvalue;
+            if (k == 0 || kidNT[k - 1] == NT_REG) {
+                nasmImmediateText(k == 0 ? result : kidReg[k - 1], 0, value);
+            } else {
+                nasmImmediateText(NOREG, kid[k - 1]->v.identifierIndex,
+                                  value);
+            }
+            break;
+        case 's':
+            // The sequence's own %1 is the rule's
+            k = *++t - '0';
+            emitText(nasmMulSequence(kid[k - 1]->v.intvalue), n, kid, kidNT,
+                     kidReg, result);
+            break;
+        default:
+            k = *t - '0';
+            if (k == 0) {
+                fputs(nasmRegisterName(result), Outfile);
+            } else {
+                formatOperand(kid[k - 1], kidNT[k - 1], kidReg[k - 1]);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * emitTemplate - Writes a rule's instructions with placeholders filled in.
+ *
+ * @param t The template.
+ * @param n The node the rule was matched at.
+ * @param kid The subtrees bound to the pattern leaves.
+ * @param kidNT Their nonterminals.
+ * @param kidReg Their registers (NT_REG leaves only).
+ * @param result The result register, or NOREG.
+ */
+static void emitTemplate(char *t, struct ASTnode *n, struct ASTnode **kid,
+                         int *kidNT, int *kidReg, int result) {
+    fputc('\t', Outfile);
+    emitText(t, n, kid, kidNT, kidReg, result);
+    fputc('\n', Outfile);
+}
+
+static int reduce(struct ASTnode *n, int nt);
+
+/**
+ * reduceRule - Emits the rule chosen for a node and nonterminal.
+ *
+ * @param n The node.
+ * @param nt The nonterminal to derive.
+ *
+ * @return The register holding the value, or NOREG.
+ */
+static int reduceRule(struct ASTnode *n, int nt) {
+    struct ASTnode *kid[ISEL_MAXKIDS];
+    int kidNT[ISEL_MAXKIDS];
+    int kidReg[ISEL_MAXKIDS];
+    int nkids = 0;
+    int result;
+    struct rule *r;
+
+    if (n->iselRule[nt] < 0) {
+        logFatald("No instruction pattern covers AST operator: ", n->op);
+    }
+    r = &rules[n->iselRule[nt]];
+
+    // Leaves are folded into the instruction that uses them
+    if (r->template == NULL) {
+        return NOREG;
+    }
+
+    // Bind the pattern leaves again, then compute them left to right
+    matchPattern(r->pattern, n, kid, kidNT, &nkids);
+    for (int i = 0; i < nkids; i++) {
+        kidReg[i] = reduce(kid[i], kidNT[i]);
+    }
+
+    if (r->result == RES_NEW) {
+        result = nasmAllocateRegister();
+    } else if (r->result == RES_NONE) {
+        result = NOREG;
+    } else {
+        result = kidReg[r->result - 1];
+    }
+
+    emitTemplate(r->template, n, kid, kidNT, kidReg, result);
+
+    // Operand registers die here, except the one holding the result
+    for (int i = 0; i < nkids; i++) {
+        if (kidNT[i] == NT_REG && kidReg[i] != result) {
+            nasmFreeRegister(kidReg[i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * reduce - Emits code deriving a node to a nonterminal.
+ *
+ * NOTE:
+ * Repeated pure expressions that end up in a register go through
+ * the CSE cache (see cse.c).
+ *
+ * @param n The node.
+ * @param nt The nonterminal to derive.
+ *
+ * @return The register holding the value, or NOREG.
+ */
+static int reduce(struct ASTnode *n, int nt) {
+    int result, slot;
+
+    if (nt != NT_REG || !cseIsCandidate(n)) {
+        return reduceRule(n, nt);
+    }
+
+    if ((slot = cseLookup(n)) != NOREG) {
+        return nasmCacheLoad(slot);
+    }
+    result = reduceRule(n, nt);
+    if ((slot = cseRecord(n)) != NOREG) {
+        nasmCacheStore(result, slot);
+    }
+    return result;
+}
+
+/**
+ * iselStatement - Selects and emits instructions for a statement
+ * (A_ASSIGN or A_PRINT).
+ *
+ * @param n The statement's AST.
+ *
+ * @return NOREG
+ */
+int iselStatement(struct ASTnode *n) {
+    label(n);
+    return reduce(n, NT_STMT);
+}
+
+/**
+ * iselCondition - Selects and emits instructions for a comparison
+ * followed by a conditional jump.
+ *
+ * @param cond The comparison's AST.
+ * @param jumpOp The comparison to test; the jump is taken when it is FALSE
+ *               (as with nasmCompareAndJump()).
+ * @param label The label number to jump to.
+ *
+ * @return NOREG
+ */
+int iselCondition(struct ASTnode *cond, int jumpOp, int labelNumber) {
+    label(cond);
+    reduce(cond, NT_COND);
+    fprintf(Outfile, "\tj%s\tL%d\n", invertedConditionCode(jumpOp),
+            labelNumber);
+    return NOREG;
+}
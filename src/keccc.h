@@ -0,0 +1,115 @@
+// src/keccc.h
+
+/**
+ * NOTE:
+ * libkeccc: the keccc compiler as an in-memory library
+ *
+ * The library keeps no state between calls, never exits the process
+ * and may be called from several threads at once.
+ *
+ * Its working state is thread-local, built for the initial-exec TLS
+ * model: about 10KB in every thread of the program, including threads
+ * that never compile. Link the library into the program (or preload
+ * it); dlopen() fails with "cannot allocate memory in static TLS
+ * block", so it does not suit plugins or other late loading.
+ *
+ * Example:
+ * ----------------------------------------
+ * keccc_output out;
+ * if (keccc_compile(src, strlen(src), &out) == KECCC_OK) {
+ *     fwrite(out.code, 1, out.code_size, stdout);
+ * } else {
+ *     fwrite(out.diagnostics, 1, out.diagnostics_size, stderr);
+ * }
+ * keccc_output_free(&out);
+ * ----------------------------------------
+ */
+
+#ifndef KECCC_H
+#define KECCC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Results of keccc_compile()
+enum {
+    KECCC_OK = 0,          // code generated
+    KECCC_ERROR_SOURCE,    // the program did not compile (see diagnostics)
+    KECCC_ERROR_OPTIONS,   // invalid option combination
+    KECCC_ERROR_RESOURCES, // out of memory or temporary files
+};
+
+// Code generation options; zero-initialized means the defaults
+typedef struct keccc_options {
+    int emit_llvm;       // LLVM IR instead of NASM assembly
+    int debug_line_info; // annotate with source lines (-g)
+    int no_isel;         // one fixed template per node (--no-isel)
+    int instrument;      // count branches (--instrument)
+    const char *profile_path; // lay out branches by profile, or NULL
+    const char *source_name;  // name used in line annotations, or NULL
+    int no_cse;          // compute repeated expressions again (--no-cse)
+    int no_if_convert;   // keep every if a branch (--no-if-convert)
+    int stream;          // statement by statement (--stream)
+    int scan_thread;     // scan on a second thread (--scan-thread)
+    int jobs;            // code generation threads (-j), 0 means 1
+    int no_jump_tables;  // compare in every switch (--no-jump-tables)
+    int no_branch_chains; // test conditions as values (--no-branch-chains)
+    int no_vectorize;    // keep array loops scalar (--no-vectorize)
+    int avx2;            // vectorize with AVX2 instead of SSE2 (-mavx2)
+    int no_inline;       // keep every call a call (--no-inline)
+    int no_regalloc;     // every local on the stack (--no-regalloc)
+    int no_ranges;       // do not fold by value ranges (--no-ranges)
+    int no_reassociate;  // keep + and * chains (--no-reassociate)
+    int no_share;        // no shared subtrees (--no-share)
+    int no_superopt;     // multiply by constants with imul (--no-superopt)
+    int optimize_size;   // smaller code (-Os)
+} keccc_options;
+
+// What a compilation produced. Both buffers are NUL-terminated,
+// owned by the caller and released with keccc_output_free().
+typedef struct keccc_output {
+    char *code;              // generated assembly or LLVM IR
+    size_t code_size;        // its length, without the NUL
+    char *diagnostics;       // error messages, "" if none
+    size_t diagnostics_size; // their length, without the NUL
+} keccc_output;
+
+/**
+ * keccc_compile - Compiles a program to NASM x86-64 assembly.
+ *
+ * @src: The source text (need not be NUL-terminated).
+ * @len: Its length in bytes.
+ * @out: Receives the output; always filled, even on failure.
+ *
+ * Returns: KECCC_OK or one of the KECCC_ERROR_* codes.
+ */
+int keccc_compile(const char *src, size_t len, keccc_output *out);
+
+/**
+ * keccc_compile_with - Compiles a program with explicit options.
+ *
+ * @src: The source text (need not be NUL-terminated).
+ * @len: Its length in bytes.
+ * @options: Code generation options, or NULL for the defaults.
+ * @out: Receives the output; always filled, even on failure.
+ *
+ * Returns: KECCC_OK or one of the KECCC_ERROR_* codes.
+ */
+int keccc_compile_with(const char *src, size_t len,
+                       const keccc_options *options, keccc_output *out);
+
+/**
+ * keccc_output_free - Releases the buffers of a keccc_output.
+ *
+ * @out: The output to release (its fields are cleared).
+ */
+void keccc_output_free(keccc_output *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+// src/libkeccc.c
+
+/**
+ * NOTE:
+ * libkeccc entry points (see keccc.h)
+ *
+ * A compilation runs on the calling thread's copy of the compiler
+ * globals (see data.h), reading the source through fmemopen() and
+ * writing code and diagnostics to open_memstream() buffers.
+ * Fatal errors jump back here (setFatalRecovery()), and
+ * resetCompilation() leaves the thread ready for the next call.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+#include "keccc.h"
+
+/**
+ * applyOptions - Sets the option globals from a keccc_options.
+ *
+ * @options: The options, or NULL for the defaults.
+ *
+ * Returns: 1 if the combination is valid, 0 otherwise.
+ */
+static int applyOptions(const keccc_options *options) {
+    static const keccc_options defaults = {0};
+
+    if (options == NULL) {
+        options = &defaults;
+    }
+    Backend = options->emit_llvm ? BACKEND_LLVM : BACKEND_NASM;
+    DebugLineInfo = options->debug_line_info;
+    UseInstructionSelection = !options->no_isel;
+    UseCSE = !options->no_cse;
+    IfConvert = !options->no_if_convert;
+    JumpTables = !options->no_jump_tables;
+    BranchChains = !options->no_branch_chains;
+    RegisterLocals = !options->no_regalloc;
+    InstrumentBranches = options->instrument;
+    StreamStatements = options->stream;
+    VectorISA = options->no_vectorize ? VECTOR_NONE
+                : options->avx2       ? VECTOR_AVX2
+                                      : VECTOR_SSE2;
+    InlineFunctions = !options->no_inline;
+    UseValueRanges = !options->no_ranges;
+    Reassociate = !options->no_reassociate;
+    ShareSubtrees = !options->no_share;
+    Superoptimize = !options->no_superopt;
+    OptimizeSize = options->optimize_size;
+    ScanThread = options->scan_thread;
+    EmitAST = FromAST = 0;
+    CodegenJobs = options->jobs > 0 ? options->jobs : 1;
+    UseCache = 0;
+    PrintStatistics = 0;
+    OutputPath = NULL;
+    Infilename = (char *)(options->source_name ? options->source_name
+                                               : "<memory>");
+
+    if (CodegenJobs > CODEGEN_MAX_JOBS) {
+        fprintf(Errfile, "At most %d code generation threads\n",
+                CODEGEN_MAX_JOBS);
+        return 0;
+    }
+    if (Backend == BACKEND_LLVM &&
+        (InstrumentBranches || options->profile_path)) {
+        fprintf(Errfile, "--instrument and --profile-use are only "
+                         "supported by the NASM backend\n");
+        return 0;
+    }
+    return 1;
+}
+
+int keccc_compile_with(const char *src, size_t len,
+                       const keccc_options *options, keccc_output *out) {
+    jmp_buf recovery;
+    char *profilePath = options ? (char *)options->profile_path : NULL;
+    FILE *code, *diagnostics;
+    int status = KECCC_ERROR_SOURCE;
+
+    memset(out, 0, sizeof(*out));
+    if ((code = open_memstream(&out->code, &out->code_size)) == NULL) {
+        return KECCC_ERROR_RESOURCES;
+    }
+    diagnostics = open_memstream(&out->diagnostics, &out->diagnostics_size);
+    if (diagnostics == NULL) {
+        fclose(code);
+        return KECCC_ERROR_RESOURCES;
+    }
+    Outfile = code;
+    Errfile = diagnostics;
+
+    // fmemopen() does not accept an empty buffer
+    Infile = len > 0 ? fmemopen((void *)src, len, "r")
+                     : fopen("/dev/null", "r");
+
+    if (Infile == NULL) {
+        status = KECCC_ERROR_RESOURCES;
+    } else if (!applyOptions(options)) {
+        status = KECCC_ERROR_OPTIONS;
+    } else if (setjmp(recovery) == 0) {
+        setFatalRecovery(&recovery);
+        compileProgram(profilePath);
+        status = KECCC_OK;
+    }
+    setFatalRecovery(NULL);
+
+    if (Infile != NULL) {
+        fclose(Infile);
+    }
+    resetCompilation();
+
+    fclose(code);
+    fclose(diagnostics);
+    Infile = Outfile = Errfile = NULL;
+    return status;
+}
+
+int keccc_compile(const char *src, size_t len, keccc_output *out) {
+    return keccc_compile_with(src, len, NULL, out);
+}
+
+void keccc_output_free(keccc_output *out) {
+    free(out->code);
+    free(out->diagnostics);
+    memset(out, 0, sizeof(*out));
+}
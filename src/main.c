@@ -1,53 +1,153 @@
 // src/main.c
 
-#include "decl.h"
-
-#define extern_
 #include "data.h"
-#undef extern_
+#include "decl.h"
 
 #include <errno.h>
 
-static void init() {
-    Line = 1;
-    Putback = '\n';
-}
-
 static void usage(char *program) {
-    fprintf(stderr, "Usage: %s infile\n", program);
+    fprintf(stderr,
+            "Usage: %s " KECCC_USAGE_OPTIONS "\n"
+            "       %s --server [socket]\n"
+            "       %s --cache-stats\n"
+            "       %s --superopt\n",
+            program, program, program, program);
+    fprintf(stderr, "  infile              source file, or - for standard "
+                    "input\n");
+    fprintf(stderr, "  -o outfile          write to outfile instead of "
+                    "out.s/out.ll, - for standard output\n");
+    fprintf(stderr, "  -g                  annotate output with source lines "
+                    "(nasm -g -F dwarf)\n");
+    fprintf(stderr, "  --emit-llvm         emit textual LLVM IR (out.ll) "
+                    "instead of NASM (out.s)\n");
+    fprintf(stderr, "  --no-isel           use one fixed instruction "
+                    "template per AST node\n");
+    fprintf(stderr, "  --no-cse            compute repeated expressions "
+                    "again instead of reusing them\n");
+    fprintf(stderr, "  --no-if-convert     keep every if statement a "
+                    "branch (no cmov/select)\n");
+    fprintf(stderr, "  --no-jump-tables    dispatch every switch by "
+                    "comparisons (NASM only)\n");
+    fprintf(stderr, "  --no-branch-chains  compute each comparison in a "
+                    "condition to 0 or 1 and test it\n");
+    fprintf(stderr, "  --no-vectorize      keep simple array loops scalar "
+                    "(NASM only)\n");
+    fprintf(stderr, "  -mavx2              vectorize loops with AVX2 "
+                    "instead of SSE2\n");
+    fprintf(stderr, "  --no-inline         keep every function call a "
+                    "call\n");
+    fprintf(stderr, "  --no-regalloc       keep every local on the stack "
+                    "(NASM only)\n");
+    fprintf(stderr, "  --no-ranges         do not fold what value ranges "
+                    "decide\n");
+    fprintf(stderr, "  --no-reassociate    keep + and * chains in "
+                    "source order\n");
+    fprintf(stderr, "  --no-share          give every expression nodes of "
+                    "its own\n");
+    fprintf(stderr, "  --no-superopt       multiply by constants with imul "
+                    "(NASM only)\n");
+    fprintf(stderr, "  -Os                 prefer smaller instructions "
+                    "and share if/else tails\n");
+    fprintf(stderr, "  --instrument        count if statement branches, "
+                    "written to " PROFILE_DEFAULT_PATH " at exit\n");
+    fprintf(stderr, "  --profile-use file  lay out branches using a "
+                    "recorded profile\n");
+    fprintf(stderr, "  --stream            generate code statement by "
+                    "statement, in constant memory\n");
+    fprintf(stderr, "  --scan-thread       run the scanner on its own "
+                    "thread, ahead of the parser\n");
+    fprintf(stderr, "  -j jobs             generate code on up to jobs "
+                    "threads (NASM only)\n");
+    fprintf(stderr, "  --emit-ast          write the parsed program "
+                    "(out.ast) instead of code\n");
+    fprintf(stderr, "  --from-ast          generate code from a file "
+                    "written by --emit-ast\n");
+    fprintf(stderr, "  --cache             reuse the output of an identical "
+                    "earlier compilation (files only)\n");
+    fprintf(stderr, "  --cache-stats       print compilation cache "
+                    "hits and misses\n");
+    fprintf(stderr, "  --stats             print how many AST nodes sharing "
+                    "identical subtrees saved\n");
+    fprintf(stderr, "  --server [socket]   stay resident and compile jobs "
+                    "sent by keccc-client\n");
+    fprintf(stderr, "  --superopt          search the multiplication "
+                    "sequences of superopt.h\n");
     exit(1);
 }
 
 int main(int argc, char **argv) {
-    struct ASTnode *tree;
+    char *outputPath;
+    char *profilePath;
+    uint64_t key = 0;
+    int i;
 
-    if (argc != 2) {
-        usage(argv[0]);
+    Errfile = stderr;
+
+    if (argc == 2 && !strcmp(argv[1], "--cache-stats")) {
+        cachePrintStats();
+        exit(0);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "--server")) {
+        if (argc > 3) {
+            usage(argv[0]);
+        }
+        return serverRun(argc == 3 ? argv[2] : NULL);
+    }
+    if (argc == 2 && !strcmp(argv[1], "--superopt")) {
+        return superoptRun();
     }
 
-    init();
+    // Scan for command-line options
+    if ((i = parseOptions(argc, argv, &profilePath)) < 0) {
+        usage(argv[0]);
+    }
 
     // Open up the input file
-    Infile = fopen(argv[1], "r");
+    if (!strcmp(argv[i], "-")) {
+        Infilename = "<stdin>";
+        Infile = stdin;
+    } else {
+        Infilename = argv[i];
+        Infile = fopen(Infilename, "r");
+    }
     if (Infile == NULL) {
-        fprintf(stderr, "Cannot open %s: %s\n", argv[1], strerror(errno));
+        fprintf(stderr, "Cannot open %s: %s\n", argv[i], strerror(errno));
         exit(1);
     }
+    setvbuf(Infile, NULL, _IOFBF, IO_BUFFER_SIZE);
+
+    // An identical earlier compilation already produced the output
+    outputPath = outputName();
+    if (Infile == stdin || !strcmp(outputPath, "-")) {
+        UseCache = 0; // the cache hashes and copies files
+    }
+    if (UseCache) {
+        key = cacheKey(profilePath);
+        if (cacheFetch(key, outputPath)) {
+            exit(0);
+        }
+    }
 
     // Create the output file
-    // TODO: make the output file name customizable later
-    if ((Outfile = fopen("out.s", "w")) == NULL) {
-        fprintf(stderr, "Cannot open out.s for writing: %s\n", strerror(errno));
+    if (!strcmp(outputPath, "-")) {
+        Outfile = stdout;
+    } else if ((Outfile = fopen(outputPath, "w")) == NULL) {
+        fprintf(stderr, "Cannot open %s for writing: %s\n", outputPath,
+                strerror(errno));
         exit(1);
     }
+    setvbuf(Outfile, NULL, _IOFBF, IO_BUFFER_SIZE);
 
-    scan(&Token);      // First token
-    codegenPreamble(); // Emit preamble(global, printint, main prologue)
-    tree = compoundStatement(); // Parse the whole input into an AST
-    codegenAST(tree, NOREG, 0); // Generate code for the AST
-    codegenPostamble();         // Output the postamble
+    compileProgram(profilePath);
 
-    fclose(Outfile);
+    if (fclose(Outfile) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", outputPath, strerror(errno));
+        exit(1);
+    }
+
+    if (UseCache) {
+        cacheStore(key, outputPath);
+    }
 
     exit(0);
 }
@@ -4,6 +4,9 @@
 #include "decl.h"
 #include "defs.h"
 
+// Where fatalExit() returns to instead of exiting (see setFatalRecovery())
+static _Thread_local jmp_buf *fatalRecovery = NULL;
+
 /**
  * match - Matches the current token with the expected token.
  *         If they match, it scans the next token.
@@ -16,9 +19,9 @@ void match(int t, char *what) {
     if (Token.token == t) {
         scan(&Token);
     } else {
-        fprintf(stderr, "Expected %s, got token %d, line %d\n", what,
+        fprintf(Errfile, "Expected %s, got token %d, line %d\n", what,
                 Token.token, Line);
-        exit(1);
+        fatalExit();
     }
 }
 
@@ -27,6 +30,11 @@ void match(int t, char *what) {
  */
 void semicolon(void) { match(T_SEMICOLON, ";"); }
 
+/**
+ * colon - Matches a colon token.
+ */
+void colon(void) { match(T_COLON, ":"); }
+
 /**
  * identifier - Matches an identifier token.
  */
@@ -52,14 +60,55 @@ void leftParenthesis(void) { match(T_LPAREN, "("); }
  */
 void rightParenthesis(void) { match(T_RPAREN, ")"); }
 
+/**
+ * leftBracket - Matches a left bracket token.
+ */
+void leftBracket(void) { match(T_LBRACKET, "["); }
+
+/**
+ * rightBracket - Matches a right bracket token.
+ */
+void rightBracket(void) { match(T_RBRACKET, "]"); }
+
+/**
+ * setFatalRecovery - Sets where a fatal error returns to.
+ *
+ * NOTE:
+ * The compile server (server.c) runs many compilations in one process,
+ * so a fatal error must end the job, not the server.
+ *
+ * @env: The recovery point, or NULL to exit on fatal errors again.
+ */
+void setFatalRecovery(jmp_buf *env) { fatalRecovery = env; }
+
+/**
+ * hasFatalRecovery - Tells whether fatal errors return instead of exiting.
+ *
+ * Returns: 1 if a recovery point is set, 0 otherwise.
+ */
+int hasFatalRecovery(void) { return fatalRecovery != NULL; }
+
+/**
+ * fatalExit - Ends the current compilation after a fatal error has been
+ * reported: exits with status 1, or jumps back to the recovery point.
+ */
+_Noreturn void fatalExit(void) {
+    fflush(stdout);
+    fflush(Errfile);
+    if (fatalRecovery != NULL) {
+        longjmp(*fatalRecovery, 1);
+    }
+    exit(1);
+}
+
 /**
  * logFatal - Logs a fatal error message and exits.
  *
  * @s: The error message to log.
  */
 void logFatal(char *s) {
-    fprintf(stderr, "Fatal error: %s, line %d\n", s, Line);
-    exit(1);
+    fprintf(Errfile, "Fatal error: %s, line %d\n", s, Line);
+    fatalExit();
 }
 
 /**
@@ -69,8 +118,8 @@ void logFatal(char *s) {
  * @s2: The second part of the error message.
  */
 void logFatals(char *s1, char *s2) {
-    fprintf(stderr, "Fatal error: %s%s, line %d\n", s1, s2, Line);
-    exit(1);
+    fprintf(Errfile, "Fatal error: %s%s, line %d\n", s1, s2, Line);
+    fatalExit();
 }
 
 /**
@@ -81,8 +130,8 @@ void logFatals(char *s1, char *s2) {
  * @d: The integer part of the error message.
  */
 void logFatald(char *s, int d) {
-    fprintf(stderr, "Fatal error: %s%d, line %d\n", s, d, Line);
-    exit(1);
+    fprintf(Errfile, "Fatal error: %s%d, line %d\n", s, d, Line);
+    fatalExit();
 }
 
 /**
@@ -93,6 +142,6 @@ void logFatald(char *s, int d) {
  * @c: The character part of the error message.
  */
 void logFatalc(char *s, int c) {
-    fprintf(stderr, "Fatal error: %s:%c, line %d\n", s, c, Line);
-    exit(1);
+    fprintf(Errfile, "Fatal error: %s:%c, line %d\n", s, c, Line);
+    fatalExit();
 }
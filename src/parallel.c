@@ -0,0 +1,335 @@
+// src/parallel.c
+
+/**
+ * NOTE:
+ * Parallel code generation (-j N)
+ *
+ * The top-level statements are split into up to N chunks, and each
+ * chunk is generated on its own thread into a private buffer:
+ * ----------------------------------------
+ *   statements   s1 ... s40 | s41 ... s80 | s81 ... s120
+ *   generated by  thread 1  |  thread 2   |  thread 3
+ *   Outfile      buffer 1, then buffer 2, then buffer 3
+ * ----------------------------------------
+ * The result is byte-identical to generating them one after another:
+ * - codegenSkipStatement() first walks the statements to find the
+ *   label number, branch id and source line each chunk starts from, and
+ * - a chunk only starts where the CSE cache is known to be empty
+ *   (after an if statement's closing label, with no cacheable
+ *   expression since), so it never reuses a value from an earlier chunk.
+ * Every worker starts with a fresh register pool, just like every
+ * statement does.
+ *
+ * Only NASM output is split: the LLVM backend numbers the values
+ * of main in one sequence, so it is generated on the calling thread.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <pthread.h>
+
+// What the workers borrow from the compiling thread (read-only)
+struct sharedState {
+    int instrumentBranches;
+    int debugLineInfo;
+    int useInstructionSelection;
+    int ifConvert;
+    int jumpTables;
+    int branchChains;
+    int registerLocals;
+    int superoptimize;
+    int vectorISA;
+    int optimizeSize;
+    char *infilename;
+    struct symbolTable *globalSymbols;
+    int symbolCount;
+    struct cseCount **cseCounts;
+    long *profileTaken;
+    long *profileNotTaken;
+    int profileCount;
+};
+
+// A run of consecutive top-level statements generated by one worker
+struct chunk {
+    struct ASTnode **statements;  // the first statement
+    int count;                    // number of statements
+    struct codegenPosition start; // counters before the first statement
+    struct sharedState *shared;   // the compiling thread's state
+    char *code;                   // generated code
+    size_t codeSize;
+    char *cold;                   // out-of-line code (see gen.c)
+    size_t coldSize;
+    char *errors;                 // diagnostics, if generation failed
+    size_t errorsSize;
+    int failed;                   // 1 if generation failed
+    pthread_t thread;
+};
+
+/**
+ * flattenStatements - Lists the top-level statements of a program.
+ *
+ * NOTE:
+ * compoundStatement() glues statements into a left-leaning chain,
+ * ----------------------------------------
+ *          A_GLUE
+ *          /    \
+ *      A_GLUE    s3
+ *      /    \
+ *    s1      s2
+ * ----------------------------------------
+ * which is walked down its left spine without recursion.
+ *
+ * @tree: The program.
+ * @count: Receives the number of statements.
+ *
+ * @return The statements in program order (to be freed by the caller).
+ */
+static struct ASTnode **flattenStatements(struct ASTnode *tree, int *count) {
+    struct ASTnode **statements;
+    struct ASTnode *n;
+    int i = 0;
+
+    for (n = tree; n != NULL && n->op == A_GLUE; n = n->left) {
+        i += n->right != NULL;
+    }
+    i += n != NULL;
+
+    if ((statements = malloc((i ? i : 1) * sizeof(*statements))) == NULL) {
+        logFatal("Out of memory in flattenStatements()");
+    }
+    *count = i;
+
+    for (n = tree; n != NULL && n->op == A_GLUE; n = n->left) {
+        if (n->right != NULL) {
+            statements[--i] = n->right;
+        }
+    }
+    if (n != NULL) {
+        statements[--i] = n;
+    }
+    return statements;
+}
+
+/**
+ * generateChunk - Body of a worker: generates one chunk.
+ *
+ * NOTE:
+ * The compiler globals are thread-local (see data.h), so the
+ * worker first copies the options and symbols it needs.
+ *
+ * @arg: The chunk.
+ *
+ * @return NULL
+ */
+static void *generateChunk(void *arg) {
+    struct chunk *c = arg;
+    struct sharedState *s = c->shared;
+    jmp_buf recovery;
+    FILE *code, *cold;
+
+    Backend = BACKEND_NASM;
+    InstrumentBranches = s->instrumentBranches;
+    DebugLineInfo = s->debugLineInfo;
+    UseInstructionSelection = s->useInstructionSelection;
+    IfConvert = s->ifConvert;
+    JumpTables = s->jumpTables;
+    BranchChains = s->branchChains;
+    RegisterLocals = s->registerLocals;
+    Superoptimize = s->superoptimize;
+    VectorISA = s->vectorISA;
+    OptimizeSize = s->optimizeSize;
+    Infilename = s->infilename;
+    cseBorrowCounts(s->cseCounts);
+    profileBorrow(s->profileTaken, s->profileNotTaken, s->profileCount);
+
+    Outfile = code = open_memstream(&c->code, &c->codeSize);
+    cold = open_memstream(&c->cold, &c->coldSize);
+    Errfile = open_memstream(&c->errors, &c->errorsSize);
+
+    if (code == NULL || cold == NULL || Errfile == NULL) {
+        c->failed = 1;
+    } else if (setjmp(recovery) == 0) {
+        setFatalRecovery(&recovery);
+        borrowGlobalSymbols(s->globalSymbols, s->symbolCount);
+        codegenSetPosition(&c->start);
+        codegenResetRegisters();
+        for (int i = 0; i < c->count; i++) {
+            codegenAST(c->statements[i], NOREG, A_GLUE);
+            codegenResetRegisters();
+        }
+        codegenMoveColdCode(cold);
+    } else {
+        c->failed = 1;
+    }
+
+    setFatalRecovery(NULL);
+    codegenReset();
+    treeReset();
+    releaseGlobalSymbols();
+    cseBorrowCounts(NULL);
+    profileBorrow(NULL, NULL, 0);
+    // A fatal error in a function or cold block leaves Outfile at the
+    // out-of-line code, which codegenReset() has closed
+    Outfile = NULL;
+    if (code != NULL) {
+        fclose(code);
+    }
+    if (cold != NULL) {
+        fclose(cold);
+    }
+    if (Errfile != NULL) {
+        fclose(Errfile);
+    }
+    return NULL;
+}
+
+/**
+ * freeChunks - Releases the chunks and their buffers.
+ *
+ * @chunks: The chunks.
+ * @count: Number of chunks.
+ */
+static void freeChunks(struct chunk *chunks, int count) {
+    for (int i = 0; i < count; i++) {
+        free(chunks[i].code);
+        free(chunks[i].cold);
+        free(chunks[i].errors);
+    }
+    free(chunks);
+}
+
+/**
+ * splitStatements - Divides the statements into chunks of about
+ * equal length that start with an empty CSE cache.
+ *
+ * @statements: The statements.
+ * @count: Number of statements.
+ * @chunks: Receives up to CodegenJobs chunks.
+ * @end: In: counters before the first statement.
+ *       Out: counters after the last one.
+ *
+ * @return Number of chunks.
+ */
+static int splitStatements(struct ASTnode **statements, int count,
+                           struct chunk *chunks, struct codegenPosition *end) {
+    int chunkCount = 1;
+    int cacheEmpty = 1;
+
+    chunks[0].statements = statements;
+    chunks[0].start = *end;
+
+    for (int i = 0; i < count; i++) {
+        if (cacheEmpty && chunkCount < CodegenJobs &&
+            i >= (long)chunkCount * count / CodegenJobs) {
+            chunks[chunkCount - 1].count =
+                i - (int)(chunks[chunkCount - 1].statements - statements);
+            chunks[chunkCount].statements = statements + i;
+            chunks[chunkCount].start = *end;
+            chunkCount++;
+        }
+
+        // A label empties the cache; a cacheable expression may fill it
+        if (codegenSkipStatement(statements[i], end)) {
+            cacheEmpty = 1;
+        } else if (cacheEmpty && cseHasCandidates(statements[i])) {
+            cacheEmpty = 0;
+        }
+    }
+    chunks[chunkCount - 1].count =
+        count - (int)(chunks[chunkCount - 1].statements - statements);
+    return chunkCount;
+}
+
+/**
+ * codegenParallel - Generates the program on CodegenJobs threads.
+ *
+ * NOTE:
+ * Falls back to codegenAST() on this thread when there is nothing
+ * to split (LLVM output, a single chunk) or no thread can be started.
+ * cseCountCandidates() must have counted the whole program.
+ *
+ * @tree: The program.
+ */
+void codegenParallel(struct ASTnode *tree) {
+    struct ASTnode **statements;
+    struct chunk *chunks;
+    struct sharedState shared;
+    struct codegenPosition end;
+    int count, chunkCount, started = 0;
+
+    if (Backend != BACKEND_NASM || CodegenJobs < 2) {
+        codegenAST(tree, NOREG, 0);
+        return;
+    }
+
+    statements = flattenStatements(tree, &count);
+    if ((chunks = calloc(CodegenJobs, sizeof(*chunks))) == NULL) {
+        free(statements);
+        logFatal("Out of memory in codegenParallel()");
+    }
+    codegenGetPosition(&end);
+    chunkCount = splitStatements(statements, count, chunks, &end);
+
+    shared.instrumentBranches = InstrumentBranches;
+    shared.debugLineInfo = DebugLineInfo;
+    shared.useInstructionSelection = UseInstructionSelection;
+    shared.ifConvert = IfConvert;
+    shared.jumpTables = JumpTables;
+    shared.branchChains = BranchChains;
+    shared.registerLocals = RegisterLocals;
+    shared.superoptimize = Superoptimize;
+    shared.vectorISA = VectorISA;
+    shared.optimizeSize = OptimizeSize;
+    shared.infilename = Infilename;
+    shared.globalSymbols = GlobalSymbolTable;
+    shared.symbolCount = countGlobalSymbols();
+    shared.cseCounts = cseShareCounts();
+    profileShare(&shared.profileTaken, &shared.profileNotTaken,
+                 &shared.profileCount);
+
+    if (chunkCount > 1) {
+        for (; started < chunkCount; started++) {
+            chunks[started].shared = &shared;
+            if (pthread_create(&chunks[started].thread, NULL, generateChunk,
+                               &chunks[started]) != 0) {
+                break;
+            }
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+    }
+
+    if (started < chunkCount) {
+        // Not worth it, or no threads to be had
+        freeChunks(chunks, chunkCount);
+        free(statements);
+        codegenAST(tree, NOREG, 0);
+        return;
+    }
+
+    // Report the error a serial run would have stopped at
+    for (int i = 0; i < chunkCount; i++) {
+        if (chunks[i].failed) {
+            if (chunks[i].errorsSize > 0) {
+                fwrite(chunks[i].errors, 1, chunks[i].errorsSize, Errfile);
+            } else {
+                fprintf(Errfile, "Fatal error: code generation failed\n");
+            }
+            freeChunks(chunks, chunkCount);
+            free(statements);
+            fatalExit();
+        }
+    }
+
+    for (int i = 0; i < chunkCount; i++) {
+        fwrite(chunks[i].code, 1, chunks[i].codeSize, Outfile);
+        codegenAddColdCode(chunks[i].cold, chunks[i].coldSize);
+    }
+    codegenSetPosition(&end);
+
+    freeChunks(chunks, chunkCount);
+    free(statements);
+}
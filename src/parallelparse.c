@@ -0,0 +1,515 @@
+// src/parallelparse.c
+
+/**
+ * NOTE:
+ * Parallel parsing of the program's block (-j N)
+ *
+ * A quick pass over the input finds where top-level statements end,
+ * and the block is cut into segments that are parsed on their own
+ * threads:
+ * ----------------------------------------
+ *   {  s1; s2; ... s40; | s41; ... s80; | s81; ... s120; }
+ *      thread 1         | thread 2      | thread 3
+ * ----------------------------------------
+ * A ';' at brace depth 1 and outside parentheses (a for loop's header
+ * has two) always ends a top-level statement (the language has no
+ * strings or comments to hide one), so the pass only looks at braces,
+ * parentheses, ';' and newlines, 16 bytes at a time with SSE2.
+ *
+ * A worker does not know what earlier segments declare, so it logs
+ * its declarations and the uses it cannot resolve (see
+ * deferGlobalSymbols()). The parts are then joined in order: the
+ * log is replayed against the real symbol table, identifiers are
+ * renumbered, and each segment's statement chain is hung below the
+ * one before it, giving exactly the tree compoundStatement() builds.
+ *
+ * The split is speculative: if any worker fails, or a use turns out
+ * to be undeclared or of the wrong kind (an int indexed, an array
+ * used whole, a variable called, a function called with the wrong
+ * number of arguments), the segments are thrown away and the block
+ * is parsed serially, which then reports the error as usual.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A run of top-level statements parsed by one worker
+struct segment {
+    char *start;                // source text
+    size_t size;                // its length
+    int line;                   // Line at its start
+    int first;                  // the block's first segment
+    int last;                   // the block's last segment (ends with '}')
+    struct ASTnode placeholder; // stands for the statements before it
+    struct ASTnode *tree;       // the statements, glued
+    struct ASTnode *bottom;     // glue node whose left is placeholder
+    char **names;               // the worker's symbol names
+    int nameCount;
+    int *map;                   // worker symbol index -> real index
+    struct symbolEvent *events; // see deferGlobalSymbols()
+    int eventCount;
+    struct token token;         // token after the block (last segment)
+    int endLine;                // Line after the block (last segment)
+    int failed;                 // 1 if parsing failed
+    pthread_t thread;
+};
+
+/**
+ * isSpace - Whether the scanner skips a character (see skip()).
+ */
+static int isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/**
+ * markMask - Finds the characters the boundary pass cares about.
+ *
+ * @p: 16 bytes of input.
+ *
+ * @return Bit i set when p[i] is a brace, a parenthesis, ';' or
+ *         a newline.
+ */
+static unsigned markMask(const char *p) {
+#ifdef __SSE2__
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i braces = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+    __m128i parens = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('(')),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    __m128i ends = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(';')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+
+    return (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(braces, parens), ends));
+#else
+    unsigned mask = 0;
+
+    for (int i = 0; i < 16; i++) {
+        if (p[i] == '{' || p[i] == '}' || p[i] == '(' || p[i] == ')' ||
+            p[i] == ';' || p[i] == '\n') {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/**
+ * findSegments - Cuts the block's body into segments of about
+ * equal size.
+ *
+ * NOTE:
+ * A segment starts at the first token after a ';' at depth 1
+ * (outside any parentheses), so
+ * the whitespace (and newlines) in between belong to the segment
+ * before, just as the serial parser reads them looking ahead.
+ *
+ * @body: The input after the block's '{'.
+ * @size: Its length.
+ * @line: Line at its start.
+ * @segs: Receives up to 'want' segments.
+ * @want: Number of segments wanted.
+ *
+ * @return Number of segments, or 0 if the block never closes.
+ */
+static int findSegments(char *body, size_t size, int line,
+                        struct segment *segs, int want) {
+    int depth = 1, parens = 0, count = 1, newlines;
+    size_t pos, i, j;
+    unsigned mask;
+    char tail[16];
+
+    segs[0].start = body;
+    segs[0].line = line;
+
+    for (pos = 0; pos < size; pos += 16) {
+        if (pos + 16 <= size) {
+            mask = markMask(body + pos);
+        } else {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, body + pos, size - pos);
+            mask = markMask(tail);
+        }
+
+        for (; mask != 0; mask &= mask - 1) {
+            i = pos + __builtin_ctz(mask);
+            switch (body[i]) {
+            case '\n':
+                line++;
+                break;
+            case '{':
+                depth++;
+                break;
+            case '}':
+                if (--depth == 0) {
+                    goto closed;
+                }
+                break;
+            case '(':
+                parens++;
+                break;
+            case ')':
+                parens--;
+                break;
+            case ';':
+                if (depth != 1 || parens != 0 || count == want ||
+                    i < (size_t)((double)size * count / want)) {
+                    break;
+                }
+                newlines = 0;
+                for (j = i + 1; j < size && isSpace(body[j]); j++) {
+                    newlines += body[j] == '\n';
+                }
+                if (j < size && body[j] != '}') {
+                    segs[count].start = body + j;
+                    segs[count].line = line + newlines;
+                    count++;
+                }
+                break;
+            }
+        }
+    }
+    return 0;
+
+closed:
+    for (int k = 0; k < count; k++) {
+        segs[k].first = k == 0;
+        segs[k].last = k == count - 1;
+        segs[k].size = (k + 1 < count ? segs[k + 1].start : body + size) -
+                       segs[k].start;
+    }
+    return count;
+}
+
+/**
+ * parseSegment - Body of a worker: parses one segment.
+ *
+ * NOTE:
+ * Builds the statement chain exactly like compoundStatement(),
+ * starting from the placeholder rather than nothing in all but
+ * the first segment.
+ *
+ * @arg: The segment.
+ *
+ * @return NULL
+ */
+static void *parseSegment(void *arg) {
+    struct segment *s = arg;
+    struct ASTnode *tree;
+    char *errors = NULL;
+    size_t errorsSize;
+    jmp_buf recovery;
+
+    // Errors are reported by the serial parse that follows a failure
+    Errfile = open_memstream(&errors, &errorsSize);
+    Infile = fmemopen(s->start, s->size, "r");
+    Line = s->line;
+    Putback = 0;
+    deferGlobalSymbols();
+
+    if (Errfile == NULL || Infile == NULL) {
+        s->failed = 1;
+    } else if (setjmp(recovery) == 0) {
+        setFatalRecovery(&recovery);
+        trackNodes(1);
+        s->placeholder.op = A_GLUE;
+        s->tree = s->first ? NULL : &s->placeholder;
+
+        scan(&Token);
+        while (Token.token != (s->last ? T_RBRACE : T_EOF)) {
+            tree = singleStatement();
+            if (s->tree == NULL) {
+                s->tree = tree;
+            } else {
+                s->tree = makeASTNode(A_GLUE, s->tree, NULL, tree, 0);
+                if (s->tree->left == &s->placeholder) {
+                    s->bottom = s->tree;
+                }
+            }
+        }
+        if (s->last) {
+            rightBrace();
+        }
+        s->token = Token;
+        s->endLine = Line;
+        trackNodes(0);
+    } else {
+        // What was built may hang off nothing yet, so free it node by node
+        freeTrackedNodes();
+        s->tree = s->bottom = NULL;
+        s->failed = 1;
+    }
+    setFatalRecovery(NULL);
+
+    s->events = takeSymbolEvents(&s->eventCount);
+    s->nameCount = countGlobalSymbols();
+    if ((s->names = malloc((s->nameCount + 1) * sizeof(char *))) == NULL) {
+        s->failed = 1;
+        clearGlobalSymbols();
+        s->nameCount = 0;
+    } else {
+        for (int i = 0; i < s->nameCount; i++) {
+            s->names[i] = GlobalSymbolTable[i].name; // now owned by s
+        }
+        releaseGlobalSymbols();
+    }
+
+    if (Infile != NULL) {
+        fclose(Infile);
+    }
+    if (Errfile != NULL) {
+        fclose(Errfile);
+    }
+    free(errors);
+    treeReset(); // this thread's node list
+    return NULL;
+}
+
+/**
+ * resolveSegment - Replays a segment's symbol log against the real
+ * symbol table and fills in its index map.
+ *
+ * @s: The segment.
+ *
+ * @return 1 on success, 0 if a use is undeclared, a declaration
+ *         conflicts with an earlier one or the table is full.
+ */
+static int resolveSegment(struct segment *s) {
+    struct symbolEvent *e;
+    char *name;
+    int id;
+
+    if ((s->map = malloc((s->nameCount + 1) * sizeof(int))) == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < s->eventCount; i++) {
+        e = &s->events[i];
+        name = s->names[e->id];
+        if (e->kind == S_PARAMETER || e->kind == S_LOCAL) {
+            // Always a symbol of its own, see addParameter()
+            s->map[e->id] = e->kind == S_PARAMETER
+                                ? addParameter(name, e->position)
+                                : addLocalSymbol(name);
+            continue;
+        }
+        id = findGlobalSymbol(name);
+        if (id == -1) {
+            if (!e->declaration) {
+                return 0;
+            }
+            id = addGlobalSymbol(name);
+        }
+        if (e->declaration) {
+            if (GlobalSymbolTable[id].length != -1 &&
+                (e->kind == S_FUNCTION ||
+                 GlobalSymbolTable[id].kind != e->kind ||
+                 GlobalSymbolTable[id].length != e->length)) {
+                return 0;
+            }
+            GlobalSymbolTable[id].kind = e->kind;
+            GlobalSymbolTable[id].length = e->length;
+            GlobalSymbolTable[id].parameters = e->parameters;
+        }
+        s->map[e->id] = id;
+    }
+    return 1;
+}
+
+/**
+ * renumberIdentifiers - Rewrites a segment's symbol indices.
+ *
+ * NOTE:
+ * A worker could not check how a name declared in an earlier segment
+ * is used, so the kind is checked here, against the real table.
+ *
+ * @n: The tree (statement chains are walked iteratively).
+ * @map: Worker symbol index -> real index.
+ *
+ * @return 1 on success, 0 if an int is indexed, an array used whole,
+ *         a function used as a variable or a variable called.
+ */
+static int renumberIdentifiers(struct ASTnode *n, int *map) {
+    struct symbolTable *s;
+    int isArray;
+
+    for (; n != NULL; n = n->left) {
+        isArray = n->op == A_INDEX || n->op == A_LVALUEINDEX;
+        if (isArray || n->op == A_IDENTIFIER ||
+            n->op == A_LVALUEIDENTIFIER) {
+            n->v.identifierIndex = map[n->v.identifierIndex];
+            s = &GlobalSymbolTable[n->v.identifierIndex];
+            if (s->kind == S_FUNCTION || (s->length > 0) != isArray) {
+                return 0;
+            }
+        }
+        if (n->op == A_CALL || n->op == A_FUNCTION) {
+            n->v.identifierIndex = map[n->v.identifierIndex];
+            s = &GlobalSymbolTable[n->v.identifierIndex];
+            if (s->kind != S_FUNCTION ||
+                (n->op == A_CALL && s->parameters != countArguments(n))) {
+                return 0;
+            }
+        }
+        if (!renumberIdentifiers(n->middle, map) ||
+            !renumberIdentifiers(n->right, map)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * joinSegments - Joins the parsed segments into one tree.
+ *
+ * @segs: The segments.
+ * @count: Number of segments.
+ * @tree: Receives the program's tree.
+ *
+ * @return 1 on success, 0 if the block must be parsed serially.
+ */
+static int joinSegments(struct segment *segs, int count,
+                        struct ASTnode **tree) {
+    for (int k = 0; k < count; k++) {
+        if (segs[k].failed) {
+            return 0;
+        }
+    }
+    // Chaining onto nothing is the one case the placeholder gets wrong
+    if (segs[0].tree == NULL) {
+        return 0;
+    }
+
+    for (int k = 0; k < count; k++) {
+        if (!resolveSegment(&segs[k])) {
+            clearGlobalSymbols();
+            return 0;
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        if (!renumberIdentifiers(segs[k].tree, segs[k].map)) {
+            clearGlobalSymbols();
+            return 0;
+        }
+    }
+
+    *tree = NULL;
+    for (int k = 0; k < count; k++) {
+        for (int i = 0; i < segs[k].eventCount; i++) {
+            if (segs[k].events[i].declaration &&
+                segs[k].events[i].kind == S_VARIABLE) {
+                codegenDeclareGlobalSymbol(
+                    GlobalSymbolTable[segs[k].map[segs[k].events[i].id]]
+                        .name,
+                    segs[k].events[i].length);
+            }
+        }
+        if (k == 0) {
+            *tree = segs[k].tree;
+        } else {
+            segs[k].bottom->left = *tree;
+            *tree = segs[k].tree;
+        }
+        segs[k].tree = NULL;
+    }
+    return 1;
+}
+
+/**
+ * freeSegments - Releases the segments and whatever they still own.
+ *
+ * @segs: The segments.
+ * @count: Number of segments.
+ */
+static void freeSegments(struct segment *segs, int count) {
+    for (int k = 0; k < count; k++) {
+        if (segs[k].tree != NULL && segs[k].tree != &segs[k].placeholder) {
+            if (segs[k].bottom != NULL) {
+                segs[k].bottom->left = NULL;
+            }
+            freeAST(segs[k].tree);
+        }
+        for (int i = 0; i < segs[k].nameCount; i++) {
+            free(segs[k].names[i]);
+        }
+        free(segs[k].names);
+        free(segs[k].map);
+        free(segs[k].events);
+    }
+    free(segs);
+}
+
+/**
+ * parseParallel - Parses the program's block like compoundStatement(),
+ * on up to CodegenJobs threads.
+ *
+ * NOTE:
+ * Only a block read from a regular file of at least two
+ * PARSE_MIN_SEGMENT is split; the input is mapped rather than read,
+ * so Infile stays where it is for the serial parse if it comes to
+ * that. Expects Token to be the block's '{'.
+ *
+ * @return AST node representing the compound statement.
+ */
+struct ASTnode *parseParallel(void) {
+    struct ASTnode *tree = NULL;
+    struct segment *segs;
+    struct stat st;
+    char *map;
+    long offset;
+    size_t size;
+    int fd, want, count, started = 0;
+
+    if (CodegenJobs < 2 || ScanThread || Token.token != T_LBRACE ||
+        Putback != 0 || (fd = fileno(Infile)) < 0 || fstat(fd, &st) < 0 ||
+        !S_ISREG(st.st_mode) || (offset = ftell(Infile)) < 0 ||
+        st.st_size - offset < 2 * PARSE_MIN_SEGMENT) {
+        return compoundStatement();
+    }
+
+    size = st.st_size - offset;
+    want = size / PARSE_MIN_SEGMENT;
+    want = want < CodegenJobs ? want : CodegenJobs;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return compoundStatement();
+    }
+    if ((segs = calloc(want, sizeof(*segs))) == NULL) {
+        munmap(map, st.st_size);
+        return compoundStatement();
+    }
+
+    count = findSegments(map + offset, size, Line, segs, want);
+    if (count > 1) {
+        for (; started < count; started++) {
+            if (pthread_create(&segs[started].thread, NULL, parseSegment,
+                               &segs[started]) != 0) {
+                break;
+            }
+        }
+        for (int k = 0; k < started; k++) {
+            pthread_join(segs[k].thread, NULL);
+        }
+    }
+
+    if (count < 2 || started < count || !joinSegments(segs, count, &tree)) {
+        freeSegments(segs, started);
+        munmap(map, st.st_size);
+        return compoundStatement();
+    }
+
+    Token = segs[count - 1].token;
+    Line = segs[count - 1].endLine;
+    freeSegments(segs, count);
+    munmap(map, st.st_size);
+    return tree;
+}
@@ -0,0 +1,149 @@
+// src/profile.c
+
+/**
+ * NOTE:
+ * Branch profile loader for --profile-use
+ *
+ * An --instrument build writes one line per A_IF when the program exits:
+ * ----------------------------------------
+ * # keccc branch profile v1
+ * <branch id> <taken count> <not-taken count>
+ * ...
+ * ----------------------------------------
+ * Branch ids are handed out by gen.c in code generation order,
+ * so a profile only matches the source it was recorded from. The lines
+ * come in id order from 0, and a profile with more of them than the
+ * program has if statements is rejected (see profileCheck()).
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// Per-branch counts, indexed by branch id
+static _Thread_local long *profileTaken = NULL;
+static _Thread_local long *profileNotTaken = NULL;
+static _Thread_local int profileCount = 0;
+// Number of entries the tables have room for
+static _Thread_local int profileCapacity = 0;
+
+/**
+ * profileLoad - Reads a branch profile written by an instrumented build.
+ *
+ * @param path Path of the profile file.
+ *
+ * @note Logs a fatal error if the file cannot be read or is malformed.
+ */
+void profileLoad(char *path) {
+    FILE *f;
+    char line[128];
+    int id;
+    long taken, notTaken;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        logFatals("Cannot open profile ", path);
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%d %ld %ld", &id, &taken, &notTaken) != 3) {
+            logFatals("Malformed profile line in ", path);
+        }
+        // The ids are written in order, so anything else is not a profile
+        // we wrote (and a huge id must not size the tables)
+        if (id != profileCount) {
+            logFatals("Profile branch ids out of order in ", path);
+        }
+
+        if (profileCount == profileCapacity) {
+            profileCapacity = profileCapacity ? profileCapacity * 2 : 64;
+            profileTaken =
+                realloc(profileTaken, profileCapacity * sizeof(long));
+            profileNotTaken =
+                realloc(profileNotTaken, profileCapacity * sizeof(long));
+            if (profileTaken == NULL || profileNotTaken == NULL) {
+                logFatal("Out of memory while loading profile");
+            }
+        }
+        profileTaken[id] = taken;
+        profileNotTaken[id] = notTaken;
+        profileCount++;
+    }
+
+    fclose(f);
+}
+
+/**
+ * profileLookup - Fetches the recorded counts of a branch.
+ *
+ * @param id       The branch id (see getBranchNumber() in gen.c).
+ * @param taken    Receives how often the 'then' branch ran.
+ * @param notTaken Receives how often the 'then' branch was skipped.
+ *
+ * @return 1 if the branch was executed in the profiled run, 0 otherwise.
+ */
+int profileLookup(int id, long *taken, long *notTaken) {
+    if (id < 0 || id >= profileCount) {
+        return 0;
+    }
+    *taken = profileTaken[id];
+    *notTaken = profileNotTaken[id];
+    return (*taken + *notTaken) > 0;
+}
+
+/**
+ * profileCheck - Rejects a loaded profile recorded from another program.
+ *
+ * @param branchCount The number of if statements code generation gave
+ *                    ids to.
+ *
+ * @note Logs a fatal error if the profile has more branches.
+ */
+void profileCheck(int branchCount) {
+    if (profileCount > branchCount) {
+        fprintf(Errfile,
+                "Fatal error: profile has %d branches, the program %d\n",
+                profileCount, branchCount);
+        fatalExit();
+    }
+}
+
+/**
+ * profileShare - Returns this thread's profile, for code generation
+ * workers to borrow.
+ *
+ * @param taken    Receives the 'then' counts.
+ * @param notTaken Receives the skipped counts.
+ * @param count    Receives the number of branches.
+ */
+void profileShare(long **taken, long **notTaken, int *count) {
+    *taken = profileTaken;
+    *notTaken = profileNotTaken;
+    *count = profileCount;
+}
+
+/**
+ * profileBorrow - Makes profileLookup() read a profile owned by
+ * another thread (see profileShare()).
+ *
+ * @param taken    The 'then' counts (NULL to stop borrowing).
+ * @param notTaken The skipped counts.
+ * @param count    The number of branches.
+ */
+void profileBorrow(long *taken, long *notTaken, int count) {
+    profileTaken = taken;
+    profileNotTaken = notTaken;
+    profileCount = count;
+}
+
+/**
+ * profileReset - Forgets the loaded profile.
+ */
+void profileReset(void) {
+    free(profileTaken);
+    free(profileNotTaken);
+    profileTaken = profileNotTaken = NULL;
+    profileCount = profileCapacity = 0;
+}
@@ -0,0 +1,1126 @@
+// src/range.c
+
+/**
+ * NOTE:
+ * Value range analysis (on the AST, before code generation)
+ *
+ * Every int variable has an interval [low, high] of the values it may
+ * hold, followed through the program in the order it runs: set by
+ * assignments, narrowed by the conditions of if statements and loops
+ * and joined where branches meet:
+ * ----------------------------------------
+ *   n = 100;                       n: [100, 100]
+ *   if (x < 0) {                   x: [min, -1]
+ *       x = 0;                     x: [0, 0]
+ *   }                              x: [0, max] (both branches)
+ *   for (i = 0; i < n; ...) {      i: [0, 99] in the body
+ *       a[i] = i / 4;              i >= 0, so a shift
+ *   }
+ * ----------------------------------------
+ * The ranges are used to
+ * - replace a comparison they decide by 0 or 1, an if statement whose
+ *   condition they decide by the branch taken, and a loop whose
+ *   condition fails at the start by nothing;
+ * - turn x / 2^k and x % 2^k into a shift and a mask (A_SHIFTRIGHT,
+ *   A_BITAND) where x cannot be negative, without the correction a
+ *   negative x needs (see nasmDivPowerOfTwo()).
+ *
+ * Nothing is known of array elements, of what a call returns, of the
+ * parameters of a function and of the globals after a call, which may
+ * assign them. Arithmetic that may overflow gives the full range.
+ *
+ * A loop runs its body with what holds on every iteration: a variable
+ * the loop assigns is unknown, except a counter that only moves towards
+ * a bound of its condition the loop does not change,
+ * ----------------------------------------
+ *   i = 0;                         i: [0, 0]
+ *   while (i < n) {                n: [0, 100], so i: [0, 99]
+ *       ...
+ *       i = i + 1;                 i: [1, 100]
+ *   }                              i: [0, 100], and i >= n
+ * ----------------------------------------
+ * which stays between its value on entry and that bound.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <limits.h>
+
+// The values an expression or variable may have
+struct range {
+    long low;
+    long high;
+};
+
+// What is known at a point of the program: the variables whose range
+// is narrower than the full one, by increasing symbol index
+struct rangeState {
+    int *symbols;
+    struct range *ranges;
+    int count;
+    int capacity;
+};
+
+static const struct range fullRange = {LONG_MIN, LONG_MAX};
+
+// State of main's statements between calls of rangeStatement()
+static _Thread_local struct rangeState mainState = {NULL, NULL, 0, 0};
+
+static void analyzeStatement(struct ASTnode **link, struct rangeState *s);
+static void analyzeStatements(struct ASTnode **link, struct rangeState *s);
+static struct range evaluate(struct ASTnode **link, struct rangeState *s,
+                             int isCondition);
+
+/**
+ * NOTE:
+ * States
+ */
+
+/**
+ * findSymbol - Finds a variable in a state.
+ *
+ * @return Its index, or where it would be inserted.
+ */
+static int findSymbol(struct rangeState *s, int id) {
+    int low = 0, high = s->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (s->symbols[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * getRange - Returns the range of a variable.
+ */
+static struct range getRange(struct rangeState *s, int id) {
+    int i = findSymbol(s, id);
+
+    if (i < s->count && s->symbols[i] == id) {
+        return s->ranges[i];
+    }
+    return fullRange;
+}
+
+/**
+ * setRange - Sets the range of a variable.
+ */
+static void setRange(struct rangeState *s, int id, struct range r) {
+    int i = findSymbol(s, id);
+    int known = r.low != LONG_MIN || r.high != LONG_MAX;
+
+    if (i < s->count && s->symbols[i] == id) {
+        if (known) {
+            s->ranges[i] = r;
+            return;
+        }
+        s->count--;
+        memmove(&s->symbols[i], &s->symbols[i + 1],
+                (s->count - i) * sizeof(*s->symbols));
+        memmove(&s->ranges[i], &s->ranges[i + 1],
+                (s->count - i) * sizeof(*s->ranges));
+        return;
+    }
+    if (!known) {
+        return;
+    }
+
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 16;
+        s->symbols = realloc(s->symbols, s->capacity * sizeof(*s->symbols));
+        s->ranges = realloc(s->ranges, s->capacity * sizeof(*s->ranges));
+        if (s->symbols == NULL || s->ranges == NULL) {
+            logFatal("Out of memory while analyzing value ranges");
+        }
+    }
+    memmove(&s->symbols[i + 1], &s->symbols[i],
+            (s->count - i) * sizeof(*s->symbols));
+    memmove(&s->ranges[i + 1], &s->ranges[i],
+            (s->count - i) * sizeof(*s->ranges));
+    s->symbols[i] = id;
+    s->ranges[i] = r;
+    s->count++;
+}
+
+/**
+ * copyState - Makes dst know what src knows.
+ */
+static void copyState(struct rangeState *dst, struct rangeState *src) {
+    if (dst->capacity < src->count) {
+        dst->capacity = src->count;
+        dst->symbols =
+            realloc(dst->symbols, dst->capacity * sizeof(*dst->symbols));
+        dst->ranges =
+            realloc(dst->ranges, dst->capacity * sizeof(*dst->ranges));
+        if (dst->symbols == NULL || dst->ranges == NULL) {
+            logFatal("Out of memory while analyzing value ranges");
+        }
+    }
+    if (src->count > 0) {
+        memcpy(dst->symbols, src->symbols, src->count * sizeof(*dst->symbols));
+        memcpy(dst->ranges, src->ranges, src->count * sizeof(*dst->ranges));
+    }
+    dst->count = src->count;
+}
+
+/**
+ * freeState - Releases a state's memory.
+ */
+static void freeState(struct rangeState *s) {
+    free(s->symbols);
+    free(s->ranges);
+    *s = (struct rangeState){NULL, NULL, 0, 0};
+}
+
+/**
+ * joinState - Makes s know what holds after either of two branches
+ * (s itself or other): each variable gets both ranges.
+ */
+static void joinState(struct rangeState *s, struct rangeState *other) {
+    int i, j = 0, kept = 0;
+
+    for (i = 0; i < s->count; i++) {
+        while (j < other->count && other->symbols[j] < s->symbols[i]) {
+            j++;
+        }
+        if (j == other->count || other->symbols[j] != s->symbols[i]) {
+            continue; // unknown after the other branch
+        }
+        s->symbols[kept] = s->symbols[i];
+        s->ranges[kept].low = s->ranges[i].low < other->ranges[j].low
+                                  ? s->ranges[i].low
+                                  : other->ranges[j].low;
+        s->ranges[kept].high = s->ranges[i].high > other->ranges[j].high
+                                   ? s->ranges[i].high
+                                   : other->ranges[j].high;
+        kept++;
+    }
+    s->count = kept;
+}
+
+/**
+ * forgetGlobals - Forgets the globals, after a call.
+ */
+static void forgetGlobals(struct rangeState *s) {
+    int kept = 0;
+
+    for (int i = 0; i < s->count; i++) {
+        if (GlobalSymbolTable[s->symbols[i]].kind != S_VARIABLE) {
+            s->symbols[kept] = s->symbols[i];
+            s->ranges[kept++] = s->ranges[i];
+        }
+    }
+    s->count = kept;
+}
+
+/**
+ * NOTE:
+ * Trees
+ */
+
+/**
+ * hasBreak - Checks whether a loop body has a break that leaves it.
+ */
+static int hasBreak(struct ASTnode *n) {
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_BREAK) {
+            return 1;
+        }
+        if (n->op == A_WHILE || n->op == A_SWITCH) {
+            return 0; // its breaks are its own
+        }
+        if (hasBreak(n->middle) || hasBreak(n->right)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * forgetAssigned - Forgets the variables a tree assigns, and the
+ * globals if it makes a call.
+ */
+static void forgetAssigned(struct rangeState *s, struct ASTnode *n) {
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_LVALUEIDENTIFIER) {
+            setRange(s, n->v.identifierIndex, fullRange);
+        } else if (n->op == A_CALL) {
+            forgetGlobals(s);
+        }
+        forgetAssigned(s, n->middle);
+        forgetAssigned(s, n->right);
+    }
+}
+
+/**
+ * replaceByLiteral - Turns an expression into an integer literal.
+ */
+static void replaceByLiteral(struct ASTnode *n, int value) {
+    freeAST(n->left);
+    freeAST(n->middle);
+    freeAST(n->right);
+    n->op = A_INTLIT;
+    n->left = n->middle = n->right = NULL;
+    n->v.intvalue = value;
+}
+
+/**
+ * replaceByChild - Replaces a node by one of its subtrees.
+ *
+ * @link: Where the node hangs.
+ * @child: The subtree kept (may be NULL); the rest is freed.
+ */
+static void replaceByChild(struct ASTnode **link, struct ASTnode *child) {
+    struct ASTnode *n = *link;
+
+    if (n->left == child) {
+        n->left = NULL;
+    } else if (n->middle == child) {
+        n->middle = NULL;
+    } else if (n->right == child) {
+        n->right = NULL;
+    }
+    freeAST(n);
+    *link = child;
+}
+
+/**
+ * isBoolean - Checks whether an expression's value is 0 or 1.
+ */
+static int isBoolean(struct ASTnode *n) {
+    return isComparison(n->op) || n->op == A_LOGAND || n->op == A_LOGOR ||
+           n->op == A_LOGNOT;
+}
+
+/**
+ * invert - Returns the comparison that holds when one fails.
+ */
+static int invert(int op) {
+    switch (op) {
+    case A_EQ:
+        return A_NE;
+    case A_NE:
+        return A_EQ;
+    case A_LT:
+        return A_GE;
+    case A_GE:
+        return A_LT;
+    case A_GT:
+        return A_LE;
+    default:
+        return A_GT;
+    }
+}
+
+/**
+ * mirror - Returns the comparison with its operands swapped.
+ */
+static int mirror(int op) {
+    switch (op) {
+    case A_LT:
+        return A_GT;
+    case A_GT:
+        return A_LT;
+    case A_LE:
+        return A_GE;
+    case A_GE:
+        return A_LE;
+    default:
+        return op;
+    }
+}
+
+/**
+ * NOTE:
+ * Arithmetic on ranges
+ */
+
+/**
+ * span - Returns the smallest range holding four values.
+ */
+static struct range span(long a, long b, long c, long d) {
+    struct range r = {a, a};
+    long values[3] = {b, c, d};
+
+    for (int i = 0; i < 3; i++) {
+        r.low = values[i] < r.low ? values[i] : r.low;
+        r.high = values[i] > r.high ? values[i] : r.high;
+    }
+    return r;
+}
+
+/**
+ * decide - Decides a comparison of two ranges.
+ *
+ * @return 1 if it always holds, 0 if it never does, -1 otherwise.
+ */
+static int decide(int op, struct range a, struct range b) {
+    switch (op) {
+    case A_LT:
+        return a.high < b.low ? 1 : a.low >= b.high ? 0 : -1;
+    case A_LE:
+        return a.high <= b.low ? 1 : a.low > b.high ? 0 : -1;
+    case A_GT:
+        return decide(A_LT, b, a);
+    case A_GE:
+        return decide(A_LE, b, a);
+    case A_EQ:
+        if (a.low == a.high && b.low == b.high && a.low == b.low) {
+            return 1;
+        }
+        return a.high < b.low || b.high < a.low ? 0 : -1;
+    case A_NE:
+        return decide(A_EQ, a, b) == -1 ? -1 : !decide(A_EQ, a, b);
+    }
+    return -1;
+}
+
+/**
+ * combine - Returns the range of an operator's value.
+ *
+ * @op: The operator.
+ * @a: The range of its left operand.
+ * @b: The range of its right operand (if any).
+ */
+static struct range combine(int op, struct range a, struct range b) {
+    long w, x, y, z, m;
+    int decided;
+
+    switch (op) {
+    case A_ADD:
+        if (__builtin_add_overflow(a.low, b.low, &w) ||
+            __builtin_add_overflow(a.high, b.high, &x)) {
+            return fullRange;
+        }
+        return (struct range){w, x};
+    case A_SUBTRACT:
+        if (__builtin_sub_overflow(a.low, b.high, &w) ||
+            __builtin_sub_overflow(a.high, b.low, &x)) {
+            return fullRange;
+        }
+        return (struct range){w, x};
+    case A_MULTIPLY:
+        if (__builtin_mul_overflow(a.low, b.low, &w) ||
+            __builtin_mul_overflow(a.low, b.high, &x) ||
+            __builtin_mul_overflow(a.high, b.low, &y) ||
+            __builtin_mul_overflow(a.high, b.high, &z)) {
+            return fullRange;
+        }
+        return span(w, x, y, z);
+    case A_DIVIDE:
+        // Division by zero traps; LONG_MIN / -1 overflows
+        if ((b.low <= 0 && b.high >= 0) ||
+            (a.low == LONG_MIN && b.low <= -1 && b.high >= -1)) {
+            return fullRange;
+        }
+        // Monotonic in each operand, so the corners are the extremes
+        return span(a.low / b.low, a.low / b.high, a.high / b.low,
+                    a.high / b.high);
+    case A_MODULO:
+        if ((b.low <= 0 && b.high >= 0) || b.low == LONG_MIN) {
+            return fullRange;
+        }
+        // |a % b| < |b|, with the sign of a
+        m = (-b.low > b.high ? -b.low : b.high) - 1;
+        return (struct range){a.low >= 0 ? 0 : a.low > -m ? a.low : -m,
+                              a.high <= 0 ? 0 : a.high < m ? a.high : m};
+    case A_SHIFTRIGHT:
+        return (struct range){a.low >> b.low, a.high >> b.low};
+    case A_BITAND:
+        return (struct range){0, a.low >= 0 && a.high < b.low ? a.high
+                                                              : b.low};
+    case A_LOGNOT:
+        decided = decide(A_EQ, a, (struct range){0, 0});
+        if (decided != -1) {
+            return (struct range){decided, decided};
+        }
+        return (struct range){0, 1};
+    default:
+        if (isComparison(op) && (decided = decide(op, a, b)) != -1) {
+            return (struct range){decided, decided};
+        }
+        if (isComparison(op) || op == A_LOGAND || op == A_LOGOR) {
+            return (struct range){0, 1};
+        }
+        return fullRange;
+    }
+}
+
+/**
+ * rangeOf - Returns the range of an expression, without changing it.
+ */
+static struct range rangeOf(struct ASTnode *n, struct rangeState *s) {
+    switch (n->op) {
+    case A_INTLIT:
+        return (struct range){n->v.intvalue, n->v.intvalue};
+    case A_IDENTIFIER:
+        return getRange(s, n->v.identifierIndex);
+    case A_INDEX:
+    case A_CALL:
+        return fullRange;
+    }
+    return combine(n->op, rangeOf(n->left, s),
+                   n->right ? rangeOf(n->right, s) : fullRange);
+}
+
+/**
+ * NOTE:
+ * Conditions
+ */
+
+/**
+ * narrow - Narrows a variable's range to the values that compare
+ * as given with a range.
+ */
+static void narrow(struct rangeState *s, int id, int op, struct range b) {
+    struct range r = getRange(s, id);
+
+    switch (op) {
+    case A_LT:
+        if (b.high == LONG_MIN) {
+            return;
+        }
+        b.high--;
+        // fall through
+    case A_LE:
+        r.high = b.high < r.high ? b.high : r.high;
+        break;
+    case A_GT:
+        if (b.low == LONG_MAX) {
+            return;
+        }
+        b.low++;
+        // fall through
+    case A_GE:
+        r.low = b.low > r.low ? b.low : r.low;
+        break;
+    case A_EQ:
+        r.low = b.low > r.low ? b.low : r.low;
+        r.high = b.high < r.high ? b.high : r.high;
+        break;
+    case A_NE:
+        if (b.low != b.high) {
+            return;
+        }
+        if (r.low == b.low && r.low < r.high) {
+            r.low++;
+        } else if (r.high == b.low && r.low < r.high) {
+            r.high--;
+        }
+        break;
+    }
+
+    // A contradiction: the branch never runs, and anything holds
+    if (r.low <= r.high) {
+        setRange(s, id, r);
+    }
+}
+
+/**
+ * refine - Narrows a state to what holds when a condition has a truth
+ * value. The condition must make no call.
+ *
+ * @s: The state.
+ * @cond: The condition.
+ * @truth: Its value, 1 or 0.
+ */
+static void refine(struct rangeState *s, struct ASTnode *cond, int truth) {
+    struct range left, right;
+    int op;
+
+    switch (cond->op) {
+    case A_LOGNOT:
+        refine(s, cond->left, !truth);
+        return;
+    case A_LOGAND:
+    case A_LOGOR:
+        // Both operands have the value of the whole
+        if (truth == (cond->op == A_LOGAND)) {
+            refine(s, cond->left, truth);
+            refine(s, cond->right, truth);
+        }
+        return;
+    case A_IDENTIFIER:
+        narrow(s, cond->v.identifierIndex, truth ? A_NE : A_EQ,
+               (struct range){0, 0});
+        return;
+    }
+    if (!isComparison(cond->op)) {
+        return;
+    }
+
+    op = truth ? cond->op : invert(cond->op);
+    left = rangeOf(cond->left, s);
+    right = rangeOf(cond->right, s);
+    if (cond->left->op == A_IDENTIFIER) {
+        narrow(s, cond->left->v.identifierIndex, op, right);
+    }
+    if (cond->right->op == A_IDENTIFIER) {
+        narrow(s, cond->right->v.identifierIndex, mirror(op), left);
+    }
+}
+
+/**
+ * NOTE:
+ * Expressions
+ */
+
+/**
+ * simplifyLogical - Folds && and || with a literal operand.
+ *
+ * @link: Where the operator hangs.
+ * @isCondition: Whether only its truth matters, not its 0 or 1.
+ *
+ * @return 1 if the node was replaced.
+ */
+static int simplifyLogical(struct ASTnode **link, int isCondition) {
+    struct ASTnode *n = *link;
+    int isAnd = n->op == A_LOGAND, keep;
+
+    // The literal that decides the operator: 0 for &&, 1 for ||
+    if (n->left->op == A_INTLIT) {
+        if ((n->left->v.intvalue != 0) != isAnd) {
+            replaceByLiteral(n, !isAnd);
+            return 1;
+        }
+        keep = isCondition || isBoolean(n->right);
+        if (keep) {
+            replaceByChild(link, n->right);
+        }
+        return keep;
+    }
+    if (n->right->op == A_INTLIT) {
+        if ((n->right->v.intvalue != 0) != isAnd) {
+            if (hasCall(n->left)) {
+                return 0;
+            }
+            replaceByLiteral(n, !isAnd);
+            return 1;
+        }
+        keep = isCondition || isBoolean(n->left);
+        if (keep) {
+            replaceByChild(link, n->left);
+        }
+        return keep;
+    }
+    return 0;
+}
+
+/**
+ * evaluate - Returns the range of an expression, folding what the
+ * ranges decide in it (see the note at the top of this file).
+ *
+ * NOTE:
+ * A call may change the globals, so the caller forgets them first
+ * when the expression makes one.
+ *
+ * @link: Where the expression hangs.
+ * @s: What holds before it.
+ * @isCondition: Whether only its truth matters (an if or loop's
+ *               condition).
+ */
+static struct range evaluate(struct ASTnode **link, struct rangeState *s,
+                             int isCondition) {
+    struct ASTnode *n = *link;
+    struct range left, right = fullRange, r;
+    struct rangeState branch = {NULL, NULL, 0, 0};
+    int value;
+
+    switch (n->op) {
+    case A_INTLIT:
+    case A_IDENTIFIER:
+        return rangeOf(n, s);
+    case A_INDEX:
+        evaluate(&n->left, s, 0);
+        return fullRange;
+    case A_CALL:
+        for (struct ASTnode *a = n->left; a != NULL; a = a->right) {
+            evaluate(&a->left, s, 0);
+        }
+        return fullRange;
+    case A_LOGAND:
+    case A_LOGOR:
+        // The right operand runs only when the left one did not decide
+        evaluate(&n->left, s, isCondition);
+        copyState(&branch, s);
+        if (!hasCall(n->left)) {
+            refine(&branch, n->left, n->op == A_LOGAND);
+        }
+        evaluate(&n->right, &branch, isCondition);
+        freeState(&branch);
+        if (simplifyLogical(link, isCondition)) {
+            return rangeOf(*link, s);
+        }
+        return (struct range){0, 1};
+    }
+
+    left = evaluate(&n->left, s, n->op == A_LOGNOT && isCondition);
+    if (n->right != NULL) {
+        right = evaluate(&n->right, s, 0);
+    }
+    r = combine(n->op, left, right);
+
+    // A decided comparison or !, unless it makes a call
+    if ((isComparison(n->op) || n->op == A_LOGNOT) && r.low == r.high &&
+        !hasCall(n)) {
+        replaceByLiteral(n, r.low);
+        return r;
+    }
+
+    // x / 2^k and x % 2^k with x >= 0 (with k from 1)
+    if ((n->op == A_DIVIDE || n->op == A_MODULO) &&
+        n->right->op == A_INTLIT && left.low >= 0) {
+        value = n->right->v.intvalue;
+        if (value > 1 && (value & (value - 1)) == 0) {
+            n->op = n->op == A_DIVIDE ? A_SHIFTRIGHT : A_BITAND;
+            n->right->v.intvalue =
+                n->op == A_SHIFTRIGHT ? __builtin_ctz(value) : value - 1;
+        }
+    }
+    return r;
+}
+
+/**
+ * evaluateStatement - Evaluates an expression of a statement, and
+ * forgets the globals first if it makes a call.
+ */
+static struct range evaluateStatement(struct ASTnode **link,
+                                      struct rangeState *s, int isCondition) {
+    if (hasCall(*link)) {
+        forgetGlobals(s);
+    }
+    return evaluate(link, s, isCondition);
+}
+
+/**
+ * NOTE:
+ * Statements
+ */
+
+/**
+ * analyzeIf - Analyzes an if statement, replacing it by a branch if
+ * its condition is decided.
+ */
+static void analyzeIf(struct ASTnode **link, struct rangeState *s) {
+    struct ASTnode *n = *link;
+    struct rangeState taken = {NULL, NULL, 0, 0};
+
+    evaluateStatement(&n->left, s, 1);
+    if (n->left->op == A_INTLIT) {
+        replaceByChild(link, n->left->v.intvalue ? n->middle : n->right);
+        analyzeStatements(link, s);
+        return;
+    }
+
+    copyState(&taken, s);
+    if (!hasCall(n->left)) {
+        refine(&taken, n->left, 1);
+        refine(s, n->left, 0);
+    }
+    analyzeStatements(&n->middle, &taken);
+    analyzeStatements(&n->right, s);
+    joinState(s, &taken);
+    freeState(&taken);
+}
+
+/**
+ * stepOf - Returns by how much an assignment moves a variable,
+ * for `v = v + c`, `v = c + v` and `v = v - c`.
+ *
+ * @return The step, or LONG_MIN for any other assignment.
+ */
+static long stepOf(struct ASTnode *assign, int id) {
+    struct ASTnode *value = assign->left, *c;
+
+    if (value->op != A_ADD && value->op != A_SUBTRACT) {
+        return LONG_MIN;
+    }
+    if (value->left->op == A_IDENTIFIER &&
+        value->left->v.identifierIndex == id) {
+        c = value->right;
+    } else if (value->op == A_ADD && value->right->op == A_IDENTIFIER &&
+               value->right->v.identifierIndex == id) {
+        c = value->left;
+    } else {
+        return LONG_MIN;
+    }
+    if (c->op != A_INTLIT) {
+        return LONG_MIN;
+    }
+    return value->op == A_ADD ? c->v.intvalue : -(long)c->v.intvalue;
+}
+
+/**
+ * sumSteps - Adds up the steps of the assignments of a loop to a
+ * variable, separately for those up and down.
+ *
+ * @return 0 if some assignment is no step, or is in an inner loop
+ *         (and so may run more than once per iteration).
+ */
+static int sumSteps(struct ASTnode *n, int id, int inLoop, long *up,
+                    long *down) {
+    long step;
+
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_ASSIGN && n->right->op == A_LVALUEIDENTIFIER &&
+            n->right->v.identifierIndex == id) {
+            if (inLoop || (step = stepOf(n, id)) == LONG_MIN) {
+                return 0;
+            }
+            *(step >= 0 ? up : down) += step >= 0 ? step : -step;
+        }
+        if (!sumSteps(n->middle, id, inLoop || n->op == A_WHILE, up, down) ||
+            !sumSteps(n->right, id, inLoop || n->op == A_WHILE, up, down)) {
+            return 0;
+        }
+        inLoop = inLoop || n->op == A_WHILE;
+    }
+    return 1;
+}
+
+/**
+ * findBound - Finds a conjunct `v < e`, `v <= e`, `v > e` or `v >= e`
+ * of a loop condition, with e unchanged by the loop.
+ *
+ * @cond: The condition.
+ * @id: The variable v.
+ * @loop: The loop.
+ * @s: What holds before the loop.
+ * @op: Receives the comparison, as if v were its left operand.
+ * @bound: Receives the range of e.
+ *
+ * @return 1 if found.
+ */
+static int findBound(struct ASTnode *cond, int id, struct ASTnode *loop,
+                     struct rangeState *s, int *op, struct range *bound) {
+    struct rangeState inside = {NULL, NULL, 0, 0};
+    struct ASTnode *e;
+    struct range r;
+
+    if (cond->op == A_LOGAND) {
+        return findBound(cond->left, id, loop, s, op, bound) ||
+               findBound(cond->right, id, loop, s, op, bound);
+    }
+    if (!isComparison(cond->op) || cond->op == A_EQ || cond->op == A_NE) {
+        return 0;
+    }
+    if (cond->left->op == A_IDENTIFIER &&
+        cond->left->v.identifierIndex == id) {
+        *op = cond->op;
+        e = cond->right;
+    } else if (cond->right->op == A_IDENTIFIER &&
+               cond->right->v.identifierIndex == id) {
+        *op = mirror(cond->op);
+        e = cond->left;
+    } else {
+        return 0;
+    }
+    if (e->op != A_INTLIT && e->op != A_IDENTIFIER) {
+        return 0;
+    }
+
+    // e keeps its range if the loop leaves it alone
+    r = rangeOf(e, s);
+    if (e->op == A_IDENTIFIER) {
+        copyState(&inside, s);
+        setRange(&inside, e->v.identifierIndex, r);
+        forgetAssigned(&inside, loop);
+        r = rangeOf(e, &inside);
+        freeState(&inside);
+    }
+    if (r.low == LONG_MIN && r.high == LONG_MAX) {
+        return 0;
+    }
+    *bound = r;
+    return 1;
+}
+
+/**
+ * counterRange - Returns the range of a variable a loop assigns, at the
+ * start of every iteration (see the note at the top of this file).
+ *
+ * @loop: The A_WHILE node.
+ * @id: The variable.
+ * @entry: Its range before the loop.
+ * @s: What holds before the loop.
+ */
+static struct range counterRange(struct ASTnode *loop, int id,
+                                 struct range entry, struct rangeState *s) {
+    struct range bound, r = entry;
+    long up = 0, down = 0, limit;
+    int op;
+
+    if (!sumSteps(loop->middle, id, 0, &up, &down) ||
+        !sumSteps(loop->right, id, 0, &up, &down) || (up > 0 && down > 0) ||
+        !findBound(loop->left, id, loop, s, &op, &bound)) {
+        return fullRange;
+    }
+
+    // The condition held before the steps of an iteration were taken
+    if (up > 0 && (op == A_LT || op == A_LE)) {
+        limit = op == A_LT ? bound.high - 1 : bound.high;
+        if (__builtin_add_overflow(limit, up, &limit)) {
+            return fullRange;
+        }
+        r.high = limit > r.high ? limit : r.high;
+        return r;
+    }
+    if (down > 0 && (op == A_GT || op == A_GE)) {
+        limit = op == A_GT ? bound.low + 1 : bound.low;
+        if (__builtin_sub_overflow(limit, down, &limit)) {
+            return fullRange;
+        }
+        r.low = limit < r.low ? limit : r.low;
+        return r;
+    }
+    return up == 0 && down == 0 ? entry : fullRange;
+}
+
+/**
+ * loopHead - Computes what holds at the start of every iteration.
+ *
+ * @loop: The A_WHILE node.
+ * @n: A part of the loop, whose assignments are visited.
+ * @s: What holds before the loop.
+ * @head: Receives the state (a copy of s on the first call).
+ */
+static void loopHead(struct ASTnode *loop, struct ASTnode *n,
+                     struct rangeState *s, struct rangeState *head) {
+    int id;
+
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_LVALUEIDENTIFIER) {
+            id = n->v.identifierIndex;
+            setRange(head, id, counterRange(loop, id, getRange(s, id), s));
+        }
+        loopHead(loop, n->middle, s, head);
+        loopHead(loop, n->right, s, head);
+    }
+}
+
+/**
+ * analyzeWhile - Analyzes a loop, removing it if it never runs.
+ */
+static void analyzeWhile(struct ASTnode **link, struct rangeState *s) {
+    struct ASTnode *n = *link;
+    struct rangeState head = {NULL, NULL, 0, 0};
+    struct rangeState body = {NULL, NULL, 0, 0};
+
+    copyState(&head, s);
+    if (hasCall(n)) {
+        forgetGlobals(&head);
+    }
+    loopHead(n, n->middle, s, &head);
+    loopHead(n, n->right, s, &head);
+    if (hasCall(n)) {
+        forgetGlobals(&head); // counters that are globals too
+    }
+
+    evaluate(&n->left, &head, 1);
+    if (n->left->op == A_INTLIT && n->left->v.intvalue == 0) {
+        freeAST(n);
+        *link = NULL;
+        freeState(&head);
+        return;
+    }
+
+    copyState(&body, &head);
+    if (!hasCall(n->left)) {
+        refine(&body, n->left, 1);
+    }
+    analyzeStatements(&n->middle, &body);
+    analyzeStatements(&n->right, &body);
+    freeState(&body);
+
+    // Left when the condition fails, or by a break
+    if (!hasCall(n->left) && !hasBreak(n->middle)) {
+        refine(&head, n->left, 0);
+    }
+    copyState(s, &head);
+    freeState(&head);
+}
+
+/**
+ * analyzeSwitch - Analyzes a switch statement.
+ *
+ * NOTE:
+ * Any case label may be jumped to, so what holds at one is what held
+ * before the switch, less the variables its body assigns.
+ */
+static void analyzeSwitch(struct ASTnode **link, struct rangeState *s) {
+    struct ASTnode *n = *link, ***spine, *m;
+    struct rangeState current = {NULL, NULL, 0, 0};
+    int count = 0;
+
+    evaluateStatement(&n->left, s, 0);
+    forgetAssigned(s, n->right);
+
+    for (m = n->right; m != NULL && m->op == A_GLUE; m = m->left) {
+        count++;
+    }
+    if ((spine = malloc((count + 1) * sizeof(*spine))) == NULL) {
+        logFatal("Out of memory while analyzing value ranges");
+    }
+    spine[count] = &n->right;
+    for (int i = count - 1; i >= 0; i--) {
+        spine[i] = &(*spine[i + 1])->left;
+    }
+
+    copyState(&current, s);
+    for (int i = 0; i <= count; i++) {
+        struct ASTnode **statement = i == 0 ? spine[0] : &(*spine[i])->right;
+        if (*statement == NULL) {
+            continue;
+        }
+        if ((*statement)->op == A_CASE || (*statement)->op == A_DEFAULT) {
+            copyState(&current, s);
+        } else {
+            analyzeStatement(statement, &current);
+        }
+    }
+    freeState(&current);
+    free(spine);
+}
+
+/**
+ * analyzeStatement - Analyzes a statement, updating what holds.
+ *
+ * @link: Where the statement hangs.
+ * @s: What holds before it; receives what holds after it.
+ */
+static void analyzeStatement(struct ASTnode **link, struct rangeState *s) {
+    struct ASTnode *n = *link;
+    struct rangeState inner = {NULL, NULL, 0, 0};
+    struct range r;
+
+    switch (n->op) {
+    case A_GLUE:
+        analyzeStatements(link, s);
+        return;
+    case A_IF:
+        analyzeIf(link, s);
+        return;
+    case A_WHILE:
+        analyzeWhile(link, s);
+        return;
+    case A_SWITCH:
+        analyzeSwitch(link, s);
+        return;
+    case A_FUNCTION:
+        // Called from anywhere: nothing is known at its start
+        analyzeStatements(&n->left, &inner);
+        freeState(&inner);
+        return;
+    case A_INLINE:
+        // A return leaves the body anywhere
+        copyState(&inner, s);
+        analyzeStatements(&n->left, &inner);
+        freeState(&inner);
+        forgetAssigned(s, n->left);
+        return;
+    case A_ASSIGN:
+        r = evaluateStatement(&n->left, s, 0);
+        if (n->right->op == A_LVALUEINDEX) {
+            evaluateStatement(&n->right->left, s, 0);
+        } else {
+            setRange(s, n->right->v.identifierIndex, r);
+        }
+        return;
+    case A_PRINT:
+    case A_RETURN:
+    case A_CALLSTATEMENT:
+        if (n->left != NULL) {
+            evaluateStatement(&n->left, s, 0);
+        }
+        return;
+    }
+}
+
+/**
+ * analyzeStatements - Analyzes a statement chain, in program order.
+ *
+ * @link: Where the chain hangs (it may be NULL, or be removed).
+ * @s: What holds before it; receives what holds after it.
+ */
+static void analyzeStatements(struct ASTnode **link, struct rangeState *s) {
+    struct ASTnode ***spine, *n;
+    int count = 0;
+
+    if (*link == NULL) {
+        return;
+    }
+    if ((*link)->op != A_GLUE) {
+        analyzeStatement(link, s);
+        return;
+    }
+
+    // Collect the chain's left spine (see inlineStatements())
+    for (n = *link; n != NULL && n->op == A_GLUE; n = n->left) {
+        count++;
+    }
+    if ((spine = malloc((count + 1) * sizeof(*spine))) == NULL) {
+        logFatal("Out of memory while analyzing value ranges");
+    }
+    spine[count] = link;
+    for (int i = count - 1; i >= 0; i--) {
+        spine[i] = &(*spine[i + 1])->left;
+    }
+
+    // The first statement is at the bottom
+    if (*spine[0] != NULL) {
+        analyzeStatement(spine[0], s);
+    }
+    for (int i = 1; i <= count; i++) {
+        if ((*spine[i])->right != NULL) {
+            analyzeStatement(&(*spine[i])->right, s);
+        }
+    }
+    free(spine);
+}
+
+/**
+ * rangeProgram - Folds what value ranges decide in a program, see the
+ * note at the top of this file.
+ *
+ * @tree: The program.
+ *
+ * @return The program (NULL if nothing is left of it).
+ */
+struct ASTnode *rangeProgram(struct ASTnode *tree) {
+    struct rangeState s = {NULL, NULL, 0, 0};
+
+    if (!UseValueRanges || tree == NULL) {
+        return tree;
+    }
+    analyzeStatements(&tree, &s);
+    freeState(&s);
+    return tree;
+}
+
+/**
+ * rangeStatement - Folds what value ranges decide in a top-level
+ * statement (--stream), knowing what the statements before it did.
+ *
+ * @n: The statement.
+ *
+ * @return The statement (NULL if nothing is left of it).
+ */
+struct ASTnode *rangeStatement(struct ASTnode *n) {
+    if (!UseValueRanges || n == NULL) {
+        return n;
+    }
+    analyzeStatements(&n, &mainState);
+    return n;
+}
+
+/**
+ * rangeReset - Forgets the statements of the program compiled last.
+ */
+void rangeReset(void) { freeState(&mainState); }
@@ -0,0 +1,380 @@
+// src/reassociate.c
+
+/**
+ * NOTE:
+ * Reassociation of + and * chains (on the AST, before code generation)
+ *
+ * binexpr() builds a + b + c + d left-deep, so each addition waits for
+ * the one before it. + and * are associative and commutative (also
+ * when they wrap around), so a chain of either is flattened into its
+ * operands and rebuilt balanced, where a + b and c + d can run at once:
+ * ----------------------------------------
+ *           +
+ *          / \
+ *         +   d                  +
+ *        / \         ->        /   \
+ *       +   c                 +     +
+ *      / \                   / \   / \
+ *     a   b                 a   b c   d
+ * ----------------------------------------
+ * The operands are combined two at a time, those needing the fewest
+ * registers (their Sethi-Ullman numbers) first, and each node computes
+ * its heavier operand first. Equal operands thus pair up level by
+ * level, and a heavy operand is not held in a register while lighter
+ * ones are computed.
+ *
+ * The literals of a chain are merged into one, kept as the right
+ * operand of its root (an immediate, or the displacement of a lea);
+ * x + 0 and x * 1 lose it, and x * 0 is 0. In `s = s + ...` the
+ * operand s stays at the root's left, so the statement remains an add
+ * to s (and a reduction, see vectorize.c).
+ *
+ * A chain with a call keeps its order: the call may assign a global
+ * that another operand reads. --no-reassociate leaves every chain as
+ * it was parsed.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <limits.h>
+
+// An operand of a chain
+struct operand {
+    struct ASTnode *n;
+    int need;  // registers needed to compute it (Sethi-Ullman number)
+    int order; // its place in the chain
+};
+
+// A chain being rebuilt
+struct chain {
+    int op;                    // A_ADD or A_MULTIPLY
+    struct operand *operands;  // in source order
+    int count, capacity;
+    struct ASTnode **nodes;    // its + or * nodes, reused when rebuilding
+    int nodeCount, nodeCapacity;
+    int hasCall;
+};
+
+static int reassociate(struct ASTnode **link, int target);
+
+/**
+ * combinedNeed - Returns the registers a binary node needs, computing
+ * its heavier operand first.
+ */
+static int combinedNeed(int left, int right) {
+    if (left == right) {
+        return left + 1;
+    }
+    return left > right ? left : right;
+}
+
+/**
+ * grow - Makes room for one more element in an array.
+ *
+ * @array: The array (may be NULL).
+ * @count: Number of elements in it.
+ * @capacity: Its capacity in elements, updated.
+ * @size: Bytes per element.
+ *
+ * @return The (possibly reallocated) array.
+ */
+static void *grow(void *array, int count, int *capacity, size_t size) {
+    if (count < *capacity) {
+        return array;
+    }
+    *capacity = *capacity ? *capacity * 2 : 8;
+    if ((array = realloc(array, *capacity * size)) == NULL) {
+        logFatal("Out of memory while reassociating");
+    }
+    return array;
+}
+
+/**
+ * collect - Flattens a chain into its operands, reassociating each.
+ *
+ * @link: Where the part of the chain hangs.
+ * @c: The chain.
+ *
+ * @return The registers the part needs, as it is.
+ */
+static int collect(struct ASTnode **link, struct chain *c) {
+    struct ASTnode *n = *link;
+    int left, right;
+
+    if (n->op != c->op) {
+        c->operands = grow(c->operands, c->count, &c->capacity,
+                           sizeof(*c->operands));
+        c->operands[c->count].need = reassociate(link, -1);
+        c->operands[c->count].order = c->count;
+        c->operands[c->count++].n = *link;
+        c->hasCall |= hasCall(*link);
+        return c->operands[c->count - 1].need;
+    }
+
+    c->nodes = grow(c->nodes, c->nodeCount, &c->nodeCapacity,
+                    sizeof(*c->nodes));
+    c->nodes[c->nodeCount++] = n;
+    left = collect(&n->left, c);
+    right = collect(&n->right, c);
+    return combinedNeed(left, right);
+}
+
+/**
+ * join - Makes a node of the chain from two operands.
+ *
+ * @c: The chain, whose nodes are reused.
+ * @first: The operand computed first.
+ * @second: The other one.
+ */
+static struct operand join(struct chain *c, struct operand first,
+                           struct operand second) {
+    struct ASTnode *n = c->nodes[--c->nodeCount];
+
+    n->left = first.n;
+    n->right = second.n;
+    return (struct operand){n, combinedNeed(first.need, second.need),
+                            first.order};
+}
+
+/**
+ * mergeLiterals - Merges the literals of a chain into one.
+ *
+ * @c: The chain; its literals are removed from its operands.
+ * @value: Receives the merged value.
+ *
+ * @return The literal node kept, or NULL if the chain has none or
+ *         their value does not fit in one (they are left alone then).
+ */
+static struct ASTnode *mergeLiterals(struct chain *c, long *value) {
+    struct ASTnode *literal = NULL;
+    unsigned long v = c->op == A_ADD ? 0 : 1;
+    int kept = 0;
+
+    // Wrap around like the code would
+    for (int i = 0; i < c->count; i++) {
+        if (c->operands[i].n->op == A_INTLIT) {
+            v = c->op == A_ADD ? v + c->operands[i].n->v.intvalue
+                               : v * c->operands[i].n->v.intvalue;
+        }
+    }
+    if ((long)v < INT_MIN || (long)v > INT_MAX) {
+        return NULL;
+    }
+
+    for (int i = 0; i < c->count; i++) {
+        if (c->operands[i].n->op != A_INTLIT) {
+            c->operands[kept++] = c->operands[i];
+        } else if (literal == NULL) {
+            literal = c->operands[i].n;
+        } else {
+            free(c->operands[i].n);
+        }
+    }
+    c->count = kept;
+    *value = (long)v;
+    return literal;
+}
+
+/**
+ * compareNeeds - Orders operands by the registers they need, for
+ * qsort(); those needing the same keep their order.
+ */
+static int compareNeeds(const void *a, const void *b) {
+    const struct operand *x = a, *y = b;
+
+    if (x->need != y->need) {
+        return x->need - y->need;
+    }
+    return x->order - y->order;
+}
+
+/**
+ * balance - Combines the operands of a chain into a tree, see the note
+ * at the top of this file.
+ *
+ * NOTE:
+ * The operands are taken lightest first, and a node needs at least as
+ * many registers as either of its operands. So the nodes are made in
+ * order of their need, and the two lightest left are always at the
+ * front of the operands or of the nodes made (Huffman's two queues).
+ *
+ * @c: The chain, with at least one operand.
+ */
+static struct operand balance(struct chain *c) {
+    struct operand *made, pair[2];
+    int next = 0, first = 0, last = 0;
+
+    qsort(c->operands, c->count, sizeof(*c->operands), compareNeeds);
+    if ((made = malloc(c->count * sizeof(*made))) == NULL) {
+        logFatal("Out of memory while reassociating");
+    }
+
+    while ((c->count - next) + (last - first) > 1) {
+        for (int k = 0; k < 2; k++) {
+            if (first == last || (next < c->count &&
+                                  c->operands[next].need <= made[first].need)) {
+                pair[k] = c->operands[next++];
+            } else {
+                pair[k] = made[first++];
+            }
+        }
+        made[last++] = pair[1].need > pair[0].need
+                           ? join(c, pair[1], pair[0])
+                           : join(c, pair[0], pair[1]);
+    }
+
+    pair[0] = next < c->count ? c->operands[next] : made[first];
+    free(made);
+    return pair[0];
+}
+
+/**
+ * rebuild - Rebuilds a flattened chain.
+ *
+ * @link: Where the chain hangs.
+ * @c: The chain.
+ * @target: The variable assigned the chain's value, or -1.
+ *
+ * @return The registers the new tree needs.
+ */
+static int rebuild(struct ASTnode **link, struct chain *c, int target) {
+    struct operand root, self = {NULL, 1, 0};
+    struct ASTnode *literal;
+    long value;
+    int keep;
+
+    literal = mergeLiterals(c, &value);
+    if (literal != NULL && c->op == A_MULTIPLY && value == 0) {
+        for (int i = 0; i < c->count; i++) {
+            freeAST(c->operands[i].n);
+        }
+        c->count = 0;
+    }
+    keep = literal != NULL && (c->count == 0 ||
+                               value != (c->op == A_ADD ? 0 : 1));
+    if (literal != NULL && !keep) {
+        free(literal);
+    }
+
+    // s in `s = s + ...`
+    for (int i = 0; c->op == A_ADD && i < c->count && self.n == NULL; i++) {
+        if (c->operands[i].n->op == A_IDENTIFIER &&
+            c->operands[i].n->v.identifierIndex == target) {
+            self = c->operands[i];
+            memmove(&c->operands[i], &c->operands[i + 1],
+                    (c->count - i - 1) * sizeof(*c->operands));
+            c->count--;
+        }
+    }
+
+    if (c->count > 0) {
+        root = balance(c);
+        if (keep) {
+            literal->v.intvalue = value;
+            root = join(c, root, (struct operand){literal, 1, 0});
+        }
+    } else if (keep) {
+        literal->v.intvalue = value;
+        root = (struct operand){literal, 1, 0};
+    } else {
+        root = self; // x + 0 with only x left (x * 1 has no self)
+        self.n = NULL;
+    }
+    if (self.n != NULL) {
+        root = join(c, self, root);
+    }
+
+    // The nodes not reused
+    while (c->nodeCount > 0) {
+        free(c->nodes[--c->nodeCount]);
+    }
+    *link = root.n;
+    return root.need;
+}
+
+/**
+ * reassociateChain - Reassociates a chain of + or *.
+ *
+ * @link: Where the chain hangs.
+ * @target: The variable assigned the chain's value, or -1.
+ *
+ * @return The registers the chain needs.
+ */
+static int reassociateChain(struct ASTnode **link, int target) {
+    struct chain c = {(*link)->op, NULL, 0, 0, NULL, 0, 0, 0};
+    int need;
+
+    need = collect(link, &c);
+    if (!c.hasCall) {
+        need = rebuild(link, &c, target);
+    }
+    free(c.operands);
+    free(c.nodes);
+    return need;
+}
+
+/**
+ * reassociateStatement - Reassociates one statement of a chain.
+ *
+ * @link: Where the statement hangs (see walkStatements()).
+ * @arg: Unused.
+ */
+static void reassociateStatement(struct ASTnode **link, void *arg) {
+    (void)arg;
+    reassociate(link, -1);
+}
+
+/**
+ * reassociate - Reassociates the chains of a tree.
+ *
+ * @link: Where the tree hangs.
+ * @target: The variable assigned the tree's value, or -1.
+ *
+ * @return The registers the tree needs, when it is an expression.
+ */
+static int reassociate(struct ASTnode **link, int target) {
+    struct ASTnode *n = *link;
+    int left, right;
+
+    if (n == NULL) {
+        return 0;
+    }
+
+    switch (n->op) {
+    case A_GLUE:
+        walkStatements(link, reassociateStatement, NULL);
+        return 0;
+    case A_ADD:
+    case A_MULTIPLY:
+        return reassociateChain(link, target);
+    case A_ASSIGN:
+        if (n->right->op == A_LVALUEIDENTIFIER) {
+            target = n->right->v.identifierIndex;
+        }
+        reassociate(&n->left, target);
+        reassociate(&n->right, -1);
+        return 0;
+    case A_INTLIT:
+    case A_IDENTIFIER:
+        return 1;
+    }
+
+    left = reassociate(&n->left, -1);
+    reassociate(&n->middle, -1);
+    right = reassociate(&n->right, -1);
+    return n->right != NULL ? combinedNeed(left, right) : left;
+}
+
+/**
+ * reassociateChains - Rebalances the + and * chains of a program, or
+ * of one of its statements, see the note at the top of this file.
+ *
+ * @tree: The program or statement (may be NULL).
+ */
+void reassociateChains(struct ASTnode *tree) {
+    if (Reassociate) {
+        reassociate(&tree, -1);
+    }
+}
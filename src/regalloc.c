@@ -0,0 +1,425 @@
+// src/regalloc.c
+
+/**
+ * NOTE:
+ * Register allocation for locals, by linear scan
+ * (NASM backend, before code generation)
+ *
+ * allocateLocals() works on one frame: main's statements, or the body
+ * of a function. It numbers the frame's nodes in the order their code
+ * runs (children before their parent), and each local becomes the
+ * interval from the first node naming it, its declaration, to the
+ * last:
+ * ----------------------------------------
+ *   {                      nodes           intervals
+ *       int s;             0-2 (s = 0)     s: [1, 20]
+ *       int i;             3-5 (i = 0)     i: [4, 17], live in the
+ *       while (i < 9) {    6-19 (loop)        loop, so [4, 19]
+ *           s = s + i;     9-13
+ *           i = i + 1;     14-18
+ *       }
+ *       print s;           20-21 (21 is a call)
+ *   }
+ * ----------------------------------------
+ * A loop runs its nodes again, so a local that is live when a loop
+ * starts and is named inside it stays live until the loop's end.
+ *
+ * The intervals are then visited by start, with the active ones (those
+ * holding a register) kept by end (Poletto and Sarkar):
+ * ----------------------------------------
+ *   for each interval, by start:
+ *       the active intervals ending before it give their registers back
+ *       if a register is free:          it takes the register
+ *       else if an active one ends last: that one goes to a stack slot
+ *                                        and gives up its register
+ *       else:                            it goes to a stack slot
+ * ----------------------------------------
+ * printint and the functions keep rbx but may clobber rcx, rsi and rdi.
+ * An interval with a call inside prefers rbx and any other prefers the
+ * rest; the calls then save the registers of the intervals live across
+ * them (their liveLocals, see nasmSaveRegisters()).
+ *
+ * A stack slot is reused once its local is dead, so a frame needs as
+ * many as are in use at once. --no-regalloc puts every local in one.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// A local's live range, in node numbers
+struct interval {
+    int symbol;     // symbol index of the local
+    int start;      // first node naming it
+    int end;        // last node it must live to
+    int acrossCall; // whether a call is made in between
+};
+
+// A loop's nodes, or a call's node (start == end)
+struct span {
+    int start;
+    int end;
+    struct ASTnode *n; // the call
+};
+
+// The frame being allocated, intervals in order of their start
+static _Thread_local struct interval *intervals = NULL;
+static _Thread_local int intervalCount = 0, intervalCapacity = 0;
+static _Thread_local struct span *loops = NULL;
+static _Thread_local int loopCount = 0, loopCapacity = 0;
+static _Thread_local struct span *calls = NULL; // in node order
+static _Thread_local int callCount = 0, callCapacity = 0;
+// Number of the next node
+static _Thread_local int nextNode = 0;
+// By symbol index: its interval + 1, or 0 if it has none yet
+static _Thread_local int *intervalOf = NULL;
+static _Thread_local int intervalOfSize = 0;
+
+static void numberNode(struct ASTnode *n);
+
+/**
+ * grow - Doubles the capacity of an array.
+ *
+ * @array: The array (may be NULL).
+ * @capacity: Its capacity in elements, updated.
+ * @size: Bytes per element.
+ *
+ * @return The reallocated array.
+ */
+static void *grow(void *array, int *capacity, size_t size) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    if ((array = realloc(array, *capacity * size)) == NULL) {
+        logFatal("Out of memory while allocating registers");
+    }
+    return array;
+}
+
+/**
+ * addSpan - Appends a loop or a call.
+ */
+static void addSpan(struct span **spans, int *count, int *capacity,
+                    int start, int end, struct ASTnode *n) {
+    if (*count == *capacity) {
+        *spans = grow(*spans, capacity, sizeof(**spans));
+    }
+    (*spans)[*count].start = start;
+    (*spans)[*count].end = end;
+    (*spans)[(*count)++].n = n;
+}
+
+/**
+ * nameLocal - Records that a node names a local.
+ *
+ * @id: The symbol index.
+ * @node: The node's number.
+ */
+static void nameLocal(int id, int node) {
+    struct interval *i;
+
+    if (intervalOf[id] != 0) {
+        intervals[intervalOf[id] - 1].end = node;
+        return;
+    }
+    if (intervalCount == intervalCapacity) {
+        intervals = grow(intervals, &intervalCapacity, sizeof(*intervals));
+    }
+    i = &intervals[intervalCount++];
+    i->symbol = id;
+    i->start = i->end = node;
+    i->acrossCall = 0;
+    intervalOf[id] = intervalCount;
+}
+
+/**
+ * numberStatements - Numbers a statement chain, first statement first.
+ *
+ * @n: The chain; its left spine is walked without recursion.
+ */
+static void numberStatements(struct ASTnode *n) {
+    struct ASTnode **spine, *m;
+    int count = 0, k;
+
+    for (m = n; m != NULL && m->op == A_GLUE; m = m->left) {
+        count++;
+    }
+    if ((spine = malloc(count * sizeof(*spine))) == NULL) {
+        logFatal("Out of memory while allocating registers");
+    }
+    for (m = n, k = count; k > 0; m = m->left) {
+        spine[--k] = m;
+    }
+
+    // The first statement is at the bottom, where the walk stopped
+    numberNode(m);
+    for (int i = 0; i < count; i++) {
+        numberNode(spine[i]->right);
+    }
+    free(spine);
+}
+
+/**
+ * numberNode - Numbers a tree's nodes in the order their code runs,
+ * recording its locals, loops and calls.
+ *
+ * @n: The tree (may be NULL).
+ */
+static void numberNode(struct ASTnode *n) {
+    int first = nextNode, node;
+    struct symbolTable *s;
+
+    if (n == NULL || n->op == A_FUNCTION) {
+        return; // a function is a frame of its own
+    }
+    if (n->op == A_GLUE) {
+        numberStatements(n);
+        return;
+    }
+
+    numberNode(n->left);
+    numberNode(n->middle);
+    numberNode(n->right);
+    node = nextNode++;
+
+    switch (n->op) {
+    case A_IDENTIFIER:
+    case A_LVALUEIDENTIFIER:
+        s = &GlobalSymbolTable[n->v.identifierIndex];
+        if (s->kind == S_LOCAL) {
+            nameLocal(n->v.identifierIndex, node);
+        }
+        break;
+    case A_WHILE:
+        addSpan(&loops, &loopCount, &loopCapacity, first, node, NULL);
+        break;
+    case A_PRINT:
+    case A_CALL:
+        n->liveLocals = 0;
+        addSpan(&calls, &callCount, &callCapacity, node, node, n);
+        break;
+    }
+}
+
+/**
+ * compareStarts - Orders loops by their first node, for qsort().
+ */
+static int compareStarts(const void *a, const void *b) {
+    return ((struct span *)a)->start - ((struct span *)b)->start;
+}
+
+/**
+ * firstAfter - Finds the first span starting after a node.
+ *
+ * @spans: The spans, by start.
+ * @count: Number of spans.
+ * @node: The node's number.
+ *
+ * @return Its index (count if there is none).
+ */
+static int firstAfter(struct span *spans, int count, int node) {
+    int low = 0, high = count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (spans[middle].start <= node) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * extendIntervals - Applies the loops and calls to the intervals, see
+ * the note at the top of this file.
+ */
+static void extendIntervals(void) {
+    struct interval *i;
+    int end, k;
+
+    if (loopCount > 1) {
+        qsort(loops, loopCount, sizeof(*loops), compareStarts);
+    }
+    for (i = intervals; i < intervals + intervalCount; i++) {
+        // The loops starting after the local and before its last use;
+        // those containing the use keep it live to their end. Loops
+        // nest, so one that starts later ends no later.
+        end = i->end;
+        for (k = firstAfter(loops, loopCount, i->start);
+             k < loopCount && loops[k].start <= end; k++) {
+            if (loops[k].end > i->end) {
+                i->end = loops[k].end;
+            }
+        }
+        k = firstAfter(calls, callCount, i->start);
+        i->acrossCall = k < callCount && calls[k].start < i->end;
+    }
+}
+
+/**
+ * spill - Moves an interval to a stack slot it does not share with
+ * a live one.
+ *
+ * @i: The interval.
+ * @slotEnds: The end of the last interval in each slot.
+ * @slotCount: Number of slots, updated.
+ */
+static void spill(struct interval *i, int *slotEnds, int *slotCount) {
+    int slot = 0;
+
+    // The intervals in a slot are in order, so the last one ends last
+    while (slot < *slotCount && slotEnds[slot] >= i->start) {
+        slot++;
+    }
+    if (slot == *slotCount) {
+        (*slotCount)++;
+    }
+    slotEnds[slot] = i->end;
+    GlobalSymbolTable[i->symbol].location = -1 - slot;
+}
+
+/**
+ * pickRegister - Chooses a free register for an interval.
+ *
+ * @i: The interval.
+ * @active: Per register, the interval holding it, or NULL.
+ *
+ * @return The register, or -1 if none is free.
+ */
+static int pickRegister(struct interval *i, struct interval **active) {
+    // A callee-saved register first if a call is made while it lives,
+    // the others first otherwise
+    for (int k = 0; k < LOCAL_REGISTERS; k++) {
+        int r = i->acrossCall ? k
+                              : (k + LOCAL_CALLEE_SAVED) % LOCAL_REGISTERS;
+        if (active[r] == NULL) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+/**
+ * scanIntervals - Gives every interval a register or a stack slot.
+ *
+ * @return Number of stack slots used.
+ */
+static int scanIntervals(void) {
+    struct interval *active[LOCAL_REGISTERS] = {NULL};
+    struct interval *i, *last;
+    int *slotEnds, slotCount = 0, r;
+
+    if ((slotEnds = malloc((intervalCount + 1) * sizeof(int))) == NULL) {
+        logFatal("Out of memory while allocating registers");
+    }
+
+    for (i = intervals; i < intervals + intervalCount; i++) {
+        if (!RegisterLocals) {
+            spill(i, slotEnds, &slotCount);
+            continue;
+        }
+
+        last = NULL;
+        for (r = 0; r < LOCAL_REGISTERS; r++) {
+            if (active[r] != NULL && active[r]->end < i->start) {
+                active[r] = NULL;
+            }
+            if (active[r] != NULL &&
+                (last == NULL || active[r]->end > last->end)) {
+                last = active[r];
+            }
+        }
+
+        if ((r = pickRegister(i, active)) == -1) {
+            if (last->end <= i->end) {
+                spill(i, slotEnds, &slotCount);
+                continue;
+            }
+            r = GlobalSymbolTable[last->symbol].location;
+            spill(last, slotEnds, &slotCount);
+        }
+        active[r] = i;
+        GlobalSymbolTable[i->symbol].location = r;
+    }
+    free(slotEnds);
+    return slotCount;
+}
+
+/**
+ * markCalls - Tells each call which caller-saved registers of locals
+ * it must save.
+ */
+static void markCalls(void) {
+    struct interval *i;
+    int r;
+
+    for (i = intervals; i < intervals + intervalCount; i++) {
+        r = GlobalSymbolTable[i->symbol].location;
+        if (!i->acrossCall || r < LOCAL_CALLEE_SAVED) {
+            continue; // in rbx or a stack slot
+        }
+        for (int k = firstAfter(calls, callCount, i->start);
+             k < callCount && calls[k].start < i->end; k++) {
+            calls[k].n->liveLocals |= 1 << r;
+        }
+    }
+}
+
+/**
+ * allocateLocals - Places the locals of a frame in registers and stack
+ * slots, see the note at the top of this file.
+ *
+ * NOTE:
+ * Each local's place is its symbol's location. The functions defined
+ * in the tree are skipped; each is a frame of its own.
+ *
+ * @n: main's statements (or some of them), or a function's body.
+ * @registers: Receives the mask of the registers given to locals.
+ *
+ * @return Number of stack slots the frame needs.
+ */
+int allocateLocals(struct ASTnode *n, int *registers) {
+    int slots, r, symbols = countGlobalSymbols();
+
+    // The symbols added since the last frame (--stream) have no entry
+    if (intervalOfSize < symbols) {
+        if ((intervalOf = realloc(intervalOf, symbols * sizeof(int))) ==
+            NULL) {
+            logFatal("Out of memory while allocating registers");
+        }
+        memset(intervalOf + intervalOfSize, 0,
+               (symbols - intervalOfSize) * sizeof(int));
+        intervalOfSize = symbols;
+    }
+    nextNode = 0;
+    numberNode(n);
+    extendIntervals();
+    slots = scanIntervals();
+    markCalls();
+
+    *registers = 0;
+    for (int k = 0; k < intervalCount; k++) {
+        intervalOf[intervals[k].symbol] = 0;
+        if ((r = GlobalSymbolTable[intervals[k].symbol].location) >= 0) {
+            *registers |= 1 << r;
+        }
+    }
+    free(intervals);
+    free(loops);
+    free(calls);
+    intervals = NULL;
+    loops = calls = NULL;
+    intervalCount = intervalCapacity = 0;
+    loopCount = loopCapacity = 0;
+    callCount = callCapacity = 0;
+    return slots;
+}
+
+/**
+ * regallocReset - Frees the symbol index of the program compiled last.
+ */
+void regallocReset(void) {
+    free(intervalOf);
+    intervalOf = NULL;
+    intervalOfSize = 0;
+}
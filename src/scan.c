@@ -100,9 +100,10 @@ static int scanIdentifier(int c, char *buf, int lengthLimit) {
     while (isalpha(c) || isdigit(c) || c == '_') {
         if (lengthLimit - 1 == i) {
             // Considering the NULL character, it's a signal of buffer overflow
-            printf("Identifier too long on line %d (Length limit: %d)\n", Line,
-                   lengthLimit);
-            exit(1);
+            fprintf(Errfile,
+                    "Identifier too long on line %d (Length limit: %d)\n",
+                    Line, lengthLimit);
+            fatalExit();
         } else if (i < lengthLimit - 1) {
             buf[i++] = c;
         }
@@ -128,11 +129,31 @@ static int scanIdentifier(int c, char *buf, int lengthLimit) {
  */
 static int keyword(char *s) {
     switch (*s) {
+    case 'b':
+        if (!strcmp(s, "break")) {
+            return T_BREAK;
+        }
+        break;
+    case 'c':
+        if (!strcmp(s, "case")) {
+            return T_CASE;
+        }
+        break;
+    case 'd':
+        if (!strcmp(s, "default")) {
+            return T_DEFAULT;
+        }
+        break;
     case 'e':
         if (!strcmp(s, "else")) {
             return T_ELSE;
         }
         break;
+    case 'f':
+        if (!strcmp(s, "for")) {
+            return T_FOR;
+        }
+        break;
     case 'i':
         if (!strcmp(s, "if")) {
             return T_IF;
@@ -146,17 +167,46 @@ static int keyword(char *s) {
             return T_PRINT;
         }
         break;
+    case 'r':
+        if (!strcmp(s, "return")) {
+            return T_RETURN;
+        }
+        break;
+    case 's':
+        if (!strcmp(s, "switch")) {
+            return T_SWITCH;
+        }
+        break;
+    case 'w':
+        if (!strcmp(s, "while")) {
+            return T_WHILE;
+        }
+        break;
     }
     return 0;
 }
 
 /**
- * scan - Scan and return the next token found in the input.
+ * scan - Return the next token, from the scanner thread with
+ * --scan-thread (see scanthread.c) or straight from the input.
  *
  * @param t Pointer to the token structure to store the scanned token
  * @return 1 if a token was successfully scanned, 0 if end of file
  */
 int scan(struct token *t) {
+    if (ScanThread) {
+        return scanThreadNext(t);
+    }
+    return scanInput(t);
+}
+
+/**
+ * scanInput - Scan and return the next token found in the input.
+ *
+ * @param t Pointer to the token structure to store the scanned token
+ * @return 1 if a token was successfully scanned, 0 if end of file
+ */
+int scanInput(struct token *t) {
     int c;
     int tokenType;
 
@@ -180,6 +230,9 @@ int scan(struct token *t) {
     case '/':
         t->token = T_SLASH;
         break;
+    case '%':
+        t->token = T_PERCENT;
+        break;
     case ';':
         t->token = T_SEMICOLON;
         break;
@@ -195,6 +248,18 @@ int scan(struct token *t) {
     case ')':
         t->token = T_RPAREN;
         break;
+    case ':':
+        t->token = T_COLON;
+        break;
+    case '[':
+        t->token = T_LBRACKET;
+        break;
+    case ']':
+        t->token = T_RBRACKET;
+        break;
+    case ',':
+        t->token = T_COMMA;
+        break;
     case '=':
         if ((c = next()) == '=') {
             // "=="
@@ -210,9 +275,31 @@ int scan(struct token *t) {
             // "!="
             t->token = T_NE;
         } else {
-            // Unrecognized token starting with '!'
-            printf("Unrecognized character '!%c' on line %d\n", c, Line);
-            exit(1);
+            // "!"
+            putback(c);
+            t->token = T_LOGNOT;
+        }
+        break;
+    case '&':
+        if ((c = next()) == '&') {
+            // "&&"
+            t->token = T_LOGAND;
+        } else {
+            // Unrecognized token starting with '&'
+            fprintf(Errfile, "Unrecognized character '&%c' on line %d\n", c,
+                    Line);
+            fatalExit();
+        }
+        break;
+    case '|':
+        if ((c = next()) == '|') {
+            // "||"
+            t->token = T_LOGOR;
+        } else {
+            // Unrecognized token starting with '|'
+            fprintf(Errfile, "Unrecognized character '|%c' on line %d\n", c,
+                    Line);
+            fatalExit();
         }
         break;
     case '<':
@@ -257,8 +344,9 @@ int scan(struct token *t) {
         }
 
         // The character isn't part of any recognized token, raise an error
-        printf("Unrecognized character '%c' on line %d\n", c, Line);
-        exit(1);
+        fprintf(Errfile, "Unrecognized character '%c' on line %d\n", c,
+                Line);
+        fatalExit();
     }
 
     // Successfully scanned a token
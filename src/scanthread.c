@@ -0,0 +1,362 @@
+// src/scanthread.c
+
+/**
+ * NOTE:
+ * Pipelined scanner (--scan-thread)
+ *
+ * A second thread runs the scanner (scanInput()) ahead of the parser
+ * and passes the tokens through a single-producer/single-consumer ring:
+ * ----------------------------------------
+ *   scanner thread                         parser thread
+ *   scanInput() -> push() -> [ring] -> pop() -> scan() -> match() ...
+ * ----------------------------------------
+ * The scanner writes only 'head' and the parser only 'tail', so the
+ * ring needs no lock: a release store of an index publishes the slots
+ * (and interned names) written before it, and the acquire load on
+ * the other side makes them visible.
+ *
+ * Identifiers are interned by the scanner thread, so a token carries
+ * a small id instead of the text. Interned names never move, and the
+ * parser copies a name into Text when it reaches the token.
+ *
+ * A scanner error is not reported right away: it travels down the
+ * ring as an error token, so the parser still reports any error
+ * earlier in the input first, just like the single-threaded scanner.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// A token as passed from the scanner thread to the parser
+struct pipedToken {
+    int token;    // token type
+    int intvalue; // value of a T_INTLIT
+    int intern;   // interned name of a T_IDENTIFIER, NO_NAME or SCAN_FAILED
+    int line;     // Line right after the token was scanned
+};
+
+// Values of pipedToken.intern other than name ids
+#define NO_NAME -1     // not an identifier
+#define SCAN_FAILED -2 // T_EOF standing in for a scanner error
+
+// State shared by the two threads
+struct scanPipe {
+    struct pipedToken ring[SCAN_RING_SIZE];
+    // Each side also keeps the last index it saw of the other side,
+    // and only reloads it when the ring looks full (or empty)
+    _Alignas(64) atomic_size_t head; // next slot the scanner fills
+    size_t tailSeen;                 // scanner's copy of tail
+    _Alignas(64) atomic_size_t tail; // next slot the parser reads
+    size_t headSeen;                 // parser's copy of head
+    atomic_int stop;                 // the parser no longer needs tokens
+
+    // Interned names, in chunks that never move once allocated
+    char **nameChunks[SCAN_INTERN_CHUNKS];
+    int nameCount;
+    // Scanner-only hash table of name ids (-1 = empty slot)
+    int *internTable;
+    int internTableSize;
+
+    FILE *in;            // the input file, read by the scanner only
+    char *error;         // the scanner's error message, if any
+    size_t errorSize;    // its length
+    pthread_t thread;    // the scanner thread
+    int finished;        // the parser has received the last token
+};
+
+// Pipe of the compilation running on this thread (NULL if none)
+static _Thread_local struct scanPipe *activePipe = NULL;
+
+/**
+ * internedName - Returns the text of an interned name.
+ *
+ * @param p  The pipe.
+ * @param id The name id.
+ *
+ * @return The name.
+ */
+static char *internedName(struct scanPipe *p, int id) {
+    return p->nameChunks[id / SCAN_INTERN_CHUNK][id % SCAN_INTERN_CHUNK];
+}
+
+/**
+ * hashName - FNV-1a hash of a name.
+ */
+static unsigned hashName(char *s) {
+    unsigned h = 2166136261u;
+
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * growInternTable - Doubles the intern hash table (scanner thread only).
+ *
+ * @param p The pipe.
+ */
+static void growInternTable(struct scanPipe *p) {
+    int size = p->internTableSize ? p->internTableSize * 2 : 1024;
+    int *table = malloc(size * sizeof(int));
+    unsigned h;
+
+    if (table == NULL) {
+        logFatal("Out of memory while interning identifiers");
+    }
+    for (int i = 0; i < size; i++) {
+        table[i] = -1;
+    }
+    for (int id = 0; id < p->nameCount; id++) {
+        h = hashName(internedName(p, id)) & (size - 1);
+        while (table[h] != -1) {
+            h = (h + 1) & (size - 1);
+        }
+        table[h] = id;
+    }
+    free(p->internTable);
+    p->internTable = table;
+    p->internTableSize = size;
+}
+
+/**
+ * intern - Returns the id of a name, adding it if it is new
+ * (scanner thread only).
+ *
+ * @param p    The pipe.
+ * @param name The name.
+ *
+ * @return The name id.
+ */
+static int intern(struct scanPipe *p, char *name) {
+    unsigned h;
+    int id;
+
+    if (2 * (p->nameCount + 1) > p->internTableSize) {
+        growInternTable(p);
+    }
+
+    h = hashName(name) & (p->internTableSize - 1);
+    while ((id = p->internTable[h]) != -1) {
+        if (!strcmp(internedName(p, id), name)) {
+            return id;
+        }
+        h = (h + 1) & (p->internTableSize - 1);
+    }
+
+    id = p->nameCount;
+    if (id / SCAN_INTERN_CHUNK >= SCAN_INTERN_CHUNKS) {
+        logFatal("Too many distinct identifiers");
+    }
+    if (id % SCAN_INTERN_CHUNK == 0) {
+        p->nameChunks[id / SCAN_INTERN_CHUNK] =
+            malloc(SCAN_INTERN_CHUNK * sizeof(char *));
+    }
+    if (p->nameChunks[id / SCAN_INTERN_CHUNK] == NULL ||
+        (p->nameChunks[id / SCAN_INTERN_CHUNK][id % SCAN_INTERN_CHUNK] =
+             strdup(name)) == NULL) {
+        logFatal("Out of memory while interning identifiers");
+    }
+    p->internTable[h] = id;
+    p->nameCount++;
+    return id;
+}
+
+/**
+ * push - Hands a token to the parser, waiting while the ring is full.
+ *
+ * @param p   The pipe.
+ * @param tok The token.
+ *
+ * @return 1 if the token was queued, 0 if the parser has stopped.
+ */
+static int push(struct scanPipe *p, struct pipedToken *tok) {
+    size_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+
+    while (head - p->tailSeen == SCAN_RING_SIZE) {
+        p->tailSeen = atomic_load_explicit(&p->tail, memory_order_acquire);
+        if (head - p->tailSeen < SCAN_RING_SIZE) {
+            break;
+        }
+        if (atomic_load_explicit(&p->stop, memory_order_relaxed)) {
+            return 0;
+        }
+        sched_yield();
+    }
+    p->ring[head % SCAN_RING_SIZE] = *tok;
+    atomic_store_explicit(&p->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * pop - Takes the next token, waiting while the ring is empty.
+ *
+ * @param p   The pipe.
+ * @param tok Receives the token.
+ */
+static void pop(struct scanPipe *p, struct pipedToken *tok) {
+    size_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+
+    while (p->headSeen == tail) {
+        p->headSeen = atomic_load_explicit(&p->head, memory_order_acquire);
+        if (p->headSeen != tail) {
+            break;
+        }
+        sched_yield();
+    }
+    *tok = p->ring[tail % SCAN_RING_SIZE];
+    atomic_store_explicit(&p->tail, tail + 1, memory_order_release);
+}
+
+/**
+ * scannerThread - Body of the scanner thread.
+ *
+ * NOTE:
+ * The compiler globals are thread-local (see data.h),
+ * so this thread has its own Line, Putback and Text.
+ *
+ * @param arg The pipe.
+ *
+ * @return NULL
+ */
+static void *scannerThread(void *arg) {
+    struct scanPipe *p = arg;
+    struct pipedToken tok;
+    struct token t = {0};
+    jmp_buf recovery;
+    FILE *errors;
+
+    Infile = p->in;
+    Line = 1;
+    Putback = '\n';
+    if ((errors = open_memstream(&p->error, &p->errorSize)) == NULL) {
+        errors = stderr;
+    }
+    Errfile = errors;
+
+    if (setjmp(recovery) == 0) {
+        setFatalRecovery(&recovery);
+        do {
+            scanInput(&t);
+            tok.token = t.token;
+            tok.intvalue = t.intvalue;
+            tok.intern =
+                t.token == T_IDENTIFIER ? intern(p, Text) : NO_NAME;
+            tok.line = Line;
+        } while (push(p, &tok) && t.token != T_EOF);
+    } else {
+        // Finish the message before the parser can read it
+        if (errors != stderr) {
+            fclose(errors);
+            errors = stderr;
+        }
+        tok.token = T_EOF;
+        tok.intvalue = 0;
+        tok.intern = SCAN_FAILED;
+        tok.line = Line;
+        push(p, &tok);
+    }
+
+    setFatalRecovery(NULL);
+    if (errors != stderr) {
+        fclose(errors);
+    }
+    return NULL;
+}
+
+/**
+ * scanThreadStart - Starts scanning Infile on a separate thread.
+ *
+ * NOTE:
+ * If the thread cannot be created, scanning silently stays on
+ * the calling thread.
+ */
+void scanThreadStart(void) {
+    struct scanPipe *p;
+
+    if ((p = calloc(1, sizeof(*p))) == NULL) {
+        return;
+    }
+    atomic_init(&p->head, 0);
+    atomic_init(&p->tail, 0);
+    atomic_init(&p->stop, 0);
+    p->in = Infile;
+
+    if (pthread_create(&p->thread, NULL, scannerThread, p) != 0) {
+        free(p);
+        return;
+    }
+    activePipe = p;
+}
+
+/**
+ * scanThreadNext - Returns the next token from the scanner thread.
+ *
+ * NOTE:
+ * Sets Line and, for identifiers, Text as the scanner would have.
+ * Without a scanner thread this is just scanInput().
+ *
+ * @param t Pointer to the token structure to store the token
+ * @return 1 if a token was returned, 0 at the end of the input
+ */
+int scanThreadNext(struct token *t) {
+    struct scanPipe *p = activePipe;
+    struct pipedToken tok;
+
+    if (p == NULL) {
+        return scanInput(t);
+    }
+    if (p->finished) {
+        t->token = T_EOF;
+        return 0;
+    }
+
+    pop(p, &tok);
+    Line = tok.line;
+    t->token = tok.token;
+    t->intvalue = tok.intvalue;
+
+    if (tok.token == T_IDENTIFIER) {
+        strcpy(Text, internedName(p, tok.intern));
+    } else if (tok.token == T_EOF) {
+        p->finished = 1;
+        if (tok.intern == SCAN_FAILED) {
+            // The scanner thread failed here; report it as our own
+            fwrite(p->error, 1, p->errorSize, Errfile);
+            fatalExit();
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * scanThreadStop - Stops the scanner thread and frees the pipe.
+ * Safe to call when no scanner thread is running.
+ */
+void scanThreadStop(void) {
+    struct scanPipe *p = activePipe;
+
+    if (p == NULL) {
+        return;
+    }
+    activePipe = NULL;
+
+    atomic_store_explicit(&p->stop, 1, memory_order_relaxed);
+    pthread_join(p->thread, NULL);
+
+    for (int id = 0; id < p->nameCount; id++) {
+        free(internedName(p, id));
+    }
+    for (int i = 0; i * SCAN_INTERN_CHUNK < p->nameCount; i++) {
+        free(p->nameChunks[i]);
+    }
+    free(p->internTable);
+    free(p->error);
+    free(p);
+}
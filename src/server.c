@@ -0,0 +1,300 @@
+// src/server.c
+
+/**
+ * NOTE:
+ * Compile server (--server)
+ *
+ * Stays resident and compiles the jobs sent by keccc-client (client.c)
+ * over a Unix domain socket (protocol in ipc.c). Each connection is
+ * served on a thread of its own, so the jobs of a parallel build run at
+ * the same time: the compiler globals are thread-local (see data.h),
+ * the output and diagnostics are kept in memory and sent back, then
+ * resetCompilation() clears the thread's module state. Fatal errors
+ * return here through setFatalRecovery() instead of exiting.
+ *
+ * The working directory is shared by the threads, so a job's relative
+ * paths are resolved against its client's directory instead of
+ * changing to it.
+ *
+ * Only the user running the server may connect: the socket is created
+ * with mode 0600 and every peer's credentials are checked. At most
+ * IPC_MAX_CONNECTIONS jobs are served at once; further connections
+ * wait in the listen queue.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Connections being served, see serverRun()
+static pthread_mutex_t connectionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connectionDone = PTHREAD_COND_INITIALIZER;
+static int connectionCount = 0;
+
+/**
+ * clientPath - Resolves a path of a job against its client's directory.
+ *
+ * @param directory The client's working directory.
+ * @param path      The path as given.
+ * @param buffer    Receives the resolved path, if it is relative.
+ * @param size      Size of the buffer.
+ *
+ * @return path, buffer, or NULL if the resolved path does not fit.
+ */
+static char *clientPath(char *directory, char *path, char *buffer,
+                        size_t size) {
+    int length;
+
+    if (path[0] == '/') {
+        return path;
+    }
+    length = snprintf(buffer, size, "%s/%s", directory, path);
+    return length >= 0 && (size_t)length < size ? buffer : NULL;
+}
+
+/**
+ * compileJob - Compiles one job into memory.
+ *
+ * @param directory The client's working directory.
+ * @param argc   Number of arguments, argv[0] included.
+ * @param argv   The job's command line.
+ * @param source Inline source text, or NULL to read the input file.
+ * @param sourceBytes Length of the inline source.
+ * @param output Receives the generated code (malloc'd, may be NULL).
+ * @param outputSize Receives its length.
+ *
+ * @return The exit status the command line compiler would have returned.
+ */
+static int compileJob(char *directory, int argc, char **argv, char *source,
+                      long sourceBytes, char **output, size_t *outputSize) {
+    jmp_buf recovery;
+    char inputPath[IPC_LINE_MAX], profileBuffer[IPC_LINE_MAX];
+    char *profilePath, *path;
+    FILE *out;
+    int i, status = 1;
+
+    *output = NULL;
+    *outputSize = 0;
+
+    if ((i = parseOptions(argc, argv, &profilePath)) < 0) {
+        fprintf(Errfile, "Usage: keccc " KECCC_USAGE_OPTIONS "\n");
+        return 1;
+    }
+    if (profilePath != NULL &&
+        (profilePath = clientPath(directory, profilePath, profileBuffer,
+                                  sizeof(profileBuffer))) == NULL) {
+        fprintf(Errfile, "Profile path too long\n");
+        return 1;
+    }
+
+    // The name stays as given, for -g's line annotations
+    Infilename = argv[i];
+    if (source != NULL) {
+        Infile = fmemopen(source, sourceBytes, "r");
+    } else if ((path = clientPath(directory, Infilename, inputPath,
+                                  sizeof(inputPath))) != NULL) {
+        Infile = fopen(path, "r");
+    } else {
+        Infile = NULL;
+        errno = ENAMETOOLONG;
+    }
+    if (Infile == NULL) {
+        fprintf(Errfile, "Cannot open %s: %s\n", Infilename, strerror(errno));
+        return 1;
+    }
+    if ((out = open_memstream(output, outputSize)) == NULL) {
+        fprintf(Errfile, "Cannot buffer output: %s\n", strerror(errno));
+        fclose(Infile);
+        return 1;
+    }
+    Outfile = out;
+
+    if (setjmp(recovery) == 0) {
+        setFatalRecovery(&recovery);
+        compileProgram(profilePath);
+        status = 0;
+    }
+    setFatalRecovery(NULL);
+
+    fclose(Infile);
+    fclose(out);
+    resetCompilation();
+
+    return status;
+}
+
+/**
+ * serveJob - Reads one job from a connection, compiles it and replies.
+ *
+ * @param fd The accepted connection.
+ */
+static void serveJob(int fd) {
+    char line[IPC_LINE_MAX], directory[IPC_LINE_MAX];
+    char *argv[IPC_MAX_ARGS + 2];
+    char *source = NULL, *output = NULL, *diagnostics = NULL;
+    size_t outputSize = 0, diagnosticsSize = 0;
+    long sourceBytes;
+    int argc = 0, nargs, status;
+
+    if (ipcReadLine(fd, line, sizeof(line)) < 0 ||
+        sscanf(line, IPC_MAGIC " %d %ld", &nargs, &sourceBytes) != 2 ||
+        nargs < 1 || nargs > IPC_MAX_ARGS || sourceBytes < -1) {
+        return;
+    }
+
+    // Relative paths in the job are relative to the client
+    if (ipcReadLine(fd, directory, sizeof(directory)) < 0) {
+        return;
+    }
+
+    argv[argc++] = "keccc";
+    while (argc <= nargs) {
+        if (ipcReadLine(fd, line, sizeof(line)) < 0 ||
+            (argv[argc] = strdup(line)) == NULL) {
+            goto done;
+        }
+        argc++;
+    }
+    argv[argc] = NULL;
+
+    if (sourceBytes >= 0) {
+        // One spare byte so fmemopen() also accepts an empty source
+        if ((source = malloc(sourceBytes + 1)) == NULL ||
+            ipcReadFull(fd, source, sourceBytes) < 0) {
+            goto done;
+        }
+    }
+
+    // Diagnostics are sent back along with the output
+    if ((Errfile = open_memstream(&diagnostics, &diagnosticsSize)) == NULL) {
+        Errfile = stderr;
+        goto done;
+    }
+    status = compileJob(directory, argc, argv, source, sourceBytes, &output,
+                        &outputSize);
+    fclose(Errfile);
+    Errfile = stderr;
+
+    snprintf(line, sizeof(line), IPC_MAGIC " %d %zu %zu\n", status,
+             outputSize, diagnosticsSize);
+    if (ipcWriteFull(fd, line, strlen(line)) == 0 &&
+        ipcWriteFull(fd, output, outputSize) == 0) {
+        ipcWriteFull(fd, diagnostics, diagnosticsSize);
+    }
+
+done:
+    for (int i = 1; i < argc; i++) {
+        free(argv[i]);
+    }
+    free(source);
+    free(output);
+    free(diagnostics);
+}
+
+/**
+ * serveConnection - Body of a connection's thread: serves its job.
+ *
+ * @param arg The accepted connection.
+ *
+ * @return NULL
+ */
+static void *serveConnection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+
+    Errfile = stderr;
+    serveJob(fd);
+    close(fd);
+
+    pthread_mutex_lock(&connectionLock);
+    connectionCount--;
+    pthread_cond_signal(&connectionDone);
+    pthread_mutex_unlock(&connectionLock);
+    return NULL;
+}
+
+/**
+ * serverRun - Listens for compile jobs until killed.
+ *
+ * @param socketPath Where to listen, or NULL for ipcSocketPath().
+ *
+ * @return Exit status (only returned if the socket cannot be set up).
+ */
+int serverRun(char *socketPath) {
+    struct sockaddr_un addr;
+    char defaultPath[sizeof(addr.sun_path)];
+    pthread_attr_t detached;
+    pthread_t thread;
+    mode_t mask;
+    int listener, fd, bound;
+
+    if (socketPath == NULL) {
+        socketPath = ipcSocketPath(defaultPath, sizeof(defaultPath));
+    }
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    // A client that goes away must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        fprintf(stderr, "Cannot create socket: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(socketPath); // left over from a previous server
+    mask = umask(0177); // the socket is mode 0600 from the start
+    bound = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(listener, SOMAXCONN) < 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", socketPath,
+                strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "keccc: serving on %s\n", socketPath);
+
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+        pthread_mutex_lock(&connectionLock);
+        while (connectionCount == IPC_MAX_CONNECTIONS) {
+            pthread_cond_wait(&connectionDone, &connectionLock);
+        }
+        pthread_mutex_unlock(&connectionLock);
+
+        if ((fd = accept(listener, NULL, NULL)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            return 1;
+        }
+        if (!ipcPeerIsUser(fd)) {
+            fprintf(stderr, "keccc: refused a connection from another "
+                            "user\n");
+            close(fd);
+            continue;
+        }
+
+        pthread_mutex_lock(&connectionLock);
+        connectionCount++;
+        pthread_mutex_unlock(&connectionLock);
+        if (pthread_create(&thread, &detached, serveConnection,
+                           (void *)(intptr_t)fd) != 0) {
+            serveConnection((void *)(intptr_t)fd); // no thread to be had
+        }
+    }
+}
@@ -6,6 +6,16 @@
 
 #include <stdbool.h>
 
+// Number of switch statements being parsed around the current statement
+static _Thread_local int switchDepth = 0;
+// Number of loops being parsed around the current statement
+static _Thread_local int loopDepth = 0;
+// Number of statements being parsed, including the current one
+// (1 for a statement of the program's block)
+static _Thread_local int statementDepth = 0;
+// Whether a function body is being parsed
+static _Thread_local int inFunction = 0;
+
 /**
  * A brief BNF expressions note:
  *
@@ -16,21 +26,67 @@
  *
  * statement: print_statement
  *      |     declaration
+ *      |     function_definition // only in the program's block
  *      |     assignment_statement
  *      |     if_statement
+ *      |     switch_statement
+ *      |     while_statement
+ *      |     for_statement
+ *      |     break_statement
+ *      |     return_statement
  *      ;
  *
  * print_statement: 'print' expression ';' ;
  *
- * declaration: 'int' identifier ';' ; // only int type supported
+ * declaration: 'int' identifier ';' // only int type supported
+ *      |       'int' identifier '[' integer_literal ']' ';' // global
+ *      ;
+ *
+ * function_definition: 'int' identifier '(' parameter_list ')'
+ *                      compound_statements ;
+ *
+ * parameter_list: // empty
+ *      |     'int' identifier
+ *      |     'int' identifier ',' parameter_list // at most 6
+ *      ;
+ *
+ * assignment_statement: assignment ';' ;
  *
- * assignment_statement: identifier '=' expression ';' ;
+ * assignment: identifier '=' expression
+ *      |      identifier '[' expression ']' '=' expression
+ *      |      function_call // its value is discarded
+ *      ;
+ *
+ * function_call: identifier '(' ')'
+ *      |         identifier '(' argument_list ')'
+ *      ;
+ *
+ * argument_list: expression
+ *      |         expression ',' argument_list
+ *      ;
  *
  * if_statement: if_head
  *      |        if_head 'else' compound_statements
  *      ;
  *
- * if_head: 'if' '(' true_false_expression ')' compound_statements ;
+ * if_head: 'if' '(' expression ')' compound_statements ;
+ *
+ * switch_statement: 'switch' '(' expression ')' '{' switch_body '}' ;
+ *
+ * switch_body: // empty
+ *      |     'case' integer_literal ':' switch_body
+ *      |     'default' ':' switch_body
+ *      |     statement switch_body
+ *      ;
+ *
+ * while_statement: 'while' '(' expression ')' compound_statements ;
+ *
+ * for_statement: 'for' '(' assignment ';' expression ';' assignment ')'
+ *                compound_statements ;
+ *
+ * break_statement: 'break' ';' ; // only inside a switch or loop
+ *
+ * return_statement: 'return' expression ';' ; // only inside a function
  *
  * identifier = T_IDENTIFIER;
  *      ;
@@ -61,24 +117,51 @@ static struct ASTnode *printStatement(void) {
 }
 
 /**
- * assignmentStatement - Parse and handle a variable declaration statement.
+ * assignment - Parse an assignment without its semicolon
+ * (also the first and last part of a for loop's header).
  *
- * @return AST node representing the assignment statement.
+ * @return AST node representing the assignment.
  */
-static struct ASTnode *assignmentStatement(void) {
+static struct ASTnode *assignment(void) {
     struct ASTnode *leftNode = NULL;
     struct ASTnode *rightNode = NULL;
-    struct ASTnode *treeNode = NULL;
     int identifierIndex;
 
     // Ensure we have an identifier
     identifier();
 
     // Check it's been defined then make a leaf node for it
-    if ((identifierIndex = findGlobalSymbol(Text)) == -1) {
+    if ((identifierIndex = useGlobalSymbol(Text)) == -1) {
         logFatals("Undeclared identifier: ", Text);
     }
-    rightNode = makeASTLeaf(A_LVALUEIDENTIFIER, identifierIndex);
+
+    if (Token.token == T_LPAREN) {
+        // A call on its own; the A_CALLSTATEMENT gives it a statement's
+        // source line
+        return makeASTUnary(A_CALLSTATEMENT, functionCall(identifierIndex),
+                            0);
+    }
+    if (GlobalSymbolTable[identifierIndex].kind == S_FUNCTION) {
+        logFatals("Not a variable: ", GlobalSymbolTable[identifierIndex].name);
+    }
+
+    if (Token.token == T_LBRACKET) {
+        // An array element; the index is its left child
+        if (GlobalSymbolTable[identifierIndex].length == 0) {
+            logFatals("Not an array: ",
+                      GlobalSymbolTable[identifierIndex].name);
+        }
+        leftBracket();
+        rightNode =
+            makeASTUnary(A_LVALUEINDEX, binexpr(0), identifierIndex);
+        rightBracket();
+    } else {
+        if (GlobalSymbolTable[identifierIndex].length > 0) {
+            logFatals("Array used without an index: ",
+                      GlobalSymbolTable[identifierIndex].name);
+        }
+        rightNode = makeASTLeaf(A_LVALUEIDENTIFIER, identifierIndex);
+    }
 
     // Match the '=' token
     match(T_ASSIGN, "=");
@@ -87,7 +170,16 @@ static struct ASTnode *assignmentStatement(void) {
     leftNode = binexpr(0);
 
     // Create an assignment AST node
-    treeNode = makeASTNode(A_ASSIGN, leftNode, NULL, rightNode, 0);
+    return makeASTNode(A_ASSIGN, leftNode, NULL, rightNode, 0);
+}
+
+/**
+ * assignmentStatement - Parse and handle an assignment statement.
+ *
+ * @return AST node representing the assignment statement.
+ */
+static struct ASTnode *assignmentStatement(void) {
+    struct ASTnode *treeNode = assignment();
 
     // Match the following semicolon(;)
     semicolon();
@@ -117,15 +209,9 @@ struct ASTnode *ifStatement(void) {
     match(T_IF, "if");
     leftParenthesis();
 
-    // Parse the following expression and the following ')'
-    // Ensure the tree's operation is a comparison.
+    // Parse the following expression and the following ')'.
+    // Any integer expression will do; nonzero means true.
     conditionAST = binexpr(0);
-
-    if (!(conditionAST->op == A_EQ) && !(conditionAST->op == A_NE) &&
-        !(conditionAST->op == A_LT) && !(conditionAST->op == A_LE) &&
-        !(conditionAST->op == A_GT) && !(conditionAST->op == A_GE)) {
-        logFatal("If statement condition is not a comparison");
-    }
     rightParenthesis();
 
     // Get the AST for the compount statement; this is the 'then' branch
@@ -139,6 +225,292 @@ struct ASTnode *ifStatement(void) {
     return makeASTNode(A_IF, conditionAST, thenAST, elseAST, 0);
 }
 
+/**
+ * whileStatement - Parse a while loop.
+ *
+ * NOTE:
+ * ----------------------------------------
+ *        [  A_WHILE  ]
+ *        /     |     \
+ *    cond    body    NULL
+ *  (left)  (middle)
+ * ----------------------------------------
+ *
+ * @return AST node representing the while statement.
+ */
+static struct ASTnode *whileStatement(void) {
+    struct ASTnode *conditionAST, *bodyAST;
+
+    match(T_WHILE, "while");
+    leftParenthesis();
+    conditionAST = binexpr(0);
+    rightParenthesis();
+
+    loopDepth++;
+    bodyAST = compoundStatement();
+    loopDepth--;
+
+    return makeASTNode(A_WHILE, conditionAST, bodyAST, NULL, 0);
+}
+
+/**
+ * forStatement - Parse a for loop.
+ *
+ * NOTE:
+ * A for loop is its first assignment followed by a while loop
+ * that runs the last one (the step) after the body:
+ * ----------------------------------------
+ *           A_GLUE
+ *          /      \
+ *      init     [  A_WHILE  ]
+ *               /     |     \
+ *           cond    body    step
+ * ----------------------------------------
+ *
+ * @return AST node representing the for statement.
+ */
+static struct ASTnode *forStatement(void) {
+    struct ASTnode *initAST, *conditionAST, *stepAST, *bodyAST;
+
+    match(T_FOR, "for");
+    leftParenthesis();
+    initAST = assignment();
+    semicolon();
+    conditionAST = binexpr(0);
+    semicolon();
+    stepAST = assignment();
+    rightParenthesis();
+
+    loopDepth++;
+    bodyAST = compoundStatement();
+    loopDepth--;
+
+    return makeASTNode(
+        A_GLUE, initAST, NULL,
+        makeASTNode(A_WHILE, conditionAST, bodyAST, stepAST, 0), 0);
+}
+
+/**
+ * compareCaseValues - qsort() comparator for case values.
+ */
+static int compareCaseValues(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * checkCaseValues - Rejects a switch with the same case value twice.
+ *
+ * @values: The case values (sorted in place, then freed).
+ * @count: Number of values.
+ */
+static void checkCaseValues(int *values, int count) {
+    int duplicate = -1;
+
+    qsort(values, count, sizeof(*values), compareCaseValues);
+    for (int i = 1; i < count && duplicate == -1; i++) {
+        if (values[i] == values[i - 1]) {
+            duplicate = i;
+        }
+    }
+    if (duplicate != -1) {
+        duplicate = values[duplicate];
+        free(values);
+        logFatald("Duplicate case value: ", duplicate);
+    }
+    free(values);
+}
+
+/**
+ * switchStatement - Parse and handle a switch statement.
+ *
+ * NOTE:
+ * Case and default labels are statements of the switch body,
+ * so control falls through from one case into the next:
+ * -----------------------------------
+ * switch (selector) {
+ *     case 1:            (A_CASE 1)
+ *         print 10;
+ *     case 2:            (A_CASE 2)
+ *         print 20;
+ *         break;         (A_BREAK)
+ *     default:           (A_DEFAULT)
+ *         print 0;
+ * }
+ * -----------------------------------
+ * is parsed into
+ * -----------------------------------
+ *        [  A_SWITCH  ]
+ *        /            \
+ *    selector        body
+ *    (left)    (right, glued like a
+ *               compound statement)
+ * -----------------------------------
+ * Labels are only allowed directly in the body, not in nested blocks.
+ *
+ * @return AST node representing the switch statement.
+ */
+static struct ASTnode *switchStatement(void) {
+    struct ASTnode *selector, *body = NULL, *n;
+    int *values = NULL;
+    int valueCount = 0, valueCapacity = 0;
+    int hasDefault = 0;
+
+    match(T_SWITCH, "switch");
+    leftParenthesis();
+    selector = binexpr(0);
+    rightParenthesis();
+    leftBrace();
+    openScope(); // the locals of the body
+    switchDepth++;
+
+    while (Token.token != T_RBRACE) {
+        switch (Token.token) {
+        case T_CASE:
+            scan(&Token);
+            if (Token.token != T_INTLIT) {
+                logFatal("Case value is not an integer literal");
+            }
+            if (valueCount == valueCapacity) {
+                valueCapacity = valueCapacity ? valueCapacity * 2 : 16;
+                values = realloc(values, valueCapacity * sizeof(*values));
+                if (values == NULL) {
+                    logFatal("Out of memory while parsing a switch");
+                }
+            }
+            values[valueCount++] = Token.intvalue;
+            n = makeASTLeaf(A_CASE, Token.intvalue);
+            scan(&Token);
+            colon();
+            break;
+        case T_DEFAULT:
+            if (hasDefault) {
+                logFatal("More than one default label in a switch");
+            }
+            hasDefault = 1;
+            n = makeASTLeaf(A_DEFAULT, 0);
+            scan(&Token);
+            colon();
+            break;
+        default:
+            if ((n = singleStatement()) == NULL) {
+                continue; // a declaration
+            }
+        }
+
+        if (body == NULL) {
+            body = n;
+        } else {
+            body = makeASTNode(A_GLUE, body, NULL, n, 0);
+        }
+    }
+    closeScope();
+    rightBrace();
+    switchDepth--;
+
+    checkCaseValues(values, valueCount);
+    return makeASTNode(A_SWITCH, selector, NULL, body, 0);
+}
+
+/**
+ * breakStatement - Parse a break statement.
+ *
+ * @return AST node representing the break statement.
+ */
+static struct ASTnode *breakStatement(void) {
+    if (switchDepth == 0 && loopDepth == 0) {
+        logFatal("break outside of a switch or loop");
+    }
+    match(T_BREAK, "break");
+    semicolon();
+    return makeASTLeaf(A_BREAK, 0);
+}
+
+/**
+ * returnStatement - Parse a return statement.
+ *
+ * @return AST node representing the return statement.
+ */
+static struct ASTnode *returnStatement(void) {
+    struct ASTnode *tree;
+
+    if (!inFunction) {
+        logFatal("return outside of a function");
+    }
+    match(T_RETURN, "return");
+    tree = makeASTUnary(A_RETURN, binexpr(0), 0);
+    semicolon();
+    return tree;
+}
+
+/**
+ * functionBody - Parse the body of a function, whose parameters are
+ * already in scope (see functionDeclaration()).
+ *
+ * @return AST node representing the body.
+ */
+struct ASTnode *functionBody(void) {
+    struct ASTnode *body;
+    int outerSwitchDepth = switchDepth, outerLoopDepth = loopDepth;
+
+    // A break in the body cannot leave the function
+    inFunction = 1;
+    switchDepth = loopDepth = 0;
+    body = compoundStatement();
+    switchDepth = outerSwitchDepth;
+    loopDepth = outerLoopDepth;
+    inFunction = 0;
+    return body;
+}
+
+/**
+ * statement - Parse one statement, see singleStatement().
+ *
+ * @return AST node representing the statement
+ *         (NULL for declarations of globals, which have no AST node).
+ */
+static struct ASTnode *statement(void) {
+    switch (Token.token) {
+    case T_PRINT:
+        return printStatement();
+    case T_INT:
+        // Inside any block but the program's, a local
+        return declaration(statementDepth == 1);
+    case T_IDENTIFIER:
+        return assignmentStatement();
+    case T_IF:
+        return ifStatement();
+    case T_SWITCH:
+        return switchStatement();
+    case T_WHILE:
+        return whileStatement();
+    case T_FOR:
+        return forStatement();
+    case T_BREAK:
+        return breakStatement();
+    case T_RETURN:
+        return returnStatement();
+    default:
+        logFatal("Unexpected token in compound statement");
+    }
+    return NULL;
+}
+
+/**
+ * singleStatement - Parse one statement of a compound statement.
+ *
+ * @return AST node representing the statement
+ *         (NULL for declarations of globals, which have no AST node).
+ */
+struct ASTnode *singleStatement(void) {
+    struct ASTnode *tree;
+
+    statementDepth++;
+    tree = statement();
+    statementDepth--;
+    return tree;
+}
+
 /**
  * compoundStatement - Parse and handle a compound statement.
  *
@@ -152,31 +524,18 @@ struct ASTnode *compoundStatement(void) {
     // It requires, at least, a left curly bracket '{'
     // when code starts
     leftBrace();
+    openScope(); // the locals declared in it
 
     while (true) {
-        switch (Token.token) {
-        case T_PRINT:
-            treeNode = printStatement();
-            break;
-        case T_INT:
-            variableDeclaration();
-            treeNode = NULL; // No AST node for declarations
-            break;
-        case T_IDENTIFIER:
-            treeNode = assignmentStatement();
-            break;
-        case T_IF:
-            treeNode = ifStatement();
-            break;
-        case T_RBRACE:
+        if (Token.token == T_RBRACE) {
             // When we hit the right curly bracket,
             // we are done with this compound statement.
             // Return the left AST node.
+            closeScope();
             rightBrace();
             return leftASTNode;
-        default:
-            logFatal("Unexpected token in compound statement");
         }
+        treeNode = singleStatement();
 
         /**
          * For each new tree, either save it in left
@@ -223,3 +582,15 @@ struct ASTnode *compoundStatement(void) {
         }
     }
 }
+
+/**
+ * parseReset - Forgets the statements being parsed, after a fatal
+ * error left some unfinished.
+ */
+void parseReset(void) {
+    switchDepth = 0;
+    loopDepth = 0;
+    statementDepth = 0;
+    inFunction = 0;
+    resetScopes();
+}
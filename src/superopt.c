@@ -0,0 +1,336 @@
+// src/superopt.c
+
+/**
+ * NOTE:
+ * Superoptimizer for multiplication by a constant (offline)
+ *
+ * imul takes 3 cycles, a shift, add or lea one. `keccc --superopt`
+ * tries every sequence of up to SUPEROPT_LENGTH instructions over the
+ * operand x and one scratch register t (rax), built from mov, add, sub,
+ * imul, lea, shl, sar and neg, and keeps for each multiplier c the
+ * fastest sequence leaving x * c in x:
+ * ----------------------------------------
+ *   x * 6:   add     x, x            x * -7:  lea     t, [x*8]
+ *            lea     x, [x+x*2]               sub     x, t
+ * ----------------------------------------
+ * Candidates run on a model of the two registers. A sequence's
+ * multiplier is what it makes of x = 1, and it is accepted only if it
+ * then agrees with x * c on random 64-bit values and on every x in
+ * [-SUPEROPT_DOMAIN, SUPEROPT_DOMAIN], with garbage in t at the start
+ * (so a sequence reading t before writing it fails).
+ *
+ * Those faster than imul are written out as the table in superopt.h,
+ * which cgn.c and isel.c use. The table is checked in; regenerate it
+ * after changing this file:
+ * ----------------------------------------
+ *   ./src/keccc --superopt > src/superopt.h
+ * ----------------------------------------
+ */
+
+#include "data.h"
+#include "decl.h"
+
+// Longest sequence tried
+#define SUPEROPT_LENGTH 3
+// Largest multiplier recorded, either way
+#define SUPEROPT_RANGE 65536
+// Every x in [-SUPEROPT_DOMAIN, SUPEROPT_DOMAIN] is tried
+#define SUPEROPT_DOMAIN 1024
+// Number of random 64-bit values tried
+#define SUPEROPT_SAMPLES 64
+// Cycles taken by imul, which a sequence has to beat
+#define IMUL_CYCLES 3
+
+// The registers of the model
+#define X 0
+#define T 1
+
+enum { I_ADD, I_SUB, I_NEG, I_SHL, I_SAR, I_LEA, I_LEAINDEX, I_MOV, I_IMUL };
+
+// An instruction: d = op(a, b), with k a shift count or lea scale
+struct insn {
+    int op, d, a, b, k;
+};
+
+// The best sequence found for a multiplier
+struct best {
+    struct insn code[SUPEROPT_LENGTH];
+    int length; // 0 if none
+    int cycles;
+};
+
+static struct insn insns[256];
+static int insnCount;
+static uint64_t samples[SUPEROPT_SAMPLES], garbage[SUPEROPT_SAMPLES];
+
+/**
+ * addInsn - Adds an instruction to those tried.
+ */
+static void addInsn(int op, int d, int a, int b, int k) {
+    insns[insnCount++] = (struct insn){op, d, a, b, k};
+}
+
+/**
+ * buildInsns - Lists every instruction over x and t; those tried first
+ * win ties, so the plain ones come first.
+ */
+static void buildInsns(void) {
+    for (int d = X; d <= T; d++) {
+        for (int s = X; s <= T; s++) {
+            addInsn(I_ADD, d, s, 0, 0);
+            addInsn(I_SUB, d, s, 0, 0);
+        }
+        addInsn(I_NEG, d, 0, 0, 0);
+        for (int k = 1; k <= 16; k++) {
+            addInsn(I_SHL, d, 0, 0, k);
+            addInsn(I_SAR, d, 0, 0, k);
+        }
+        for (int a = X; a <= T; a++) {
+            for (int b = X; b <= T; b++) {
+                for (int k = 1; k <= 8; k *= 2) {
+                    addInsn(I_LEA, d, a, b, k);
+                }
+            }
+        }
+        for (int b = X; b <= T; b++) {
+            for (int k = 2; k <= 8; k *= 2) {
+                addInsn(I_LEAINDEX, d, 0, b, k);
+            }
+        }
+        addInsn(I_MOV, d, d == X ? T : X, 0, 0);
+        for (int s = X; s <= T; s++) {
+            addInsn(I_IMUL, d, s, 0, 0);
+        }
+    }
+}
+
+/**
+ * insnCycles - Returns the latency of an instruction (a register move
+ * is eliminated at rename).
+ */
+static int insnCycles(struct insn *i) {
+    switch (i->op) {
+    case I_MOV:
+        return 0;
+    case I_IMUL:
+        return IMUL_CYCLES;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * run - Runs a sequence on the model.
+ *
+ * @code: The sequence.
+ * @length: Its number of instructions.
+ * @x: The value in x at the start.
+ * @t: The value in t at the start.
+ *
+ * @return The value in x at the end.
+ */
+static uint64_t run(struct insn *code, int length, uint64_t x, uint64_t t) {
+    uint64_t r[2] = {x, t};
+
+    for (struct insn *i = code; i < code + length; i++) {
+        switch (i->op) {
+        case I_ADD:
+            r[i->d] += r[i->a];
+            break;
+        case I_SUB:
+            r[i->d] -= r[i->a];
+            break;
+        case I_NEG:
+            r[i->d] = -r[i->d];
+            break;
+        case I_SHL:
+            r[i->d] <<= i->k;
+            break;
+        case I_SAR:
+            r[i->d] = (uint64_t)((int64_t)r[i->d] >> i->k);
+            break;
+        case I_LEA:
+            r[i->d] = r[i->a] + r[i->b] * i->k;
+            break;
+        case I_LEAINDEX:
+            r[i->d] = r[i->b] * i->k;
+            break;
+        case I_MOV:
+            r[i->d] = r[i->a];
+            break;
+        case I_IMUL:
+            r[i->d] *= r[i->a];
+            break;
+        }
+    }
+    return r[X];
+}
+
+/**
+ * computes - Checks whether a sequence computes x * c, see the note at
+ * the top of this file.
+ */
+static int computes(struct insn *code, int length, int64_t c) {
+    for (int i = 0; i < SUPEROPT_SAMPLES; i++) {
+        if (run(code, length, samples[i], garbage[i]) !=
+            samples[i] * (uint64_t)c) {
+            return 0;
+        }
+    }
+    for (int64_t x = -SUPEROPT_DOMAIN; x <= SUPEROPT_DOMAIN; x++) {
+        if (run(code, length, (uint64_t)x, garbage[x & 1]) !=
+            (uint64_t)(x * c)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * search - Tries every sequence of a given length.
+ *
+ * @code: The sequence, of which the first depth instructions are set.
+ * @depth: Number of instructions set so far.
+ * @length: The length tried.
+ * @cycles: The cycles taken by the instructions set so far.
+ * @best: The best sequence so far for every multiplier.
+ */
+static void search(struct insn *code, int depth, int length, int cycles,
+                   struct best *best) {
+    int64_t c;
+    struct best *b;
+
+    if (cycles >= IMUL_CYCLES) {
+        return;
+    }
+    if (depth < length) {
+        for (int i = 0; i < insnCount; i++) {
+            code[depth] = insns[i];
+            search(code, depth + 1, length, cycles + insnCycles(&insns[i]),
+                   best);
+        }
+        return;
+    }
+
+    c = (int64_t)run(code, length, 1, garbage[0]);
+    if (c < -SUPEROPT_RANGE || c > SUPEROPT_RANGE || c == 0 || c == 1) {
+        return;
+    }
+    // Shorter sequences were all tried first
+    b = &best[c + SUPEROPT_RANGE];
+    if (b->length != 0 && b->cycles <= cycles) {
+        return;
+    }
+    if (computes(code, length, c)) {
+        memcpy(b->code, code, length * sizeof(*code));
+        b->length = length;
+        b->cycles = cycles;
+    }
+}
+
+/**
+ * registerName - Returns the template text of a model register.
+ */
+static char *registerName(int r) { return r == X ? "%1" : "rax"; }
+
+/**
+ * printInsn - Writes an instruction in template form.
+ */
+static void printInsn(struct insn *i) {
+    static char *names[] = {"add", "sub", "neg", "shl", "sar",
+                            "lea", "lea", "mov", "imul"};
+    char *d = registerName(i->d);
+
+    printf("%s\\t%s", names[i->op], d);
+    switch (i->op) {
+    case I_NEG:
+        break;
+    case I_SHL:
+    case I_SAR:
+        printf(", %d", i->k);
+        break;
+    case I_LEA:
+        printf(", [%s+%s", registerName(i->a), registerName(i->b));
+        if (i->k > 1) {
+            printf("*%d", i->k);
+        }
+        printf("]");
+        break;
+    case I_LEAINDEX:
+        printf(", [%s*%d]", registerName(i->b), i->k);
+        break;
+    default:
+        printf(", %s", registerName(i->a));
+        break;
+    }
+}
+
+/**
+ * printTable - Writes superopt.h.
+ */
+static void printTable(struct best *best) {
+    printf("// src/superopt.h\n"
+           "// Generated by `keccc --superopt` (see superopt.c), do not "
+           "edit.\n\n"
+           "/**\n"
+           " * Instruction sequences multiplying a register by a constant "
+           "in fewer\n"
+           " * cycles than imul (%d), by multiplier. %%1 is the register, "
+           "and rax\n"
+           " * is scratch.\n"
+           " */\n\n"
+           "struct superoptRule {\n"
+           "    int multiplier;\n"
+           "    int cycles;\n"
+           "    char *sequence;\n"
+           "};\n\n"
+           "static const struct superoptRule superoptRules[] = {\n",
+           IMUL_CYCLES);
+    for (int c = -SUPEROPT_RANGE; c <= SUPEROPT_RANGE; c++) {
+        struct best *b = &best[c + SUPEROPT_RANGE];
+        if (b->length == 0) {
+            continue;
+        }
+        printf("    {%d, %d, \"", c, b->cycles);
+        for (int i = 0; i < b->length; i++) {
+            if (i > 0) {
+                printf("\\n");
+            }
+            printInsn(&b->code[i]);
+        }
+        printf("\"},\n");
+    }
+    printf("};\n");
+}
+
+/**
+ * superoptRun - Searches the sequences and writes the table to standard
+ * output (--superopt).
+ *
+ * @return The exit status.
+ */
+int superoptRun(void) {
+    struct insn code[SUPEROPT_LENGTH];
+    struct best *best;
+    uint64_t seed = 0x9e3779b97f4a7c15u;
+
+    // Fixed random values, so the table comes out the same every time
+    for (int i = 0; i < SUPEROPT_SAMPLES; i++) {
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+        samples[i] = seed;
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+        garbage[i] = seed;
+    }
+    if ((best = calloc(2 * SUPEROPT_RANGE + 1, sizeof(*best))) == NULL) {
+        fprintf(stderr, "Out of memory while superoptimizing\n");
+        return 1;
+    }
+
+    buildInsns();
+    for (int length = 1; length <= SUPEROPT_LENGTH; length++) {
+        search(code, 0, length, 0, best);
+    }
+    printTable(best);
+    free(best);
+    return 0;
+}
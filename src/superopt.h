@@ -0,0 +1,176 @@
+// src/superopt.h
+// Generated by `keccc --superopt` (see superopt.c), do not edit.
+
+/**
+ * Instruction sequences multiplying a register by a constant in fewer
+ * cycles than imul (3), by multiplier. %1 is the register, and rax
+ * is scratch.
+ */
+
+struct superoptRule {
+    int multiplier;
+    int cycles;
+    char *sequence;
+};
+
+static const struct superoptRule superoptRules[] = {
+    {-65536, 2, "neg\t%1\nshl\t%1, 16"},
+    {-65535, 2, "mov\trax, %1\nshl\trax, 16\nsub\t%1, rax"},
+    {-32768, 2, "neg\t%1\nshl\t%1, 15"},
+    {-32767, 2, "mov\trax, %1\nshl\trax, 15\nsub\t%1, rax"},
+    {-16384, 2, "neg\t%1\nshl\t%1, 14"},
+    {-16383, 2, "mov\trax, %1\nshl\trax, 14\nsub\t%1, rax"},
+    {-8192, 2, "neg\t%1\nshl\t%1, 13"},
+    {-8191, 2, "mov\trax, %1\nshl\trax, 13\nsub\t%1, rax"},
+    {-4096, 2, "neg\t%1\nshl\t%1, 12"},
+    {-4095, 2, "mov\trax, %1\nshl\trax, 12\nsub\t%1, rax"},
+    {-2048, 2, "neg\t%1\nshl\t%1, 11"},
+    {-2047, 2, "mov\trax, %1\nshl\trax, 11\nsub\t%1, rax"},
+    {-1024, 2, "neg\t%1\nshl\t%1, 10"},
+    {-1023, 2, "mov\trax, %1\nshl\trax, 10\nsub\t%1, rax"},
+    {-512, 2, "neg\t%1\nshl\t%1, 9"},
+    {-511, 2, "mov\trax, %1\nshl\trax, 9\nsub\t%1, rax"},
+    {-256, 2, "neg\t%1\nshl\t%1, 8"},
+    {-255, 2, "mov\trax, %1\nshl\trax, 8\nsub\t%1, rax"},
+    {-128, 2, "neg\t%1\nshl\t%1, 7"},
+    {-127, 2, "mov\trax, %1\nshl\trax, 7\nsub\t%1, rax"},
+    {-64, 2, "neg\t%1\nshl\t%1, 6"},
+    {-63, 2, "mov\trax, %1\nshl\trax, 6\nsub\t%1, rax"},
+    {-32, 2, "neg\t%1\nshl\t%1, 5"},
+    {-31, 2, "mov\trax, %1\nshl\trax, 5\nsub\t%1, rax"},
+    {-16, 2, "neg\t%1\nshl\t%1, 4"},
+    {-15, 2, "mov\trax, %1\nshl\trax, 4\nsub\t%1, rax"},
+    {-9, 2, "neg\t%1\nlea\t%1, [%1+%1*8]"},
+    {-8, 2, "neg\t%1\nshl\t%1, 3"},
+    {-7, 2, "lea\trax, [%1*8]\nsub\t%1, rax"},
+    {-5, 2, "neg\t%1\nlea\t%1, [%1+%1*4]"},
+    {-4, 2, "neg\t%1\nshl\t%1, 2"},
+    {-3, 2, "neg\t%1\nlea\t%1, [%1+%1*2]"},
+    {-2, 2, "add\t%1, %1\nneg\t%1"},
+    {-1, 1, "neg\t%1"},
+    {2, 1, "add\t%1, %1"},
+    {3, 1, "lea\t%1, [%1+%1*2]"},
+    {4, 1, "shl\t%1, 2"},
+    {5, 1, "lea\t%1, [%1+%1*4]"},
+    {6, 2, "add\t%1, %1\nlea\t%1, [%1+%1*2]"},
+    {7, 2, "lea\trax, [%1+%1*2]\nlea\t%1, [%1+rax*2]"},
+    {8, 1, "shl\t%1, 3"},
+    {9, 1, "lea\t%1, [%1+%1*8]"},
+    {10, 2, "add\t%1, %1\nlea\t%1, [%1+%1*4]"},
+    {11, 2, "lea\trax, [%1+%1*2]\nlea\t%1, [rax+%1*8]"},
+    {12, 2, "shl\t%1, 2\nlea\t%1, [%1+%1*2]"},
+    {13, 2, "lea\trax, [%1+%1*2]\nlea\t%1, [%1+rax*4]"},
+    {15, 2, "lea\t%1, [%1+%1*2]\nlea\t%1, [%1+%1*4]"},
+    {16, 1, "shl\t%1, 4"},
+    {17, 2, "lea\trax, [%1+%1]\nlea\t%1, [%1+rax*8]"},
+    {18, 2, "add\t%1, %1\nlea\t%1, [%1+%1*8]"},
+    {19, 2, "lea\trax, [%1+%1*8]\nlea\t%1, [%1+rax*2]"},
+    {20, 2, "shl\t%1, 2\nlea\t%1, [%1+%1*4]"},
+    {21, 2, "lea\trax, [%1+%1*4]\nlea\t%1, [%1+rax*4]"},
+    {24, 2, "shl\t%1, 3\nlea\t%1, [%1+%1*2]"},
+    {25, 2, "lea\t%1, [%1+%1*4]\nlea\t%1, [%1+%1*4]"},
+    {27, 2, "lea\t%1, [%1+%1*2]\nlea\t%1, [%1+%1*8]"},
+    {31, 2, "mov\trax, %1\nshl\t%1, 5\nsub\t%1, rax"},
+    {32, 1, "shl\t%1, 5"},
+    {33, 2, "lea\trax, [%1*4]\nlea\t%1, [%1+rax*8]"},
+    {34, 2, "mov\trax, %1\nshl\t%1, 5\nlea\t%1, [%1+rax*2]"},
+    {36, 2, "shl\t%1, 2\nlea\t%1, [%1+%1*8]"},
+    {37, 2, "lea\trax, [%1+%1*8]\nlea\t%1, [%1+rax*4]"},
+    {40, 2, "shl\t%1, 3\nlea\t%1, [%1+%1*4]"},
+    {41, 2, "lea\trax, [%1+%1*4]\nlea\t%1, [%1+rax*8]"},
+    {45, 2, "lea\t%1, [%1+%1*4]\nlea\t%1, [%1+%1*8]"},
+    {48, 2, "shl\t%1, 4\nlea\t%1, [%1+%1*2]"},
+    {63, 2, "mov\trax, %1\nshl\t%1, 6\nsub\t%1, rax"},
+    {64, 1, "shl\t%1, 6"},
+    {65, 2, "lea\trax, [%1*8]\nlea\t%1, [%1+rax*8]"},
+    {66, 2, "mov\trax, %1\nshl\t%1, 6\nlea\t%1, [%1+rax*2]"},
+    {68, 2, "mov\trax, %1\nshl\t%1, 6\nlea\t%1, [%1+rax*4]"},
+    {72, 2, "shl\t%1, 3\nlea\t%1, [%1+%1*8]"},
+    {73, 2, "lea\trax, [%1+%1*8]\nlea\t%1, [%1+rax*8]"},
+    {80, 2, "shl\t%1, 4\nlea\t%1, [%1+%1*4]"},
+    {81, 2, "lea\t%1, [%1+%1*8]\nlea\t%1, [%1+%1*8]"},
+    {96, 2, "shl\t%1, 5\nlea\t%1, [%1+%1*2]"},
+    {127, 2, "mov\trax, %1\nshl\t%1, 7\nsub\t%1, rax"},
+    {128, 1, "shl\t%1, 7"},
+    {129, 2, "mov\trax, %1\nshl\t%1, 4\nlea\t%1, [rax+%1*8]"},
+    {130, 2, "mov\trax, %1\nshl\t%1, 7\nlea\t%1, [%1+rax*2]"},
+    {132, 2, "mov\trax, %1\nshl\t%1, 7\nlea\t%1, [%1+rax*4]"},
+    {136, 2, "mov\trax, %1\nshl\t%1, 7\nlea\t%1, [%1+rax*8]"},
+    {144, 2, "shl\t%1, 4\nlea\t%1, [%1+%1*8]"},
+    {160, 2, "shl\t%1, 5\nlea\t%1, [%1+%1*4]"},
+    {192, 2, "shl\t%1, 6\nlea\t%1, [%1+%1*2]"},
+    {255, 2, "mov\trax, %1\nshl\t%1, 8\nsub\t%1, rax"},
+    {256, 1, "shl\t%1, 8"},
+    {257, 2, "mov\trax, %1\nshl\t%1, 5\nlea\t%1, [rax+%1*8]"},
+    {258, 2, "mov\trax, %1\nshl\t%1, 8\nlea\t%1, [%1+rax*2]"},
+    {260, 2, "mov\trax, %1\nshl\t%1, 8\nlea\t%1, [%1+rax*4]"},
+    {264, 2, "mov\trax, %1\nshl\t%1, 8\nlea\t%1, [%1+rax*8]"},
+    {288, 2, "shl\t%1, 5\nlea\t%1, [%1+%1*8]"},
+    {320, 2, "shl\t%1, 6\nlea\t%1, [%1+%1*4]"},
+    {384, 2, "shl\t%1, 7\nlea\t%1, [%1+%1*2]"},
+    {511, 2, "mov\trax, %1\nshl\t%1, 9\nsub\t%1, rax"},
+    {512, 1, "shl\t%1, 9"},
+    {513, 2, "mov\trax, %1\nshl\t%1, 6\nlea\t%1, [rax+%1*8]"},
+    {514, 2, "mov\trax, %1\nshl\t%1, 9\nlea\t%1, [%1+rax*2]"},
+    {516, 2, "mov\trax, %1\nshl\t%1, 9\nlea\t%1, [%1+rax*4]"},
+    {520, 2, "mov\trax, %1\nshl\t%1, 9\nlea\t%1, [%1+rax*8]"},
+    {576, 2, "shl\t%1, 6\nlea\t%1, [%1+%1*8]"},
+    {640, 2, "shl\t%1, 7\nlea\t%1, [%1+%1*4]"},
+    {768, 2, "shl\t%1, 8\nlea\t%1, [%1+%1*2]"},
+    {1023, 2, "mov\trax, %1\nshl\t%1, 10\nsub\t%1, rax"},
+    {1024, 1, "shl\t%1, 10"},
+    {1025, 2, "mov\trax, %1\nshl\t%1, 7\nlea\t%1, [rax+%1*8]"},
+    {1026, 2, "mov\trax, %1\nshl\t%1, 10\nlea\t%1, [%1+rax*2]"},
+    {1028, 2, "mov\trax, %1\nshl\t%1, 10\nlea\t%1, [%1+rax*4]"},
+    {1032, 2, "mov\trax, %1\nshl\t%1, 10\nlea\t%1, [%1+rax*8]"},
+    {1152, 2, "shl\t%1, 7\nlea\t%1, [%1+%1*8]"},
+    {1280, 2, "shl\t%1, 8\nlea\t%1, [%1+%1*4]"},
+    {1536, 2, "shl\t%1, 9\nlea\t%1, [%1+%1*2]"},
+    {2047, 2, "mov\trax, %1\nshl\t%1, 11\nsub\t%1, rax"},
+    {2048, 1, "shl\t%1, 11"},
+    {2049, 2, "mov\trax, %1\nshl\t%1, 8\nlea\t%1, [rax+%1*8]"},
+    {2050, 2, "mov\trax, %1\nshl\t%1, 11\nlea\t%1, [%1+rax*2]"},
+    {2052, 2, "mov\trax, %1\nshl\t%1, 11\nlea\t%1, [%1+rax*4]"},
+    {2056, 2, "mov\trax, %1\nshl\t%1, 11\nlea\t%1, [%1+rax*8]"},
+    {2304, 2, "shl\t%1, 8\nlea\t%1, [%1+%1*8]"},
+    {2560, 2, "shl\t%1, 9\nlea\t%1, [%1+%1*4]"},
+    {3072, 2, "shl\t%1, 10\nlea\t%1, [%1+%1*2]"},
+    {4095, 2, "mov\trax, %1\nshl\t%1, 12\nsub\t%1, rax"},
+    {4096, 1, "shl\t%1, 12"},
+    {4097, 2, "mov\trax, %1\nshl\t%1, 9\nlea\t%1, [rax+%1*8]"},
+    {4098, 2, "mov\trax, %1\nshl\t%1, 12\nlea\t%1, [%1+rax*2]"},
+    {4100, 2, "mov\trax, %1\nshl\t%1, 12\nlea\t%1, [%1+rax*4]"},
+    {4104, 2, "mov\trax, %1\nshl\t%1, 12\nlea\t%1, [%1+rax*8]"},
+    {4608, 2, "shl\t%1, 9\nlea\t%1, [%1+%1*8]"},
+    {5120, 2, "shl\t%1, 10\nlea\t%1, [%1+%1*4]"},
+    {6144, 2, "shl\t%1, 11\nlea\t%1, [%1+%1*2]"},
+    {8191, 2, "mov\trax, %1\nshl\t%1, 13\nsub\t%1, rax"},
+    {8192, 1, "shl\t%1, 13"},
+    {8193, 2, "mov\trax, %1\nshl\t%1, 10\nlea\t%1, [rax+%1*8]"},
+    {8194, 2, "mov\trax, %1\nshl\t%1, 13\nlea\t%1, [%1+rax*2]"},
+    {8196, 2, "mov\trax, %1\nshl\t%1, 13\nlea\t%1, [%1+rax*4]"},
+    {8200, 2, "mov\trax, %1\nshl\t%1, 13\nlea\t%1, [%1+rax*8]"},
+    {9216, 2, "shl\t%1, 10\nlea\t%1, [%1+%1*8]"},
+    {10240, 2, "shl\t%1, 11\nlea\t%1, [%1+%1*4]"},
+    {12288, 2, "shl\t%1, 12\nlea\t%1, [%1+%1*2]"},
+    {16383, 2, "mov\trax, %1\nshl\t%1, 14\nsub\t%1, rax"},
+    {16384, 1, "shl\t%1, 14"},
+    {16385, 2, "mov\trax, %1\nshl\t%1, 11\nlea\t%1, [rax+%1*8]"},
+    {16386, 2, "mov\trax, %1\nshl\t%1, 14\nlea\t%1, [%1+rax*2]"},
+    {16388, 2, "mov\trax, %1\nshl\t%1, 14\nlea\t%1, [%1+rax*4]"},
+    {16392, 2, "mov\trax, %1\nshl\t%1, 14\nlea\t%1, [%1+rax*8]"},
+    {18432, 2, "shl\t%1, 11\nlea\t%1, [%1+%1*8]"},
+    {20480, 2, "shl\t%1, 12\nlea\t%1, [%1+%1*4]"},
+    {24576, 2, "shl\t%1, 13\nlea\t%1, [%1+%1*2]"},
+    {32767, 2, "mov\trax, %1\nshl\t%1, 15\nsub\t%1, rax"},
+    {32768, 1, "shl\t%1, 15"},
+    {32769, 2, "mov\trax, %1\nshl\t%1, 12\nlea\t%1, [rax+%1*8]"},
+    {32770, 2, "mov\trax, %1\nshl\t%1, 15\nlea\t%1, [%1+rax*2]"},
+    {32772, 2, "mov\trax, %1\nshl\t%1, 15\nlea\t%1, [%1+rax*4]"},
+    {32776, 2, "mov\trax, %1\nshl\t%1, 15\nlea\t%1, [%1+rax*8]"},
+    {36864, 2, "shl\t%1, 12\nlea\t%1, [%1+%1*8]"},
+    {40960, 2, "shl\t%1, 13\nlea\t%1, [%1+%1*4]"},
+    {49152, 2, "shl\t%1, 14\nlea\t%1, [%1+%1*2]"},
+    {65535, 2, "mov\trax, %1\nshl\t%1, 16\nsub\t%1, rax"},
+    {65536, 1, "shl\t%1, 16"},
+};
@@ -3,20 +3,77 @@
 #include "data.h"
 #include "decl.h"
 #include "defs.h"
+#include <limits.h>
 
 // Position of the next free global symbol slot
-static int NextGlobalSymbolIndex = 0;
+static _Thread_local int NextGlobalSymbolIndex = 0;
+// Number of slots GlobalSymbolTable has room for
+static _Thread_local int symbolCapacity = 0;
+
+// Declarations and first uses logged while symbols are deferred
+// (see deferGlobalSymbols())
+static _Thread_local int deferring = 0;
+static _Thread_local struct symbolEvent *events = NULL;
+static _Thread_local int eventCount = 0;
+static _Thread_local int eventCapacity = 0;
+
+// Parameters and locals visible by name, innermost last
+// (see openScope())
+static _Thread_local int *scopeSymbols = NULL;
+static _Thread_local int scopeCount = 0, scopeCapacity = 0;
+// Where each open block's symbols start in scopeSymbols
+static _Thread_local int *blockStarts = NULL;
+static _Thread_local int blockCount = 0, blockCapacity = 0;
+
+/**
+ * growTable - Makes room for one more entry at the end of a table,
+ * doubling its capacity when it is full.
+ *
+ * @param table The table (NULL for none yet)
+ * @param count Number of entries in use
+ * @param capacity Number of entries it has room for, updated
+ * @param size Size of an entry
+ *
+ * @return The table, which may have moved.
+ *
+ * @note Logs a fatal error if there is no memory for it
+ */
+static void *growTable(void *table, int count, int *capacity, size_t size) {
+    if (count < *capacity) {
+        return table;
+    }
+    if (*capacity > INT_MAX / 2) {
+        logFatal("Too many symbols");
+    }
+    *capacity = *capacity ? *capacity * 2 : NSYMBOLS;
+    if ((table = realloc(table, (size_t)*capacity * size)) == NULL) {
+        logFatal("Out of memory for the symbol table");
+    }
+    return table;
+}
 
 /**
  * findGlobalSymbol - Find a global symbol in the symbol table.
  *
+ * NOTE:
+ * Parameters and locals are only found while their block is open,
+ * and then hide any other symbol of the same name, the innermost
+ * first (see openScope()).
+ *
  * @param s The name of the symbol to add
  *
  * @return The index of the symbol in the symbol table.
  */
 int findGlobalSymbol(char *s) {
+    for (int i = scopeCount - 1; i >= 0; i--) {
+        if (!strcmp(GlobalSymbolTable[scopeSymbols[i]].name, s)) {
+            return scopeSymbols[i];
+        }
+    }
     for (int i = 0; i < NextGlobalSymbolIndex; i++) {
-        if (!strcmp(GlobalSymbolTable[i].name, s)) {
+        if (GlobalSymbolTable[i].kind != S_PARAMETER &&
+            GlobalSymbolTable[i].kind != S_LOCAL &&
+            !strcmp(GlobalSymbolTable[i].name, s)) {
             return i;
         }
     }
@@ -28,16 +85,41 @@ int findGlobalSymbol(char *s) {
  *
  * @return The new index for the global symbol
  *
- * @note Logs a fatal error if the symbol table is full
+ * NOTE:
+ * The table grows as needed, so any pointer into it is only good
+ * until the next symbol is added.
+ *
+ * @note Logs a fatal error if there is no memory for it
  */
 static int getNewGlobalSymbolIndex(void) {
-    int p;
+    GlobalSymbolTable =
+        growTable(GlobalSymbolTable, NextGlobalSymbolIndex, &symbolCapacity,
+                  sizeof(*GlobalSymbolTable));
+
+    return NextGlobalSymbolIndex++;
+}
 
-    if ((p = NextGlobalSymbolIndex++) >= NSYMBOLS) {
-        logFatal("Too many global symbols");
+/**
+ * newGlobalSymbol - Add a symbol that is not declared yet.
+ *
+ * @param name The name of the symbol
+ *
+ * @return The index of the new symbol.
+ */
+static int newGlobalSymbol(char *name) {
+    int symbolIndex = getNewGlobalSymbolIndex();
+
+    GlobalSymbolTable[symbolIndex].name = strdup(name);
+    if (GlobalSymbolTable[symbolIndex].name == NULL) {
+        logFatal("Memory allocation failed for symbol name");
     }
+    GlobalSymbolTable[symbolIndex].kind = S_VARIABLE;
+    GlobalSymbolTable[symbolIndex].length = -1;
+    GlobalSymbolTable[symbolIndex].parameters = 0;
+    GlobalSymbolTable[symbolIndex].position = 0;
+    GlobalSymbolTable[symbolIndex].location = 0;
 
-    return p;
+    return symbolIndex;
 }
 
 /**
@@ -57,11 +139,288 @@ int addGlobalSymbol(char *name) {
         return symbolIndex;
     }
 
-    symbolIndex = getNewGlobalSymbolIndex();
-    GlobalSymbolTable[symbolIndex].name = strdup(name);
-    if (GlobalSymbolTable[symbolIndex].name == NULL) {
-        logFatal("Memory allocation failed for symbol name");
+    return newGlobalSymbol(name);
+}
+
+/**
+ * logSymbolEvent - Appends to the deferred symbol log.
+ *
+ * @param declaration 1 for a declaration, 0 for a first use.
+ * @param id The symbol index; a declaration logs what it declared.
+ */
+static void logSymbolEvent(int declaration, int id) {
+    if (eventCount == eventCapacity) {
+        eventCapacity = eventCapacity ? eventCapacity * 2 : 64;
+        events = realloc(events, eventCapacity * sizeof(*events));
+        if (events == NULL) {
+            logFatal("Out of memory while logging symbols");
+        }
     }
+    events[eventCount].declaration = declaration;
+    events[eventCount].id = id;
+    events[eventCount].kind = GlobalSymbolTable[id].kind;
+    events[eventCount].length = GlobalSymbolTable[id].length;
+    events[eventCount].parameters = GlobalSymbolTable[id].parameters;
+    events[eventCount].position = GlobalSymbolTable[id].position;
+    eventCount++;
+}
 
-    return symbolIndex;
+/**
+ * declareGlobalSymbol - Declare a global variable (`int name;`)
+ * or array (`int name[length];`).
+ *
+ * @param name The name of the variable
+ * @param length Number of elements of an array, 0 for an int
+ *
+ * @return The index of the symbol in the symbol table.
+ *
+ * @note Logs a fatal error if the name was declared as the other kind
+ */
+int declareGlobalSymbol(char *name, int length) {
+    int id = addGlobalSymbol(name);
+
+    if (GlobalSymbolTable[id].length != -1 &&
+        (GlobalSymbolTable[id].kind != S_VARIABLE ||
+         GlobalSymbolTable[id].length != length)) {
+        logFatals("Conflicting declaration of ", name);
+    }
+    GlobalSymbolTable[id].length = length;
+
+    if (deferring) {
+        logSymbolEvent(1, id);
+    } else {
+        codegenDeclareGlobalSymbol(GlobalSymbolTable[id].name, length);
+    }
+    return id;
+}
+
+/**
+ * declareFunction - Declare a function (`int name(...)`), before its
+ * body is parsed so the body may call it.
+ *
+ * @param name The name of the function
+ * @param parameters Number of parameters
+ *
+ * @return The index of the symbol in the symbol table.
+ *
+ * @note Logs a fatal error if the name is already declared
+ */
+int declareFunction(char *name, int parameters) {
+    int id = addGlobalSymbol(name);
+
+    if (GlobalSymbolTable[id].length != -1) {
+        logFatals("Conflicting declaration of ", name);
+    }
+    GlobalSymbolTable[id].kind = S_FUNCTION;
+    GlobalSymbolTable[id].length = 0;
+    GlobalSymbolTable[id].parameters = parameters;
+
+    if (deferring) {
+        logSymbolEvent(1, id);
+    }
+    return id;
+}
+
+/**
+ * addParameter - Add a parameter of a function.
+ *
+ * NOTE:
+ * Every parameter gets a symbol of its own, even if another function
+ * has one of the same name; it is only found by name once added to
+ * the scope of its function's body (see addToScope()).
+ *
+ * @param name The name of the parameter
+ * @param position Its position (0 for the first)
+ *
+ * @return The index of the symbol in the symbol table.
+ */
+int addParameter(char *name, int position) {
+    int id = newGlobalSymbol(name);
+
+    GlobalSymbolTable[id].kind = S_PARAMETER;
+    GlobalSymbolTable[id].length = 0;
+    GlobalSymbolTable[id].position = position;
+
+    if (deferring) {
+        logSymbolEvent(1, id);
+    }
+    return id;
+}
+
+/**
+ * addLocalSymbol - Add a local variable (`int name;` inside a block).
+ *
+ * NOTE:
+ * Like a parameter, every local gets a symbol of its own and is not
+ * found by name until it is added to a scope. The inliner and the AST
+ * loaders add locals that the source never names.
+ *
+ * @param name The name of the local
+ *
+ * @return The index of the symbol in the symbol table.
+ */
+int addLocalSymbol(char *name) {
+    int id = newGlobalSymbol(name);
+
+    GlobalSymbolTable[id].kind = S_LOCAL;
+    GlobalSymbolTable[id].length = 0;
+
+    if (deferring) {
+        logSymbolEvent(1, id);
+    }
+    return id;
+}
+
+/**
+ * openScope - Opens a block, whose locals hide the symbols of the
+ * same name outside it until closeScope().
+ */
+void openScope(void) {
+    blockStarts = growTable(blockStarts, blockCount, &blockCapacity,
+                            sizeof(*blockStarts));
+    blockStarts[blockCount++] = scopeCount;
+}
+
+/**
+ * closeScope - Closes the innermost block; its locals are no longer
+ * found by name.
+ */
+void closeScope(void) {
+    scopeCount = blockStarts[--blockCount];
+}
+
+/**
+ * addToScope - Makes a parameter or local visible by name in the
+ * innermost block.
+ *
+ * @param id The symbol index.
+ *
+ * @note Logs a fatal error if the block already has the name
+ */
+void addToScope(int id) {
+    char *name = GlobalSymbolTable[id].name;
+
+    for (int i = blockCount ? blockStarts[blockCount - 1] : 0;
+         i < scopeCount; i++) {
+        if (!strcmp(GlobalSymbolTable[scopeSymbols[i]].name, name)) {
+            logFatals("Conflicting declaration of ", name);
+        }
+    }
+    scopeSymbols = growTable(scopeSymbols, scopeCount, &scopeCapacity,
+                             sizeof(*scopeSymbols));
+    scopeSymbols[scopeCount++] = id;
+}
+
+/**
+ * resetScopes - Closes every block, after a fatal error left some open.
+ */
+void resetScopes(void) {
+    scopeCount = 0;
+    blockCount = 0;
+}
+
+/**
+ * useGlobalSymbol - Find the symbol an identifier in the source refers to.
+ *
+ * NOTE:
+ * While symbols are deferred, a name that has not been declared yet
+ * is added anyway, and the use is logged to be checked later.
+ *
+ * @param name The identifier
+ *
+ * @return The index of the symbol, or -1 if it is undeclared.
+ */
+int useGlobalSymbol(char *name) {
+    int id = findGlobalSymbol(name);
+
+    if (id == -1 && deferring) {
+        id = addGlobalSymbol(name);
+        logSymbolEvent(0, id);
+    }
+    return id;
+}
+
+/**
+ * deferGlobalSymbols - Start logging declarations and uses instead of
+ * checking them and emitting the declarations.
+ *
+ * NOTE:
+ * Used by parallelparse.c, whose workers parse part of the program
+ * without knowing what the parts before it declare.
+ */
+void deferGlobalSymbols(void) {
+    deferring = 1;
+    eventCount = 0;
+}
+
+/**
+ * takeSymbolEvents - Stop deferring and hand over the log.
+ *
+ * @param count Receives the number of events.
+ *
+ * @return The events in source order (to be freed by the caller).
+ */
+struct symbolEvent *takeSymbolEvents(int *count) {
+    struct symbolEvent *log = events;
+
+    *count = eventCount;
+    deferring = 0;
+    events = NULL;
+    eventCount = eventCapacity = 0;
+    return log;
+}
+
+/**
+ * countGlobalSymbols - Get the number of symbols in the symbol table.
+ *
+ * @return The number of symbols (they occupy indices 0 .. count-1).
+ */
+int countGlobalSymbols(void) { return NextGlobalSymbolIndex; }
+
+/**
+ * borrowGlobalSymbols - Use a copy of another thread's symbol table,
+ * until releaseGlobalSymbols(); the names are still that thread's.
+ *
+ * @param table Its symbol table
+ * @param count Number of symbols in it
+ *
+ * @note Logs a fatal error if there is no memory for the copy
+ */
+void borrowGlobalSymbols(struct symbolTable *table, int count) {
+    releaseGlobalSymbols();
+    if (count > 0) {
+        GlobalSymbolTable = malloc(count * sizeof(*table));
+        if (GlobalSymbolTable == NULL) {
+            logFatal("Out of memory for the symbol table");
+        }
+        memcpy(GlobalSymbolTable, table, count * sizeof(*table));
+        symbolCapacity = count;
+    }
+    NextGlobalSymbolIndex = count;
+}
+
+/**
+ * releaseGlobalSymbols - Empty the symbol table without freeing the
+ * names, which belong to another thread or were handed over.
+ */
+void releaseGlobalSymbols(void) {
+    free(GlobalSymbolTable);
+    GlobalSymbolTable = NULL;
+    NextGlobalSymbolIndex = symbolCapacity = 0;
+    free(scopeSymbols);
+    scopeSymbols = NULL;
+    free(blockStarts);
+    blockStarts = NULL;
+    scopeCapacity = blockCapacity = 0;
+    resetScopes();
+}
+
+/**
+ * clearGlobalSymbols - Empty the symbol table.
+ */
+void clearGlobalSymbols(void) {
+    for (int i = 0; i < NextGlobalSymbolIndex; i++) {
+        free(GlobalSymbolTable[i].name);
+    }
+    releaseGlobalSymbols();
 }
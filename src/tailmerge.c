@@ -0,0 +1,149 @@
+// src/tailmerge.c
+
+/**
+ * NOTE:
+ * Tail merging of if statements (on the AST, -Os only)
+ *
+ * When both branches of an if statement end with the same statements,
+ * those are moved after it, so their code is generated once:
+ * ----------------------------------------
+ *   if (a < b) {                  if (a < b) {
+ *       x = 1;                        x = 1;
+ *       print x + y;       ->     } else {
+ *   } else {                          x = 2;
+ *       x = 2;                    }
+ *       print x + y;              print x + y;
+ *   }
+ * ----------------------------------------
+ * Whichever branch runs, the statements ran last, and a break or
+ * return before them skips them after the if just the same. Every
+ * local has a symbol of its own (see addLocalSymbol()), so statements
+ * naming a local declared in one branch never match the other's.
+ *
+ * Inner if statements are merged first, which may leave the outer ones
+ * with equal tails. A branch may end up empty; the condition is still
+ * evaluated.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+/**
+ * sameTree - Checks whether two trees are the same statements or
+ * expression.
+ */
+static int sameTree(struct ASTnode *a, struct ASTnode *b) {
+    // Down the left spine in a loop, see walkStatements()
+    for (; a != NULL && b != NULL; a = a->left, b = b->left) {
+        if (a->op != b->op || a->v.intvalue != b->v.intvalue ||
+            !sameTree(a->middle, b->middle) || !sameTree(a->right, b->right)) {
+            return 0;
+        }
+    }
+    return a == b;
+}
+
+/**
+ * lastStatement - Returns the last statement of a branch, or NULL if it
+ * has none.
+ */
+static struct ASTnode *lastStatement(struct ASTnode *branch) {
+    return branch != NULL && branch->op == A_GLUE ? branch->right : branch;
+}
+
+/**
+ * dropLast - Removes the last statement from a branch.
+ *
+ * @link: Where the branch hangs.
+ *
+ * @return The A_GLUE node that held the statement, or NULL if it was
+ *         the only one.
+ */
+static struct ASTnode *dropLast(struct ASTnode **link) {
+    struct ASTnode *glue = *link;
+
+    if (glue->op != A_GLUE) {
+        *link = NULL;
+        return NULL;
+    }
+    *link = glue->left;
+    return glue;
+}
+
+/**
+ * mergeIf - Moves the common tail of an if statement's branches after
+ * it, see the note at the top of this file.
+ *
+ * @link: Where the if statement hangs; it becomes the chain of the if
+ *        and the moved statements.
+ */
+static void mergeIf(struct ASTnode **link) {
+    struct ASTnode *n = *link, *glue, *t, *f;
+
+    // Take the statements from the last, each going right after the if
+    while ((t = lastStatement(n->middle)) != NULL &&
+           (f = lastStatement(n->right)) != NULL && sameTree(t, f)) {
+        free(dropLast(&n->right));
+        freeAST(f);
+        if ((glue = dropLast(&n->middle)) == NULL) {
+            glue = makeASTNode(A_GLUE, NULL, NULL, t, 0);
+            glue->line = n->line;
+        }
+        glue->left = n;
+        *link = glue;
+        link = &glue->left;
+    }
+}
+
+static void mergeTree(struct ASTnode **link);
+
+/**
+ * mergeStatement - Merges the if statements of one statement of a chain.
+ *
+ * @link: Where the statement hangs (see walkStatements()).
+ * @arg: Unused.
+ */
+static void mergeStatement(struct ASTnode **link, void *arg) {
+    (void)arg;
+    mergeTree(link);
+}
+
+/**
+ * mergeTree - Merges the if statements of a tree, innermost first.
+ *
+ * @link: Where the tree hangs.
+ */
+static void mergeTree(struct ASTnode **link) {
+    struct ASTnode *n = *link;
+
+    if (n == NULL) {
+        return;
+    }
+    if (n->op == A_GLUE) {
+        walkStatements(link, mergeStatement, NULL);
+        return;
+    }
+
+    mergeTree(&n->left);
+    mergeTree(&n->middle);
+    mergeTree(&n->right);
+    if (n->op == A_IF) {
+        mergeIf(link);
+    }
+}
+
+/**
+ * mergeTails - Moves the common tails of if/else branches after them
+ * under -Os, see the note at the top of this file.
+ *
+ * @tree: The program or statement (may be NULL).
+ *
+ * @return The tree (a statement may become a chain).
+ */
+struct ASTnode *mergeTails(struct ASTnode *tree) {
+    if (OptimizeSize) {
+        mergeTree(&tree);
+    }
+    return tree;
+}
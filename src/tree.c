@@ -4,9 +4,52 @@
 #include "decl.h"
 #include "defs.h"
 
+// Links of the statements walkStatements() has yet to visit (a stack:
+// the blocks inside a statement are walked while its chain is)
+static _Thread_local struct ASTnode ***walkStack = NULL;
+static _Thread_local int walkSize = 0, walkTop = 0;
+// Nodes made since trackNodes() was turned on (see there)
+static _Thread_local struct ASTnode **trackedNodes = NULL;
+static _Thread_local int trackedSize = 0, trackedCount = 0, tracking = 0;
+
+/**
+ * trackNodes - list the nodes made from now on, or stop listing them
+ *
+ * NOTE:
+ * A fatal error in the middle of parsing leaves the statements built so
+ * far in the parser's locals, out of reach of whoever recovers from it
+ * (libkeccc, the compile server, a parallelparse.c worker). So every
+ * node made while the parser runs is listed, and freeTrackedNodes()
+ * releases them all. Where a fatal error just exits, nothing is listed.
+ *
+ * @param on 1 to start a new list, 0 to forget it (the nodes are in a
+ *           finished tree then)
+ */
+void trackNodes(int on) {
+    tracking = on && hasFatalRecovery();
+    trackedCount = 0;
+}
+
+/**
+ * freeTrackedNodes - free the nodes listed since trackNodes() was
+ * turned on, and stop listing
+ */
+void freeTrackedNodes(void) {
+    if (tracking) {
+        for (int i = 0; i < trackedCount; i++) {
+            free(trackedNodes[i]);
+        }
+    }
+    trackNodes(0);
+}
+
 /**
  * makeASTNode - Build and return a generic ASt node
  *
+ * NOTE:
+ * The node remembers the current Line so the code generator
+ * can map the instructions it emits back to the source.
+ *
  * @param op       the operator
  * @param left     pointer to left subtree
  * @param middle   pointer to middle subtree
@@ -22,8 +65,8 @@ struct ASTnode *makeASTNode(int op, struct ASTnode *left,
 
     n = (struct ASTnode *)malloc(sizeof(struct ASTnode));
     if (n == NULL) {
-        fprintf(stderr, "out of memory in makeASTNode()\n");
-        exit(1);
+        fprintf(Errfile, "out of memory in makeASTNode()\n");
+        fatalExit();
     }
 
     n->op = op;
@@ -31,7 +74,25 @@ struct ASTnode *makeASTNode(int op, struct ASTnode *left,
     n->middle = middle;
     n->right = right;
     n->v.intvalue = intvalue;
+    n->line = Line;
+    n->liveLocals = 0;
+    n->refs = 0;
 
+    if (tracking) {
+        if (trackedCount == trackedSize) {
+            int size = trackedSize ? trackedSize * 2 : 1024;
+            struct ASTnode **nodes =
+                realloc(trackedNodes, size * sizeof(*trackedNodes));
+            if (nodes == NULL) {
+                free(n);
+                fprintf(Errfile, "out of memory in makeASTNode()\n");
+                fatalExit();
+            }
+            trackedNodes = nodes;
+            trackedSize = size;
+        }
+        trackedNodes[trackedCount++] = n;
+    }
     return n;
 }
 
@@ -59,3 +120,164 @@ struct ASTnode *makeASTLeaf(int op, int intvalue) {
 struct ASTnode *makeASTUnary(int op, struct ASTnode *left, int intvalue) {
     return makeASTNode(op, left, NULL, NULL, intvalue);
 }
+
+/**
+ * freeAST - release an AST and all of its subtrees
+ *
+ * @param n root of the tree (may be NULL)
+ */
+void freeAST(struct ASTnode *n) {
+    struct ASTnode *left;
+
+    // Down the left spine in a loop, see walkStatements()
+    while (n != NULL) {
+        if (n->refs > 0) {
+            n->refs--; // another parent still shares it
+            return;
+        }
+        left = n->left;
+        freeAST(n->middle);
+        freeAST(n->right);
+        free(n);
+        n = left;
+    }
+}
+
+/**
+ * copyAST - make a deep copy of an AST
+ *
+ * @param n root of the tree (may be NULL)
+ *
+ * @return pointer to the copy (NULL for an empty tree)
+ */
+struct ASTnode *copyAST(struct ASTnode *n) {
+    struct ASTnode *copy, *node, **link = &copy;
+
+    // Walk down the left spine like freeAST()
+    for (; n != NULL; n = n->left) {
+        node = makeASTNode(n->op, NULL, copyAST(n->middle), copyAST(n->right),
+                           n->v.intvalue);
+        node->line = n->line;
+        *link = node;
+        link = &node->left;
+    }
+    *link = NULL;
+    return copy;
+}
+
+/**
+ * pushStatement - push a statement's link onto the walk stack
+ *
+ * @param link where the statement hangs
+ */
+static void pushStatement(struct ASTnode **link) {
+    if (walkTop == walkSize) {
+        walkSize = walkSize ? walkSize * 2 : 256;
+        walkStack = realloc(walkStack, walkSize * sizeof(*walkStack));
+        if (walkStack == NULL) {
+            fprintf(Errfile, "out of memory in walkStatements()\n");
+            fatalExit();
+        }
+    }
+    walkStack[walkTop++] = link;
+}
+
+/**
+ * walkStatements - visit the statements of a chain in program order
+ *
+ * NOTE:
+ * compoundStatement() glues statements into a left-leaning chain,
+ * ----------------------------------------
+ *          A_GLUE
+ *          /    \
+ *      A_GLUE    s3
+ *      /    \
+ *    s1      s2
+ * ----------------------------------------
+ * as deep as the block is long, so a pass that recursed down it would
+ * run out of stack on a generated program of many thousands of
+ * statements. The spine is walked in a loop instead, here and in the
+ * tree helpers of this file.
+ *
+ * @param link  where the chain hangs
+ * @param visit called with where each statement hangs (empty ones are
+ *              skipped); it may replace the statement
+ * @param arg   passed on to visit
+ */
+void walkStatements(struct ASTnode **link,
+                    void (*visit)(struct ASTnode **link, void *arg),
+                    void *arg) {
+    int base = walkTop;
+
+    // Push the statements from the last one up to the first,
+    for (; *link != NULL && (*link)->op == A_GLUE; link = &(*link)->left) {
+        pushStatement(&(*link)->right);
+    }
+    pushStatement(link);
+
+    // then pop them in program order
+    while (walkTop > base) {
+        link = walkStack[--walkTop];
+        if (*link != NULL) {
+            visit(link, arg);
+        }
+    }
+}
+
+/**
+ * treeReset - free what a fatal error left unfinished: the nodes of a
+ * parse (see trackNodes()) and the walks
+ */
+void treeReset(void) {
+    freeTrackedNodes();
+    free(trackedNodes);
+    trackedNodes = NULL;
+    trackedSize = 0;
+    free(walkStack);
+    walkStack = NULL;
+    walkSize = walkTop = 0;
+}
+
+/**
+ * isComparison - check whether an AST operator is a comparison
+ *
+ * @param op the AST operator
+ *
+ * @return 1 if it is one of ==, !=, <, >, <= and >=, 0 otherwise
+ */
+int isComparison(int op) {
+    return op == A_EQ || op == A_NE || op == A_LT || op == A_GT ||
+           op == A_LE || op == A_GE;
+}
+
+/**
+ * hasCall - check whether a tree calls a function
+ *
+ * @param n root of the tree (may be NULL)
+ *
+ * @return 1 if it contains an A_CALL node, 0 otherwise
+ */
+int hasCall(struct ASTnode *n) {
+    for (; n != NULL; n = n->left) {
+        if (n->op == A_CALL || hasCall(n->middle) || hasCall(n->right)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * countArguments - count the arguments of a function call
+ *
+ * @param call the A_CALL node
+ *
+ * @return the number of arguments
+ */
+int countArguments(struct ASTnode *call) {
+    int count = 0;
+
+    for (struct ASTnode *a = call->left; a != NULL; a = a->right) {
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,628 @@
+// src/vectorize.c
+
+/**
+ * NOTE:
+ * Loop vectorization for NASM x86-64 (SSE2 / AVX2)
+ * (Target-specific layer)
+ *
+ * A loop of the shape
+ * ----------------------------------------
+ *   for (i = 0; i < n; i = i + 1) {
+ *       a[i] = b[i] + c[i] - k;   (element-wise)
+ *       s = s + a[i];             (reduction)
+ *   }
+ * ----------------------------------------
+ * only touches element i in iteration i, so W iterations can run at
+ * once, one per lane of a vector register (W = 2 qwords in an xmm
+ * register with SSE2, 4 in a ymm register with AVX2):
+ * ----------------------------------------
+ *        broadcast the loop-invariant operands, zero the accumulators
+ *        load i
+ * Lvector:
+ *        jump to Ldone unless i + W <= n
+ *        the body on elements i .. i+W-1
+ *        i = i + W
+ *        jump to Lvector
+ * Ldone:
+ *        store i, add the lanes of each accumulator to its global
+ * ----------------------------------------
+ * The scalar loop generated right after it (see
+ * codegenWhileStatementAST() in gen.c) runs the n - i < W
+ * iterations left over.
+ *
+ * The body may only hold such assignments, and their values may only
+ * add and subtract elements [i] and loop-invariant operands (literals
+ * and globals the loop does not assign). There is no packed 64-bit
+ * multiply below AVX-512, so a product keeps the loop scalar.
+ */
+
+#include "data.h"
+#include "decl.h"
+#include "defs.h"
+
+// What analyzeLoop() found out about a loop
+struct vectorPlan {
+    int counter;           // the symbol i
+    struct ASTnode *bound; // n (a literal or a global)
+    // The body's assignments, without the step
+    struct ASTnode *statements[VECTOR_MAX_STATEMENTS];
+    int count;
+    // Invariant operands, broadcast into registers 0 .. invariantCount-1
+    struct ASTnode *invariants[VECTOR_REGISTERS];
+    int invariantCount;
+    int accumulators; // one register per reduction, after the invariants
+};
+
+static char *xmmRegisterList[VECTOR_REGISTERS] = {
+    "xmm0", "xmm1", "xmm2",  "xmm3",  "xmm4",  "xmm5",  "xmm6",  "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+static char *ymmRegisterList[VECTOR_REGISTERS] = {
+    "ymm0", "ymm1", "ymm2",  "ymm3",  "ymm4",  "ymm5",  "ymm6",  "ymm7",
+    "ymm8", "ymm9", "ymm10", "ymm11", "ymm12", "ymm13", "ymm14", "ymm15"};
+
+// Vector registers free for temporaries (bit r for register r)
+static _Thread_local unsigned freeVectors = 0;
+
+/**
+ * isInvariant - Checks whether an operand is the same in every iteration.
+ *
+ * NOTE:
+ * analyzeLoop() has made sure the only globals the loop assigns are the
+ * counter and the reduction targets, which no operand may read.
+ */
+static int isInvariant(struct ASTnode *n) {
+    return n->op == A_INTLIT || n->op == A_IDENTIFIER;
+}
+
+/**
+ * sameOperand - Checks whether two invariant operands are the same.
+ */
+static int sameOperand(struct ASTnode *a, struct ASTnode *b) {
+    return a->op == b->op && a->v.intvalue == b->v.intvalue;
+}
+
+/**
+ * findInvariant - Returns the register an invariant operand is
+ * broadcast into, or -1.
+ */
+static int findInvariant(struct vectorPlan *p, struct ASTnode *n) {
+    for (int i = 0; i < p->invariantCount; i++) {
+        if (sameOperand(p->invariants[i], n)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * isCounterPlusOne - Checks for `i + 1` or `1 + i`.
+ */
+static int isCounterPlusOne(struct ASTnode *n, int counter) {
+    struct ASTnode *l = n->left, *r = n->right;
+
+    if (n->op != A_ADD) {
+        return 0;
+    }
+    if (r->op == A_IDENTIFIER) {
+        l = n->right;
+        r = n->left;
+    }
+    return l->op == A_IDENTIFIER && l->v.identifierIndex == counter &&
+           r->op == A_INTLIT && r->v.intvalue == 1;
+}
+
+/**
+ * reductionTarget - Returns the global a statement accumulates into,
+ * or -1 if it is not a reduction.
+ *
+ * NOTE:
+ * A reduction is `s = s + value`, `s = value + s` or `s = s - value`.
+ */
+static int reductionTarget(struct ASTnode *statement) {
+    struct ASTnode *value = statement->left;
+    int s = statement->right->v.identifierIndex;
+
+    if (statement->right->op != A_LVALUEIDENTIFIER ||
+        (value->op != A_ADD && value->op != A_SUBTRACT)) {
+        return -1;
+    }
+    if (value->left->op == A_IDENTIFIER &&
+        value->left->v.identifierIndex == s) {
+        return s;
+    }
+    if (value->op == A_ADD && value->right->op == A_IDENTIFIER &&
+        value->right->v.identifierIndex == s) {
+        return s;
+    }
+    return -1;
+}
+
+/**
+ * reductionValue - Returns what a reduction adds (or subtracts).
+ */
+static struct ASTnode *reductionValue(struct ASTnode *statement) {
+    struct ASTnode *value = statement->left;
+
+    if (value->left->op == A_IDENTIFIER &&
+        value->left->v.identifierIndex == statement->right->v.identifierIndex) {
+        return value->right;
+    }
+    return value->left;
+}
+
+/**
+ * isReductionTarget - Checks whether a global is accumulated into.
+ */
+static int isReductionTarget(struct vectorPlan *p, int id) {
+    for (int i = 0; i < p->count; i++) {
+        if (p->statements[i]->right->op == A_LVALUEIDENTIFIER &&
+            p->statements[i]->right->v.identifierIndex == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * checkValue - Checks that a value can be computed lane by lane and
+ * collects its invariant operands.
+ *
+ * @p: The plan.
+ * @n: The value.
+ *
+ * @return int 1 if it can, 0 otherwise.
+ */
+static int checkValue(struct vectorPlan *p, struct ASTnode *n) {
+    switch (n->op) {
+    case A_INDEX:
+        return n->left->op == A_IDENTIFIER &&
+               n->left->v.identifierIndex == p->counter;
+    case A_IDENTIFIER:
+        if (n->v.identifierIndex == p->counter ||
+            isReductionTarget(p, n->v.identifierIndex)) {
+            return 0;
+        }
+        // fall through
+    case A_INTLIT:
+        if (findInvariant(p, n) == -1) {
+            if (p->invariantCount == VECTOR_REGISTERS) {
+                return 0;
+            }
+            p->invariants[p->invariantCount++] = n;
+        }
+        return 1;
+    case A_ADD:
+    case A_SUBTRACT:
+        return checkValue(p, n->left) && checkValue(p, n->right);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * temporaries - Returns how many temporaries computing a value needs
+ * at once (see emitValue()).
+ *
+ * @n: The value.
+ * @avx: Whether three-operand VEX instructions are available.
+ */
+static int temporaries(struct ASTnode *n, int avx) {
+    int left, right, holdsLeft, holdsRight, need;
+
+    if (n->op == A_INDEX) {
+        return 1;
+    }
+    if (isInvariant(n)) {
+        return 0;
+    }
+
+    left = temporaries(n->left, avx);
+    right = temporaries(n->right, avx);
+    holdsLeft = !isInvariant(n->left);
+    holdsRight = !isInvariant(n->right);
+
+    need = left > holdsLeft + right ? left : holdsLeft + right;
+    // A fresh register for the result, next to the right operand's
+    if (!holdsLeft && (!holdsRight || (!avx && n->op == A_SUBTRACT)) &&
+        holdsRight + 1 > need) {
+        need = holdsRight + 1;
+    }
+    return need;
+}
+
+/**
+ * collectStatements - Lists the statements of a loop body.
+ *
+ * @p: The plan, receiving the statements.
+ * @n: The body (glued like a compound statement, may be NULL).
+ *
+ * @return int 1 if they fit, 0 otherwise.
+ */
+static int collectStatements(struct vectorPlan *p, struct ASTnode *n) {
+    if (n == NULL) {
+        return 1;
+    }
+    if (n->op == A_GLUE) {
+        return collectStatements(p, n->left) &&
+               collectStatements(p, n->right);
+    }
+    if (p->count == VECTOR_MAX_STATEMENTS) {
+        return 0;
+    }
+    p->statements[p->count++] = n;
+    return 1;
+}
+
+/**
+ * analyzeLoop - Decides whether a loop can be vectorized, and how.
+ *
+ * @loop: The A_WHILE node.
+ * @p: Receives the plan.
+ *
+ * @return int 1 if it can, 0 otherwise.
+ */
+static int analyzeLoop(struct ASTnode *loop, struct vectorPlan *p) {
+    struct ASTnode *cond = loop->left, *step = loop->right, *s;
+    int temps = 1;
+
+    memset(p, 0, sizeof(*p));
+
+    // i < n, with n a literal or another global
+    if (cond->op != A_LT || cond->left->op != A_IDENTIFIER ||
+        !isInvariant(cond->right)) {
+        return 0;
+    }
+    p->counter = cond->left->v.identifierIndex;
+    p->bound = cond->right;
+    if (p->bound->op == A_IDENTIFIER &&
+        p->bound->v.identifierIndex == p->counter) {
+        return 0;
+    }
+
+    // A while loop steps i as its last statement
+    if (!collectStatements(p, loop->middle)) {
+        return 0;
+    }
+    if (step == NULL && p->count > 0) {
+        step = p->statements[--p->count];
+    }
+    if (step == NULL || step->op != A_ASSIGN ||
+        step->right->op != A_LVALUEIDENTIFIER ||
+        step->right->v.identifierIndex != p->counter ||
+        !isCounterPlusOne(step->left, p->counter) || p->count == 0) {
+        return 0;
+    }
+
+    // a[i] = value, or a reduction into a global of its own
+    for (int i = 0; i < p->count; i++) {
+        s = p->statements[i];
+        if (s->op != A_ASSIGN) {
+            return 0;
+        }
+        if (s->right->op == A_LVALUEINDEX) {
+            if (s->right->left->op != A_IDENTIFIER ||
+                s->right->left->v.identifierIndex != p->counter) {
+                return 0;
+            }
+            continue;
+        }
+        if (reductionTarget(s) == -1 ||
+            reductionTarget(s) == p->counter ||
+            (p->bound->op == A_IDENTIFIER &&
+             reductionTarget(s) == p->bound->v.identifierIndex)) {
+            return 0;
+        }
+        for (int j = 0; j < i; j++) {
+            if (p->statements[j]->right->op == A_LVALUEIDENTIFIER &&
+                p->statements[j]->right->v.identifierIndex ==
+                    reductionTarget(s)) {
+                return 0;
+            }
+        }
+        p->accumulators++;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        s = p->statements[i];
+        if (s->right->op == A_LVALUEINDEX ? !checkValue(p, s->left)
+                                          : !checkValue(p, reductionValue(s))) {
+            return 0;
+        }
+        s = s->right->op == A_LVALUEINDEX ? s->left : reductionValue(s);
+        if (temporaries(s, VectorISA == VECTOR_AVX2) > temps) {
+            temps = temporaries(s, VectorISA == VECTOR_AVX2);
+        }
+    }
+
+    return p->invariantCount + p->accumulators + temps <= VECTOR_REGISTERS;
+}
+
+/**
+ * vectorWidth - Returns how many iterations of a loop vectorLoop()
+ * runs at once.
+ *
+ * @loop: The A_WHILE node.
+ *
+ * @return int 2 (SSE2) or 4 (AVX2), or 0 if the loop stays scalar.
+ */
+int vectorWidth(struct ASTnode *loop) {
+    struct vectorPlan p;
+
+    if (VectorISA == VECTOR_NONE || !analyzeLoop(loop, &p)) {
+        return 0;
+    }
+    return VectorISA == VECTOR_AVX2 ? 4 : 2;
+}
+
+/**
+ * vectorName - Returns the name of a vector register at the loop's width.
+ */
+static char *vectorName(int r) {
+    return VectorISA == VECTOR_AVX2 ? ymmRegisterList[r] : xmmRegisterList[r];
+}
+
+/**
+ * allocateVector - Allocates a vector register for a temporary.
+ */
+static int allocateVector(void) {
+    int r;
+
+    if (freeVectors == 0) {
+        logFatal("No free vector registers");
+    }
+    r = __builtin_ctz(freeVectors);
+    freeVectors &= ~(1u << r);
+    return r;
+}
+
+/**
+ * freeVector - Frees a temporary (invariants and accumulators stay).
+ */
+static void freeVector(struct vectorPlan *p, int r) {
+    if (r >= p->invariantCount + p->accumulators) {
+        freeVectors |= 1u << r;
+    }
+}
+
+/**
+ * emitValue - Generates the W lanes of a value.
+ *
+ * NOTE:
+ * Elements are loaded into temporaries; invariants are already
+ * broadcast into registers of their own and are never overwritten.
+ *
+ * @p: The plan.
+ * @n: The value.
+ * @index: The register holding i.
+ *
+ * @return int The vector register holding the value.
+ */
+static int emitValue(struct vectorPlan *p, struct ASTnode *n, int index) {
+    int avx = VectorISA == VECTOR_AVX2;
+    int isTemp = p->invariantCount + p->accumulators;
+    int left, right, result;
+    char *op;
+
+    if (n->op == A_INDEX) {
+        result = allocateVector();
+        fprintf(Outfile, "\t%s\t%s, [%s+%s*8]\n", avx ? "vmovdqu" : "movdqu",
+                vectorName(result),
+                GlobalSymbolTable[n->v.identifierIndex].name,
+                nasmRegisterName(index));
+        return result;
+    }
+    if (isInvariant(n)) {
+        return findInvariant(p, n);
+    }
+
+    left = emitValue(p, n->left, index);
+    right = emitValue(p, n->right, index);
+    op = n->op == A_ADD ? "paddq" : "psubq";
+
+    if (left >= isTemp) {
+        result = left;
+    } else if (right >= isTemp && (avx || n->op == A_ADD)) {
+        result = right;
+    } else {
+        result = allocateVector();
+    }
+
+    if (avx) {
+        fprintf(Outfile, "\tv%s\t%s, %s, %s\n", op, vectorName(result),
+                vectorName(left), vectorName(right));
+    } else if (result == left) {
+        fprintf(Outfile, "\t%s\t%s, %s\n", op, vectorName(result),
+                vectorName(right));
+    } else if (result == right) {
+        // Addition commutes
+        fprintf(Outfile, "\t%s\t%s, %s\n", op, vectorName(result),
+                vectorName(left));
+    } else {
+        fprintf(Outfile, "\tmovdqa\t%s, %s\n", vectorName(result),
+                vectorName(left));
+        fprintf(Outfile, "\t%s\t%s, %s\n", op, vectorName(result),
+                vectorName(right));
+    }
+
+    if (left != result) {
+        freeVector(p, left);
+    }
+    if (right != result) {
+        freeVector(p, right);
+    }
+    return result;
+}
+
+/**
+ * broadcast - Fills every lane of a register with an invariant operand.
+ *
+ * @r: The vector register.
+ * @n: The operand.
+ * @scratch: A general purpose register to use.
+ */
+static void broadcast(int r, struct ASTnode *n, int scratch) {
+    char operand[TEXTLEN + 3];
+
+    if (n->op == A_INTLIT) {
+        fprintf(Outfile, "\tmov\t%s, %d\n", nasmRegisterName(scratch),
+                n->v.intvalue);
+        snprintf(operand, sizeof(operand), "%s", nasmRegisterName(scratch));
+    } else {
+        snprintf(operand, sizeof(operand), "%s",
+                 nasmVariableOperand(n->v.identifierIndex));
+    }
+
+    if (VectorISA == VECTOR_AVX2) {
+        // vpbroadcastq reads memory or an xmm register, not rbx etc.
+        if (n->op == A_INTLIT ||
+            nasmVariableInRegister(n->v.identifierIndex)) {
+            fprintf(Outfile, "\tvmovq\t%s, %s\n", xmmRegisterList[r], operand);
+            fprintf(Outfile, "\tvpbroadcastq\t%s, %s\n", ymmRegisterList[r],
+                    xmmRegisterList[r]);
+        } else {
+            fprintf(Outfile, "\tvpbroadcastq\t%s, %s\n", ymmRegisterList[r],
+                    operand);
+        }
+        return;
+    }
+    fprintf(Outfile, "\tmovq\t%s, %s\n", xmmRegisterList[r], operand);
+    fprintf(Outfile, "\tpunpcklqdq\t%s, %s\n", xmmRegisterList[r],
+            xmmRegisterList[r]);
+}
+
+/**
+ * reduceAccumulator - Adds the lanes of an accumulator to its variable.
+ *
+ * @r: The accumulator (clobbered).
+ * @t: A free vector register.
+ * @scratch: A general purpose register to use.
+ * @target: The symbol table index of the variable.
+ */
+static void reduceAccumulator(int r, int t, int scratch, int target) {
+    char *acc = xmmRegisterList[r], *tmp = xmmRegisterList[t];
+
+    if (VectorISA == VECTOR_AVX2) {
+        // Fold the upper 128 bits onto the lower ones first
+        fprintf(Outfile, "\tvextracti128\t%s, %s, 1\n", tmp,
+                ymmRegisterList[r]);
+        fprintf(Outfile, "\tvpaddq\t%s, %s, %s\n", tmp, tmp, acc);
+        fprintf(Outfile, "\tvpshufd\t%s, %s, 0x4e\n", acc, tmp);
+        fprintf(Outfile, "\tvpaddq\t%s, %s, %s\n", tmp, tmp, acc);
+        fprintf(Outfile, "\tvmovq\t%s, %s\n", nasmRegisterName(scratch), tmp);
+    } else {
+        fprintf(Outfile, "\tpshufd\t%s, %s, 0x4e\n", tmp, acc);
+        fprintf(Outfile, "\tpaddq\t%s, %s\n", tmp, acc);
+        fprintf(Outfile, "\tmovq\t%s, %s\n", nasmRegisterName(scratch), tmp);
+    }
+    fprintf(Outfile, "\tadd\t%s, %s\n", nasmVariableOperand(target),
+            nasmRegisterName(scratch));
+}
+
+/**
+ * vectorLoop - Generates the vector part of a loop, see the note at the
+ * top of this file.
+ *
+ * NOTE:
+ * Expects vectorWidth() to have accepted the loop. i is kept in a
+ * register while the vector loop runs and stored when it is done,
+ * so the scalar loop continues from there.
+ *
+ * @loop: The A_WHILE node.
+ * @labelLoop: The label of the vector loop.
+ * @labelDone: The label after it.
+ */
+void vectorLoop(struct ASTnode *loop, int labelLoop, int labelDone) {
+    struct vectorPlan p;
+    struct ASTnode *s;
+    int width = vectorWidth(loop);
+    int avx = VectorISA == VECTOR_AVX2;
+    int index, next, bound = NOREG, r, accumulator;
+    char counter[TEXTLEN + 3];
+
+    analyzeLoop(loop, &p);
+    snprintf(counter, sizeof(counter), "%s", nasmVariableOperand(p.counter));
+    freeVectors = 0;
+    for (r = p.invariantCount + p.accumulators; r < VECTOR_REGISTERS; r++) {
+        freeVectors |= 1u << r;
+    }
+
+    index = nasmAllocateRegister();
+    next = nasmAllocateRegister();
+    for (r = 0; r < p.invariantCount; r++) {
+        broadcast(r, p.invariants[r], next);
+    }
+    for (; r < p.invariantCount + p.accumulators; r++) {
+        if (avx) {
+            fprintf(Outfile, "\tvpxor\t%s, %s, %s\n", ymmRegisterList[r],
+                    ymmRegisterList[r], ymmRegisterList[r]);
+        } else {
+            fprintf(Outfile, "\tpxor\t%s, %s\n", xmmRegisterList[r],
+                    xmmRegisterList[r]);
+        }
+    }
+    if (p.bound->op == A_IDENTIFIER) {
+        bound = nasmAllocateRegister();
+        fprintf(Outfile, "\tmov\t%s, %s\n", nasmRegisterName(bound),
+                nasmVariableOperand(p.bound->v.identifierIndex));
+    }
+    fprintf(Outfile, "\tmov\t%s, %s\n", nasmRegisterName(index), counter);
+
+    // Run while i + W <= n
+    codegenLabel(labelLoop);
+    fprintf(Outfile, "\tlea\t%s, [%s+%d]\n", nasmRegisterName(next),
+            nasmRegisterName(index), width);
+    if (bound != NOREG) {
+        fprintf(Outfile, "\tcmp\t%s, %s\n", nasmRegisterName(next),
+                nasmRegisterName(bound));
+    } else {
+        fprintf(Outfile, "\tcmp\t%s, %d\n", nasmRegisterName(next),
+                p.bound->v.intvalue);
+    }
+    fprintf(Outfile, "\tjg\tL%d\n", labelDone);
+
+    accumulator = p.invariantCount;
+    for (int i = 0; i < p.count; i++) {
+        s = p.statements[i];
+        if (s->right->op == A_LVALUEINDEX) {
+            r = emitValue(&p, s->left, index);
+            fprintf(Outfile, "\t%s\t[%s+%s*8], %s\n",
+                    avx ? "vmovdqu" : "movdqu",
+                    GlobalSymbolTable[s->right->v.identifierIndex].name,
+                    nasmRegisterName(index), vectorName(r));
+        } else {
+            r = emitValue(&p, reductionValue(s), index);
+            if (avx) {
+                fprintf(Outfile, "\tv%s\t%s, %s, %s\n",
+                        s->left->op == A_ADD ? "paddq" : "psubq",
+                        vectorName(accumulator), vectorName(accumulator),
+                        vectorName(r));
+            } else {
+                fprintf(Outfile, "\t%s\t%s, %s\n",
+                        s->left->op == A_ADD ? "paddq" : "psubq",
+                        vectorName(accumulator), vectorName(r));
+            }
+            accumulator++;
+        }
+        freeVector(&p, r);
+    }
+
+    fprintf(Outfile, "\tmov\t%s, %s\n", nasmRegisterName(index),
+            nasmRegisterName(next));
+    codegenJump(labelLoop);
+    codegenLabel(labelDone);
+    fprintf(Outfile, "\tmov\t%s, %s\n", counter, nasmRegisterName(index));
+
+    // Every temporary is free again; the first one is scratch
+    accumulator = p.invariantCount;
+    for (int i = 0; i < p.count; i++) {
+        s = p.statements[i];
+        if (s->right->op == A_LVALUEIDENTIFIER) {
+            reduceAccumulator(accumulator++, __builtin_ctz(freeVectors), next,
+                              s->right->v.identifierIndex);
+        }
+    }
+    if (avx) {
+        // Avoid the SSE/AVX transition penalty in the code after
+        fputs("\tvzeroupper\n", Outfile);
+    }
+}
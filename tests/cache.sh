@@ -0,0 +1,41 @@
+#!/bin/sh
+# Usage: cache.sh keccc program.kc...
+#
+# Compiles each program twice with --cache, in a cache directory of its
+# own, under several option sets: both must write what keccc writes
+# without the cache, and --cache-stats must count one miss and then one
+# hit per compilation. A cache directory path too long to use must
+# leave the compilation uncached, not fail it.
+
+keccc=$1
+shift
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+KECCC_CACHE_DIR=$dir/cache
+export KECCC_CACHE_DIR
+
+status=0
+compilations=0
+for program; do
+    for options in "" "-g" "-Os" "--emit-llvm" "--no-isel --no-cse"; do
+        compilations=$((compilations + 1))
+        "$keccc" $options -o "$dir/plain" "$program" || exit 1
+        "$keccc" --cache $options -o "$dir/miss" "$program" || exit 1
+        "$keccc" --cache $options -o "$dir/hit" "$program" || exit 1
+        cmp "$dir/plain" "$dir/miss" || status=1
+        cmp "$dir/plain" "$dir/hit" || status=1
+    done
+done
+
+"$keccc" --cache-stats > "$dir/stats" || exit 1
+grep -q "^hits: *$compilations\$" "$dir/stats" || status=1
+grep -q "^misses: *$compilations\$" "$dir/stats" || status=1
+[ $status -eq 0 ] || cat "$dir/stats"
+
+# A cache directory whose paths do not fit is not used at all
+KECCC_CACHE_DIR=$dir/$(printf '%04096d' 0)
+"$keccc" -o "$dir/plain" "$1" || exit 1
+"$keccc" --cache -o "$dir/uncached" "$1" || status=1
+cmp "$dir/plain" "$dir/uncached" || status=1
+exit $status
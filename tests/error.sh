@@ -0,0 +1,23 @@
+#!/bin/sh
+# Usage: error.sh keccc program message [keccc options]
+#
+# Compiles a program that must not compile. keccc must fail with exit
+# status 1, neither crashing nor writing anything to standard error but
+# message (the whole of it, one line).
+
+keccc=$1
+program=$2
+message=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+"$keccc" "$@" -o "$dir/out" "$program" 2> "$dir/errors"
+status=$?
+if [ $status -ne 1 ]; then
+    echo "exit status $status, expected 1"
+    cat "$dir/errors"
+    exit 1
+fi
+printf '%s\n' "$message" | diff -u - "$dir/errors"
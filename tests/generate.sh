@@ -0,0 +1,67 @@
+#!/bin/sh
+# Usage: generate.sh count
+#
+# Writes a program of count groups of top-level statements to standard
+# output, using every construct of the language in turn: large enough
+# to be split among -j threads (and, from about 1500 groups, parsed in
+# parallel segments), and the same on every run.
+
+awk -v count="$1" 'BEGIN {
+    print "{"
+    for (g = 0; g < 8; g++) {
+        print "    int g" g ";"
+    }
+    print "    int i;"
+    print "    int a[64];"
+    print "    int mix(int x, int y) { return (x * 7 + y) % 1000; }"
+    print "    int clamp(int x) {"
+    print "        if (x > 500) {"
+    print "            return 500;"
+    print "        }"
+    print "        return x;"
+    print "    }"
+    for (k = 1; k <= count; k++) {
+        v = k % 8
+        w = (k + 3) % 8
+        kind = k % 7
+        if (kind == 0) {
+            print "    g" v " = (g" w " + " k ") % 1000;"
+            print "    print g" v ";"
+        } else if (kind == 1) {
+            print "    if ((g" v " * 3) > " k % 200 ") {"
+            print "        int t;"
+            print "        t = g" w " + " k % 50 ";"
+            print "        g" w " = t % 1000;"
+            print "    } else {"
+            print "        g" v " = g" v " + 1;"
+            print "    }"
+        } else if (kind == 2) {
+            print "    for (i = 0; i < 64; i = i + 1) {"
+            print "        a[i] = a[i] + i * " k % 5 ";"
+            print "    }"
+            print "    print a[" k % 64 "] % 10000;"
+        } else if (kind == 3) {
+            print "    switch (g" v " % 6) {"
+            print "        case 0: g" w " = g" w " + 2; break;"
+            print "        case 1: g" w " = g" w " * 2 % 1000;"
+            print "        case 3: g" w " = g" w " - 1; break;"
+            print "        default: g" w " = " k % 90 ";"
+            print "    }"
+        } else if (kind == 4) {
+            print "    g" v " = clamp(mix(g" v ", " k % 13 "));"
+            print "    print g" v " + g" w " * 2 + g" v " * 2;"
+        } else if (kind == 5) {
+            print "    if (((g" v " > 3) && (g" w " < 800)) || (g" v " == " k % 9 ")) {"
+            print "        g" w " = (g" w " + g" v " / 4) % 1000;"
+            print "    }"
+        } else {
+            print "    i = 0;"
+            print "    while (i < " k % 4 + 1 ") {"
+            print "        g" v " = (g" v " + a[i] % 7) % 1000;"
+            print "        i = i + 1;"
+            print "    }"
+            print "    print g" v ";"
+        }
+    }
+    print "}"
+}'
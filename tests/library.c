@@ -0,0 +1,144 @@
+// tests/library.c
+
+/**
+ * NOTE:
+ * Checks libkeccc's contract (see keccc.h): a program compiles to code
+ * with no diagnostics, one that does not compile reports why, invalid
+ * options are refused, and no call leaves state behind for the next.
+ * Built with -Db_sanitize=address, it also checks that a failed
+ * compilation frees what it built.
+ */
+
+#include "keccc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *program = "{\n"
+                             "    int a;\n"
+                             "    int b;\n"
+                             "    a = 6;\n"
+                             "    b = a * 7;\n"
+                             "    if (b > a) {\n"
+                             "        print b;\n"
+                             "    }\n"
+                             "}\n";
+
+// Fails late, with most of the program already parsed
+static const char *syntaxError = "{\n"
+                                 "    int a;\n"
+                                 "    a = 1;\n"
+                                 "    print a;\n"
+                                 "    a = ;\n"
+                                 "}\n";
+
+// Recorded from a program with two if statements; program has one, so
+// its code generation fails at the end
+static const char *otherProfile = "# keccc branch profile v1\n"
+                                  "0 1 0\n"
+                                  "1 1 0\n";
+
+static int failures = 0;
+
+/**
+ * check - Reports a failed expectation.
+ *
+ * @ok: Whether it held.
+ * @what: What was expected.
+ */
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/**
+ * compile - Compiles a program and checks the result code.
+ *
+ * @src: The source.
+ * @options: The options, or NULL.
+ * @status: The expected result.
+ * @what: What is being checked.
+ * @out: Receives the output.
+ */
+static void compile(const char *src, const keccc_options *options,
+                    int status, const char *what, keccc_output *out) {
+    int got = keccc_compile_with(src, strlen(src), options, out);
+
+    if (got != status) {
+        fprintf(stderr, "FAIL: %s: status %d, expected %d\n%s", what, got,
+                status, out->diagnostics ? out->diagnostics : "");
+        failures++;
+    }
+    check(out->code != NULL && out->diagnostics != NULL,
+          "both buffers are always set");
+}
+
+int main(void) {
+    keccc_options options = {0};
+    keccc_output first, out;
+    char profile[] = "/tmp/keccc-profile-XXXXXX";
+    FILE *f;
+    int fd;
+
+    compile(program, NULL, KECCC_OK, "a program", &first);
+    check(strstr(first.code, "main") != NULL, "the code defines main");
+    check(first.diagnostics_size == 0, "no diagnostics for a program");
+
+    compile(syntaxError, NULL, KECCC_ERROR_SOURCE, "a syntax error", &out);
+    check(strstr(out.diagnostics, "line 5") != NULL,
+          "the syntax error is reported with its line");
+    keccc_output_free(&out);
+    check(out.code == NULL && out.diagnostics == NULL,
+          "keccc_output_free() clears the output");
+
+    if ((fd = mkstemp(profile)) < 0 || (f = fdopen(fd, "w")) == NULL ||
+        fputs(otherProfile, f) == EOF || fclose(f) != 0) {
+        perror(profile);
+        return 1;
+    }
+    options.profile_path = profile;
+    compile(program, &options, KECCC_ERROR_SOURCE,
+            "a profile of another program", &out);
+    check(strstr(out.diagnostics, "profile has 2 branches") != NULL,
+          "the profile mismatch is reported");
+    keccc_output_free(&out);
+    unlink(profile);
+    options.profile_path = NULL;
+
+    // Nothing of the failed compilations may show in the next one
+    compile(program, NULL, KECCC_OK, "a program after errors", &out);
+    check(out.code_size == first.code_size &&
+              memcmp(out.code, first.code, first.code_size) == 0,
+          "the same program compiles to the same code");
+    keccc_output_free(&out);
+
+    options.emit_llvm = 1;
+    compile(program, &options, KECCC_OK, "LLVM IR", &out);
+    check(strstr(out.code, "define") != NULL, "the IR defines main");
+    keccc_output_free(&out);
+
+    options.instrument = 1;
+    compile(program, &options, KECCC_ERROR_OPTIONS,
+            "--instrument with --emit-llvm", &out);
+    keccc_output_free(&out);
+
+    memset(&options, 0, sizeof(options));
+    options.jobs = 1000;
+    compile(program, &options, KECCC_ERROR_OPTIONS, "too many jobs", &out);
+    keccc_output_free(&out);
+
+    // The defaults again, after options that were refused
+    compile(program, NULL, KECCC_OK, "a program after refused options",
+            &out);
+    check(out.code_size == first.code_size &&
+              memcmp(out.code, first.code, first.code_size) == 0,
+          "the defaults are restored");
+    keccc_output_free(&out);
+
+    keccc_output_free(&first);
+    return failures != 0;
+}
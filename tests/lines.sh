@@ -0,0 +1,29 @@
+#!/bin/sh
+# Usage: lines.sh keccc program.kc expected [keccc options]
+#
+# Compiles the program with -g and lists the source line each %line
+# directive names, number and text, which must be the expected list.
+# Every directive must also name the program's file.
+
+keccc=$1
+program=$2
+expected=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+"$keccc" -g "$@" -o "$dir/out.s" "$program" || exit 1
+awk -v program="$program" '
+    FILENAME == program { source[FNR] = $0; next }
+    $1 == "%line" {
+        if ($3 != program) {
+            print "line directive for " $3
+        }
+        line = $2
+        sub(/\+.*/, "", line)
+        text = source[line]
+        sub(/^ +/, "", text)
+        print line " " text
+    }' "$program" "$dir/out.s" > "$dir/lines" || exit 1
+diff -u "$expected" "$dir/lines"
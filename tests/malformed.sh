@@ -0,0 +1,40 @@
+#!/bin/sh
+# Usage: malformed.sh keccc program record field value
+#
+# Writes the program with --emit-ast (calls not inlined), sets one field
+# of one node record to value (fields 0 to 5: op, line, value, left,
+# middle, right; see astfile.c) and checks that --from-ast refuses the
+# file, with exit status 1 and no other message, instead of crashing.
+# The records are in host byte order; this writes little-endian ones.
+
+keccc=$1
+program=$2
+record=$3
+field=$4
+value=$5
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+"$keccc" --no-inline --emit-ast -o "$dir/in.ast" "$program" || exit 1
+# A 40-byte header, then 24 bytes per record
+printf "$(awk -v v="$value" 'BEGIN {
+    if (v < 0) {
+        v += 4294967296
+    }
+    for (i = 0; i < 4; i++) {
+        printf "\\%03o", v % 256
+        v = int(v / 256)
+    }
+}')" | dd of="$dir/in.ast" bs=1 seek=$((40 + record * 24 + field * 4)) \
+    conv=notrunc 2> /dev/null || exit 1
+
+"$keccc" --from-ast -o "$dir/out" "$dir/in.ast" 2> "$dir/errors"
+status=$?
+if [ $status -ne 1 ]; then
+    echo "exit status $status, expected 1"
+    cat "$dir/errors"
+    exit 1
+fi
+printf 'Fatal error: Malformed AST file: %s, line 1\n' "$dir/in.ast" |
+    diff -u - "$dir/errors"
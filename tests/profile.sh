@@ -0,0 +1,46 @@
+#!/bin/sh
+# Usage: profile.sh keccc program.kc expected.out
+#
+# Round trip of branch profiling: compiles the program with
+# --instrument and runs it, which writes keccc.prof, then compiles it
+# again with --profile-use and runs that. Both must print the expected
+# output. The profile must change the layout: the program's rarely
+# taken then block (the one adding to rare) moves out of line, after
+# the end of main (its main.frame equ), where a build without a profile
+# keeps it in place.
+# Exits 77, which meson reports as skipped, without nasm.
+
+keccc=$1
+program=$2
+expected=$3
+
+command -v nasm > /dev/null || exit 77
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# run.sh's steps; the instrumented program writes keccc.prof in $dir
+build() {
+    "$keccc" "$@" -o "$dir/$name.s" "$program" || exit 1
+    nasm -f elf64 "$dir/$name.s" -o "$dir/$name.o" || exit 1
+    ${CC:-cc} -no-pie "$dir/$name.o" -o "$dir/$name" || exit 1
+    (cd "$dir" && "./$name") > "$dir/$name.output" || exit 1
+    diff -u "$expected" "$dir/$name.output" || exit 1
+}
+
+# Whether the block is after the end of main
+outOfLine() {
+    awk '/^main\.frame/ { end = NR }
+         /add\tqword \[rare\]/ { block = NR }
+         END { exit !(end && block > end) }' "$dir/$1.s"
+}
+
+name=instrumented
+build --instrument
+[ -s "$dir/keccc.prof" ] || exit 1
+name=profiled
+build --profile-use "$dir/keccc.prof"
+name=plain
+build
+
+outOfLine profiled && ! outOfLine plain
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Usage: run.sh keccc program.kc expected.out [keccc options]
+#
+# Compiles the program, assembles and links it like the README does (or
+# runs the LLVM IR of --emit-llvm with lli), runs it and compares what
+# it prints with the expected output. --from-ast first writes the
+# program with --emit-ast. With KECCC_STDIN set, the source is piped in
+# and the code out. Exits 77, which meson reports as skipped, when a
+# tool or the CPU feature an option needs is missing.
+
+keccc=$1
+program=$2
+expected=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+input=$program
+code=$dir/out.s
+case " $* " in
+*" --emit-llvm "*)
+    command -v lli > /dev/null || exit 77
+    code=$dir/out.ll
+    ;;
+*)
+    command -v nasm > /dev/null || exit 77
+    ;;
+esac
+case " $* " in
+*" -mavx2 "*)
+    grep -qw avx2 /proc/cpuinfo 2> /dev/null || exit 77
+    ;;
+esac
+case " $* " in
+*" --from-ast "*)
+    input=$dir/out.ast
+    "$keccc" --emit-ast -o "$input" "$program" || exit 1
+    ;;
+esac
+
+if [ -n "$KECCC_STDIN" ]; then
+    "$keccc" "$@" -o - - < "$input" > "$code" || exit 1
+else
+    "$keccc" "$@" -o "$code" "$input" || exit 1
+fi
+
+if [ "$code" = "$dir/out.ll" ]; then
+    lli "$code" > "$dir/output" || exit 1
+else
+    nasm -f elf64 "$code" -o "$dir/out.o" || exit 1
+    ${CC:-cc} -no-pie "$dir/out.o" -o "$dir/out" || exit 1
+    "$dir/out" > "$dir/output" || exit 1
+fi
+
+diff -u "$expected" "$dir/output"
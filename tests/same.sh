@@ -0,0 +1,24 @@
+#!/bin/sh
+# Usage: same.sh keccc 'options' 'other options' program...
+#
+# Compiles each program with both option sets, which must not change
+# the code: it has to be the same byte for byte.
+
+keccc=$1
+options=$2
+others=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+status=0
+for program; do
+    "$keccc" $options -o "$dir/one" "$program" || exit 1
+    "$keccc" $others -o "$dir/other" "$program" || exit 1
+    if ! cmp -s "$dir/one" "$dir/other"; then
+        echo "$program: '$options' and '$others' give different code"
+        status=1
+    fi
+done
+exit $status
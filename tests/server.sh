@@ -0,0 +1,72 @@
+#!/bin/sh
+# Usage: server.sh keccc keccc-client program.kc...
+#
+# Starts a compile server on a socket of its own and compiles each
+# program through keccc-client with several option sets, all clients at
+# once; the code must be byte for byte what keccc writes itself. A
+# program that does not compile must fail the same way through both.
+# The socket must be its user's only, and without -o the client must
+# write out.s or out.ll in its own directory, like keccc.
+
+keccc=$1
+client=$2
+shift 2
+
+dir=$(mktemp -d) || exit 1
+KECCC_SOCKET=$dir/keccc.sock
+export KECCC_SOCKET
+"$keccc" --server > "$dir/server.log" 2>&1 &
+server=$!
+trap 'kill $server; wait $server 2> /dev/null; rm -rf "$dir"' EXIT
+
+tries=0
+while [ ! -S "$KECCC_SOCKET" ]; do
+    tries=$((tries + 1))
+    [ $tries -le 100 ] || exit 1
+    sleep 0.1
+done
+
+jobs=0
+clients=
+for program; do
+    for options in "" "-g" "-j 2" "--emit-llvm" "-Os --no-isel"; do
+        jobs=$((jobs + 1))
+        "$keccc" $options -o "$dir/local$jobs" "$program" || exit 1
+        "$client" $options -o "$dir/served$jobs" "$program" &
+        clients="$clients $!"
+    done
+done
+status=0
+for pid in $clients; do
+    wait $pid || status=1
+done
+while [ $jobs -gt 0 ]; do
+    cmp "$dir/local$jobs" "$dir/served$jobs" || status=1
+    jobs=$((jobs - 1))
+done
+
+[ "$(stat -c %a "$KECCC_SOCKET")" = 600 ] || status=1
+mkdir "$dir/default" || exit 1
+absolute() {
+    case $1 in
+    /*) echo "$1" ;;
+    *) echo "$(pwd)/$1" ;;
+    esac
+}
+program=$(absolute "$1")
+client=$(absolute "$client")
+for options in "" "--emit-llvm"; do
+    (cd "$dir/default" && "$client" $options "$program") || status=1
+done
+"$keccc" -o "$dir/local.s" "$1" && cmp "$dir/local.s" "$dir/default/out.s" ||
+    status=1
+"$keccc" --emit-llvm -o "$dir/local.ll" "$1" &&
+    cmp "$dir/local.ll" "$dir/default/out.ll" || status=1
+
+printf '{\n    print undeclared;\n}\n' > "$dir/error.kc"
+"$keccc" -o "$dir/error.s" "$dir/error.kc" 2> "$dir/local.err" && status=1
+"$client" -o "$dir/error.s" "$dir/error.kc" 2> "$dir/served.err" && status=1
+cmp "$dir/local.err" "$dir/served.err" || status=1
+
+[ $status -eq 0 ] || cat "$dir/server.log"
+exit $status
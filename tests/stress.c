@@ -0,0 +1,165 @@
+// tests/stress.c
+
+/**
+ * NOTE:
+ * Compiles the programs given on the command line under several option
+ * sets once, then again on STRESS_THREADS threads at the same time,
+ * each going through them in a different order. Every compilation must
+ * give the code and status it gave alone: libkeccc keeps all of its
+ * state per thread, and -j's own threads must not mix either. Best run
+ * under -Db_sanitize=thread as well.
+ */
+
+#include "keccc.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Threads compiling at once
+#define STRESS_THREADS 8
+
+// Times each thread goes through all the compilations
+#define STRESS_ROUNDS 1
+
+// Most programs on the command line
+#define STRESS_MAX_PROGRAMS 16
+
+// A program, read into memory
+struct program {
+    char *name;
+    char *text;
+    size_t size;
+};
+
+// The option sets each program is compiled with
+static keccc_options optionSets[] = {
+    {0},
+    {.debug_line_info = 1},
+    {.jobs = 3},
+    {.jobs = 2, .debug_line_info = 1, .optimize_size = 1},
+    {.emit_llvm = 1},
+    {.stream = 1, .scan_thread = 1},
+    {.no_isel = 1, .no_cse = 1, .no_ranges = 1},
+};
+
+#define NOPTIONS ((int)(sizeof(optionSets) / sizeof(optionSets[0])))
+
+static struct program programs[STRESS_MAX_PROGRAMS + 1];
+static int programCount = 0;
+
+// What each compilation gave alone, by program and option set
+static keccc_output expected[STRESS_MAX_PROGRAMS + 1][NOPTIONS];
+static int expectedStatus[STRESS_MAX_PROGRAMS + 1][NOPTIONS];
+
+/**
+ * readProgram - Reads a program file into memory.
+ *
+ * @name: Its path.
+ * @p: Receives the program.
+ *
+ * Returns: 1 on success, 0 otherwise.
+ */
+static int readProgram(char *name, struct program *p) {
+    FILE *f = fopen(name, "r");
+    long size;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0 || (p->text = malloc(size + 1)) == NULL ||
+        fread(p->text, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", name);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return 0;
+    }
+    fclose(f);
+    p->name = name;
+    p->size = size;
+    return 1;
+}
+
+/**
+ * compileAll - Thread body: goes through every compilation, starting at
+ * a different one per thread, and compares each with its expectation.
+ *
+ * @arg: The thread's number (as an intptr_t).
+ *
+ * Returns: The number of mismatches (as a pointer).
+ */
+static void *compileAll(void *arg) {
+    int start = (int)(intptr_t)arg, total = programCount * NOPTIONS;
+    intptr_t mismatches = 0;
+    keccc_output out;
+
+    for (int i = 0; i < STRESS_ROUNDS * total; i++) {
+        int k = (start * 5 + i) % total;
+        int p = k / NOPTIONS, o = k % NOPTIONS;
+        int status = keccc_compile_with(programs[p].text, programs[p].size,
+                                        &optionSets[o], &out);
+
+        if (status != expectedStatus[p][o] ||
+            out.code_size != expected[p][o].code_size ||
+            memcmp(out.code, expected[p][o].code, out.code_size) != 0) {
+            fprintf(stderr, "%s, option set %d: different on thread %d\n",
+                    programs[p].name, o, start);
+            mismatches++;
+        }
+        keccc_output_free(&out);
+    }
+    return (void *)mismatches;
+}
+
+int main(int argc, char **argv) {
+    static const char error[] = "{\n    int a;\n    a = ;\n}\n";
+    pthread_t threads[STRESS_THREADS];
+    intptr_t mismatches = 0;
+    void *result;
+
+    if (argc < 2 || argc - 1 > STRESS_MAX_PROGRAMS) {
+        fprintf(stderr, "Usage: %s program.kc... (at most %d)\n", argv[0],
+                STRESS_MAX_PROGRAMS);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (!readProgram(argv[i], &programs[programCount++])) {
+            return 1;
+        }
+    }
+    // One that does not compile, which must not upset the others
+    programs[programCount].name = "syntax error";
+    programs[programCount].text = (char *)error;
+    programs[programCount++].size = sizeof(error) - 1;
+
+    for (int p = 0; p < programCount; p++) {
+        for (int o = 0; o < NOPTIONS; o++) {
+            expectedStatus[p][o] = keccc_compile_with(
+                programs[p].text, programs[p].size, &optionSets[o],
+                &expected[p][o]);
+        }
+    }
+
+    for (int t = 0; t < STRESS_THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, compileAll,
+                           (void *)(intptr_t)t) != 0) {
+            fprintf(stderr, "Cannot start thread %d\n", t);
+            return 1;
+        }
+    }
+    for (int t = 0; t < STRESS_THREADS; t++) {
+        pthread_join(threads[t], &result);
+        mismatches += (intptr_t)result;
+    }
+
+    for (int p = 0; p < programCount; p++) {
+        for (int o = 0; o < NOPTIONS; o++) {
+            keccc_output_free(&expected[p][o]);
+        }
+        if (p < argc - 1) {
+            free(programs[p].text);
+        }
+    }
+    return mismatches != 0;
+}